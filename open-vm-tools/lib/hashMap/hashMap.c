@@ -80,6 +80,8 @@
  *      is resized.  If this is a problem, you should store the pointer in the
  *      HashMap rather than the object itself.
  *    - HashMap will ensure that a maximum load factor is not exceeded.
+ *      Removed entries count towards the load until the map is rebuilt, so
+ *      a map with many removals does not fill up with deleted entries.
  *
  *    hashMap is now restrictd to userworld applications on ESX builds ONLY.
  *    See PR 817760 which has an attached patchfile to remove this limitation
@@ -92,6 +94,7 @@ struct HashMap {
    uint8 *entries;
    uint32 numEntries;
    uint32 count;
+   uint32 numDeleted;
    uint32 alpha;
 
    size_t keySize;
@@ -142,6 +145,7 @@ static uint32 ComputeHash(struct HashMap *map, const void *key);
 static Bool LookupKey(struct HashMap* map, const void *key, HashMapEntryHeader **header, void **data, uint32 *freeIndex);
 static Bool CompareKeys(struct HashMap *map, const void *key, const void *compare);
 static Bool NeedsResize(struct HashMap *map);
+static Bool NeedsGrow(struct HashMap *map, uint32 numEntries);
 static void Resize(struct HashMap *map);
 INLINE void EnsureSanity(HashMap *map);
 
@@ -327,6 +331,8 @@ InitMap(struct HashMap *map,     // IN
    numEntries *= alpha;
 
    map->numEntries = numEntries;
+   map->count = 0;
+   map->numDeleted = 0;
    map->alpha = alpha;
    map->keySize = keySize;
    map->dataSize = dataSize;
@@ -394,6 +400,9 @@ HashMap_Put(struct HashMap *map,    // IN
       GetEntry(map, freeIndex, &header, &tableKey, &tableData);
       ASSERT(header);
 
+      if (header->state == HashMapState_DELETED) {
+         map->numDeleted--;
+      }
       header->state = HashMapState_FILLED;
       header->hash = hash;
       memcpy(tableKey, key, map->keySize);
@@ -470,6 +479,7 @@ HashMap_Clear(struct HashMap *map) // IN
       header->state = HashMapState_EMPTY;
    }
    map->count = 0;
+   map->numDeleted = 0;
    EnsureSanity(map);
 }
 
@@ -508,6 +518,7 @@ HashMap_Remove(struct HashMap *map,   // IN
     * to see if it's EMPTY and then mark this one as empty as well.
     */
    map->count--;
+   map->numDeleted++;
    header->state = HashMapState_DELETED;
 
    EnsureSanity(map);
@@ -772,7 +783,8 @@ CompareKeys(struct HashMap *map,    // IN
  *
  *    Determine if adding another element to the map will require that the map
  *    be resized.  This takes into account the maximum load factor that is
- *    allowed for this map.
+ *    allowed for this map.  Deleted entries count towards the load as they
+ *    lengthen the probe sequences just as much as filled ones.
  *
  * Results:
  *    Returns TRUE if the map should be resized.
@@ -788,24 +800,57 @@ NeedsResize(struct HashMap *map)
 {
    uint32 required;
 
-   Clamped_UMul32(&required, map->count, map->alpha);
+   Clamped_UMul32(&required, map->count + map->numDeleted, map->alpha);
 
    return required >= map->numEntries;
 }
 
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * NeedsGrow --
+ *
+ *    Determine if an entries array of the given size is too small for the
+ *    filled entries of the map under its maximum load factor.
+ *
+ * Results:
+ *    Returns TRUE if the map needs more entries.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+Bool
+NeedsGrow(struct HashMap *map,   // IN
+          uint32 numEntries)     // IN
+{
+   uint32 required;
+
+   Clamped_UMul32(&required, map->count, map->alpha);
+
+   return required >= numEntries;
+}
+
 /*
  * ----------------------------------------------------------------------------
  *
  * Resize --
  *
  *    Doubles the size of the entries array until it is at least large enough
- *    to ensure the maximum load factor is not exceeded.
+ *    to ensure the maximum load factor is not exceeded.  If deleted entries
+ *    outnumber half of the filled ones and the filled entries alone do not
+ *    exceed it, the map is rebuilt at the same size instead, which drops
+ *    them.  As that many entries must have been deleted since the map was
+ *    last rebuilt, the cost of rebuilding is amortized over the deletions.
  *
  * Results:
  *    None.
  *
  * Side Effects:
- *    The entries list is doubled in size and the entries are copied into the
+ *    The entries list is reallocated and the entries are copied into the
  *    appropriate location.  Callers should not assume that the locations that
  *    were valid before this was called are still valid as all entries may
  *    appear at different locations after this function completes.
@@ -817,8 +862,13 @@ void
 Resize(struct HashMap *map)   // IN
 {
    struct HashMap oldHashMap = *map;
+   uint32 numEntries = map->numEntries;
    int i;
 
+   if (map->numDeleted > map->count / 2 && !NeedsGrow(map, numEntries)) {
+      goto rehash;
+   }
+
    if (map->numEntries == MAX_UINT32) {
       if (map->count < MAX_UINT32) {
          /*
@@ -841,20 +891,23 @@ Resize(struct HashMap *map)   // IN
     * keep it simple for now, however, we'll just grow geometrically all the
     * time.
     */
-   map->entries = calloc(oldHashMap.numEntries * 2, oldHashMap.entrySize);
-   if (!map->entries) {
-      map->entries = oldHashMap.entries;
-      return;
-   }
-
    do {
-      if (!Clamped_UMul32(&map->numEntries, map->numEntries, 2)) {
+      if (!Clamped_UMul32(&numEntries, numEntries, 2)) {
          /* Prevent overflow and */
          break;
       }
-   } while (NeedsResize(map));
+   } while (NeedsGrow(map, numEntries));
 
+rehash:
+   map->entries = calloc(numEntries, oldHashMap.entrySize);
+   if (!map->entries) {
+      map->entries = oldHashMap.entries;
+      return;
+   }
+
+   map->numEntries = numEntries;
    map->count = 0;
+   map->numDeleted = 0;
 
    for (i = 0; i < oldHashMap.numEntries; i++) {
       HashMapEntryHeader *oldHeader;
@@ -941,6 +994,9 @@ HashMap_Iterate(HashMap *map,             // IN
          header->state = HashMapState_EMPTY;
       }
    }
+   if (clear) {
+      map->numDeleted = 0;
+   }
 
    ASSERT(map->count == 0 || !clear);
 }
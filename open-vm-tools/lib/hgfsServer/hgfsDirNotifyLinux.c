@@ -0,0 +1,1781 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsDirNotifyLinux.c --
+ *
+ *	Directory change notification support for Linux, based on inotify.
+ *
+ *	A single monitor thread reads the inotify descriptor, translates the
+ *	inotify events into HGFS notification events and queues them. Events
+ *	for the same file which arrive within a short window are coalesced
+ *	into one event. The queue is bounded: once it is full further events
+ *	are dropped and the subscriber is sent a single "events dropped"
+ *	notification instead.
+ *
+ *	Recursive subscribers get a watch on every directory of the subtree,
+ *	and watches are added and removed as directories are created, moved
+ *	or deleted.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/poll.h>
+#include <sys/inotify.h>
+
+#include "vmware.h"
+#include "vm_basic_types.h"
+#include "str.h"
+#include "util.h"
+#include "hostinfo.h"
+#include "dbllnklst.h"
+#include "hashMap.h"
+#include "userlock.h"
+#include "mutexRankLib.h"
+
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsUtil.h"
+#include "hgfsDirNotify.h"
+
+#define LOGLEVEL_MODULE hgfs
+#include "loglevel_user.h"
+
+
+/* Maximum number of events waiting to be delivered. */
+#define HGFS_NOTIFY_MAX_QUEUED_EVENTS   1024
+
+/* Events for the same file within this window are merged into one. */
+#define HGFS_NOTIFY_COALESCE_MSEC       50
+
+/* Size of the buffer used to read events from the inotify descriptor. */
+#define HGFS_NOTIFY_READ_BUFFER_SIZE    (16 * 1024)
+
+/* HGFS events which may be merged into a single event. */
+#define HGFS_NOTIFY_COALESCE_MASK  (HGFS_NOTIFY_ACCESS | HGFS_NOTIFY_ATTRIB | \
+                                    HGFS_NOTIFY_SIZE | HGFS_NOTIFY_ATIME |     \
+                                    HGFS_NOTIFY_MTIME | HGFS_NOTIFY_CTIME |   \
+                                    HGFS_NOTIFY_OPEN | HGFS_NOTIFY_MODIFY |   \
+                                    HGFS_NOTIFY_CLOSE_WRITE |                 \
+                                    HGFS_NOTIFY_CLOSE_NOWRITE)
+
+/* Inotify events needed to keep the watches of a recursive subscriber. */
+#define HGFS_NOTIFY_TREE_MASK      (IN_CREATE | IN_MOVED_FROM | IN_MOVED_TO)
+
+
+typedef struct HgfsNotifyFolder {
+   DblLnkLst_Links links;
+   HgfsSharedFolderHandle handle;
+   char *path;                        /* Local path of the shared folder. */
+} HgfsNotifyFolder;
+
+typedef struct HgfsNotifySubscriber {
+   DblLnkLst_Links links;             /* Link in the subscribers list. */
+   HgfsSubscriberHandle handle;
+   HgfsSharedFolderHandle folder;
+   char *folderPath;                  /* Local path of the shared folder. */
+   uint32 eventFilter;                /* HGFS_NOTIFY_* events to report. */
+   uint32 inotifyMask;                /* IN_* events to watch for. */
+   Bool recursive;
+   Bool removed;                      /* Unlinked, no more events. */
+   Bool eventsDropped;                /* Overflow event is queued. */
+   uint32 refCount;                   /* Subscriber list, events and scans. */
+   HgfsNotifyEventReceiveCb *eventCb;
+   struct HgfsSessionInfo *session;
+   DblLnkLst_Links subWatches;        /* HgfsNotifySubWatch of the subscriber. */
+} HgfsNotifySubscriber;
+
+/* An inotify watch descriptor, possibly shared by several subscribers. */
+typedef struct HgfsNotifyWatch {
+   int wd;
+   DblLnkLst_Links subWatches;        /* HgfsNotifySubWatch using this wd. */
+} HgfsNotifyWatch;
+
+/* A directory watched on behalf of a subscriber. */
+typedef struct HgfsNotifySubWatch {
+   DblLnkLst_Links watchLinks;        /* Link in HgfsNotifyWatch. */
+   DblLnkLst_Links subscriberLinks;   /* Link in HgfsNotifySubscriber. */
+   HgfsNotifyWatch *watch;
+   HgfsNotifySubscriber *subscriber;
+   char *path;                        /* Relative to the shared folder root. */
+   Bool isRoot;                       /* The directory the client watches. */
+} HgfsNotifySubWatch;
+
+/* A new directory of a recursive subscriber, waiting to be watched. */
+typedef struct HgfsNotifyScan {
+   DblLnkLst_Links links;
+   HgfsNotifySubscriber *subscriber;  /* Holds a subscriber reference. */
+   char *path;                        /* Relative to the shared folder root. */
+} HgfsNotifyScan;
+
+/* Directories found by HgfsNotifyCollectTree. */
+typedef struct HgfsNotifyDirList {
+   char **paths;                      /* Relative to the shared folder root. */
+   size_t numPaths;
+   size_t maxPaths;
+} HgfsNotifyDirList;
+
+typedef struct HgfsNotifyEvent {
+   DblLnkLst_Links links;
+   HgfsNotifySubscriber *subscriber;  /* Holds a subscriber reference. */
+   char *fileName;                    /* NULL for an overflow event. */
+   uint32 mask;
+} HgfsNotifyEvent;
+
+static struct {
+   /*
+    * Protects everything below. Never held while calling a subscriber
+    * callback since the callback acquires the server shared folders lock.
+    */
+   MXUserExclLock *lock;
+   MXUserCondVar *deliveredVar;        /* Signalled after each delivery. */
+   HgfsNotifySubscriber *delivering;   /* Subscriber being called back. */
+
+   int inotifyFd;
+   int wakeFds[2];                     /* Wakes up the monitor thread. */
+   pthread_t thread;
+   Bool threadStarted;
+   Bool exiting;
+   Bool suspended;                     /* Server is synchronizing. */
+
+   DblLnkLst_Links folders;
+   DblLnkLst_Links subscribers;
+   HashMap *watches;                   /* wd -> HgfsNotifyWatch * */
+   HgfsSharedFolderHandle nextFolderHandle;
+   HgfsSubscriberHandle nextSubscriberHandle;
+
+   DblLnkLst_Links scans;              /* HgfsNotifyScan to walk. */
+   DblLnkLst_Links events;
+   uint32 numEvents;
+   VmTimeType firstEventTime;          /* When the oldest event was queued. */
+} gHgfsNotify = { NULL, NULL, NULL, -1, { -1, -1 } };
+
+
+static void HgfsNotifyRemoveSubWatch(HgfsNotifySubWatch *subWatch);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyJoinPath --
+ *
+ *    Join two path components, either of which may be empty.
+ *
+ * Results:
+ *    Allocated path.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+HgfsNotifyJoinPath(const char *dir,    // IN: directory
+                   const char *name)   // IN: name within the directory
+{
+   if ('\0' == dir[0]) {
+      return Util_SafeStrdup(name);
+   }
+   if ('\0' == name[0]) {
+      return Util_SafeStrdup(dir);
+   }
+   return Str_SafeAsprintf(NULL, "%s/%s", dir, name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFilterToInotify --
+ *
+ *    Convert an HGFS event filter to the inotify events that generate it.
+ *
+ * Results:
+ *    Inotify event mask.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyFilterToInotify(uint32 eventFilter)   // IN: HGFS_NOTIFY_* mask
+{
+   uint32 mask = 0;
+
+   if (eventFilter & HGFS_NOTIFY_ACCESS) {
+      mask |= IN_ACCESS;
+   }
+   if (eventFilter & (HGFS_NOTIFY_ATTRIB | HGFS_NOTIFY_ATIME |
+                      HGFS_NOTIFY_CTIME | HGFS_NOTIFY_CHANGE_SECURITY |
+                      HGFS_NOTIFY_CHANGE_EA)) {
+      mask |= IN_ATTRIB;
+   }
+   if (eventFilter & (HGFS_NOTIFY_SIZE | HGFS_NOTIFY_MTIME | HGFS_NOTIFY_MODIFY)) {
+      mask |= IN_MODIFY;
+   }
+   if (eventFilter & HGFS_NOTIFY_OPEN) {
+      mask |= IN_OPEN;
+   }
+   if (eventFilter & HGFS_NOTIFY_CLOSE_WRITE) {
+      mask |= IN_CLOSE_WRITE;
+   }
+   if (eventFilter & HGFS_NOTIFY_CLOSE_NOWRITE) {
+      mask |= IN_CLOSE_NOWRITE;
+   }
+   if (eventFilter & (HGFS_NOTIFY_CREATE_FILE | HGFS_NOTIFY_CREATE_DIR |
+                      HGFS_NOTIFY_CRTIME)) {
+      mask |= IN_CREATE;
+   }
+   if (eventFilter & (HGFS_NOTIFY_DELETE_FILE | HGFS_NOTIFY_DELETE_DIR)) {
+      mask |= IN_DELETE;
+   }
+   if (eventFilter & (HGFS_NOTIFY_DELETE_SELF | HGFS_NOTIFY_WATCH_DELETED)) {
+      mask |= IN_DELETE_SELF;
+   }
+   if (eventFilter & HGFS_NOTIFY_MOVE_SELF) {
+      mask |= IN_MOVE_SELF;
+   }
+   if (eventFilter & (HGFS_NOTIFY_OLD_FILE_NAME | HGFS_NOTIFY_OLD_DIR_NAME |
+                      HGFS_NOTIFY_NAME)) {
+      mask |= IN_MOVED_FROM;
+   }
+   if (eventFilter & (HGFS_NOTIFY_NEW_FILE_NAME | HGFS_NOTIFY_NEW_DIR_NAME |
+                      HGFS_NOTIFY_NAME)) {
+      mask |= IN_MOVED_TO;
+   }
+
+   return mask;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyInotifyToHgfs --
+ *
+ *    Convert the inotify events of a single inotify record to HGFS events.
+ *
+ * Results:
+ *    HGFS_NOTIFY_* event mask.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyInotifyToHgfs(uint32 mask)   // IN: IN_* mask
+{
+   Bool isDir = (0 != (mask & IN_ISDIR));
+   uint32 result = 0;
+
+   if (mask & IN_ACCESS) {
+      result |= HGFS_NOTIFY_ACCESS;
+   }
+   if (mask & IN_ATTRIB) {
+      result |= HGFS_NOTIFY_ATTRIB;
+   }
+   if (mask & IN_MODIFY) {
+      result |= HGFS_NOTIFY_MODIFY | HGFS_NOTIFY_SIZE | HGFS_NOTIFY_MTIME;
+   }
+   if (mask & IN_OPEN) {
+      result |= HGFS_NOTIFY_OPEN;
+   }
+   if (mask & IN_CLOSE_WRITE) {
+      result |= HGFS_NOTIFY_CLOSE_WRITE;
+   }
+   if (mask & IN_CLOSE_NOWRITE) {
+      result |= HGFS_NOTIFY_CLOSE_NOWRITE;
+   }
+   if (mask & IN_CREATE) {
+      result |= isDir ? HGFS_NOTIFY_CREATE_DIR : HGFS_NOTIFY_CREATE_FILE;
+   }
+   if (mask & IN_DELETE) {
+      result |= isDir ? HGFS_NOTIFY_DELETE_DIR : HGFS_NOTIFY_DELETE_FILE;
+   }
+   if (mask & IN_DELETE_SELF) {
+      result |= HGFS_NOTIFY_DELETE_SELF | HGFS_NOTIFY_WATCH_DELETED;
+   }
+   if (mask & IN_MOVE_SELF) {
+      result |= HGFS_NOTIFY_MOVE_SELF;
+   }
+   if (mask & IN_MOVED_FROM) {
+      result |= isDir ? HGFS_NOTIFY_OLD_DIR_NAME : HGFS_NOTIFY_OLD_FILE_NAME;
+   }
+   if (mask & IN_MOVED_TO) {
+      result |= isDir ? HGFS_NOTIFY_NEW_DIR_NAME : HGFS_NOTIFY_NEW_FILE_NAME;
+   }
+
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyWakeMonitor --
+ *
+ *    Wake up the monitor thread so it re-evaluates its state.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyWakeMonitor(void)
+{
+   char c = 0;
+
+   if (write(gHgfsNotify.wakeFds[1], &c, sizeof c) < 0 && EAGAIN != errno) {
+      LOG(4, ("%s: failed to wake the monitor thread %d\n", __FUNCTION__, errno));
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifySubscriberPut --
+ *
+ *    Drop a subscriber reference, freeing the subscriber with the last one.
+ *
+ *    Called with the notification lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifySubscriberPut(HgfsNotifySubscriber *subscriber)   // IN
+{
+   ASSERT(subscriber->refCount > 0);
+
+   if (--subscriber->refCount == 0) {
+      ASSERT(subscriber->removed);
+      ASSERT(!DblLnkLst_IsLinked(&subscriber->subWatches));
+      free(subscriber->folderPath);
+      free(subscriber);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyUnlinkSubscriber --
+ *
+ *    Remove all the watches of a subscriber and take it off the subscribers
+ *    list. Events still queued for the subscriber are discarded on delivery.
+ *
+ *    Called with the notification lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    May free the subscriber.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyUnlinkSubscriber(HgfsNotifySubscriber *subscriber)   // IN
+{
+   DblLnkLst_Links *link, *nextElem;
+
+   LOG(8, ("%s: removing subscriber %"FMT64"x\n", __FUNCTION__,
+           subscriber->handle));
+
+   DblLnkLst_ForEachSafe(link, nextElem, &subscriber->subWatches) {
+      HgfsNotifyRemoveSubWatch(DblLnkLst_Container(link, HgfsNotifySubWatch,
+                                                   subscriberLinks));
+   }
+   DblLnkLst_Unlink1(&subscriber->links);
+   subscriber->removed = TRUE;
+   HgfsNotifySubscriberPut(subscriber);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFindFolder --
+ *
+ *    Look up a shared folder by its handle.
+ *
+ *    Called with the notification lock held.
+ *
+ * Results:
+ *    The shared folder or NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNotifyFolder *
+HgfsNotifyFindFolder(HgfsSharedFolderHandle handle)   // IN
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &gHgfsNotify.folders) {
+      HgfsNotifyFolder *folder = DblLnkLst_Container(link, HgfsNotifyFolder,
+                                                     links);
+      if (folder->handle == handle) {
+         return folder;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyAddSubWatch --
+ *
+ *    Watch a directory on behalf of a subscriber.
+ *
+ *    Called with the notification lock held.
+ *
+ * Results:
+ *    TRUE if the directory is watched, FALSE otherwise.
+ *
+ * Side effects:
+ *    Adds or updates an inotify watch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyAddSubWatch(HgfsNotifySubscriber *subscriber,   // IN
+                      const char *path,                   // IN: relative path
+                      Bool isRoot)                        // IN: client's directory
+{
+   HgfsNotifyWatch **entry;
+   HgfsNotifyWatch *watch;
+   HgfsNotifySubWatch *subWatch;
+   DblLnkLst_Links *link;
+   char *localPath;
+   int wd;
+
+   localPath = HgfsNotifyJoinPath(subscriber->folderPath, path);
+   /* IN_MASK_ADD keeps the events other subscribers want from the same wd. */
+   wd = inotify_add_watch(gHgfsNotify.inotifyFd, localPath,
+                          subscriber->inotifyMask | IN_MASK_ADD | IN_ONLYDIR |
+                          IN_DONT_FOLLOW);
+   if (wd < 0) {
+      LOG(4, ("%s: failed to watch %s: %d\n", __FUNCTION__, localPath, errno));
+      free(localPath);
+      return FALSE;
+   }
+   free(localPath);
+
+   entry = HashMap_Get(gHgfsNotify.watches, &wd);
+   if (NULL != entry) {
+      watch = *entry;
+      DblLnkLst_ForEach(link, &watch->subWatches) {
+         subWatch = DblLnkLst_Container(link, HgfsNotifySubWatch, watchLinks);
+         if (subWatch->subscriber == subscriber) {
+            /* Same directory reached through another path. */
+            return TRUE;
+         }
+      }
+   } else {
+      watch = Util_SafeMalloc(sizeof *watch);
+      watch->wd = wd;
+      DblLnkLst_Init(&watch->subWatches);
+      if (!HashMap_Put(gHgfsNotify.watches, &wd, &watch)) {
+         inotify_rm_watch(gHgfsNotify.inotifyFd, wd);
+         free(watch);
+         return FALSE;
+      }
+   }
+
+   subWatch = Util_SafeMalloc(sizeof *subWatch);
+   DblLnkLst_Init(&subWatch->watchLinks);
+   DblLnkLst_Init(&subWatch->subscriberLinks);
+   subWatch->watch = watch;
+   subWatch->subscriber = subscriber;
+   subWatch->path = Util_SafeStrdup(path);
+   subWatch->isRoot = isRoot;
+   DblLnkLst_LinkLast(&watch->subWatches, &subWatch->watchLinks);
+   DblLnkLst_LinkLast(&subscriber->subWatches, &subWatch->subscriberLinks);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyRemoveSubWatch --
+ *
+ *    Stop watching a directory on behalf of a subscriber. The inotify watch
+ *    is removed when no other subscriber uses it.
+ *
+ *    Called with the notification lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    May remove an inotify watch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyRemoveSubWatch(HgfsNotifySubWatch *subWatch)   // IN
+{
+   HgfsNotifyWatch *watch = subWatch->watch;
+
+   DblLnkLst_Unlink1(&subWatch->watchLinks);
+   DblLnkLst_Unlink1(&subWatch->subscriberLinks);
+   free(subWatch->path);
+   free(subWatch);
+
+   if (!DblLnkLst_IsLinked(&watch->subWatches)) {
+      /* May fail if the directory is already gone, which is fine. */
+      inotify_rm_watch(gHgfsNotify.inotifyFd, watch->wd);
+      HashMap_Remove(gHgfsNotify.watches, &watch->wd);
+      free(watch);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyCollectTree --
+ *
+ *    List a directory and, if recursive, all the directories below it.
+ *    Symbolic links are not followed.
+ *
+ *    Walks the file system, so must be called without the notification
+ *    lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Fills in dirs, the first entry is the directory itself.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyCollectTree(const char *folderPath,    // IN: shared folder root
+                      const char *path,          // IN: relative path
+                      Bool recursive,            // IN
+                      HgfsNotifyDirList *dirs)   // OUT
+{
+   size_t i;
+
+   dirs->paths = Util_SafeMalloc(sizeof *dirs->paths);
+   dirs->paths[0] = Util_SafeStrdup(path);
+   dirs->numPaths = 1;
+   dirs->maxPaths = 1;
+
+   if (!recursive) {
+      return;
+   }
+
+   /* Breadth first: the list doubles as the queue of directories to scan. */
+   for (i = 0; i < dirs->numPaths; i++) {
+      struct dirent *entry;
+      char *localPath;
+      DIR *dir;
+
+      localPath = HgfsNotifyJoinPath(folderPath, dirs->paths[i]);
+      dir = opendir(localPath);
+      if (NULL == dir) {
+         LOG(4, ("%s: failed to open %s: %d\n", __FUNCTION__, localPath, errno));
+         free(localPath);
+         continue;
+      }
+
+      while ((entry = readdir(dir)) != NULL) {
+         Bool isDir;
+
+         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+         }
+
+         if (DT_UNKNOWN == entry->d_type) {
+            struct stat st;
+            char *childLocalPath = HgfsNotifyJoinPath(localPath, entry->d_name);
+
+            isDir = lstat(childLocalPath, &st) == 0 && S_ISDIR(st.st_mode);
+            free(childLocalPath);
+         } else {
+            isDir = DT_DIR == entry->d_type;
+         }
+         if (!isDir) {
+            continue;
+         }
+
+         if (dirs->numPaths == dirs->maxPaths) {
+            dirs->maxPaths *= 2;
+            dirs->paths = Util_SafeRealloc(dirs->paths,
+                                           dirs->maxPaths * sizeof *dirs->paths);
+         }
+         dirs->paths[dirs->numPaths++] = HgfsNotifyJoinPath(dirs->paths[i],
+                                                            entry->d_name);
+      }
+
+      closedir(dir);
+      free(localPath);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFreeDirList --
+ *
+ *    Free a list filled in by HgfsNotifyCollectTree.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFreeDirList(HgfsNotifyDirList *dirs)   // IN
+{
+   size_t i;
+
+   for (i = 0; i < dirs->numPaths; i++) {
+      free(dirs->paths[i]);
+   }
+   free(dirs->paths);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyAddTree --
+ *
+ *    Watch the directories collected by HgfsNotifyCollectTree. Directories
+ *    which went away in the meantime are skipped.
+ *
+ *    Called with the notification lock held.
+ *
+ * Results:
+ *    TRUE if the top directory is watched, FALSE otherwise.
+ *
+ * Side effects:
+ *    Adds inotify watches.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyAddTree(HgfsNotifySubscriber *subscriber,   // IN
+                  const HgfsNotifyDirList *dirs,      // IN
+                  Bool isRoot)                        // IN: client's directory
+{
+   size_t i;
+
+   if (!HgfsNotifyAddSubWatch(subscriber, dirs->paths[0], isRoot)) {
+      return FALSE;
+   }
+
+   for (i = 1; i < dirs->numPaths; i++) {
+      HgfsNotifyAddSubWatch(subscriber, dirs->paths[i], FALSE);
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyRemoveTree --
+ *
+ *    Remove the subscriber's watches on a directory and everything below it.
+ *
+ *    Called with the notification lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    May remove inotify watches.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyRemoveTree(HgfsNotifySubscriber *subscriber,   // IN
+                     const char *path)                   // IN: relative path
+{
+   DblLnkLst_Links *link, *nextElem;
+   size_t pathLen = strlen(path);
+
+   DblLnkLst_ForEachSafe(link, nextElem, &subscriber->subWatches) {
+      HgfsNotifySubWatch *subWatch =
+         DblLnkLst_Container(link, HgfsNotifySubWatch, subscriberLinks);
+
+      if (!subWatch->isRoot &&
+          strncmp(subWatch->path, path, pathLen) == 0 &&
+          ('\0' == subWatch->path[pathLen] || '/' == subWatch->path[pathLen])) {
+         HgfsNotifyRemoveSubWatch(subWatch);
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyQueueEvent --
+ *
+ *    Queue an event for delivery to a subscriber.
+ *
+ *    An event is merged with an already queued event for the same file if
+ *    both only carry attribute or content changes. When the queue is full
+ *    the event is dropped and a single overflow event is queued for the
+ *    subscriber instead.
+ *
+ *    Called with the notification lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Takes ownership of fileName.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyQueueEvent(HgfsNotifySubscriber *subscriber,   // IN
+                     char *fileName,                     // IN: NULL for overflow
+                     uint32 mask)                        // IN: HGFS_NOTIFY_* mask
+{
+   HgfsNotifyEvent *event;
+
+   if (subscriber->eventsDropped) {
+      /* The subscriber will rescan anyway. */
+      free(fileName);
+      return;
+   }
+
+   if (NULL != fileName && 0 == (mask & ~HGFS_NOTIFY_COALESCE_MASK)) {
+      DblLnkLst_Links *link;
+
+      for (link = gHgfsNotify.events.prev; link != &gHgfsNotify.events;
+           link = link->prev) {
+         event = DblLnkLst_Container(link, HgfsNotifyEvent, links);
+         if (event->subscriber != subscriber || NULL == event->fileName ||
+             strcmp(event->fileName, fileName) != 0) {
+            continue;
+         }
+         if (0 == (event->mask & ~HGFS_NOTIFY_COALESCE_MASK)) {
+            event->mask |= mask;
+            free(fileName);
+            return;
+         }
+         /* Keep the order of name changes for the same file. */
+         break;
+      }
+   }
+
+   if (gHgfsNotify.numEvents >= HGFS_NOTIFY_MAX_QUEUED_EVENTS) {
+      /* The overflow event may go past the limit, once per subscriber. */
+      LOG(4, ("%s: dropping events for subscriber %"FMT64"x\n", __FUNCTION__,
+              subscriber->handle));
+      free(fileName);
+      fileName = NULL;
+      mask = HGFS_NOTIFY_EVENTS_DROPPED;
+   }
+   if (NULL == fileName) {
+      subscriber->eventsDropped = TRUE;
+   }
+
+   event = Util_SafeMalloc(sizeof *event);
+   DblLnkLst_Init(&event->links);
+   event->subscriber = subscriber;
+   subscriber->refCount++;
+   event->fileName = fileName;
+   event->mask = mask;
+
+   if (0 == gHgfsNotify.numEvents) {
+      gHgfsNotify.firstEventTime = Hostinfo_SystemTimerMS();
+   }
+   DblLnkLst_LinkLast(&gHgfsNotify.events, &event->links);
+   gHgfsNotify.numEvents++;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyQueueOverflow --
+ *
+ *    Queue an overflow event for every subscriber, used when the kernel
+ *    dropped events.
+ *
+ *    Called with the notification lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyQueueOverflow(void)
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &gHgfsNotify.subscribers) {
+      HgfsNotifySubscriber *subscriber =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      HgfsNotifyQueueEvent(subscriber, NULL, HGFS_NOTIFY_EVENTS_DROPPED);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyQueueScan --
+ *
+ *    Queue a new directory of a recursive subscriber to be watched, along
+ *    with everything below it, by HgfsNotifyRunScans.
+ *
+ *    Called with the notification lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyQueueScan(HgfsNotifySubscriber *subscriber,   // IN
+                    const char *path)                   // IN: relative path
+{
+   HgfsNotifyScan *scan = Util_SafeMalloc(sizeof *scan);
+
+   DblLnkLst_Init(&scan->links);
+   scan->subscriber = subscriber;
+   subscriber->refCount++;
+   scan->path = Util_SafeStrdup(path);
+   DblLnkLst_LinkLast(&gHgfsNotify.scans, &scan->links);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyRunScans --
+ *
+ *    Watch the directories queued by HgfsNotifyQueueScan and their subtrees.
+ *
+ *    A directory moved into a watched tree may hold a large tree, so the
+ *    lock is dropped while walking it. Subscribers removed in the meantime
+ *    get no new watches.
+ *
+ *    Called with the notification lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Adds inotify watches.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyRunScans(void)
+{
+   while (DblLnkLst_IsLinked(&gHgfsNotify.scans)) {
+      HgfsNotifyScan *scan = DblLnkLst_Container(gHgfsNotify.scans.next,
+                                                 HgfsNotifyScan, links);
+      HgfsNotifySubscriber *subscriber = scan->subscriber;
+      HgfsNotifyDirList dirs;
+
+      DblLnkLst_Unlink1(&scan->links);
+
+      /* The subscriber reference keeps folderPath valid. */
+      MXUser_ReleaseExclLock(gHgfsNotify.lock);
+      HgfsNotifyCollectTree(subscriber->folderPath, scan->path, TRUE, &dirs);
+      MXUser_AcquireExclLock(gHgfsNotify.lock);
+
+      if (!subscriber->removed) {
+         HgfsNotifyAddTree(subscriber, &dirs, FALSE);
+      }
+
+      HgfsNotifyFreeDirList(&dirs);
+      HgfsNotifySubscriberPut(subscriber);
+      free(scan->path);
+      free(scan);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyProcessEvent --
+ *
+ *    Translate one inotify event for every subscriber watching the
+ *    directory, and keep the watches of recursive subscribers up to date.
+ *
+ *    Called with the notification lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    May remove watches and queue scans of new directories.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyProcessEvent(const struct inotify_event *inEvent)   // IN
+{
+   HgfsNotifyWatch **entry;
+   HgfsNotifyWatch *watch;
+   DblLnkLst_Links *link, *nextElem;
+   uint32 hgfsMask;
+
+   if (inEvent->mask & IN_Q_OVERFLOW) {
+      LOG(4, ("%s: inotify queue overflow\n", __FUNCTION__));
+      HgfsNotifyQueueOverflow();
+      return;
+   }
+
+   entry = HashMap_Get(gHgfsNotify.watches, &inEvent->wd);
+   if (NULL == entry) {
+      /* The watch was removed while the event was in flight. */
+      return;
+   }
+   watch = *entry;
+
+   if (inEvent->mask & IN_IGNORED) {
+      /* The directory is gone, the kernel already dropped the watch. */
+      DblLnkLst_ForEachSafe(link, nextElem, &watch->subWatches) {
+         HgfsNotifyRemoveSubWatch(DblLnkLst_Container(link, HgfsNotifySubWatch,
+                                                      watchLinks));
+      }
+      return;
+   }
+
+   hgfsMask = HgfsNotifyInotifyToHgfs(inEvent->mask);
+
+   DblLnkLst_ForEachSafe(link, nextElem, &watch->subWatches) {
+      HgfsNotifySubWatch *subWatch =
+         DblLnkLst_Container(link, HgfsNotifySubWatch, watchLinks);
+      HgfsNotifySubscriber *subscriber = subWatch->subscriber;
+      const char *name = (inEvent->len > 0) ? inEvent->name : "";
+      uint32 mask = hgfsMask & subscriber->eventFilter;
+      char *fileName;
+
+      if ('\0' == name[0] && !subWatch->isRoot) {
+         /* Self events of subdirectories are reported by their parent. */
+         continue;
+      }
+
+      fileName = HgfsNotifyJoinPath(subWatch->path, name);
+
+      if (subscriber->recursive && (inEvent->mask & IN_ISDIR) &&
+          '\0' != name[0]) {
+         if (inEvent->mask & (IN_CREATE | IN_MOVED_TO)) {
+            HgfsNotifyQueueScan(subscriber, fileName);
+         } else if (inEvent->mask & IN_MOVED_FROM) {
+            HgfsNotifyRemoveTree(subscriber, fileName);
+         }
+      }
+
+      if (0 != mask) {
+         HgfsNotifyQueueEvent(subscriber, fileName, mask);
+      } else {
+         free(fileName);
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyReadEvents --
+ *
+ *    Read and process all available inotify events.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyReadEvents(void)
+{
+   char buf[HGFS_NOTIFY_READ_BUFFER_SIZE]
+      __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+   for (;;) {
+      ssize_t len = read(gHgfsNotify.inotifyFd, buf, sizeof buf);
+      char *p;
+
+      if (len <= 0) {
+         if (len < 0 && EINTR == errno) {
+            continue;
+         }
+         break;
+      }
+
+      MXUser_AcquireExclLock(gHgfsNotify.lock);
+      for (p = buf; p < buf + len; ) {
+         const struct inotify_event *inEvent = (const struct inotify_event *)p;
+
+         HgfsNotifyProcessEvent(inEvent);
+         p += sizeof *inEvent + inEvent->len;
+      }
+      HgfsNotifyRunScans();
+      MXUser_ReleaseExclLock(gHgfsNotify.lock);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDeliverEvents --
+ *
+ *    Deliver all queued events to the subscribers.
+ *
+ *    The lock is dropped around each callback. Subscribers removed in the
+ *    meantime do not get their remaining events.
+ *
+ *    Called with the notification lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDeliverEvents(void)
+{
+   while (DblLnkLst_IsLinked(&gHgfsNotify.events)) {
+      HgfsNotifyEvent *event = DblLnkLst_Container(gHgfsNotify.events.next,
+                                                   HgfsNotifyEvent, links);
+      HgfsNotifySubscriber *subscriber = event->subscriber;
+
+      DblLnkLst_Unlink1(&event->links);
+      gHgfsNotify.numEvents--;
+      if (NULL == event->fileName) {
+         subscriber->eventsDropped = FALSE;
+      }
+
+      if (!subscriber->removed) {
+         gHgfsNotify.delivering = subscriber;
+         MXUser_ReleaseExclLock(gHgfsNotify.lock);
+
+         subscriber->eventCb(subscriber->folder, subscriber->handle,
+                             event->fileName, event->mask, subscriber->session);
+
+         MXUser_AcquireExclLock(gHgfsNotify.lock);
+         gHgfsNotify.delivering = NULL;
+         MXUser_BroadcastCondVar(gHgfsNotify.deliveredVar);
+      }
+
+      HgfsNotifySubscriberPut(subscriber);
+      free(event->fileName);
+      free(event);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyMonitorThread --
+ *
+ *    Monitor thread: waits for inotify events and delivers them once the
+ *    coalescing window of the oldest queued event has passed.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsNotifyMonitorThread(void *clientData)   // IN: unused
+{
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+
+   while (!gHgfsNotify.exiting) {
+      struct pollfd fds[2];
+      nfds_t nfds = 1;
+      int timeout = -1;
+      char c;
+
+      fds[0].fd = gHgfsNotify.wakeFds[0];
+      fds[0].events = POLLIN;
+      if (!gHgfsNotify.suspended) {
+         /* While suspended events stay in the kernel queue. */
+         fds[1].fd = gHgfsNotify.inotifyFd;
+         fds[1].events = POLLIN;
+         nfds++;
+
+         if (gHgfsNotify.numEvents > 0) {
+            VmTimeType age = Hostinfo_SystemTimerMS() - gHgfsNotify.firstEventTime;
+
+            if (age >= HGFS_NOTIFY_COALESCE_MSEC ||
+                gHgfsNotify.numEvents >= HGFS_NOTIFY_MAX_QUEUED_EVENTS) {
+               HgfsNotifyDeliverEvents();
+               continue;
+            }
+            timeout = HGFS_NOTIFY_COALESCE_MSEC - (int)age;
+         }
+      }
+      MXUser_ReleaseExclLock(gHgfsNotify.lock);
+
+      if (poll(fds, nfds, timeout) < 0 && EINTR != errno) {
+         LOG(4, ("%s: poll failed %d\n", __FUNCTION__, errno));
+      }
+
+      while (read(gHgfsNotify.wakeFds[0], &c, sizeof c) > 0) {
+      }
+      if (nfds > 1 && (fds[1].revents & POLLIN)) {
+         HgfsNotifyReadEvents();
+      }
+
+      MXUser_AcquireExclLock(gHgfsNotify.lock);
+   }
+
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyCleanup --
+ *
+ *    Release all notification state.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyCleanup(void)
+{
+   DblLnkLst_Links *link, *nextElem;
+
+   if (NULL != gHgfsNotify.lock) {
+      MXUser_AcquireExclLock(gHgfsNotify.lock);
+      DblLnkLst_ForEachSafe(link, nextElem, &gHgfsNotify.subscribers) {
+         HgfsNotifyUnlinkSubscriber(DblLnkLst_Container(link, HgfsNotifySubscriber,
+                                                        links));
+      }
+      /* Drops the references of the queued events. */
+      DblLnkLst_ForEachSafe(link, nextElem, &gHgfsNotify.events) {
+         HgfsNotifyEvent *event = DblLnkLst_Container(link, HgfsNotifyEvent,
+                                                      links);
+
+         DblLnkLst_Unlink1(&event->links);
+         HgfsNotifySubscriberPut(event->subscriber);
+         free(event->fileName);
+         free(event);
+      }
+      gHgfsNotify.numEvents = 0;
+      DblLnkLst_ForEachSafe(link, nextElem, &gHgfsNotify.scans) {
+         HgfsNotifyScan *scan = DblLnkLst_Container(link, HgfsNotifyScan,
+                                                    links);
+
+         DblLnkLst_Unlink1(&scan->links);
+         HgfsNotifySubscriberPut(scan->subscriber);
+         free(scan->path);
+         free(scan);
+      }
+      DblLnkLst_ForEachSafe(link, nextElem, &gHgfsNotify.folders) {
+         HgfsNotifyFolder *folder = DblLnkLst_Container(link, HgfsNotifyFolder,
+                                                        links);
+
+         DblLnkLst_Unlink1(&folder->links);
+         free(folder->path);
+         free(folder);
+      }
+      MXUser_ReleaseExclLock(gHgfsNotify.lock);
+   }
+
+   if (NULL != gHgfsNotify.watches) {
+      HashMap_DestroyMap(gHgfsNotify.watches);
+      gHgfsNotify.watches = NULL;
+   }
+   if (gHgfsNotify.inotifyFd >= 0) {
+      close(gHgfsNotify.inotifyFd);
+      gHgfsNotify.inotifyFd = -1;
+   }
+   if (gHgfsNotify.wakeFds[0] >= 0) {
+      close(gHgfsNotify.wakeFds[0]);
+      close(gHgfsNotify.wakeFds[1]);
+      gHgfsNotify.wakeFds[0] = -1;
+      gHgfsNotify.wakeFds[1] = -1;
+   }
+   if (NULL != gHgfsNotify.deliveredVar) {
+      MXUser_DestroyCondVar(gHgfsNotify.deliveredVar);
+      gHgfsNotify.deliveredVar = NULL;
+   }
+   if (NULL != gHgfsNotify.lock) {
+      MXUser_DestroyExclLock(gHgfsNotify.lock);
+      gHgfsNotify.lock = NULL;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Init --
+ *
+ *    Initialization for the notification component: creates the inotify
+ *    instance and starts the monitor thread.
+ *
+ * Results:
+ *    HGFS_STATUS_SUCCESS or an error code.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsNotify_Init(void)
+{
+   HgfsInternalStatus status;
+   int i;
+
+   DblLnkLst_Init(&gHgfsNotify.folders);
+   DblLnkLst_Init(&gHgfsNotify.subscribers);
+   DblLnkLst_Init(&gHgfsNotify.scans);
+   DblLnkLst_Init(&gHgfsNotify.events);
+   gHgfsNotify.numEvents = 0;
+   gHgfsNotify.delivering = NULL;
+   gHgfsNotify.exiting = FALSE;
+   gHgfsNotify.suspended = FALSE;
+   gHgfsNotify.threadStarted = FALSE;
+   gHgfsNotify.nextFolderHandle = 0;
+   gHgfsNotify.nextSubscriberHandle = 0;
+
+   gHgfsNotify.lock = MXUser_CreateExclLock("hgfsNotifyLock",
+                                            RANK_hgfsNotifyLock);
+   gHgfsNotify.deliveredVar = MXUser_CreateCondVarExclLock(gHgfsNotify.lock);
+   gHgfsNotify.watches = HashMap_AllocMap(64, sizeof (int),
+                                          sizeof (HgfsNotifyWatch *));
+
+   gHgfsNotify.inotifyFd = inotify_init();
+   if (gHgfsNotify.inotifyFd < 0) {
+      status = errno;
+      LOG(4, ("%s: inotify_init failed %d\n", __FUNCTION__, status));
+      goto error;
+   }
+
+   if (pipe(gHgfsNotify.wakeFds) < 0) {
+      status = errno;
+      gHgfsNotify.wakeFds[0] = gHgfsNotify.wakeFds[1] = -1;
+      LOG(4, ("%s: pipe failed %d\n", __FUNCTION__, status));
+      goto error;
+   }
+
+   for (i = 0; i < ARRAYSIZE(gHgfsNotify.wakeFds); i++) {
+      fcntl(gHgfsNotify.wakeFds[i], F_SETFL, O_NONBLOCK);
+      fcntl(gHgfsNotify.wakeFds[i], F_SETFD, FD_CLOEXEC);
+   }
+   fcntl(gHgfsNotify.inotifyFd, F_SETFL, O_NONBLOCK);
+   fcntl(gHgfsNotify.inotifyFd, F_SETFD, FD_CLOEXEC);
+
+   status = pthread_create(&gHgfsNotify.thread, NULL, HgfsNotifyMonitorThread,
+                           NULL);
+   if (0 != status) {
+      LOG(4, ("%s: failed to start the monitor thread %d\n", __FUNCTION__,
+              status));
+      goto error;
+   }
+   gHgfsNotify.threadStarted = TRUE;
+
+   return HGFS_STATUS_SUCCESS;
+
+error:
+   HgfsNotifyCleanup();
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Exit --
+ *
+ *    Exit for the notification component: stops the monitor thread and
+ *    removes all shared folders, subscribers and watches.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Exit(void)
+{
+   if (gHgfsNotify.threadStarted) {
+      MXUser_AcquireExclLock(gHgfsNotify.lock);
+      gHgfsNotify.exiting = TRUE;
+      MXUser_ReleaseExclLock(gHgfsNotify.lock);
+      HgfsNotifyWakeMonitor();
+      pthread_join(gHgfsNotify.thread, NULL);
+      gHgfsNotify.threadStarted = FALSE;
+   }
+   HgfsNotifyCleanup();
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Deactivate --
+ *
+ *    Deactivates generating file system change notifications.
+ *
+ *    While the server synchronizes, events are left in the kernel queue.
+ *    If it overflows the subscribers are sent an "events dropped" event.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Deactivate(HgfsNotifyActivateReason reason) // IN: reason
+{
+   if (HGFS_NOTIFY_REASON_SERVER_SYNC == reason && NULL != gHgfsNotify.lock) {
+      MXUser_AcquireExclLock(gHgfsNotify.lock);
+      gHgfsNotify.suspended = TRUE;
+      MXUser_ReleaseExclLock(gHgfsNotify.lock);
+      HgfsNotifyWakeMonitor();
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Activate --
+ *
+ *    Activates generating file system change notifications.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Activate(HgfsNotifyActivateReason reason) // IN: reason
+{
+   if (HGFS_NOTIFY_REASON_SERVER_SYNC == reason && NULL != gHgfsNotify.lock) {
+      MXUser_AcquireExclLock(gHgfsNotify.lock);
+      gHgfsNotify.suspended = FALSE;
+      MXUser_ReleaseExclLock(gHgfsNotify.lock);
+      HgfsNotifyWakeMonitor();
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSharedFolder --
+ *
+ *    Allocates memory and initializes new shared folder structure.
+ *
+ * Results:
+ *    Opaque subscriber handle for the new subscriber or HGFS_INVALID_FOLDER_HANDLE
+ *    if adding shared folder fails.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSharedFolderHandle
+HgfsNotify_AddSharedFolder(const char *path,       // IN: path in the host
+                           const char *shareName)  // IN: name of the shared folder
+{
+   HgfsNotifyFolder *folder;
+   HgfsSharedFolderHandle handle;
+
+   ASSERT(path);
+   ASSERT(shareName);
+
+   if (NULL == gHgfsNotify.lock) {
+      return HGFS_INVALID_FOLDER_HANDLE;
+   }
+
+   folder = Util_SafeMalloc(sizeof *folder);
+   DblLnkLst_Init(&folder->links);
+   folder->path = Util_SafeStrdup(path);
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+   handle = gHgfsNotify.nextFolderHandle++;
+   if (HGFS_INVALID_FOLDER_HANDLE == gHgfsNotify.nextFolderHandle) {
+      gHgfsNotify.nextFolderHandle = 0;
+   }
+   folder->handle = handle;
+   DblLnkLst_LinkLast(&gHgfsNotify.folders, &folder->links);
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+
+   LOG(8, ("%s: share %s path %s handle %#x\n", __FUNCTION__, shareName, path,
+           handle));
+   return handle;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSubscriber --
+ *
+ *    Allocates memory and initializes new subscriber structure.
+ *    Inserts allocated subscriber into corrspondent array.
+ *
+ * Results:
+ *    Opaque subscriber handle for the new subscriber or HGFS_INVALID_SUBSCRIBER_HANDLE
+ *    if adding subscriber fails.
+ *
+ * Side effects:
+ *    Adds inotify watches.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSubscriberHandle
+HgfsNotify_AddSubscriber(HgfsSharedFolderHandle sharedFolder, // IN: shared folder handle
+                         const char *path,                    // IN: relative path
+                         uint32 eventFilter,                  // IN: event filter
+                         uint32 recursive,                    // IN: look in subfolders
+                         HgfsNotifyEventReceiveCb eventCb,    // IN notification callback
+                         struct HgfsSessionInfo *session)     // IN: server context
+{
+   HgfsSubscriberHandle handle = HGFS_INVALID_SUBSCRIBER_HANDLE;
+   HgfsNotifySubscriber *subscriber;
+   HgfsNotifyFolder *folder;
+   HgfsNotifyDirList dirs;
+   char *folderPath;
+   char *relPath;
+   size_t relPathLen;
+
+   ASSERT(path);
+   ASSERT(eventCb);
+
+   if (NULL == gHgfsNotify.lock) {
+      return HGFS_INVALID_SUBSCRIBER_HANDLE;
+   }
+
+   /* Watched directories are kept relative to the share root, without slashes. */
+   while ('/' == *path) {
+      path++;
+   }
+   relPath = Util_SafeStrdup(path);
+   relPathLen = strlen(relPath);
+   while (relPathLen > 0 && '/' == relPath[relPathLen - 1]) {
+      relPath[--relPathLen] = '\0';
+   }
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+   folder = HgfsNotifyFindFolder(sharedFolder);
+   folderPath = (NULL != folder) ? Util_SafeStrdup(folder->path) : NULL;
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+
+   if (NULL == folderPath) {
+      LOG(4, ("%s: unknown shared folder handle %#x\n", __FUNCTION__,
+              sharedFolder));
+      free(relPath);
+      return HGFS_INVALID_SUBSCRIBER_HANDLE;
+   }
+
+   /* Walk the subtree before taking the lock, it may be large. */
+   HgfsNotifyCollectTree(folderPath, relPath, 0 != recursive, &dirs);
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+
+   if (NULL == HgfsNotifyFindFolder(sharedFolder)) {
+      LOG(4, ("%s: shared folder %#x removed\n", __FUNCTION__, sharedFolder));
+      free(folderPath);
+      goto exit;
+   }
+
+   subscriber = Util_SafeCalloc(1, sizeof *subscriber);
+   DblLnkLst_Init(&subscriber->links);
+   DblLnkLst_Init(&subscriber->subWatches);
+   subscriber->folder = sharedFolder;
+   subscriber->folderPath = folderPath;
+   subscriber->eventFilter = eventFilter;
+   subscriber->inotifyMask = HgfsNotifyFilterToInotify(eventFilter);
+   subscriber->recursive = (0 != recursive);
+   if (subscriber->recursive) {
+      subscriber->inotifyMask |= HGFS_NOTIFY_TREE_MASK;
+   }
+   subscriber->eventCb = eventCb;
+   subscriber->session = session;
+   subscriber->refCount = 1;
+
+   if (!HgfsNotifyAddTree(subscriber, &dirs, TRUE)) {
+      subscriber->removed = TRUE;
+      HgfsNotifySubscriberPut(subscriber);
+      goto exit;
+   }
+
+   subscriber->handle = gHgfsNotify.nextSubscriberHandle++;
+   if (HGFS_INVALID_SUBSCRIBER_HANDLE == gHgfsNotify.nextSubscriberHandle) {
+      gHgfsNotify.nextSubscriberHandle = 0;
+   }
+   DblLnkLst_LinkLast(&gHgfsNotify.subscribers, &subscriber->links);
+   handle = subscriber->handle;
+
+   LOG(8, ("%s: subscriber %"FMT64"x on %#x path \"%s\" filter %#x%s\n",
+           __FUNCTION__, handle, sharedFolder, relPath, eventFilter,
+           subscriber->recursive ? " recursive" : ""));
+
+exit:
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+   HgfsNotifyFreeDirList(&dirs);
+   free(relPath);
+   return handle;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSharedFolder --
+ *
+ *    Deallcates memory used by shared folder and performs necessary cleanup.
+ *    Also deletes all subscribers that are defined for the shared folder.
+ *
+ * Results:
+ *    TRUE if the shared folder was found, FALSE otherwise.
+ *
+ * Side effects:
+ *    Removes all subscribers that correspond to the shared folder and invalidates
+ *    thier handles.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSharedFolder(HgfsSharedFolderHandle sharedFolder) // IN
+{
+   DblLnkLst_Links *link, *nextElem;
+   HgfsNotifyFolder *folder;
+
+   if (NULL == gHgfsNotify.lock) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+
+   folder = HgfsNotifyFindFolder(sharedFolder);
+   if (NULL != folder) {
+      DblLnkLst_ForEachSafe(link, nextElem, &gHgfsNotify.subscribers) {
+         HgfsNotifySubscriber *subscriber =
+            DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+         if (subscriber->folder == sharedFolder) {
+            HgfsNotifyUnlinkSubscriber(subscriber);
+         }
+      }
+      DblLnkLst_Unlink1(&folder->links);
+      free(folder->path);
+      free(folder);
+   }
+
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+
+   return NULL != folder;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSubscriber --
+ *
+ *    Deallcates memory used by NotificationSubscriber and performs necessary cleanup.
+ *
+ * Results:
+ *    TRUE if the subscriber was found, FALSE otherwise.
+ *
+ * Side effects:
+ *    Removes the subscriber's inotify watches.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSubscriber(HgfsSubscriberHandle subscriber) // IN
+{
+   DblLnkLst_Links *link;
+   Bool found = FALSE;
+
+   if (NULL == gHgfsNotify.lock) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+
+   DblLnkLst_ForEach(link, &gHgfsNotify.subscribers) {
+      HgfsNotifySubscriber *entry =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      if (entry->handle == subscriber) {
+         HgfsNotifyUnlinkSubscriber(entry);
+         found = TRUE;
+         break;
+      }
+   }
+
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSessionSubscribers --
+ *
+ *    Removes all entries that are related to a particular session.
+ *
+ *    On return no callback for the session is running or will be made, so
+ *    the caller may free the session.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_RemoveSessionSubscribers(struct HgfsSessionInfo *session) // IN
+{
+   DblLnkLst_Links *link, *nextElem;
+
+   if (NULL == gHgfsNotify.lock) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+
+   DblLnkLst_ForEachSafe(link, nextElem, &gHgfsNotify.subscribers) {
+      HgfsNotifySubscriber *subscriber =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      if (subscriber->session == session) {
+         HgfsNotifyUnlinkSubscriber(subscriber);
+      }
+   }
+
+   while (NULL != gHgfsNotify.delivering &&
+          gHgfsNotify.delivering->session == session) {
+      MXUser_WaitCondVarExclLock(gHgfsNotify.lock, gHgfsNotify.deliveredVar);
+   }
+
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+}
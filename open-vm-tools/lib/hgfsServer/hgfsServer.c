@@ -40,6 +40,7 @@
 #include "hgfsVirtualDir.h"
 #include "codeset.h"
 #include "dbllnklst.h"
+#include "hashMap.h"
 #include "file.h"
 #include "util.h"
 #include "wiper.h"
@@ -52,6 +53,8 @@
 #include "mutexRankLib.h"
 #include "vm_basic_asm.h"
 #include "unicodeOperations.h"
+#include "hostinfo.h"
+#include "logFixed.h"
 
 #if defined(_WIN32)
 #include <io.h>
@@ -120,14 +123,20 @@
 #define HGFS_PATH_MAX HGFS_PACKET_MAX
 
 /*
- * Array of FileNodes for opening files.
+ * Number of FileNodes and searches added to a session at a time.
  */
-#define NUM_FILE_NODES 100
-#define NUM_SEARCHES 100
+#define NUM_FILE_NODES HGFS_ARRAY_CHUNK_SIZE
+#define NUM_SEARCHES HGFS_ARRAY_CHUNK_SIZE
 
 /* Default maximun number of open nodes that have server locks. */
 #define MAX_LOCKED_FILENODES 10
 
+/*
+ * Amount of sequentially written data after which write back is started.
+ * Large enough that each sync_file_range covers many writes.
+ */
+#define HGFS_WRITE_BEHIND_WINDOW (8 * 1024 * 1024)
+
 
 struct HgfsTransportSessionInfo {
    /* Default session id. */
@@ -175,6 +184,7 @@ typedef struct HgfsInputParam {
    HgfsOp op;                    /* Hgfs operation command code */
    uint32 id;                    /* Request ID to be matched with the reply */
    Bool sessionEnabled;          /* Requests have session enabled headers */
+   VmTimeType startTimeUS;       /* Time the request was received */
 } HgfsInputParam;
 
 /*
@@ -271,6 +281,16 @@ static Bool gHgfsInitialized = FALSE;
  */
 static Bool gHgfsDirNotifyActive = FALSE;
 
+/*
+ * Operation statistics. Each session keeps its own counters which are
+ * updated atomically without a lock. The lock only protects the list of
+ * sessions walked by HgfsServer_GetStats. The counters of sessions that have
+ * gone away, and of requests that have no session, are kept in the totals.
+ */
+static MXUserExclLock *gHgfsStatsLock = NULL;
+static DblLnkLst_Links gHgfsStatsSessionList;
+static HgfsSessionOpStats gHgfsStatsTotals[HGFS_OP_MAX];
+
 typedef struct HgfsSharedFolderProperties {
    DblLnkLst_Links links;
    char *name;                                /* Name of the share. */
@@ -365,6 +385,8 @@ static Bool HgfsPacketSend(HgfsPacket *packet,
 static void HgfsServerOpen(HgfsInputParam *input);
 static void HgfsServerRead(HgfsInputParam *input);
 static void HgfsServerWrite(HgfsInputParam *input);
+static void HgfsServerReadV(HgfsInputParam *input);
+static void HgfsServerWriteV(HgfsInputParam *input);
 static void HgfsServerSearchOpen(HgfsInputParam *input);
 static void HgfsServerSearchRead(HgfsInputParam *input);
 static void HgfsServerGetattr(HgfsInputParam *input);
@@ -596,22 +618,14 @@ static HgfsFileNode *
 HgfsHandle2FileNode(HgfsHandle handle,        // IN: Hgfs file handle
                     HgfsSessionInfo *session) // IN: Session info
 {
-   unsigned int i;
-   HgfsFileNode *fileNode = NULL;
+   HgfsFileNode **fileNode;
 
    ASSERT(session);
    ASSERT(session->nodeArray);
 
-   /* XXX: This O(n) lookup can and should be optimized. */
-   for (i = 0; i < session->numNodes; i++) {
-      if (session->nodeArray[i].state != FILENODE_STATE_UNUSED &&
-          session->nodeArray[i].handle == handle) {
-         fileNode = &session->nodeArray[i];
-         break;
-      }
-   }
+   fileNode = HashMap_Get(session->nodeHandleMap, &handle);
 
-   return fileNode;
+   return (NULL != fileNode) ? *fileNode : NULL;
 }
 
 
@@ -672,12 +686,14 @@ HgfsDumpAllNodes(HgfsSessionInfo *session)  // IN: session info
 
    Log("Dumping all nodes\n");
    for (i = 0; i < session->numNodes; i++) {
+      HgfsFileNode *node = HGFS_SESSION_NODE(session, i);
+
       Log("handle %u, name \"%s\", localdev %"FMT64"u, localInum %"FMT64"u %u\n",
-          session->nodeArray[i].handle,
-          session->nodeArray[i].utf8Name ? session->nodeArray[i].utf8Name : "NULL",
-          session->nodeArray[i].localId.volumeId,
-          session->nodeArray[i].localId.fileId,
-          session->nodeArray[i].fileDesc);
+          node->handle,
+          node->utf8Name ? node->utf8Name : "NULL",
+          node->localId.volumeId,
+          node->localId.fileId,
+          node->fileDesc);
    }
    Log("Done\n");
 }
@@ -822,7 +838,9 @@ exit:
  *
  * HgfsFileDesc2Handle --
  *
- *    Given an OS handle/fd, return file's hgfs handle.
+ *    Given the OS handle/fd of a file with a server lock, return file's hgfs
+ *    handle. Descriptors without a server lock may be shared by several
+ *    nodes, so they cannot be mapped back to one and are not looked up.
  *
  * Results:
  *    TRUE if the node was found.
@@ -849,8 +867,9 @@ HgfsFileDesc2Handle(fileDesc fd,              // IN: OS handle (file descriptor)
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
    for (i = 0; i < session->numNodes; i++) {
-      existingFileNode = &session->nodeArray[i];
+      existingFileNode = HGFS_SESSION_NODE(session, i);
       if ((existingFileNode->state == FILENODE_STATE_IN_USE_CACHED) &&
+          (existingFileNode->serverLock != HGFS_LOCK_NONE) &&
           (existingFileNode->fileDesc == fd)) {
          *handle = HgfsFileNode2Handle(existingFileNode);
          found = TRUE;
@@ -1212,6 +1231,137 @@ exit:
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsHandleTrackWrite --
+ *
+ *    Record a completed write on the handle. Contiguous writes accumulate
+ *    into a pending range; once the range reaches the write-behind window
+ *    it is handed back to the caller to start write back and a new range is
+ *    begun. A write at any other offset starts a new range, leaving the
+ *    previous one to normal write back.
+ *
+ * Results:
+ *    TRUE on success, FALSE if the handle is invalid. flushLength is zero if
+ *    no write back should be started.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsHandleTrackWrite(HgfsHandle handle,         // IN: Hgfs file handle
+                     HgfsSessionInfo *session,  // IN: session info
+                     uint64 offset,             // IN: offset of the write
+                     uint32 length,             // IN: bytes written
+                     uint64 *flushOffset,       // OUT: start of write back
+                     uint64 *flushLength)       // OUT: write back length
+{
+   HgfsFileNode *node;
+   Bool success = FALSE;
+
+   ASSERT(flushOffset);
+   ASSERT(flushLength);
+
+   *flushOffset = 0;
+   *flushLength = 0;
+
+   MXUser_AcquireExclLock(session->nodeArrayLock);
+
+   node = HgfsHandle2FileNode(handle, session);
+   if (node == NULL) {
+      goto exit;
+   }
+
+   if (offset != node->nextWriteOffset) {
+      node->writeBehindStart = offset;
+   }
+   node->nextWriteOffset = offset + length;
+
+   if (node->nextWriteOffset - node->writeBehindStart >=
+       HGFS_WRITE_BEHIND_WINDOW) {
+      *flushOffset = node->writeBehindStart;
+      *flushLength = node->nextWriteOffset - node->writeBehindStart;
+      node->writeBehindStart = node->nextWriteOffset;
+   }
+   success = TRUE;
+
+exit:
+   MXUser_ReleaseExclLock(session->nodeArrayLock);
+
+   return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsFileNodeFlushWriteBehind --
+ *
+ *    Start write back of the range the writer left pending on the node.
+ *    Called with the node array lock held, before the file is closed.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Asynchronous I/O may be started on the file.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+HgfsFileNodeFlushWriteBehind(HgfsFileNode *node)   // IN/OUT: node
+{
+   if (node->nextWriteOffset > node->writeBehindStart) {
+      HgfsPlatformWriteBehind(node->fileDesc, node->writeBehindStart,
+                              node->nextWriteOffset - node->writeBehindStart);
+   }
+   node->writeBehindStart = node->nextWriteOffset;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsHandleFlushWriteBehind --
+ *
+ *    Start write back of the range pending on the handle. Used by the
+ *    platform code before it closes the file descriptor of a cached node.
+ *
+ * Results:
+ *    TRUE on success, FALSE if the handle is invalid.
+ *
+ * Side effects:
+ *    Asynchronous I/O may be started on the file.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsHandleFlushWriteBehind(HgfsHandle handle,         // IN: Hgfs file handle
+                           HgfsSessionInfo *session)  // IN: session info
+{
+   HgfsFileNode *node;
+   Bool success = FALSE;
+
+   MXUser_AcquireExclLock(session->nodeArrayLock);
+
+   node = HgfsHandle2FileNode(handle, session);
+   if (node != NULL) {
+      HgfsFileNodeFlushWriteBehind(node);
+      success = TRUE;
+   }
+
+   MXUser_ReleaseExclLock(session->nodeArrayLock);
+
+   return success;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1263,7 +1413,8 @@ exit:
  * HgfsUpdateNodeServerLock --
  *
  *    Given a file desc (OS handle), update the node with the new oplock
- *    information.
+ *    information. Only the node holding the server lock is considered, as
+ *    descriptors without one may be shared by several nodes.
  *
  * Results:
  *    TRUE if the update is successful.
@@ -1290,8 +1441,9 @@ HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
    for (i = 0; i < session->numNodes; i++) {
-      existingFileNode = &session->nodeArray[i];
-      if (existingFileNode->state != FILENODE_STATE_UNUSED) {
+      existingFileNode = HGFS_SESSION_NODE(session, i);
+      if (existingFileNode->state != FILENODE_STATE_UNUSED &&
+          existingFileNode->serverLock != HGFS_LOCK_NONE) {
          if (existingFileNode->fileDesc == fd) {
             existingFileNode->serverLock = serverLock;
             updated = TRUE;
@@ -1451,10 +1603,11 @@ HgfsDumpAllSearches(HgfsSessionInfo *session)   // IN: session info
 
    Log("Dumping all searches\n");
    for (i = 0; i < session->numSearches; i++) {
+      HgfsSearch *search = HGFS_SESSION_SEARCH(session, i);
+
       Log("handle %u, baseDir \"%s\"\n",
-          session->searchArray[i].handle,
-          session->searchArray[i].utf8Dir ?
-          session->searchArray[i].utf8Dir : "(NULL)");
+          search->handle,
+          search->utf8Dir ? search->utf8Dir : "(NULL)");
    }
    Log("Done\n");
 }
@@ -1463,125 +1616,105 @@ HgfsDumpAllSearches(HgfsSessionInfo *session)   // IN: session info
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsGetNewNode --
+ * HgfsGrowNodeArray --
  *
- *    Remove a node from the free list and return it. Nodes on
- *    the free list should already be initialized.
+ *    Allocate another chunk of file nodes and add them to the free list.
  *
- *    If the free list is empty, reallocates more memory,
- *    initializes it appropriately, adds the new entries to the
- *    free list, and then returns one off the free list.
+ *    Existing nodes are not moved, so pointers into the node array
+ *    remain valid.
  *
  *    The session's nodeArrayLock should be acquired prior to calling this
  *    function.
  *
  * Results:
- *    An unused file node on success
- *    NULL on failure
+ *    TRUE on success, FALSE if memory could not be allocated.
  *
  * Side effects:
- *    Memory allocation (potentially).
+ *    Memory allocation.
  *
  *-----------------------------------------------------------------------------
  */
 
-static HgfsFileNode *
-HgfsGetNewNode(HgfsSessionInfo *session)  // IN: session info
+static Bool
+HgfsGrowNodeArray(HgfsSessionInfo *session)  // IN: session info
 {
-   HgfsFileNode *node;
-   HgfsFileNode *newMem;
-   unsigned int newNumNodes;
+   uint32 numChunks = session->numNodes / NUM_FILE_NODES;
+   HgfsFileNode **newChunks;
+   HgfsFileNode *chunk;
    unsigned int i;
 
-   ASSERT(session);
-   ASSERT(session->nodeArray);
-
-   LOG(4, ("%s: entered\n", __FUNCTION__));
+   ASSERT(session->numNodes % NUM_FILE_NODES == 0);
 
-   if (!DblLnkLst_IsLinked(&session->nodeFreeList)) {
-      /*
-       * This has to be unsigned and with maximum bit length. This is
-       * required to take care of "negative" differences as well.
-       */
-      uintptr_t ptrDiff;
-
-      if (DOLOG(4)) {
-         Log("Dumping nodes before realloc\n");
-         HgfsDumpAllNodes(session);
-      }
-
-      /* Try to get twice as much memory as we had */
-      newNumNodes = 2 * session->numNodes;
-      newMem = (HgfsFileNode *)realloc(session->nodeArray,
-                                       newNumNodes * sizeof *(session->nodeArray));
-      if (!newMem) {
-         LOG(4, ("%s: can't realloc more nodes\n", __FUNCTION__));
-
-         return NULL;
-      }
+   chunk = calloc(NUM_FILE_NODES, sizeof *chunk);
+   if (NULL == chunk) {
+      return FALSE;
+   }
 
-      ptrDiff = (char *)newMem - (char *)session->nodeArray;
-      if (ptrDiff) {
-         size_t const oldSize = session->numNodes * sizeof *(session->nodeArray);
+   newChunks = realloc(session->nodeArray,
+                       (numChunks + 1) * sizeof *session->nodeArray);
+   if (NULL == newChunks) {
+      free(chunk);
+      return FALSE;
+   }
 
-         /*
-          * The portion of memory that contains all our file nodes moved.
-          * All pointers that pointed inside the previous portion of memory
-          * must be updated to point to the new portion of memory.
-          *
-          * We'll need to lock this if we multithread.
-          */
+   LOG(4, ("%s: numNodes was %u, now is %u\n", __FUNCTION__,
+           session->numNodes, session->numNodes + NUM_FILE_NODES));
 
-         LOG(4, ("Rebasing pointers, diff is %"FMTSZ"u, sizeof node is "
-                  "%"FMTSZ"u\n", ptrDiff, sizeof(HgfsFileNode)));
-         LOG(4, ("old: %p new: %p\n", session->nodeArray, newMem));
-         ASSERT(newMem == (HgfsFileNode *)((char*)session->nodeArray + ptrDiff));
+   for (i = 0; i < NUM_FILE_NODES; i++) {
+      DblLnkLst_Init(&chunk[i].links);
+      chunk[i].state = FILENODE_STATE_UNUSED;
 
-#define HgfsServerRebase(_ptr, _type)                                   \
-   if ((size_t)((char *)_ptr - (char *)session->nodeArray) < oldSize) { \
-      _ptr = (_type *)((char *)_ptr + ptrDiff);                         \
+      /* Append at the end of the list. */
+      DblLnkLst_LinkLast(&session->nodeFreeList, &chunk[i].links);
    }
 
-         /*
-          * Rebase the links of all file nodes
-          */
-         for (i = 0; i < session->numNodes; i++) {
-            HgfsServerRebase(newMem[i].links.prev, DblLnkLst_Links)
-            HgfsServerRebase(newMem[i].links.next, DblLnkLst_Links)
-         }
+   newChunks[numChunks] = chunk;
+   session->nodeArray = newChunks;
+   session->numNodes += NUM_FILE_NODES;
 
-         /*
-          * There is no need to rebase the anchor of the file node free list
-          * because if we are here, it is empty.
-          */
+   return TRUE;
+}
 
-         /* Rebase the anchor of the cached file nodes list. */
-         HgfsServerRebase(session->nodeCachedList.prev, DblLnkLst_Links)
-         HgfsServerRebase(session->nodeCachedList.next, DblLnkLst_Links)
 
-#undef HgfsServerRebase
-      }
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsGetNewNode --
+ *
+ *    Remove a node from the free list and return it. Nodes on
+ *    the free list should already be initialized.
+ *
+ *    If the free list is empty, allocates another chunk of entries,
+ *    adds them to the free list, and then returns one off the free list.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    An unused file node on success
+ *    NULL on failure
+ *
+ * Side effects:
+ *    Memory allocation (potentially).
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-      /* Initialize the new nodes */
-      LOG(4, ("numNodes was %u, now is %u\n", session->numNodes, newNumNodes));
-      for (i = session->numNodes; i < newNumNodes; i++) {
-         DblLnkLst_Init(&newMem[i].links);
+static HgfsFileNode *
+HgfsGetNewNode(HgfsSessionInfo *session)  // IN: session info
+{
+   HgfsFileNode *node;
 
-         newMem[i].state = FILENODE_STATE_UNUSED;
-         newMem[i].utf8Name = NULL;
-         newMem[i].utf8NameLen = 0;
-         newMem[i].fileCtx = NULL;
+   ASSERT(session);
+   ASSERT(session->nodeArray);
 
-         /* Append at the end of the list */
-         DblLnkLst_LinkLast(&session->nodeFreeList, &newMem[i].links);
-      }
-      session->nodeArray = newMem;
-      session->numNodes = newNumNodes;
+   LOG(4, ("%s: entered\n", __FUNCTION__));
 
-      if (DOLOG(4)) {
-         Log("Dumping nodes after pointer changes\n");
-         HgfsDumpAllNodes(session);
-      }
+   if (!DblLnkLst_IsLinked(&session->nodeFreeList) &&
+       !HgfsGrowNodeArray(session)) {
+      LOG(4, ("%s: can't allocate more nodes\n", __FUNCTION__));
+
+      return NULL;
    }
 
    /* Remove the first item from the list */
@@ -1621,6 +1754,10 @@ HgfsRemoveFileNode(HgfsFileNode *node,        // IN: file node
    LOG(4, ("%s: handle %u, name %s, fileId %"FMT64"u\n", __FUNCTION__,
            HgfsFileNode2Handle(node), node->utf8Name, node->localId.fileId));
 
+   if (node->state != FILENODE_STATE_UNUSED) {
+      HashMap_Remove(session->nodeHandleMap, &node->handle);
+   }
+
    if (node->shareName) {
       free(node->shareName);
       node->shareName = NULL;
@@ -1809,12 +1946,21 @@ HgfsAddNewFileNode(HgfsFileOpenInfo *openInfo,  // IN: open info struct
       newNode->flags |= HGFS_FILE_NODE_SEQUENTIAL_FL;
    }
 
+   newNode->nextWriteOffset = 0;
+   newNode->writeBehindStart = 0;
+
    newNode->serverLock = openInfo->acquiredLock;
-   newNode->state = FILENODE_STATE_IN_USE_NOT_CACHED;
    newNode->shareInfo.readPermissions = openInfo->shareInfo.readPermissions;
    newNode->shareInfo.writePermissions = openInfo->shareInfo.writePermissions;
    newNode->shareInfo.handle = openInfo->shareInfo.handle;
 
+   if (!HashMap_Put(session->nodeHandleMap, &newNode->handle, &newNode)) {
+      LOG(4, ("%s: out of memory\n", __FUNCTION__));
+      HgfsRemoveFileNode(newNode, session);
+      return NULL;
+   }
+   newNode->state = FILENODE_STATE_IN_USE_NOT_CACHED;
+
    LOG(4, ("%s: got new node, handle %u\n", __FUNCTION__,
            HgfsFileNode2Handle(newNode)));
    return newNode;
@@ -1950,6 +2096,9 @@ HgfsRemoveFromCacheInternal(HgfsHandle handle,        // IN: Hgfs handle to the
        * Instead, we'll just await the lobotomization of the node cache to
        * really fix this.
        */
+      /* Start write back of whatever the writer left behind. */
+      HgfsFileNodeFlushWriteBehind(node);
+
       if (HgfsPlatformCloseFile(node->fileDesc, node->fileCtx)) {
          LOG(4, ("%s: Could not close fd %u\n", __FUNCTION__, node->fileDesc));
 
@@ -2059,125 +2208,102 @@ HgfsIsServerLockAllowed(HgfsSessionInfo *session)  // IN: session info
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsGetNewSearch --
+ * HgfsGrowSearchArray --
  *
- *    Remove a search from the free list and return it. Searches on
- *    the free list should already be initialized.
+ *    Allocate another chunk of searches and add them to the free list.
  *
- *    If the free list is empty, reallocates more memory,
- *    initializes it appropriately, adds the new entries to the
- *    free list, and then returns one off the free list.
+ *    Existing searches are not moved, so pointers into the search array
+ *    remain valid.
  *
  *    Caller should hold the session's searchArrayLock.
  *
  * Results:
- *    An unused search on success
- *    NULL on failure
+ *    TRUE on success, FALSE if memory could not be allocated.
  *
  * Side effects:
- *    None
+ *    Memory allocation.
  *
  *-----------------------------------------------------------------------------
  */
 
-static HgfsSearch *
-HgfsGetNewSearch(HgfsSessionInfo *session)  // IN: session info
+static Bool
+HgfsGrowSearchArray(HgfsSessionInfo *session)  // IN: session info
 {
-   HgfsSearch *search;
-   HgfsSearch *newMem;
-   unsigned int newNumSearches;
+   uint32 numChunks = session->numSearches / NUM_SEARCHES;
+   HgfsSearch **newChunks;
+   HgfsSearch *chunk;
    unsigned int i;
 
-   ASSERT(session);
-   ASSERT(session->searchArray);
-
-   LOG(4, ("%s: entered\n", __FUNCTION__));
-
-   if (!DblLnkLst_IsLinked(&session->searchFreeList)) {
-      /*
-       * This has to be unsigned and with maximum bit length. This is
-       * required to take care of "negative" differences as well.
-       */
+   ASSERT(session->numSearches % NUM_SEARCHES == 0);
 
-      uintptr_t ptrDiff;
+   chunk = calloc(NUM_SEARCHES, sizeof *chunk);
+   if (NULL == chunk) {
+      return FALSE;
+   }
 
-      if (DOLOG(4)) {
-         Log("Dumping searches before realloc\n");
-         HgfsDumpAllSearches(session);
-      }
+   newChunks = realloc(session->searchArray,
+                       (numChunks + 1) * sizeof *session->searchArray);
+   if (NULL == newChunks) {
+      free(chunk);
+      return FALSE;
+   }
 
-      /* Try to get twice as much memory as we had */
-      newNumSearches = 2 * session->numSearches;
-      newMem = (HgfsSearch *)realloc(session->searchArray,
-                                     newNumSearches * sizeof *(session->searchArray));
-      if (!newMem) {
-         LOG(4, ("%s: can't realloc more searches\n", __FUNCTION__));
+   LOG(4, ("%s: numSearches was %u, now is %u\n", __FUNCTION__,
+           session->numSearches, session->numSearches + NUM_SEARCHES));
 
-         return NULL;
-      }
+   for (i = 0; i < NUM_SEARCHES; i++) {
+      DblLnkLst_Init(&chunk[i].links);
 
-      ptrDiff = (char *)newMem - (char *)session->searchArray;
-      if (ptrDiff) {
-         size_t const oldSize = session->numSearches * sizeof *(session->searchArray);
+      /* Append at the end of the list. */
+      DblLnkLst_LinkLast(&session->searchFreeList, &chunk[i].links);
+   }
 
-         /*
-          * The portion of memory that contains all our searches moved.
-          * All pointers that pointed inside the previous portion of memory
-          * must be updated to point to the new portion of memory.
-          */
+   newChunks[numChunks] = chunk;
+   session->searchArray = newChunks;
+   session->numSearches += NUM_SEARCHES;
 
-         LOG(4, ("Rebasing pointers, diff is %"FMTSZ"u, sizeof search is "
-                 "%"FMTSZ"u\n", ptrDiff, sizeof(HgfsSearch)));
-         LOG(4, ("old: %p new: %p\n", session->searchArray, newMem));
-         ASSERT(newMem == (HgfsSearch*)((char*)session->searchArray + ptrDiff));
+   return TRUE;
+}
 
-#define HgfsServerRebase(_ptr, _type)                                     \
-   if ((size_t)((char *)_ptr - (char *)session->searchArray) < oldSize) { \
-      _ptr = (_type *)((char *)_ptr + ptrDiff);                           \
-   }
 
-         /*
-          * Rebase the links of all searches
-          */
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsGetNewSearch --
+ *
+ *    Remove a search from the free list and return it. Searches on
+ *    the free list should already be initialized.
+ *
+ *    If the free list is empty, allocates another chunk of entries,
+ *    adds them to the free list, and then returns one off the free list.
+ *
+ *    Caller should hold the session's searchArrayLock.
+ *
+ * Results:
+ *    An unused search on success
+ *    NULL on failure
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-         for (i = 0; i < session->numSearches; i++) {
-            HgfsServerRebase(newMem[i].links.prev, DblLnkLst_Links)
-            HgfsServerRebase(newMem[i].links.next, DblLnkLst_Links)
-         }
+static HgfsSearch *
+HgfsGetNewSearch(HgfsSessionInfo *session)  // IN: session info
+{
+   HgfsSearch *search;
 
-         /*
-          * There is no need to rebase the links of the search free list
-          * because if we are here, it is empty
-          */
+   ASSERT(session);
+   ASSERT(session->searchArray);
 
-#undef HgfsServerRebase
-      }
+   LOG(4, ("%s: entered\n", __FUNCTION__));
 
-      /* Initialize the new searches */
-      LOG(4, ("numSearches was %u, now is %u\n", session->numSearches,
-               newNumSearches));
-
-      for (i = session->numSearches; i < newNumSearches; i++) {
-         DblLnkLst_Init(&newMem[i].links);
-         newMem[i].utf8Dir = NULL;
-         newMem[i].utf8DirLen = 0;
-         newMem[i].utf8ShareName = NULL;
-         newMem[i].utf8ShareNameLen = 0;
-         newMem[i].shareInfo.rootDir = NULL;
-         newMem[i].shareInfo.rootDirLen = 0;
-         newMem[i].dents = NULL;
-         newMem[i].numDents = 0;
-
-         /* Append at the end of the list */
-         DblLnkLst_LinkLast(&session->searchFreeList, &newMem[i].links);
-      }
-      session->searchArray = newMem;
-      session->numSearches = newNumSearches;
+   if (!DblLnkLst_IsLinked(&session->searchFreeList) &&
+       !HgfsGrowSearchArray(session)) {
+      LOG(4, ("%s: can't allocate more searches\n", __FUNCTION__));
 
-      if (DOLOG(4)) {
-         Log("Dumping searches after pointer changes\n");
-         HgfsDumpAllSearches(session);
-      }
+      return NULL;
    }
 
    /* Remove the first item from the list */
@@ -2364,6 +2490,12 @@ HgfsAddNewSearch(char const *utf8Dir,       // IN: UTF8 name of dir to search in
    newSearch->shareInfo.rootDirLen = strlen(rootDir);
    newSearch->shareInfo.rootDir = Util_SafeStrdup(rootDir);
 
+   if (!HashMap_Put(session->searchHandleMap, &newSearch->handle, &newSearch)) {
+      LOG(4, ("%s: out of memory\n", __FUNCTION__));
+      HgfsRemoveSearchInternal(newSearch, session);
+      return NULL;
+   }
+
    LOG(4, ("%s: got new search, handle %u\n", __FUNCTION__,
            HgfsSearch2SearchHandle(newSearch)));
    return newSearch;
@@ -2432,6 +2564,7 @@ HgfsRemoveSearchInternal(HgfsSearch *search,       // IN: search
    LOG(4, ("%s: handle %u, dir %s\n", __FUNCTION__,
            HgfsSearch2SearchHandle(search), search->utf8Dir));
 
+   HashMap_Remove(session->searchHandleMap, &search->handle);
    HgfsFreeSearchDirents(search);
    free(search->utf8Dir);
    free(search->utf8ShareName);
@@ -2652,22 +2785,14 @@ HgfsSearch *
 HgfsSearchHandle2Search(HgfsHandle handle,         // IN: handle
                         HgfsSessionInfo *session)  // IN: session info
 {
-   unsigned int i;
-   HgfsSearch *search = NULL;
+   HgfsSearch **search;
 
    ASSERT(session);
    ASSERT(session->searchArray);
 
-   /* XXX: This O(n) lookup can and should be optimized. */
-   for (i = 0; i < session->numSearches; i++) {
-      if (!DblLnkLst_IsLinked(&session->searchArray[i].links) &&
-          session->searchArray[i].handle == handle) {
-         search = &session->searchArray[i];
-         break;
-      }
-   }
+   search = HashMap_Get(session->searchHandleMap, &handle);
 
-   return search;
+   return (NULL != search) ? *search : NULL;
 }
 
 
@@ -2709,7 +2834,7 @@ HgfsUpdateNodeNames(const char *oldLocalName,  // IN: Name of file to look for
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
    for (i = 0; i < session->numNodes; i++) {
-      fileNode = &session->nodeArray[i];
+      fileNode = HGFS_SESSION_NODE(session, i);
 
       /* If the node is on the free list, skip it. */
       if (fileNode->state == FILENODE_STATE_UNUSED) {
@@ -2903,7 +3028,99 @@ static struct {
    { HgfsServerRemoveDirNotifyWatch, sizeof (HgfsRequestRemoveWatchV4),            REQ_SYNC},
    { NULL,                       0,                                                REQ_SYNC}, // No Op notify
    { HgfsServerSearchRead,       sizeof (HgfsRequestSearchReadV4),                 REQ_SYNC},
+   { NULL,                       0,                                                REQ_SYNC}, // No Op open V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op enumerate streams V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op getattr V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op setattr V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op delete V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op linkmove V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op fsctl V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op access check V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op fsync V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op query volume info V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op oplock acquire V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op oplock break V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op lock byte range V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op unlock byte range V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op query EAs V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op set EAs V4
+   { HgfsServerReadV,            sizeof (HgfsRequestReadVV4),                      REQ_SYNC},
+   { HgfsServerWriteV,           sizeof (HgfsRequestWriteVV4),                     REQ_SYNC},
+
+};
 
+/*
+ * Opcode names for the statistics, indexed by opcode. Opcodes without a
+ * handler have no name.
+ */
+static const char *const hgfsOpNames[HGFS_OP_MAX] = {
+   "OPEN",
+   "READ",
+   "WRITE",
+   "CLOSE",
+   "SEARCH_OPEN",
+   "SEARCH_READ",
+   "SEARCH_CLOSE",
+   "GETATTR",
+   "SETATTR",
+   "CREATE_DIR",
+   "DELETE_FILE",
+   "DELETE_DIR",
+   "RENAME",
+   "QUERY_VOLUME_INFO",
+   "OPEN_V2",
+   "GETATTR_V2",
+   "SETATTR_V2",
+   "SEARCH_READ_V2",
+   "CREATE_SYMLINK",
+   "SERVER_LOCK_CHANGE",
+   "CREATE_DIR_V2",
+   "DELETE_FILE_V2",
+   "DELETE_DIR_V2",
+   "RENAME_V2",
+   "OPEN_V3",
+   "READ_V3",
+   "WRITE_V3",
+   "CLOSE_V3",
+   "SEARCH_OPEN_V3",
+   "SEARCH_READ_V3",
+   "SEARCH_CLOSE_V3",
+   "GETATTR_V3",
+   "SETATTR_V3",
+   "CREATE_DIR_V3",
+   "DELETE_FILE_V3",
+   "DELETE_DIR_V3",
+   "RENAME_V3",
+   "QUERY_VOLUME_INFO_V3",
+   "CREATE_SYMLINK_V3",
+   "SERVER_LOCK_CHANGE_V3",
+   "WRITE_WIN32_STREAM_V3",
+   "CREATE_SESSION_V4",
+   "DESTROY_SESSION_V4",
+   "READ_FAST_V4",
+   "WRITE_FAST_V4",
+   "SET_WATCH_V4",
+   "REMOVE_WATCH_V4",
+   NULL, // No Op notify
+   "SEARCH_READ_V4",
+   NULL, // No Op open V4
+   NULL, // No Op enumerate streams V4
+   NULL, // No Op getattr V4
+   NULL, // No Op setattr V4
+   NULL, // No Op delete V4
+   NULL, // No Op linkmove V4
+   NULL, // No Op fsctl V4
+   NULL, // No Op access check V4
+   NULL, // No Op fsync V4
+   NULL, // No Op query volume info V4
+   NULL, // No Op oplock acquire V4
+   NULL, // No Op oplock break V4
+   NULL, // No Op lock byte range V4
+   NULL, // No Op unlock byte range V4
+   NULL, // No Op query EAs V4
+   NULL, // No Op set EAs V4
+   "READV_V4",
+   "WRITEV_V4",
 };
 
 
@@ -2950,6 +3167,7 @@ HgfsServerInputAllocInit(HgfsPacket *packet,                        // IN: packe
    localParams->op = requestOp;
    localParams->payload = requestOpArgs;
    localParams->payloadSize = requestOpArgsSize;
+   localParams->startTimeUS = Hostinfo_SystemTimerUS();
 
    if (NULL != localParams->payload) {
       localParams->payloadOffset = (char *)localParams->payload -
@@ -3082,20 +3300,287 @@ HgfsServerGetRequest(HgfsPacket *packet,                        // IN: packet
                             requestOpArgs,
                             input);
 
-exit:
-   return parseStatus;
+exit:
+   return parseStatus;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerGetHeaderSize --
+ *
+ *    Takes the Hgfs input and finds the size of the header component.
+ *
+ * Results:
+ *    Size of the HGFS protocol header used by this request or reply.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsServerGetHeaderSize(Bool sessionEnabled,     // IN: session based request
+                        HgfsOp op,               // IN: operation
+                        Bool request)            // IN: TRUE for request, FALSE for reply
+{
+   size_t headerSize;
+
+   /*
+    * If the HGFS request is session enabled we must have the new header.
+    * Any V4 operation always must have the new header too.
+    * Otherwise, starting from HGFS V3 the header is not included in the
+    * request itself, so we must return the size of the separate header
+    * structure, for requests this will be HgfsRequest and replies will be HgfsReply.
+    * Prior to V3 (so V1 and V2) there was no separate header from the request
+    * or reply structure for any given operation, so a zero size is returned for these.
+    */
+   if (sessionEnabled) {
+      headerSize = sizeof (HgfsHeader);
+   } else if (op < HGFS_OP_CREATE_SESSION_V4 &&
+              op >= HGFS_OP_OPEN_V3) {
+      headerSize = (request ? sizeof (HgfsRequest) : sizeof (HgfsReply));
+   } else {
+      headerSize = 0;
+   }
+   return headerSize;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerGetRequestHeaderSize --
+ *
+ *    Takes the Hgfs request input and finds the size of the header component.
+ *
+ * Results:
+ *    Size of the HGFS protocol header used by this request and reply.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsServerGetRequestHeaderSize(Bool sessionEnabled,     // IN: session based request
+                               HgfsOp op)               // IN: operation
+{
+   return HgfsServerGetHeaderSize(sessionEnabled, op, TRUE);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerGetReplyHeaderSize --
+ *
+ *    Takes the Hgfs reply input and finds the size of the header component.
+ *
+ * Results:
+ *    Size of the HGFS protocol header used by this reply.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsServerGetReplyHeaderSize(Bool sessionEnabled,     // IN: session based request
+                             HgfsOp op)               // IN: operation
+{
+   return HgfsServerGetHeaderSize(sessionEnabled, op, FALSE);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsIndex --
+ *
+ *    Return the latency histogram bin of a latency, using the same fixed
+ *    point log10 approximation as the MXUser lock statistics.
+ *
+ * Results:
+ *    (uint32) (HGFS_STATS_BINS_PER_DECADE * log10(latencyUS)), clamped to the
+ *    last bin.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsServerStatsIndex(uint64 latencyUS)  // IN: latency
+{
+   uint32 index = 0;
+
+   if (latencyUS != 0) {
+      uint32 numerator = 0;
+      uint32 denominator = 0;
+
+      LogFixed_Base10(latencyUS, &numerator, &denominator);
+
+      index = (HGFS_STATS_BINS_PER_DECADE * numerator) / denominator;
+   }
+
+   return MIN(index, HGFS_STATS_NUM_BINS - 1);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsRecord --
+ *
+ *    Account a completed request to the statistics of its session, or to the
+ *    totals if the request has no session.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerStatsRecord(HgfsInputParam *input,      // IN: request context
+                      HgfsInternalStatus status,  // IN: reply status
+                      uint64 bytes)               // IN: bytes transferred
+{
+   HgfsSessionOpStats *opStats;
+   VmTimeType latencyUS;
+
+   if (input->op >= HGFS_OP_MAX) {
+      return;
+   }
+
+   opStats = (NULL != input->session) ? &input->session->opStats[input->op]
+                                      : &gHgfsStatsTotals[input->op];
+   latencyUS = Hostinfo_SystemTimerUS() - input->startTimeUS;
+   if (latencyUS < 0) {
+      latencyUS = 0;
+   }
+
+   Atomic_Inc64(&opStats->requests);
+   if (HGFS_ERROR_SUCCESS != status) {
+      Atomic_Inc64(&opStats->errors);
+   }
+   Atomic_Add64(&opStats->bytes, bytes);
+   Atomic_Add64(&opStats->totalLatencyUS, latencyUS);
+   Atomic_Inc64(&opStats->latencyHisto[HgfsServerStatsIndex(latencyUS)]);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsAdd --
+ *
+ *    Add the operation statistics in src to those in dst.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerStatsAdd(HgfsSessionOpStats *src,  // IN: statistics to add
+                   HgfsServerOpStats *dst)   // IN/OUT: accumulated statistics
+{
+   uint32 i;
+
+   dst->requests += Atomic_Read64(&src->requests);
+   dst->errors += Atomic_Read64(&src->errors);
+   dst->bytes += Atomic_Read64(&src->bytes);
+   dst->totalLatencyUS += Atomic_Read64(&src->totalLatencyUS);
+   for (i = 0; i < HGFS_STATS_NUM_BINS; i++) {
+      dst->latencyHisto[i] += Atomic_Read64(&src->latencyHisto[i]);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsRetire --
+ *
+ *    Fold the operation statistics in src into the totals.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerStatsRetire(HgfsSessionOpStats *src,  // IN: statistics to add
+                      HgfsSessionOpStats *dst)  // IN/OUT: totals
+{
+   uint32 i;
+
+   Atomic_Add64(&dst->requests, Atomic_Read64(&src->requests));
+   Atomic_Add64(&dst->errors, Atomic_Read64(&src->errors));
+   Atomic_Add64(&dst->bytes, Atomic_Read64(&src->bytes));
+   Atomic_Add64(&dst->totalLatencyUS, Atomic_Read64(&src->totalLatencyUS));
+   for (i = 0; i < HGFS_STATS_NUM_BINS; i++) {
+      Atomic_Add64(&dst->latencyHisto[i], Atomic_Read64(&src->latencyHisto[i]));
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsAddSession --
+ *
+ *    Start reporting the statistics of a new session.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerStatsAddSession(HgfsSessionInfo *session)  // IN: session
+{
+   DblLnkLst_Init(&session->statsLinks);
+   if (NULL != gHgfsStatsLock) {
+      MXUser_AcquireExclLock(gHgfsStatsLock);
+      DblLnkLst_LinkLast(&gHgfsStatsSessionList, &session->statsLinks);
+      MXUser_ReleaseExclLock(gHgfsStatsLock);
+   }
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerGetHeaderSize --
+ * HgfsServerStatsRemoveSession --
  *
- *    Takes the Hgfs input and finds the size of the header component.
+ *    Stop reporting a session that is going away. Its statistics are kept in
+ *    the totals.
  *
  * Results:
- *    Size of the HGFS protocol header used by this request or reply.
+ *    None
  *
  * Side effects:
  *    None
@@ -3103,43 +3588,36 @@ exit:
  *-----------------------------------------------------------------------------
  */
 
-static HgfsInternalStatus
-HgfsServerGetHeaderSize(Bool sessionEnabled,     // IN: session based request
-                        HgfsOp op,               // IN: operation
-                        Bool request)            // IN: TRUE for request, FALSE for reply
+static void
+HgfsServerStatsRemoveSession(HgfsSessionInfo *session)  // IN: session
 {
-   size_t headerSize;
+   uint32 op;
 
-   /*
-    * If the HGFS request is session enabled we must have the new header.
-    * Any V4 operation always must have the new header too.
-    * Otherwise, starting from HGFS V3 the header is not included in the
-    * request itself, so we must return the size of the separate header
-    * structure, for requests this will be HgfsRequest and replies will be HgfsReply.
-    * Prior to V3 (so V1 and V2) there was no separate header from the request
-    * or reply structure for any given operation, so a zero size is returned for these.
-    */
-   if (sessionEnabled) {
-      headerSize = sizeof (HgfsHeader);
-   } else if (op < HGFS_OP_CREATE_SESSION_V4 &&
-              op >= HGFS_OP_OPEN_V3) {
-      headerSize = (request ? sizeof (HgfsRequest) : sizeof (HgfsReply));
-   } else {
-      headerSize = 0;
+   if (NULL != gHgfsStatsLock) {
+      MXUser_AcquireExclLock(gHgfsStatsLock);
+   }
+   if (DblLnkLst_IsLinked(&session->statsLinks)) {
+      DblLnkLst_Unlink1(&session->statsLinks);
+   }
+   for (op = 0; op < HGFS_OP_MAX; op++) {
+      HgfsServerStatsRetire(&session->opStats[op], &gHgfsStatsTotals[op]);
+   }
+   if (NULL != gHgfsStatsLock) {
+      MXUser_ReleaseExclLock(gHgfsStatsLock);
    }
-   return headerSize;
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerGetRequestHeaderSize --
+ * HgfsServer_GetStats --
  *
- *    Takes the Hgfs request input and finds the size of the header component.
+ *    Get the per operation statistics of the server, summed over the current
+ *    sessions and all sessions that existed before.
  *
  * Results:
- *    Size of the HGFS protocol header used by this request and reply.
+ *    None
  *
  * Side effects:
  *    None
@@ -3147,23 +3625,51 @@ HgfsServerGetHeaderSize(Bool sessionEnabled,     // IN: session based request
  *-----------------------------------------------------------------------------
  */
 
-static HgfsInternalStatus
-HgfsServerGetRequestHeaderSize(Bool sessionEnabled,     // IN: session based request
-                               HgfsOp op)               // IN: operation
+void
+HgfsServer_GetStats(HgfsServerStats *stats)  // OUT: statistics
 {
-   return HgfsServerGetHeaderSize(sessionEnabled, op, TRUE);
+   DblLnkLst_Links *curr;
+   uint32 op;
+
+   ASSERT(stats);
+
+   memset(stats, 0, sizeof *stats);
+   for (op = 0; op < HGFS_OP_MAX; op++) {
+      stats->ops[op].name = hgfsOpNames[op];
+   }
+
+   if (NULL == gHgfsStatsLock) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gHgfsStatsLock);
+   for (op = 0; op < HGFS_OP_MAX; op++) {
+      HgfsServerStatsAdd(&gHgfsStatsTotals[op], &stats->ops[op]);
+   }
+   DblLnkLst_ForEach(curr, &gHgfsStatsSessionList) {
+      HgfsSessionInfo *session = DblLnkLst_Container(curr, HgfsSessionInfo,
+                                                     statsLinks);
+
+      for (op = 0; op < HGFS_OP_MAX; op++) {
+         HgfsServerStatsAdd(&session->opStats[op], &stats->ops[op]);
+      }
+   }
+   MXUser_ReleaseExclLock(gHgfsStatsLock);
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerGetReplyHeaderSize --
+ * HgfsServer_GetStatsBinLimitNS --
  *
- *    Takes the Hgfs reply input and finds the size of the header component.
+ *    Get the upper limit of a latency histogram bin. Bin i holds latencies
+ *    from 10^(i / HGFS_STATS_BINS_PER_DECADE) us up to the limit, which is
+ *    10^((i + 1) / HGFS_STATS_BINS_PER_DECADE) us.
  *
  * Results:
- *    Size of the HGFS protocol header used by this reply.
+ *    The limit in nanoseconds, or MAX_UINT64 for the last bin, which holds
+ *    all larger latencies too.
  *
  * Side effects:
  *    None
@@ -3171,11 +3677,26 @@ HgfsServerGetRequestHeaderSize(Bool sessionEnabled,     // IN: session based req
  *-----------------------------------------------------------------------------
  */
 
-static HgfsInternalStatus
-HgfsServerGetReplyHeaderSize(Bool sessionEnabled,     // IN: session based request
-                             HgfsOp op)               // IN: operation
+uint64
+HgfsServer_GetStatsBinLimitNS(uint32 bin)  // IN: histogram bin
 {
-   return HgfsServerGetHeaderSize(sessionEnabled, op, FALSE);
+   /* 10^(i / HGFS_STATS_BINS_PER_DECADE) us in nanoseconds. */
+   static const uint64 mantissa[HGFS_STATS_BINS_PER_DECADE] = {
+      1000, 1778, 3162, 5623
+   };
+   uint64 limit;
+   uint32 decade;
+
+   if (bin >= HGFS_STATS_NUM_BINS - 1) {
+      return MAX_UINT64;
+   }
+
+   limit = mantissa[(bin + 1) % HGFS_STATS_BINS_PER_DECADE];
+   for (decade = (bin + 1) / HGFS_STATS_BINS_PER_DECADE; decade > 0; decade--) {
+      limit *= 10;
+   }
+
+   return limit;
 }
 
 
@@ -3247,6 +3768,10 @@ HgfsServerCompleteRequest(HgfsInternalStatus status,   // IN: Status of the requ
       goto exit;
    }
 
+   HgfsServerStatsRecord(input, status,
+                         input->requestSize + replySize +
+                         input->packet->dataPacketDataSize);
+
    if (!HgfsPacketSend(input->packet, input->transportSession, 0)) {
       /* Send failed. Drop the reply. */
       Log("%s: Error sending reply\n", __FUNCTION__);
@@ -3857,6 +4382,9 @@ HgfsServer_InitState(HgfsServerCallbacks **callbackTable,         // IN/OUT: our
 
    gHgfsAsyncVar = MXUser_CreateCondVarExclLock(gHgfsAsyncLock);
 
+   DblLnkLst_Init(&gHgfsStatsSessionList);
+   gHgfsStatsLock = MXUser_CreateExclLock("statsLock", RANK_hgfsStatsLock);
+
    if (!HgfsPlatformInit()) {
       LOG(4, ("Could not initialize server platform specific \n"));
       result = FALSE;
@@ -3865,11 +4393,10 @@ HgfsServer_InitState(HgfsServerCallbacks **callbackTable,         // IN/OUT: our
    if (result) {
       *callbackTable = &gHgfsServerCBTable;
 
-      if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_NOTIFY_ENABLED)) {
-         gHgfsDirNotifyActive = HgfsNotify_Init() == HGFS_STATUS_SUCCESS;
-         Log("%s: initialized notification %s.\n", __FUNCTION__,
-             (gHgfsDirNotifyActive ? "active" : "inactive"));
-      }
+      /*
+       * Notification is started by the first session on a channel able to
+       * deliver it, see HgfsServerDirNotifyStart.
+       */
       if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_ENABLED)) {
          if (!HgfsServerOplockInit()) {
             gHgfsCfgSettings.flags &= ~HGFS_CONFIG_OPLOCK_ENABLED;
@@ -3923,6 +4450,11 @@ HgfsServer_ExitState(void)
       gHgfsSharedFoldersLock = NULL;
    }
 
+   if (NULL != gHgfsStatsLock) {
+      MXUser_DestroyExclLock(gHgfsStatsLock);
+      gHgfsStatsLock = NULL;
+   }
+
    if (NULL != gHgfsAsyncLock) {
       MXUser_DestroyExclLock(gHgfsAsyncLock);
       gHgfsAsyncLock = NULL;
@@ -4277,6 +4809,45 @@ HgfsServerSessionConnect(void *transportData,                         // IN: tra
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerDirNotifyStart --
+ *
+ *    Start the directory change notification component, unless it is
+ *    already running or disabled.
+ *
+ *    Only sessions on shared memory channels can be sent notifications,
+ *    so this is deferred until the first such session rather than done
+ *    in HgfsServer_InitState: a server without these channels never
+ *    starts monitoring the shared folders.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Clears HGFS_CONFIG_NOTIFY_ENABLED if notification cannot be started.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerDirNotifyStart(void)
+{
+   MXUser_AcquireExclLock(gHgfsSharedFoldersLock);
+   if (!gHgfsDirNotifyActive &&
+       0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_NOTIFY_ENABLED)) {
+      gHgfsDirNotifyActive = HgfsNotify_Init() == HGFS_STATUS_SUCCESS;
+      if (!gHgfsDirNotifyActive) {
+         gHgfsCfgSettings.flags &= ~HGFS_CONFIG_NOTIFY_ENABLED;
+      }
+      Log("%s: initialized notification %s.\n", __FUNCTION__,
+          (gHgfsDirNotifyActive ? "active" : "inactive"));
+   }
+   MXUser_ReleaseExclLock(gHgfsSharedFoldersLock);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -4300,7 +4871,6 @@ static Bool
 HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
                           HgfsSessionInfo **sessionData)              // OUT:
 {
-   int i;
    HgfsSessionInfo *session;
 
    LOG(8, ("%s: entered\n", __FUNCTION__));
@@ -4338,18 +4908,17 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
    DblLnkLst_Init(&session->nodeFreeList);
    DblLnkLst_Init(&session->nodeCachedList);
 
-   /* Allocate array of FileNodes and add them to free list. */
-   session->numNodes = NUM_FILE_NODES;
-   session->nodeArray = Util_SafeCalloc(session->numNodes,
-                                        sizeof (HgfsFileNode));
+   /* Allocate the first chunk of FileNodes and add them to free list. */
+   session->numNodes = 0;
+   session->nodeArray = NULL;
    session->numCachedOpenNodes = 0;
    session->numCachedLockedNodes = 0;
-
-   for (i = 0; i < session->numNodes; i++) {
-      DblLnkLst_Init(&session->nodeArray[i].links);
-      /* Append at the end of the list. */
-      DblLnkLst_LinkLast(&session->nodeFreeList, &session->nodeArray[i].links);
+   if (!HgfsGrowNodeArray(session)) {
+      Panic("%s: Unable to allocate file nodes\n", __FUNCTION__);
    }
+   session->nodeHandleMap = HashMap_AllocMap(NUM_FILE_NODES,
+                                             sizeof (HgfsHandle),
+                                             sizeof (HgfsFileNode *));
 
    /*
     * Initialize the search handling components.
@@ -4363,27 +4932,34 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
    /* Give our session a reference to hold while we are open. */
    HgfsServerSessionGet(session);
 
-   /* Allocate array of searches and add them to free list. */
-   session->numSearches = NUM_SEARCHES;
-   session->searchArray = Util_SafeCalloc(session->numSearches,
-                                          sizeof (HgfsSearch));
-
-   for (i = 0; i < session->numSearches; i++) {
-      DblLnkLst_Init(&session->searchArray[i].links);
-      /* Append at the end of the list. */
-      DblLnkLst_LinkLast(&session->searchFreeList,
-                         &session->searchArray[i].links);
+   /* Allocate the first chunk of searches and add them to free list. */
+   session->numSearches = 0;
+   session->searchArray = NULL;
+   if (!HgfsGrowSearchArray(session)) {
+      Panic("%s: Unable to allocate searches\n", __FUNCTION__);
    }
+   session->searchHandleMap = HashMap_AllocMap(NUM_SEARCHES,
+                                               sizeof (HgfsHandle),
+                                               sizeof (HgfsSearch *));
 
    /* Get common to all sessions capabiities. */
    HgfsServerGetDefaultCapabilities(session->hgfsSessionCapabilities,
                                     &session->numberOfCapabilities);
 
+   /*
+    * Only the loopback channel of vmhgfs-fuse maps the data packet buffers,
+    * so the fast and vectored V4 read and write ops are offered there only.
+    */
    if (transportSession->channelCapabilities.flags & HGFS_CHANNEL_SHARED_MEM) {
       HgfsServerSetSessionCapability(HGFS_OP_READ_FAST_V4,
                                      HGFS_REQUEST_SUPPORTED, session);
       HgfsServerSetSessionCapability(HGFS_OP_WRITE_FAST_V4,
                                      HGFS_REQUEST_SUPPORTED, session);
+      HgfsServerSetSessionCapability(HGFS_OP_READV_V4,
+                                     HGFS_REQUEST_SUPPORTED, session);
+      HgfsServerSetSessionCapability(HGFS_OP_WRITEV_V4,
+                                     HGFS_REQUEST_SUPPORTED, session);
+      HgfsServerDirNotifyStart();
       if (gHgfsDirNotifyActive) {
          LOG(8, ("%s: notify is enabled\n", __FUNCTION__));
          if (HgfsServerEnumerateSharedFolders()) {
@@ -4406,6 +4982,8 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
                                      HGFS_REQUEST_SUPPORTED, session);
    }
 
+   HgfsServerStatsAddSession(session);
+
    *sessionData = session;
 
    Log("%s: init session %p id %"FMT64"x\n", __FUNCTION__, session, session->sessionId);
@@ -4576,16 +5154,21 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
    for (i = 0; i < session->numNodes; i++) {
       HgfsHandle handle;
 
-      if (session->nodeArray[i].state == FILENODE_STATE_UNUSED) {
+      if (HGFS_SESSION_NODE(session, i)->state == FILENODE_STATE_UNUSED) {
          continue;
       }
 
-      handle = HgfsFileNode2Handle(&session->nodeArray[i]);
+      handle = HgfsFileNode2Handle(HGFS_SESSION_NODE(session, i));
       HgfsRemoveFromCacheInternal(handle, session);
       HgfsFreeFileNodeInternal(handle, session);
    }
+   for (i = 0; i < session->numNodes / NUM_FILE_NODES; i++) {
+      free(session->nodeArray[i]);
+   }
    free(session->nodeArray);
    session->nodeArray = NULL;
+   HashMap_DestroyMap(session->nodeHandleMap);
+   session->nodeHandleMap = NULL;
 
    MXUser_ReleaseExclLock(session->nodeArrayLock);
 
@@ -4597,16 +5180,23 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
    MXUser_AcquireExclLock(session->searchArrayLock);
 
    for (i = 0; i < session->numSearches; i++) {
-      if (DblLnkLst_IsLinked(&session->searchArray[i].links)) {
+      if (DblLnkLst_IsLinked(&HGFS_SESSION_SEARCH(session, i)->links)) {
          continue;
       }
-      HgfsRemoveSearchInternal(&session->searchArray[i], session);
+      HgfsRemoveSearchInternal(HGFS_SESSION_SEARCH(session, i), session);
+   }
+   for (i = 0; i < session->numSearches / NUM_SEARCHES; i++) {
+      free(session->searchArray[i]);
    }
    free(session->searchArray);
    session->searchArray = NULL;
+   HashMap_DestroyMap(session->searchHandleMap);
+   session->searchHandleMap = NULL;
 
    MXUser_ReleaseExclLock(session->searchArrayLock);
 
+   HgfsServerStatsRemoveSession(session);
+
    /* Teardown the locks for the sessions and destroy itself. */
    MXUser_DestroyExclLock(session->nodeArrayLock);
    MXUser_DestroyExclLock(session->searchArrayLock);
@@ -4856,16 +5446,17 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
     * if its filename is no longer within a share, remove it.
     */
    for (i = 0; i < session->numNodes; i++) {
+      HgfsFileNode *node = HGFS_SESSION_NODE(session, i);
       HgfsHandle handle;
       DblLnkLst_Links *l;
 
-      if (session->nodeArray[i].state == FILENODE_STATE_UNUSED) {
+      if (node->state == FILENODE_STATE_UNUSED) {
          continue;
       }
 
-      handle = HgfsFileNode2Handle(&session->nodeArray[i]);
+      handle = HgfsFileNode2Handle(node);
       LOG(4, ("%s: Examining node with fd %d (%s)\n", __FUNCTION__,
-              handle, session->nodeArray[i].utf8Name));
+              handle, node->utf8Name));
 
       /* For each share, is the node within the share? */
       for (l = shares->next; l != shares; l = l->next) {
@@ -4873,7 +5464,7 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
 
          share = DblLnkLst_Container(l, HgfsSharedFolder, links);
          ASSERT(share);
-         if (strcmp(session->nodeArray[i].shareInfo.rootDir, share->path) == 0) {
+         if (strcmp(node->shareInfo.rootDir, share->path) == 0) {
             LOG(4, ("%s: Node is still valid\n", __FUNCTION__));
             break;
          }
@@ -4900,19 +5491,20 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
     * each search, if its base name is no longer within a share, remove it.
     */
    for (i = 0; i < session->numSearches; i++) {
+      HgfsSearch *search = HGFS_SESSION_SEARCH(session, i);
       DblLnkLst_Links *l;
 
-      if (DblLnkLst_IsLinked(&session->searchArray[i].links)) {
+      if (DblLnkLst_IsLinked(&search->links)) {
          continue;
       }
 
-      if (HgfsSearchIsBaseNameSpace(&session->searchArray[i])) {
+      if (HgfsSearchIsBaseNameSpace(search)) {
          /* Skip search of the base name space. Maybe stale but it is okay. */
          continue;
       }
 
       LOG(4, ("%s: Examining search (%s)\n", __FUNCTION__,
-              session->searchArray[i].utf8Dir));
+              search->utf8Dir));
 
       /* For each share, is the search within the share? */
       for (l = shares->next; l != shares; l = l->next) {
@@ -4920,7 +5512,7 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
 
          share = DblLnkLst_Container(l, HgfsSharedFolder, links);
          ASSERT(share);
-         if (strcmp(session->searchArray[i].shareInfo.rootDir, share->path) == 0) {
+         if (strcmp(search->shareInfo.rootDir, share->path) == 0) {
             LOG(4, ("%s: Search is still valid\n", __FUNCTION__));
             break;
          }
@@ -4929,7 +5521,7 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
       /* If the node wasn't found in any share, remove it. */
       if (l == shares) {
          LOG(4, ("%s: Search is invalid, removing\n", __FUNCTION__));
-         HgfsRemoveSearchInternal(&session->searchArray[i], session);
+         HgfsRemoveSearchInternal(search, session);
       }
    }
 
@@ -6214,6 +6806,34 @@ HgfsServerRead(HgfsInputParam *input)  // IN: Input params
           * into the separate data packet buffer. Zero indicates data is read into the
           * same buffer as the reply arguments.
           */
+         if (readUseDataBuffer &&
+             (input->transportSession->channelCapabilities.flags &
+              HGFS_CHANNEL_DATA_IOV)) {
+            HgfsVmxIov *dataIov;
+            uint32 dataIovCount;
+
+            /*
+             * Read straight into the mapped data buffer iovs rather than into
+             * an allocated buffer which is then copied out to the iovs.
+             */
+            if (HSPU_GetDataPacketIov(input->packet, BUF_WRITEABLE,
+                                      input->transportSession->channelCbTable,
+                                      &dataIov, &dataIovCount)) {
+               uint32 actualSize;
+
+               status = HgfsPlatformReadFileV(readFd, file, input->session,
+                                              offset, requiredSize, dataIov,
+                                              dataIovCount, &actualSize);
+               if (HGFS_ERROR_SUCCESS == status) {
+                  reply->actualSize = actualSize;
+                  reply->reserved = 0;
+                  replyPayloadSize = sizeof *reply;
+                  HSPU_SetDataPacketSize(input->packet, actualSize);
+               }
+               break;
+            }
+         }
+
          if (readUseDataBuffer) {
             payload = HSPU_GetDataPacketBuf(input->packet, BUF_WRITEABLE,
                                             input->transportSession->channelCbTable);
@@ -6221,7 +6841,7 @@ HgfsServerRead(HgfsInputParam *input)  // IN: Input params
             payload = &reply->payload[0];
          }
          if (payload) {
-            status = HgfsPlatformReadFile(readFd, input->session, offset,
+            status = HgfsPlatformReadFile(readFd, file, input->session, offset,
                                           requiredSize, payload,
                                           &reply->actualSize);
             if (HGFS_ERROR_SUCCESS == status) {
@@ -6243,8 +6863,9 @@ HgfsServerRead(HgfsInputParam *input)  // IN: Input params
    case HGFS_OP_READ: {
          HgfsReplyRead *reply = replyRead;
 
-         status = HgfsPlatformReadFile(readFd, input->session, offset, requiredSize,
-                                       reply->payload, &reply->actualSize);
+         status = HgfsPlatformReadFile(readFd, file, input->session, offset,
+                                       requiredSize, reply->payload,
+                                       &reply->actualSize);
          if (HGFS_ERROR_SUCCESS == status) {
             replyPayloadSize = sizeof *reply + reply->actualSize;
          } else {
@@ -6493,6 +7114,7 @@ HgfsServerWrite(HgfsInputParam *input)  // IN: Input params
       }
 
       status = HgfsPlatformWriteFile(writeFd,
+                                     writeFile,
                                      input->session,
                                      writeOffset,
                                      writeSize,
@@ -6516,6 +7138,214 @@ exit:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerReadV --
+ *
+ *    Handle a vectored Read request.
+ *
+ *    In the HgfsPacket metaPacket buffer
+ *    [HgfsHeader][HgfsRequestReadVV4]
+ *    The reply is
+ *    [HgfsHeader][HgfsReplyReadVV4]
+ *    In the HgfsPacket dataPacket buffer
+ *    [Extent data packed in the order of the extents]
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerReadV(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsIoExtentV4 extents[HGFS_VECTORED_IO_MAX_EXTENTS];
+   HgfsInternalStatus status;
+   HgfsHandle file;
+   fileDesc readFd;
+   uint32 numExtents;
+   uint32 totalSize;
+   size_t replyReadSize;
+   size_t replyPayloadSize = 0;
+   uint32 extentSizes[HGFS_VECTORED_IO_MAX_EXTENTS];
+   uint32 actualSize;
+   HgfsReplyReadVV4 *reply;
+   void *payload;
+   Bool useMappedBuffer;
+
+   HGFS_ASSERT_INPUT(input);
+
+   if (!HgfsUnpackReadVRequest(input->payload, input->payloadSize, &file,
+                               extents, &numExtents, &totalSize)) {
+      LOG(4, ("%s: Failed to unpack a valid packet -> PROTOCOL_ERROR.\n", __FUNCTION__));
+      status = HGFS_ERROR_PROTOCOL;
+      goto exit;
+   }
+
+   /*
+    * Validate the reply and the data buffers can hold the per extent results
+    * and all the extent data.
+    */
+   useMappedBuffer = (input->transportSession->channelCbTable->getWriteVa != NULL);
+   replyReadSize = offsetof(HgfsReplyReadVV4, extentSizes) +
+                   numExtents * sizeof reply->extentSizes[0];
+   if (!HSPU_ValidateDataPacketSize(input->packet, totalSize) ||
+       !HSPU_ValidateReplyPacketSize(input->packet,
+                                     HgfsServerGetReplyHeaderSize(input->sessionEnabled,
+                                                                  input->op),
+                                     replyReadSize,
+                                     0,
+                                     useMappedBuffer)) {
+      status = HGFS_ERROR_INVALID_PARAMETER;
+      LOG(4, ("%s: Error: arg validation read size %u.\n", __FUNCTION__,
+              totalSize));
+      goto exit;
+   }
+
+   status = HgfsPlatformGetFd(file, input->session, FALSE, &readFd);
+   if (status != HGFS_ERROR_SUCCESS) {
+      LOG(4, ("%s: Error: arg validation handle -> %d.\n", __FUNCTION__, status));
+      goto exit;
+   }
+
+   reply = HgfsAllocInitReply(input->packet, input->request, replyReadSize,
+                              input->session);
+   payload = HSPU_GetDataPacketBuf(input->packet, BUF_WRITEABLE,
+                                   input->transportSession->channelCbTable);
+   if (NULL == payload) {
+      status = HGFS_ERROR_PROTOCOL;
+      LOG(4, ("%s: Failed to get payload -> PROTOCOL_ERROR.\n", __FUNCTION__));
+      goto exit;
+   }
+
+   status = HgfsPlatformReadExtents(readFd, file, input->session, extents,
+                                    numExtents, payload, extentSizes,
+                                    &actualSize);
+   if (HGFS_ERROR_SUCCESS == status) {
+      memcpy(reply->extentSizes, extentSizes,
+             numExtents * sizeof reply->extentSizes[0]);
+      reply->actualSize = actualSize;
+      reply->numExtents = numExtents;
+      reply->reserved = 0;
+      replyPayloadSize = replyReadSize;
+      HSPU_SetDataPacketSize(input->packet, totalSize);
+   }
+
+exit:
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerWriteV --
+ *
+ *    Handle a vectored Write request.
+ *
+ *    In the HgfsPacket metaPacket buffer
+ *    [HgfsHeader][HgfsRequestWriteVV4]
+ *    In the HgfsPacket dataPacket buffer
+ *    [Extent data packed in the order of the extents]
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerWriteV(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsIoExtentV4 extents[HGFS_VECTORED_IO_MAX_EXTENTS];
+   HgfsInternalStatus status;
+   HgfsHandle writeFile;
+   HgfsWriteFlags writeFlags;
+   fileDesc writeFd;
+   uint32 numExtents;
+   uint32 totalSize;
+   uint32 writtenSize = 0;
+   size_t writeReplySize = 0;
+   const void *writeData;
+   Bool writeSequential = FALSE;
+   Bool writeAppend = FALSE;
+
+   HGFS_ASSERT_INPUT(input);
+
+   if (!HgfsUnpackWriteVRequest(input->payload, input->payloadSize, &writeFile,
+                                &writeFlags, extents, &numExtents, &totalSize)) {
+      LOG(4, ("%s: Error: Op %d unpack write request arguments\n", __FUNCTION__,
+              input->op));
+      status = HGFS_ERROR_PROTOCOL;
+      goto exit;
+   }
+
+   /* Every extent has its own offset so appending makes no sense. */
+   if ((writeFlags & HGFS_WRITE_APPEND) ||
+       !HSPU_ValidateDataPacketSize(input->packet, totalSize)) {
+      status = HGFS_ERROR_INVALID_PARAMETER;
+      LOG(4, ("%s: Error: write flags %u data size %u\n", __FUNCTION__,
+              writeFlags, totalSize));
+      goto exit;
+   }
+
+   status = HgfsPlatformGetFd(writeFile, input->session, FALSE, &writeFd);
+   if (status != HGFS_ERROR_SUCCESS) {
+      LOG(4, ("%s: Error: arg validation handle -> %d.\n", __FUNCTION__, status));
+      goto exit;
+   }
+
+   if (!HgfsHandleIsSequentialOpen(writeFile, input->session, &writeSequential)) {
+      status = HGFS_ERROR_INVALID_HANDLE;
+      LOG(4, ("%s: Could not get sequential open status\n", __FUNCTION__));
+      goto exit;
+   }
+
+#if defined(__APPLE__)
+   if (!HgfsHandle2AppendFlag(writeFile, input->session, &writeAppend)) {
+      status = HGFS_ERROR_INVALID_HANDLE;
+      LOG(4, ("%s: Could not get append mode\n", __FUNCTION__));
+      goto exit;
+   }
+#endif
+
+   if (totalSize > 0) {
+      HSPU_SetDataPacketSize(input->packet, totalSize);
+      writeData = HSPU_GetDataPacketBuf(input->packet, BUF_READABLE,
+                                        input->transportSession->channelCbTable);
+      if (NULL == writeData) {
+         LOG(4, ("%s: Error: Op %d mapping write data buffer\n", __FUNCTION__,
+                 input->op));
+         status = HGFS_ERROR_PROTOCOL;
+         goto exit;
+      }
+
+      status = HgfsPlatformWriteExtents(writeFd, input->session, extents,
+                                        numExtents, writeSequential, writeAppend,
+                                        writeData, &writtenSize);
+      if (HGFS_ERROR_SUCCESS != status) {
+         goto exit;
+      }
+   }
+
+   if (!HgfsPackWriteReply(input->packet, input->request, input->op,
+                           writtenSize, &writeReplySize, input->session)) {
+      status = HGFS_ERROR_INTERNAL;
+   }
+
+exit:
+   HgfsServerCompleteRequest(status, writeReplySize, input);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -7829,7 +8659,7 @@ HgfsServerGetattr(HgfsInputParam *input)  // IN: Input params
          targetNameLen = 0;
          status = HgfsPlatformGetFd(file, input->session, FALSE, &fd);
          if (HGFS_ERROR_SUCCESS == status) {
-            status = HgfsPlatformGetattrFromFd(fd, input->session, &attr);
+            status = HgfsPlatformGetattrFromFd(fd, file, input->session, &attr);
          } else {
             LOG(4, ("%s: Could not get file descriptor\n", __FUNCTION__));
          }
@@ -173,6 +173,13 @@ typedef struct HgfsFileNode {
 
    /* Parameters associated with the share. */
    HgfsShareInfo shareInfo;
+
+   /*
+    * Access pattern tracking used to start write back behind sequential
+    * writers. See HgfsHandleTrackWrite.
+    */
+   uint64 nextWriteOffset;
+   uint64 writeBehindStart;
 } HgfsFileNode;
 
 
@@ -248,6 +255,18 @@ typedef enum {
    HGFS_SESSION_STATE_CLOSED,
 } HgfsSessionInfoState;
 
+/*
+ * Statistics of one operation, see HgfsServerOpStats. Updated with atomic
+ * operations only, so request processing never takes a lock for them.
+ */
+typedef struct HgfsSessionOpStats {
+   Atomic_uint64 requests;
+   Atomic_uint64 errors;
+   Atomic_uint64 bytes;
+   Atomic_uint64 totalLatencyUS;
+   Atomic_uint64 latencyHisto[HGFS_STATS_NUM_BINS];
+} HgfsSessionOpStats;
+
 typedef struct HgfsSessionInfo {
 
    DblLnkLst_Links links;
@@ -279,17 +298,20 @@ typedef struct HgfsSessionInfo {
    /*
     ** START NODE ARRAY **************************************************
     *
-    * Lock for the following 6 fields: the node array,
+    * Lock for the following 7 fields: the node array,
     * counters and lists for this session.
     */
    MXUserExclLock *nodeArrayLock;
 
-   /* Open file nodes of this session. */
-   HgfsFileNode *nodeArray;
+   /* Open file nodes of this session, in chunks of HGFS_ARRAY_CHUNK_SIZE. */
+   HgfsFileNode **nodeArray;
 
    /* Number of nodes in the nodeArray. */
    uint32 numNodes;
 
+   /* Map of in use node handles to nodes. */
+   struct HashMap *nodeHandleMap;
+
    /* Free list of file nodes. LIFO to be cache-friendly. */
    DblLnkLst_Links nodeFreeList;
 
@@ -306,17 +328,20 @@ typedef struct HgfsSessionInfo {
    /*
     ** START SEARCH ARRAY ************************************************
     *
-    * Lock for the following three fields: for the search array
-    * and it's counter and list, for this session.
+    * Lock for the following four fields: for the search array
+    * and it's counter, map and list, for this session.
     */
    MXUserExclLock *searchArrayLock;
 
-   /* Directory entry cache for this session. */
-   HgfsSearch *searchArray;
+   /* Directory entry cache for this session, in chunks of HGFS_ARRAY_CHUNK_SIZE. */
+   HgfsSearch **searchArray;
 
    /* Number of entries in searchArray. */
    uint32 numSearches;
 
+   /* Map of in use search handles to searches. */
+   struct HashMap *searchHandleMap;
+
    /* Free list of searches. LIFO. */
    DblLnkLst_Links searchFreeList;
    /** END SEARCH ARRAY ****************************************************/
@@ -326,8 +351,31 @@ typedef struct HgfsSessionInfo {
 
    uint32 numberOfCapabilities;
 
+   /* Links in the list of sessions whose statistics are reported. */
+   DblLnkLst_Links statsLinks;
+
+   /* Per operation statistics of this session. */
+   HgfsSessionOpStats opStats[HGFS_OP_MAX];
+
 } HgfsSessionInfo;
 
+/*
+ * File nodes and searches are allocated in chunks that never move once
+ * allocated, so pointers to them stay valid as the session arrays grow.
+ * Entry i lives at offset (i % HGFS_ARRAY_CHUNK_SIZE) of chunk
+ * (i / HGFS_ARRAY_CHUNK_SIZE).
+ */
+#define HGFS_ARRAY_CHUNK_SHIFT   7
+#define HGFS_ARRAY_CHUNK_SIZE    (1 << HGFS_ARRAY_CHUNK_SHIFT)
+#define HGFS_ARRAY_CHUNK_MASK    (HGFS_ARRAY_CHUNK_SIZE - 1)
+
+#define HGFS_ARRAY_ENTRY(_chunks, _i) \
+   (&(_chunks)[(_i) >> HGFS_ARRAY_CHUNK_SHIFT][(_i) & HGFS_ARRAY_CHUNK_MASK])
+#define HGFS_SESSION_NODE(_session, _i) \
+   HGFS_ARRAY_ENTRY((_session)->nodeArray, (_i))
+#define HGFS_SESSION_SEARCH(_session, _i) \
+   HGFS_ARRAY_ENTRY((_session)->searchArray, (_i))
+
 /*
  * This represents the maximum number of HGFS sessions that can be
  * created in a HGFS transport session. We picked a random value
@@ -641,6 +689,18 @@ HgfsHandleIsSharedFolderOpen(HgfsHandle handle,        // IN:  Hgfs file handle
                              HgfsSessionInfo *session, // IN: session info
                              Bool *sharedFolderOpen);  // OUT: If shared folder
 
+Bool
+HgfsHandleTrackWrite(HgfsHandle handle,         // IN: Hgfs file handle
+                     HgfsSessionInfo *session,  // IN: session info
+                     uint64 offset,             // IN: offset of the write
+                     uint32 length,             // IN: bytes written
+                     uint64 *flushOffset,       // OUT: start of write back
+                     uint64 *flushLength);      // OUT: write back length
+
+Bool
+HgfsHandleFlushWriteBehind(HgfsHandle handle,          // IN: Hgfs file handle
+                           HgfsSessionInfo *session);  // IN: session info
+
 Bool
 HgfsGetSearchCopy(HgfsHandle handle,        // IN: Hgfs search handle
                   HgfsSessionInfo *session, // IN: Session info
@@ -742,13 +802,24 @@ HgfsPlatformDirDumpDents(HgfsSearch *search);         // IN: search
 
 HgfsInternalStatus
 HgfsPlatformReadFile(fileDesc readFile,           // IN: file descriptor
+                     HgfsHandle handle,           // IN: HGFS file handle
                      HgfsSessionInfo *session,    // IN: session info
                      uint64 offset,               // IN: file offset to read from
                      uint32 requiredSize,         // IN: length of data to read
                      void* payload,               // OUT: buffer for the read data
                      uint32 *actualSize);         // OUT: actual length read
 HgfsInternalStatus
+HgfsPlatformReadFileV(fileDesc readFile,           // IN: file descriptor
+                      HgfsHandle handle,           // IN: HGFS file handle
+                      HgfsSessionInfo *session,    // IN: session info
+                      uint64 offset,               // IN: file offset to read from
+                      uint32 requiredSize,         // IN: length of data to read
+                      HgfsVmxIov *iov,             // OUT: buffers for the read data
+                      uint32 iovCount,             // IN: number of buffers
+                      uint32 *actualSize);         // OUT: actual length read
+HgfsInternalStatus
 HgfsPlatformWriteFile(fileDesc writeFile,          // IN: file descriptor
+                      HgfsHandle writeHandle,      // IN: HGFS file handle
                       HgfsSessionInfo *session,    // IN: session info
                       uint64 writeOffset,          // IN: file offset to write to
                       uint32 writeDataSize,        // IN: length of data to write
@@ -758,6 +829,28 @@ HgfsPlatformWriteFile(fileDesc writeFile,          // IN: file descriptor
                       const void *writeData,       // IN: data to be written
                       uint32 *writtenSize);        // OUT: byte length written
 HgfsInternalStatus
+HgfsPlatformReadExtents(fileDesc readFile,             // IN: file descriptor
+                        HgfsHandle handle,              // IN: HGFS file handle
+                        HgfsSessionInfo *session,       // IN: session info
+                        const HgfsIoExtentV4 *extents,  // IN: extents to read
+                        uint32 numExtents,              // IN: number of extents
+                        void *payload,                  // OUT: buffer for the data
+                        uint32 *extentSizes,            // OUT: bytes read per extent
+                        uint32 *actualSize);            // OUT: total bytes read
+HgfsInternalStatus
+HgfsPlatformWriteExtents(fileDesc writeFile,            // IN: file descriptor
+                         HgfsSessionInfo *session,       // IN: session info
+                         const HgfsIoExtentV4 *extents,  // IN: extents to write
+                         uint32 numExtents,              // IN: number of extents
+                         Bool writeSequential,           // IN: write is sequential
+                         Bool writeAppend,               // IN: write is appended
+                         const void *writeData,          // IN: data to be written
+                         uint32 *writtenSize);           // OUT: total bytes written
+void
+HgfsPlatformWriteBehind(fileDesc file,              // IN: file descriptor
+                        uint64 offset,              // IN: start of the range
+                        uint64 length);             // IN: length of the range
+HgfsInternalStatus
 HgfsPlatformWriteWin32Stream(HgfsHandle file,           // IN: packet header
                              char *dataToWrite,         // IN: data to write
                              size_t requiredSize,       // IN: data size
@@ -812,6 +905,7 @@ void
 HgfsPlatformGetDefaultDirAttrs(HgfsFileAttrInfo *attr); // OUT: attributes
 HgfsInternalStatus
 HgfsPlatformGetattrFromFd(fileDesc fileDesc,        // IN: file descriptor to query
+                          HgfsHandle handle,        // IN: HGFS file handle
                           HgfsSessionInfo *session, // IN: session info
                           HgfsFileAttrInfo *attr);  // OUT: file attributes
 HgfsInternalStatus
@@ -847,6 +941,13 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
                       MappingType mappingType,              // IN: Readable/ Writeable ?
                       HgfsServerChannelCallbacks *chanCb);  // IN: Channel callbacks
 
+Bool
+HSPU_GetDataPacketIov(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
+                      MappingType mappingType,              // IN: Readable/ Writeable ?
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      HgfsVmxIov **iov,                     // OUT: mapped data iovs
+                      uint32 *iovCount);                    // OUT: mapped iov count
+
 void
 HSPU_SetDataPacketSize(HgfsPacket *packet,            // IN/OUT: Hgfs Packet
                        size_t dataSize);              // IN: data size
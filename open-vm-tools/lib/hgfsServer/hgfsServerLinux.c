@@ -44,6 +44,10 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <sys/resource.h> // for getrlimit
+#include <sys/uio.h>      // for preadv
+#if defined(linux)
+#   include <sys/sysmacros.h> // for makedev
+#endif
 
 #if defined(__FreeBSD__)
 #   include <sys/param.h>
@@ -62,11 +66,18 @@
 #include "hgfsUtil.h"  // for cross-platform time conversion
 #include "posix.h"
 #include "file.h"
+#include "fileIO.h"
 #include "util.h"
 #include "su.h"
 #include "codeset.h"
 #include "unicodeOperations.h"
+#include "unicodeTransforms.h"
 #include "userlock.h"
+#include "mutexRankLib.h"
+#include "dbllnklst.h"
+#include "hashTable.h"
+#include "hashMap.h"
+#include "hostinfo.h"
 
 #if defined(linux) && !defined(SYS_getdents64)
 /* For DT_UNKNOWN */
@@ -88,11 +99,31 @@
 #endif
 
 #ifdef linux
+/* Record layout returned by getdents64(2). */
+typedef struct DirectoryRecord {
+   uint64 d_ino;
+   uint64 d_off;
+   uint16 d_reclen;
+   uint8  d_type;
+   char   d_name[256];
+} DirectoryRecord;
+
+/*
+ * Search entry. The attributes of the entry are gathered while scanning the
+ * directory so that search reads do not need to stat each entry again. A
+ * search may be read long after it was opened, so attributes older than
+ * HGFS_SEARCH_ATTR_MAX_AGE_MS are not used and the entry is stat'ed again.
+ */
+#define HGFS_SEARCH_ATTR_MAX_AGE_MS   1000
+
 typedef struct DirectoryEntry {
    uint64 d_ino;
    uint64 d_off;
    uint16 d_reclen;
    uint8  d_type;
+   Bool   d_statValid;   /* d_stat holds the entry's attributes */
+   VmTimeType d_statTime;   /* When d_stat was taken, in ms */
+   struct stat d_stat;
    char   d_name[256];
 } DirectoryEntry;
 #else
@@ -104,6 +135,8 @@ typedef struct DirectoryEntry {
    uint8  d_type;
    char   d_name[1024];
 } DirectoryEntry;
+
+typedef DirectoryEntry DirectoryRecord;
 #endif
 
 /*
@@ -130,7 +163,7 @@ typedef struct DirectoryEntry {
 #if defined(linux)
 static INLINE int
 getdents_linux(unsigned int fd,
-               DirectoryEntry *dirp,
+               DirectoryRecord *dirp,
                unsigned int count)
 {
 #   if defined(SYS_getdents64)
@@ -158,7 +191,7 @@ getdents_linux(unsigned int fd,
       int i;
 
       /*
-       * Translate from the Linux 'struct dirent' to the hgfs DirectoryEntry, since
+       * Translate from the Linux 'struct dirent' to the hgfs DirectoryRecord, since
        * they're not always the same layout.
        */
       for (i = 0; i < count; i++) {
@@ -227,6 +260,9 @@ getdents_apple(DIR *fd,               // IN
 #define O_NOFOLLOW 0
 #endif
 
+/* Maximum number of buffers passed to a single preadv(2). */
+#define HGFS_READV_MAX_IOVS 64
+
 
 #if defined(sun) || defined(linux) || \
     (defined(__FreeBSD_version) && __FreeBSD_version < 490000)
@@ -313,6 +349,76 @@ static const int HgfsServerOpenMode[] = {
    O_RDWR,
 };
 
+/*
+ * Case insensitive lookup cache.
+ *
+ * Each share gets a table mapping the case folded path of a component,
+ * relative to the share root, to the real name of that component. Entries
+ * are checked with lstat(2) before use and dropped if the name is gone, so
+ * renames and deletes done behind the server's back are picked up. Each
+ * table is bounded and evicts the least recently used entry.
+ */
+#define HGFS_CASE_CACHE_MAX_ENTRIES   4096
+
+typedef struct HgfsCaseCacheEntry {
+   DblLnkLst_Links lruLinks;
+   char *foldedPath;            /* Key, relative to the share root. */
+   char *realName;              /* Real name of the last component. */
+} HgfsCaseCacheEntry;
+
+typedef struct HgfsCaseCache {
+   DblLnkLst_Links links;
+   char *sharePath;
+   HashTable *entries;          /* foldedPath -> HgfsCaseCacheEntry */
+   DblLnkLst_Links lruList;     /* Most recently used first. */
+   uint32 numEntries;
+} HgfsCaseCache;
+
+static MXUserExclLock *gHgfsCaseCacheLock;
+static DblLnkLst_Links gHgfsCaseCaches;
+
+/*
+ * Process wide cache of open file descriptors.
+ *
+ * Descriptors of regular files are shared by all nodes, in any session, that
+ * open the same file with the same flags, so concurrent users of a file do
+ * not each hold a descriptor of their own. Only descriptors accessed with
+ * pread/pwrite are shared, as the file offset is shared too, and never ones
+ * that may carry a server lock, since leases belong to an open file. Only
+ * nodes open at the same time share a descriptor: it is closed when the last
+ * of them goes away, so a deleted or replaced file is not kept open, and the
+ * access of each later open is checked against the file's current mode.
+ */
+#if defined(__linux__) || defined(__APPLE__)
+#define HGFS_FD_CACHE
+#endif
+
+#ifdef HGFS_FD_CACHE
+#define HGFS_FD_CACHE_INITIAL_SIZE    64
+
+/* Open flags which do not affect the opened descriptor. */
+#define HGFS_FD_CACHE_FLAGS_IGNORED   (O_CREAT | O_NOFOLLOW)
+
+typedef struct HgfsFdCacheKey {
+   uint64 volumeId;
+   uint64 fileId;
+   int32 flags;
+   int32 reserved;              /* Zero, keys are compared as bytes. */
+} HgfsFdCacheKey;
+
+typedef struct HgfsFdCacheEntry {
+   HgfsFdCacheKey key;
+   int fd;
+   uint32 refCount;
+} HgfsFdCacheEntry;
+
+static MXUserExclLock *gHgfsFdCacheLock;
+static HashMap *gHgfsFdCacheByKey;            /* key -> HgfsFdCacheEntry * */
+static HashMap *gHgfsFdCacheByFd;             /* fd -> HgfsFdCacheEntry * */
+
+static Bool HgfsFdCacheRelease(int fd);
+#endif
+
 /* Local functions. */
 static HgfsInternalStatus HgfsGetattrResolveAlias(char const *fileName,
                                                   char **targetName);
@@ -555,6 +661,19 @@ HgfsServerGetOpenFlags(HgfsOpenFlags flagsIn, // IN
 Bool
 HgfsPlatformInit(void)
 {
+   DblLnkLst_Init(&gHgfsCaseCaches);
+   gHgfsCaseCacheLock = MXUser_CreateExclLock("hgfsCaseCacheLock",
+                                              RANK_hgfsCaseCacheLock);
+#ifdef HGFS_FD_CACHE
+   gHgfsFdCacheByKey = HashMap_AllocMap(HGFS_FD_CACHE_INITIAL_SIZE,
+                                        sizeof (HgfsFdCacheKey),
+                                        sizeof (HgfsFdCacheEntry *));
+   gHgfsFdCacheByFd = HashMap_AllocMap(HGFS_FD_CACHE_INITIAL_SIZE,
+                                       sizeof (int),
+                                       sizeof (HgfsFdCacheEntry *));
+   gHgfsFdCacheLock = MXUser_CreateExclLock("hgfsFdCacheLock",
+                                            RANK_hgfsFdCacheLock);
+#endif
    return TRUE;
 }
 
@@ -578,6 +697,42 @@ HgfsPlatformInit(void)
 void
 HgfsPlatformDestroy(void)
 {
+   DblLnkLst_Links *link, *nextElem;
+
+   DblLnkLst_ForEachSafe(link, nextElem, &gHgfsCaseCaches) {
+      HgfsCaseCache *cache = DblLnkLst_Container(link, HgfsCaseCache, links);
+      DblLnkLst_Links *entryLink, *nextEntry;
+
+      DblLnkLst_ForEachSafe(entryLink, nextEntry, &cache->lruList) {
+         HgfsCaseCacheEntry *entry = DblLnkLst_Container(entryLink,
+                                                         HgfsCaseCacheEntry,
+                                                         lruLinks);
+         DblLnkLst_Unlink1(&entry->lruLinks);
+         free(entry->foldedPath);
+         free(entry->realName);
+         free(entry);
+      }
+      HashTable_Free(cache->entries);
+      DblLnkLst_Unlink1(&cache->links);
+      free(cache->sharePath);
+      free(cache);
+   }
+
+   if (gHgfsCaseCacheLock != NULL) {
+      MXUser_DestroyExclLock(gHgfsCaseCacheLock);
+      gHgfsCaseCacheLock = NULL;
+   }
+
+#ifdef HGFS_FD_CACHE
+   if (gHgfsFdCacheLock != NULL) {
+      /* All sessions are gone, and closed their descriptors with them. */
+      ASSERT(HashMap_Count(gHgfsFdCacheByFd) == 0);
+      HashMap_DestroyMap(gHgfsFdCacheByKey);
+      HashMap_DestroyMap(gHgfsFdCacheByFd);
+      MXUser_DestroyExclLock(gHgfsFdCacheLock);
+      gHgfsFdCacheLock = NULL;
+   }
+#endif
 }
 
 
@@ -633,6 +788,243 @@ HgfsServerGetOpenMode(HgfsFileOpenInfo *openInfo, // IN:  Open info to examine
 }
 
 
+#ifdef HGFS_FD_CACHE
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsFdCacheInitKey --
+ *
+ *    Fill in a descriptor cache key. Flags which only matter while the file
+ *    is being opened are dropped so they do not split the cache.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsFdCacheInitKey(uint64 volumeId,      // IN: device of the file
+                   uint64 fileId,        // IN: inode of the file
+                   int openFlags,        // IN: open(2) mode and flags
+                   HgfsFdCacheKey *key)  // OUT: cache key
+{
+   memset(key, 0, sizeof *key);
+   key->volumeId = volumeId;
+   key->fileId = fileId;
+   key->flags = openFlags & ~HGFS_FD_CACHE_FLAGS_IGNORED;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsFdCacheIsShareable --
+ *
+ *    Check whether a descriptor opened with the given flags may be shared.
+ *    Descriptors that rely on their own file offset, that create or truncate
+ *    the file, or that may carry a server lock are never shared.
+ *
+ * Results:
+ *    TRUE if the descriptor may be shared, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsFdCacheIsShareable(int openFlags,       // IN: open(2) mode and flags
+                       Bool sequential,     // IN: opened for sequential access
+                       HgfsLockType lock)   // IN: server lock wanted
+{
+   return gHgfsFdCacheLock != NULL &&
+          !sequential &&
+          lock == HGFS_LOCK_NONE &&
+          (openFlags & (O_APPEND | O_TRUNC | O_EXCL)) == 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsFdCacheGet --
+ *
+ *    Look up an open descriptor of the given file and flags and take a
+ *    reference on it. Since the shared descriptor was opened by someone
+ *    else, possibly before the file's mode changed, the caller's access to
+ *    the file is checked as open(2) would have.
+ *
+ * Results:
+ *    The descriptor, or -1 if none is cached or access to the file is denied.
+ *    In the latter case the caller's open(2) reports the error.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsFdCacheGet(const char *fileName,  // IN: file name
+               uint64 volumeId,       // IN: device of the file
+               uint64 fileId,         // IN: inode of the file
+               int openFlags)         // IN: open(2) mode and flags
+{
+   HgfsFdCacheKey key;
+   HgfsFdCacheEntry **entryPtr;
+   int accessMode;
+   int fd = -1;
+
+   HgfsFdCacheInitKey(volumeId, fileId, openFlags, &key);
+
+   MXUser_AcquireExclLock(gHgfsFdCacheLock);
+   entryPtr = HashMap_Get(gHgfsFdCacheByKey, &key);
+   if (entryPtr != NULL) {
+      HgfsFdCacheEntry *entry = *entryPtr;
+
+      entry->refCount++;
+      fd = entry->fd;
+      LOG(4, ("%s: sharing fd %d, %u references\n", __FUNCTION__, fd,
+              entry->refCount));
+   }
+   MXUser_ReleaseExclLock(gHgfsFdCacheLock);
+
+   if (fd < 0) {
+      return -1;
+   }
+
+   switch (openFlags & O_ACCMODE) {
+   case O_WRONLY:
+      accessMode = W_OK;
+      break;
+   case O_RDWR:
+      accessMode = R_OK | W_OK;
+      break;
+   default:
+      accessMode = R_OK;
+      break;
+   }
+
+   if (Posix_Access(fileName, accessMode) != 0) {
+      LOG(4, ("%s: not sharing fd %d with \"%s\": %s\n", __FUNCTION__, fd,
+              fileName, strerror(errno)));
+      HgfsFdCacheRelease(fd);
+      fd = -1;
+   }
+
+   return fd;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsFdCacheAdd --
+ *
+ *    Make a newly opened descriptor available for sharing. The caller keeps
+ *    the first reference. If another descriptor for the same file and flags
+ *    got in first, the new one simply stays private.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsFdCacheAdd(int fd,            // IN: newly opened descriptor
+               uint64 volumeId,   // IN: device of the file
+               uint64 fileId,     // IN: inode of the file
+               int openFlags)     // IN: open(2) mode and flags
+{
+   HgfsFdCacheEntry *entry = Util_SafeMalloc(sizeof *entry);
+
+   HgfsFdCacheInitKey(volumeId, fileId, openFlags, &entry->key);
+   entry->fd = fd;
+   entry->refCount = 1;
+
+   MXUser_AcquireExclLock(gHgfsFdCacheLock);
+   if (HashMap_Get(gHgfsFdCacheByKey, &entry->key) != NULL ||
+       !HashMap_Put(gHgfsFdCacheByKey, &entry->key, &entry)) {
+      free(entry);
+      entry = NULL;
+   } else if (!HashMap_Put(gHgfsFdCacheByFd, &fd, &entry)) {
+      HashMap_Remove(gHgfsFdCacheByKey, &entry->key);
+      free(entry);
+      entry = NULL;
+   }
+   MXUser_ReleaseExclLock(gHgfsFdCacheLock);
+
+   if (entry == NULL) {
+      LOG(4, ("%s: fd %d not shared\n", __FUNCTION__, fd));
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsFdCacheRelease --
+ *
+ *    Drop a reference on a shared descriptor, closing it with the last one.
+ *
+ * Results:
+ *    TRUE if the descriptor is a shared one, FALSE if the caller should close
+ *    it itself.
+ *
+ * Side effects:
+ *    The descriptor may be closed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsFdCacheRelease(int fd)   // IN: descriptor
+{
+   HgfsFdCacheEntry **entryPtr;
+   HgfsFdCacheEntry *entry = NULL;
+   Bool shared = FALSE;
+
+   if (gHgfsFdCacheLock == NULL) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(gHgfsFdCacheLock);
+   entryPtr = HashMap_Get(gHgfsFdCacheByFd, &fd);
+   if (entryPtr != NULL) {
+      entry = *entryPtr;
+      ASSERT(entry->refCount > 0);
+      if (--entry->refCount == 0) {
+         HashMap_Remove(gHgfsFdCacheByKey, &entry->key);
+         HashMap_Remove(gHgfsFdCacheByFd, &fd);
+      } else {
+         entry = NULL;
+      }
+      shared = TRUE;
+   }
+   MXUser_ReleaseExclLock(gHgfsFdCacheLock);
+
+   if (entry != NULL) {
+      if (close(entry->fd) != 0) {
+         LOG(4, ("%s: Could not close fd %d: %s\n", __FUNCTION__, entry->fd,
+                 strerror(errno)));
+      }
+      free(entry);
+   }
+
+   return shared;
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -654,6 +1046,12 @@ HgfsInternalStatus
 HgfsPlatformCloseFile(fileDesc fileDesc, // IN: File descriptor
                       void *fileCtx)     // IN: File context
 {
+#ifdef HGFS_FD_CACHE
+   if (HgfsFdCacheRelease(fileDesc)) {
+      return 0;
+   }
+#endif
+
    if (close(fileDesc) != 0) {
       int error = errno;
 
@@ -754,6 +1152,9 @@ HgfsPlatformGetFd(HgfsHandle hgfsHandle,    // IN:  HGFS file handle
    int newFd = -1, openFlags = 0;
    HgfsFileNode node;
    HgfsInternalStatus status = 0;
+#ifdef HGFS_FD_CACHE
+   Bool shareable;
+#endif
 
    ASSERT(fd);
    ASSERT(session);
@@ -784,6 +1185,7 @@ HgfsPlatformGetFd(HgfsHandle hgfsHandle,    // IN:  HGFS file handle
        * mode.
        */
       if (append && !(node.flags & HGFS_FILE_NODE_APPEND_FL)) {
+         HgfsHandleFlushWriteBehind(hgfsHandle, session);
          status = HgfsPlatformCloseFile(node.fileDesc, node.fileCtx);
          if (status != 0) {
             LOG(4, ("%s: Couldn't close file \"%s\" for reopening\n",
@@ -822,23 +1224,47 @@ HgfsPlatformGetFd(HgfsHandle hgfsHandle,    // IN:  HGFS file handle
     * flags for a simple open request. This really should always work.
     */
    HgfsServerGetOpenFlags(0, &openFlags);
+   openFlags |= node.mode | (append ? O_APPEND : 0);
 
-   /*
-    * We don't need to specify open permissions here because we're only
-    * reopening an existing file, not creating a new one.
-    *
-    * XXX: We should use O_LARGEFILE, see lib/file/fileIOPosix.c --hpreg
-    */
-   newFd = Posix_Open(node.utf8Name,
-		node.mode | openFlags | (append ? O_APPEND : 0));
+#ifdef HGFS_FD_CACHE
+   shareable = HgfsFdCacheIsShareable(openFlags,
+                                      (node.flags & HGFS_FILE_NODE_SEQUENTIAL_FL) != 0,
+                                      HGFS_LOCK_NONE);
+   if (shareable) {
+      newFd = HgfsFdCacheGet(node.utf8Name, node.localId.volumeId,
+                             node.localId.fileId, openFlags);
+   }
+#endif
 
    if (newFd < 0) {
-      int error = errno;
+      /*
+       * We don't need to specify open permissions here because we're only
+       * reopening an existing file, not creating a new one.
+       *
+       * XXX: We should use O_LARGEFILE, see lib/file/fileIOPosix.c --hpreg
+       */
+      newFd = Posix_Open(node.utf8Name, openFlags);
 
-      LOG(4, ("%s: Couldn't open file \"%s\": %s\n", __FUNCTION__,
-              node.utf8Name, strerror(errno)));
-      status = error;
-      goto exit;
+      if (newFd < 0) {
+         int error = errno;
+
+         LOG(4, ("%s: Couldn't open file \"%s\": %s\n", __FUNCTION__,
+                 node.utf8Name, strerror(errno)));
+         status = error;
+         goto exit;
+      }
+
+#ifdef HGFS_FD_CACHE
+      if (shareable) {
+         struct stat fileStat;
+
+         if (fstat(newFd, &fileStat) == 0 && S_ISREG(fileStat.st_mode) &&
+             fileStat.st_dev == node.localId.volumeId &&
+             fileStat.st_ino == node.localId.fileId) {
+            HgfsFdCacheAdd(newFd, fileStat.st_dev, fileStat.st_ino, openFlags);
+         }
+      }
+#endif
    }
 
    /*
@@ -903,6 +1329,9 @@ HgfsPlatformValidateOpen(HgfsFileOpenInfo *openInfo, // IN: Open info struct
    HgfsLockType serverLock;
    HgfsInternalStatus status = 0;
    Bool needToSetAttribute = FALSE;
+#ifdef HGFS_FD_CACHE
+   Bool shareable;
+#endif
 
    ASSERT(openInfo);
    ASSERT(localId);
@@ -1034,34 +1463,66 @@ HgfsPlatformValidateOpen(HgfsFileOpenInfo *openInfo, // IN: Open info struct
       }
    }
 
+   fd = -1;
+
+#ifdef HGFS_FD_CACHE
    /*
-    * Try to open the file with the requested mode, flags and permissions.
+    * Share a descriptor already open on the same file with the same flags if
+    * this open allows it.
     */
-   fd = Posix_Open(openInfo->utf8Name,
-                   openMode | openFlags,
-                   openPerms);
-   if (fd < 0) {
-      status = errno;
-      if (status == EAGAIN) {
-         /*
-          * We have tried opening with O_NONBLOCK but looks like an incompatible
-          * lease may be held on the file. Tell the client that this access mode
-          * is not allowed currently.
-          */
-         status = EACCES;
+   serverLock = (openInfo->mask & HGFS_OPEN_VALID_SERVER_LOCK) ?
+                openInfo->desiredLock : HGFS_LOCK_NONE;
+   shareable = HgfsFdCacheIsShareable(openMode | openFlags,
+                                      (HGFS_OPEN_MODE_FLAGS(openInfo->mode) &
+                                       HGFS_OPEN_SEQUENTIAL) != 0,
+                                      serverLock);
+   if (shareable) {
+      if ((followSymlinks ? Posix_Stat(openInfo->utf8Name, &fileStat) :
+                            Posix_Lstat(openInfo->utf8Name, &fileStat)) == 0 &&
+          S_ISREG(fileStat.st_mode)) {
+         fd = HgfsFdCacheGet(openInfo->utf8Name, fileStat.st_dev,
+                             fileStat.st_ino, openMode | openFlags);
       }
-      LOG(4, ("%s: Error: open file \"%s\": %d %s\n", __FUNCTION__,
-              openInfo->utf8Name, status, strerror(status)));
-      goto exit;
    }
+#endif
 
-   /* Stat file to get its volume and file info */
-   if (fstat(fd, &fileStat) < 0) {
-      status = errno;
-      LOG(4, ("%s: Error: stat file\"%s\": %d %s\n", __FUNCTION__,
-              openInfo->utf8Name, status, strerror(status)));
-      close(fd);
-      goto exit;
+   if (fd < 0) {
+      /*
+       * Try to open the file with the requested mode, flags and permissions.
+       */
+      fd = Posix_Open(openInfo->utf8Name,
+                      openMode | openFlags,
+                      openPerms);
+      if (fd < 0) {
+         status = errno;
+         if (status == EAGAIN) {
+            /*
+             * We have tried opening with O_NONBLOCK but looks like an incompatible
+             * lease may be held on the file. Tell the client that this access mode
+             * is not allowed currently.
+             */
+            status = EACCES;
+         }
+         LOG(4, ("%s: Error: open file \"%s\": %d %s\n", __FUNCTION__,
+                 openInfo->utf8Name, status, strerror(status)));
+         goto exit;
+      }
+
+      /* Stat file to get its volume and file info */
+      if (fstat(fd, &fileStat) < 0) {
+         status = errno;
+         LOG(4, ("%s: Error: stat file\"%s\": %d %s\n", __FUNCTION__,
+                 openInfo->utf8Name, status, strerror(status)));
+         close(fd);
+         goto exit;
+      }
+
+#ifdef HGFS_FD_CACHE
+      if (shareable && S_ISREG(fileStat.st_mode)) {
+         HgfsFdCacheAdd(fd, fileStat.st_dev, fileStat.st_ino,
+                        openMode | openFlags);
+      }
+#endif
    }
 
    /* Set the rest of the Windows specific attributes if necessary. */
@@ -1396,6 +1857,207 @@ HgfsGetHiddenAttr(char const *fileName,         // IN:  Input filename
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseCacheFind --
+ *
+ *    Find the case insensitive lookup cache of a share, optionally creating it.
+ *
+ *    Called with gHgfsCaseCacheLock held.
+ *
+ * Results:
+ *    The cache, or NULL if not found and not created.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsCaseCache *
+HgfsCaseCacheFind(const char *sharePath,  // IN
+                  Bool create)            // IN
+{
+   DblLnkLst_Links *link;
+   HgfsCaseCache *cache;
+
+   DblLnkLst_ForEach(link, &gHgfsCaseCaches) {
+      cache = DblLnkLst_Container(link, HgfsCaseCache, links);
+      if (strcmp(cache->sharePath, sharePath) == 0) {
+         return cache;
+      }
+   }
+
+   if (!create) {
+      return NULL;
+   }
+
+   cache = Util_SafeCalloc(1, sizeof *cache);
+   DblLnkLst_Init(&cache->links);
+   DblLnkLst_Init(&cache->lruList);
+   cache->sharePath = Util_SafeStrdup(sharePath);
+   cache->entries = HashTable_Alloc(HGFS_CASE_CACHE_MAX_ENTRIES,
+                                    HASH_STRING_KEY, NULL);
+   DblLnkLst_LinkLast(&gHgfsCaseCaches, &cache->links);
+   return cache;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseCacheRemoveEntry --
+ *
+ *    Remove an entry from a case insensitive lookup cache and free it.
+ *
+ *    Called with gHgfsCaseCacheLock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCaseCacheRemoveEntry(HgfsCaseCache *cache,       // IN
+                         HgfsCaseCacheEntry *entry)  // IN
+{
+   HashTable_Delete(cache->entries, entry->foldedPath);
+   DblLnkLst_Unlink1(&entry->lruLinks);
+   cache->numEntries--;
+   free(entry->foldedPath);
+   free(entry->realName);
+   free(entry);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseCacheGet --
+ *
+ *    Look up the real name of the last component of a case folded path.
+ *
+ * Results:
+ *    Allocated real name of the component or NULL if not cached.
+ *
+ * Side effects:
+ *    Marks the entry as most recently used.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+HgfsCaseCacheGet(const char *sharePath,   // IN
+                 const char *foldedPath)  // IN: relative to sharePath
+{
+   HgfsCaseCache *cache;
+   HgfsCaseCacheEntry *entry;
+   char *realName = NULL;
+
+   MXUser_AcquireExclLock(gHgfsCaseCacheLock);
+   cache = HgfsCaseCacheFind(sharePath, FALSE);
+   if (cache != NULL &&
+       HashTable_Lookup(cache->entries, foldedPath, (void **)&entry)) {
+      DblLnkLst_Unlink1(&entry->lruLinks);
+      DblLnkLst_LinkFirst(&cache->lruList, &entry->lruLinks);
+      realName = Util_SafeStrdup(entry->realName);
+   }
+   MXUser_ReleaseExclLock(gHgfsCaseCacheLock);
+
+   return realName;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseCachePut --
+ *
+ *    Record the real name of the last component of a case folded path,
+ *    evicting the least recently used entry if the cache is full.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCaseCachePut(const char *sharePath,   // IN
+                 const char *foldedPath,  // IN: relative to sharePath
+                 const char *realName)    // IN
+{
+   HgfsCaseCache *cache;
+   HgfsCaseCacheEntry *entry;
+
+   MXUser_AcquireExclLock(gHgfsCaseCacheLock);
+   cache = HgfsCaseCacheFind(sharePath, TRUE);
+
+   if (HashTable_Lookup(cache->entries, foldedPath, (void **)&entry)) {
+      HgfsCaseCacheRemoveEntry(cache, entry);
+   }
+
+   if (cache->numEntries >= HGFS_CASE_CACHE_MAX_ENTRIES) {
+      HgfsCaseCacheRemoveEntry(cache,
+                               DblLnkLst_Container(cache->lruList.prev,
+                                                   HgfsCaseCacheEntry,
+                                                   lruLinks));
+   }
+
+   entry = Util_SafeMalloc(sizeof *entry);
+   DblLnkLst_Init(&entry->lruLinks);
+   entry->foldedPath = Util_SafeStrdup(foldedPath);
+   entry->realName = Util_SafeStrdup(realName);
+   /* The key is not copied by the table, it points into the entry. */
+   HashTable_Insert(cache->entries, entry->foldedPath, entry);
+   DblLnkLst_LinkFirst(&cache->lruList, &entry->lruLinks);
+   cache->numEntries++;
+
+   MXUser_ReleaseExclLock(gHgfsCaseCacheLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseCacheRemove --
+ *
+ *    Drop a stale entry from the case insensitive lookup cache.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCaseCacheRemove(const char *sharePath,   // IN
+                    const char *foldedPath)  // IN: relative to sharePath
+{
+   HgfsCaseCache *cache;
+   HgfsCaseCacheEntry *entry;
+
+   MXUser_AcquireExclLock(gHgfsCaseCacheLock);
+   cache = HgfsCaseCacheFind(sharePath, FALSE);
+   if (cache != NULL &&
+       HashTable_Lookup(cache->entries, foldedPath, (void **)&entry)) {
+      HgfsCaseCacheRemoveEntry(cache, entry);
+   }
+   MXUser_ReleaseExclLock(gHgfsCaseCacheLock);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1608,6 +2270,8 @@ HgfsCaseInsensitiveLookup(const char *sharePath,           // IN
    size_t curDirSize;
    char *convertedComponent = NULL;
    size_t convertedComponentSize = 0;
+   char *foldedPath = NULL;
+   Bool cacheable = TRUE;
    int error = 0;
 
    ASSERT(sharePath);
@@ -1646,6 +2310,64 @@ HgfsCaseInsensitiveLookup(const char *sharePath,           // IN
          *nextComponent = '\0';
       }
 
+      /*
+       * Build the case folded path of the component, which is the cache key.
+       * Components which are not valid unicode are not cached.
+       */
+      if (cacheable) {
+         char *foldedComponent = NULL;
+
+         if (Unicode_IsBufferValid(currentComponent, -1, STRING_ENCODING_UTF8)) {
+            foldedComponent = Unicode_FoldCase(currentComponent);
+         }
+         if (foldedComponent == NULL) {
+            cacheable = FALSE;
+            free(foldedPath);
+            foldedPath = NULL;
+         } else if (foldedPath == NULL) {
+            foldedPath = foldedComponent;
+         } else {
+            char *p = Str_SafeAsprintf(NULL, "%s%c%s", foldedPath, DIRSEPC,
+                                       foldedComponent);
+            free(foldedComponent);
+            free(foldedPath);
+            foldedPath = p;
+         }
+      }
+
+      /*
+       * Use the cached name if it still exists, otherwise drop the entry
+       * and scan the directory.
+       */
+      if (foldedPath != NULL) {
+         convertedComponent = HgfsCaseCacheGet(sharePath, foldedPath);
+         if (convertedComponent != NULL) {
+            size_t curDirLen = curDirSize - 1;
+            struct stat statBuf;
+
+            error = HgfsConstructConvertedPath(&curDir, &curDirSize,
+                                               convertedComponent,
+                                               strlen(convertedComponent) + 1);
+            free(convertedComponent);
+            convertedComponent = NULL;
+            if (error) {
+               if (nextComponent != NULL) {
+                  *nextComponent = DIRSEPC;
+               }
+               break;
+            }
+            if (Posix_Lstat(curDir, &statBuf) == 0) {
+               if (nextComponent != NULL) {
+                  *nextComponent = DIRSEPC;
+               }
+               goto nextComponent;
+            }
+            curDir[curDirLen] = '\0';
+            curDirSize = curDirLen + 1;
+            HgfsCaseCacheRemove(sharePath, foldedPath);
+         }
+      }
+
       /*
        * Try to match the current component against the one in curDir.
        * HgfsConvertComponentCase may return ENOENT. In that case return
@@ -1682,10 +2404,15 @@ HgfsCaseInsensitiveLookup(const char *sharePath,           // IN
          break;
       }
 
+      if (foldedPath != NULL) {
+         HgfsCaseCachePut(sharePath, foldedPath, convertedComponent);
+      }
+
       /* Free the converted component. */
       free(convertedComponent);
       convertedComponent = NULL;
 
+nextComponent:
       /* If there is no component after the current one then we are done. */
       if (nextComponent == NULL) {
          /* Set success. */
@@ -1714,6 +2441,7 @@ exit:
       free(curDir);
    }
    free(convertedComponent);
+   free(foldedPath);
    return error;
 }
 
@@ -2024,6 +2752,77 @@ HgfsFStat(int fd,                 // IN: file descriptor
 }
 
 
+#if defined(linux)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsStatAt --
+ *
+ *    Stat a directory entry relative to the open directory, used to gather
+ *    the attributes of all entries while scanning a directory.
+ *
+ *    statx(2) is used when available with AT_STATX_DONT_SYNC, so that network
+ *    file systems may answer from their attribute cache. Falls back to
+ *    fstatat(2) on older kernels.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsStatAt(int dirFd,               // IN: directory file descriptor
+           const char *name,        // IN: entry name
+           Bool followLink,         // IN: If true then follow symlink
+           struct stat *stats)      // OUT: file attributes
+{
+#if defined(STATX_BASIC_STATS) && defined(AT_STATX_DONT_SYNC)
+   static Bool statxUnsupported = FALSE;
+
+   if (!statxUnsupported) {
+      struct statx stx;
+      int flags = AT_STATX_DONT_SYNC | (followLink ? 0 : AT_SYMLINK_NOFOLLOW);
+
+      if (statx(dirFd, name, flags, STATX_BASIC_STATS, &stx) == 0) {
+         memset(stats, 0, sizeof *stats);
+         stats->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+         stats->st_ino = stx.stx_ino;
+         stats->st_mode = stx.stx_mode;
+         stats->st_nlink = stx.stx_nlink;
+         stats->st_uid = stx.stx_uid;
+         stats->st_gid = stx.stx_gid;
+         stats->st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+         stats->st_size = stx.stx_size;
+         stats->st_blksize = stx.stx_blksize;
+         stats->st_blocks = stx.stx_blocks;
+         stats->st_atim.tv_sec = stx.stx_atime.tv_sec;
+         stats->st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+         stats->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+         stats->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+         stats->st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+         stats->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+         return 0;
+      }
+      if (errno != ENOSYS) {
+         return errno;
+      }
+      statxUnsupported = TRUE;
+   }
+#endif
+
+   if (fstatat(dirFd, name, stats, followLink ? 0 : AT_SYMLINK_NOFOLLOW) < 0) {
+      return errno;
+   }
+   return 0;
+}
+#endif
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -2152,19 +2951,12 @@ HgfsGetSequentialOnlyFlagFromFd(int fd,                     // IN
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsPlatformGetattrFromName --
+ * HgfsGetattrFromStats --
  *
- *    Performs a stat operation on the given filename, and, if it is a symlink,
- *    allocates the target filename on behalf of the caller and performs a
- *    readlink to get it. If not a symlink, the targetName argument is
- *    untouched. Does necessary translation between Unix file stats and the
- *    HgfsFileAttrInfo formats.
- *    NOTE: The function is different from HgfsGetAttrFromId: this function returns
- *    effectve permissions while HgfsGetAttrFromId does not.
- *    The reason for this asymmetry is that effective permissions are needed
- *    to get a new handle. If the file is already opened then
- *    getting effective permissions does not have any value. However getting
- *    effective permissions would hurt perfomance and should be avoided.
+ *    Translates the stat of a file, already obtained by the caller, into the
+ *    HgfsFileAttrInfo format. If it is a symlink, allocates the target filename
+ *    on behalf of the caller and performs a readlink to get it. Also returns
+ *    the hidden flag and effective permissions of the file.
  *
  * Results:
  *    Zero on success.
@@ -2176,36 +2968,24 @@ HgfsGetSequentialOnlyFlagFromFd(int fd,                     // IN
  *-----------------------------------------------------------------------------
  */
 
-HgfsInternalStatus
-HgfsPlatformGetattrFromName(char *fileName,                 // IN/OUT:  Input filename
-                            HgfsShareOptions configOptions, // IN: Share config options
-                            char *shareName,                // IN: Share name
-                            HgfsFileAttrInfo *attr,         // OUT: Struct to copy into
-                            char **targetName)              // OUT: Symlink target
+static HgfsInternalStatus
+HgfsGetattrFromStats(char *fileName,                 // IN: Input filename
+                     const struct stat *fileStats,   // IN: stat of the file
+                     HgfsShareOptions configOptions, // IN: Share config options
+                     char *shareName,                // IN: Share name
+                     HgfsFileAttrInfo *attr,         // OUT: Struct to copy into
+                     char **targetName)              // OUT: Symlink target
 {
    HgfsInternalStatus status = 0;
-   struct stat stats;
+   struct stat stats = *fileStats;
    int error;
    char *myTargetName = NULL;
    uint64 creationTime;
    Bool followSymlinks;
 
-   ASSERT(fileName);
-   ASSERT(attr);
-
-   LOG(4, ("%s: getting attrs for \"%s\"\n", __FUNCTION__, fileName));
    followSymlinks = HgfsServerPolicy_IsShareOptionSet(configOptions,
-                                                      HGFS_SHARE_FOLLOW_SYMLINKS),
-
-   error = HgfsStat(fileName,
-                    followSymlinks,
-                    &stats,
-                    &creationTime);
-   if (error) {
-      status = errno;
-      LOG(4, ("%s: error stating file: %s\n", __FUNCTION__, strerror(status)));
-      goto exit;
-   }
+                                                      HGFS_SHARE_FOLLOW_SYMLINKS);
+   creationTime = HgfsGetCreationTime(&stats);
 
    /*
     * Deal with the file type returned from lstat(2). We currently support
@@ -2353,9 +3133,65 @@ HgfsPlatformGetattrFromName(char *fileName,                 // IN/OUT:  Input fi
       }
    }
 
-exit:
-   free(myTargetName);
-   return status;
+exit:
+   free(myTargetName);
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformGetattrFromName --
+ *
+ *    Performs a stat operation on the given filename, and, if it is a symlink,
+ *    allocates the target filename on behalf of the caller and performs a
+ *    readlink to get it. If not a symlink, the targetName argument is
+ *    untouched. Does necessary translation between Unix file stats and the
+ *    HgfsFileAttrInfo formats.
+ *    NOTE: The function is different from HgfsGetAttrFromId: this function returns
+ *    effectve permissions while HgfsGetAttrFromId does not.
+ *    The reason for this asymmetry is that effective permissions are needed
+ *    to get a new handle. If the file is already opened then
+ *    getting effective permissions does not have any value. However getting
+ *    effective permissions would hurt perfomance and should be avoided.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformGetattrFromName(char *fileName,                 // IN/OUT:  Input filename
+                            HgfsShareOptions configOptions, // IN: Share config options
+                            char *shareName,                // IN: Share name
+                            HgfsFileAttrInfo *attr,         // OUT: Struct to copy into
+                            char **targetName)              // OUT: Symlink target
+{
+   struct stat stats;
+   uint64 creationTime;
+   Bool followSymlinks;
+
+   ASSERT(fileName);
+   ASSERT(attr);
+
+   LOG(4, ("%s: getting attrs for \"%s\"\n", __FUNCTION__, fileName));
+   followSymlinks = HgfsServerPolicy_IsShareOptionSet(configOptions,
+                                                      HGFS_SHARE_FOLLOW_SYMLINKS);
+
+   if (HgfsStat(fileName, followSymlinks, &stats, &creationTime)) {
+      HgfsInternalStatus status = errno;
+      LOG(4, ("%s: error stating file: %s\n", __FUNCTION__, strerror(status)));
+      return status;
+   }
+
+   return HgfsGetattrFromStats(fileName, &stats, configOptions, shareName, attr,
+                               targetName);
 }
 
 /*
@@ -2379,6 +3215,7 @@ exit:
 
 HgfsInternalStatus
 HgfsPlatformGetattrFromFd(fileDesc fileDesc,        // IN:  file descriptor
+                          HgfsHandle handle,        // IN:  HGFS file handle
                           HgfsSessionInfo *session, // IN:  session info
                           HgfsFileAttrInfo *attr)   // OUT: FileAttrInfo to copy into
 {
@@ -2386,7 +3223,6 @@ HgfsPlatformGetattrFromFd(fileDesc fileDesc,        // IN:  file descriptor
    struct stat stats;
    int error;
    HgfsOpenMode shareMode;
-   HgfsHandle handle = HGFS_INVALID_HANDLE;
    char *fileName = NULL;
    size_t fileNameLen;
    uint64 creationTime;
@@ -2431,12 +3267,6 @@ HgfsPlatformGetattrFromFd(fileDesc fileDesc,        // IN:  file descriptor
     * are cached, for setting attributes, renaming and deletion.
     */
 
-   if (!HgfsFileDesc2Handle(fileDesc, session, &handle)) {
-      LOG(4, ("%s: could not get HGFS handle for fd %u\n", __FUNCTION__, fileDesc));
-      status = EBADF;
-      goto exit;
-   }
-
    if (!HgfsHandle2ShareMode(handle, session, &shareMode)) {
       LOG(4, ("%s: could not get share mode fd %u\n", __FUNCTION__, fileDesc));
       status = EBADF;
@@ -3519,12 +4349,8 @@ HgfsPlatformGetDirEntry(HgfsSearch *search,               // IN: search
          goto out;
       }
 
-      /*
-       * Yes, there are more members than this in a dirent. But if you look
-       * at the top of hgfsServerInt.h, you'll see that on Windows we only
-       * define d_reclen and d_name, as those are the only fields we need.
-       */
-      dent->d_reclen = originalDent->d_reclen;
+      /* Copy the fixed fields, including any cached attributes, and the name. */
+      memcpy(dent, originalDent, offsetof(DirectoryEntry, d_name));
       memcpy(dent->d_name, originalDent->d_name, nameLen);
       dent->d_name[nameLen] = 0;
    }
@@ -3610,9 +4436,25 @@ HgfsPlatformSetDirEntry(HgfsSearch *search,              // IN: partially valid
              * But isn't this handle sharing always desirable?
              */
             if (HgfsFileHasServerLock(fullName, session, &serverLock, &fileDesc)) {
+               HgfsHandle handle;
+
                LOG(4, ("%s: Reusing existing oplocked handle "
                         "to avoid oplock break deadlock\n", __FUNCTION__));
-               status = HgfsPlatformGetattrFromFd(fileDesc, session, entryAttr);
+               if (HgfsFileDesc2Handle(fileDesc, session, &handle)) {
+                  status = HgfsPlatformGetattrFromFd(fileDesc, handle, session,
+                                                     entryAttr);
+               } else {
+                  status = EBADF;
+               }
+#if defined(linux)
+            } else if (dirEntry->d_statValid &&
+                       Hostinfo_SystemTimerMS() - dirEntry->d_statTime <
+                          HGFS_SEARCH_ATTR_MAX_AGE_MS) {
+               /* Recent attributes gathered by HgfsPlatformScandir. */
+               status = HgfsGetattrFromStats(fullName, &dirEntry->d_stat,
+                                             configOptions, search->utf8ShareName,
+                                             entryAttr, NULL);
+#endif
             } else {
                status = HgfsPlatformGetattrFromName(fullName, configOptions,
                                                     search->utf8ShareName,
@@ -3826,12 +4668,32 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
    while ((result = getdents(fd, (void *)buffer, sizeof buffer)) > 0) {
       size_t offset = 0;
       while (offset < result) {
+         DirectoryRecord *record;
          DirectoryEntry *newDent, **newDents;
 
-         newDent = (DirectoryEntry *)(buffer + offset);
+         record = (DirectoryRecord *)(buffer + offset);
 
          /* This dent had better fit in the actual space we've got left. */
-         ASSERT(newDent->d_reclen <= result - offset);
+         ASSERT(record->d_reclen <= result - offset);
+
+         /*
+          * Bump the offset to the batched buffer to process the next dent
+          * within it.
+          */
+         offset += record->d_reclen;
+
+         if (!HgfsConvertToUtf8FormC(record->d_name,
+                                     record->d_reclen - offsetof(DirectoryRecord, d_name))) {
+            /*
+             * XXX:
+             *    HGFS discards all file names that can't be converted to utf8.
+             *    It is not desirable since it causes many problems like
+             *    failure to delete directories which contain such files.
+             *    Need to change this to a more reasonable behavior, similar
+             *    to name escaping which is used to deal with illegal file names.
+             */
+            continue;
+         }
 
          /* Add another dent pointer to the dents array. */
          newDents = realloc(myDents, sizeof *myDents * (myNumDents + 1));
@@ -3841,36 +4703,43 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
          }
          myDents = newDents;
 
+#if defined(linux)
+         {
+            size_t nameLen = strlen(record->d_name);
+            size_t dentSize = offsetof(DirectoryEntry, d_name) + nameLen + 1;
+
+            newDent = malloc(dentSize);
+            if (newDent == NULL) {
+               status = ENOMEM;
+               goto exit;
+            }
+            newDent->d_ino = record->d_ino;
+            newDent->d_off = record->d_off;
+            newDent->d_reclen = dentSize;
+            newDent->d_type = record->d_type;
+            memcpy(newDent->d_name, record->d_name, nameLen + 1);
+
+            /*
+             * Gather the attributes now, while the directory is open, instead
+             * of a separate stat by full path for each entry on search read.
+             */
+            newDent->d_statValid = HgfsStatAt(fd, newDent->d_name, followSymlinks,
+                                              &newDent->d_stat) == 0;
+            newDent->d_statTime = Hostinfo_SystemTimerMS();
+         }
+#else
          /*
           * Allocate the new dent and set it up. We do a straight memcpy of
           * the entire record to avoid dealing with platform-specific fields.
           */
-         myDents[myNumDents] = malloc(newDent->d_reclen);
-         if (myDents[myNumDents] == NULL) {
+         newDent = malloc(record->d_reclen);
+         if (newDent == NULL) {
             status = ENOMEM;
             goto exit;
          }
-
-         if (HgfsConvertToUtf8FormC(newDent->d_name,
-                                    newDent->d_reclen - offsetof(DirectoryEntry, d_name))) {
-            memcpy(myDents[myNumDents], newDent, newDent->d_reclen);
-            /*
-             * Dent is done. Bump the offset to the batched buffer to process the
-             * next dent within it.
-             */
-            myNumDents++;
-         } else {
-            /*
-             * XXX:
-             *    HGFS discards all file names that can't be converted to utf8.
-             *    It is not desirable since it causes many problems like
-             *    failure to delete directories which contain such files.
-             *    Need to change this to a more reasonable behavior, similar
-             *    to name escaping which is used to deal with illegal file names.
-             */
-            free(myDents[myNumDents]);
-         }
-         offset += newDent->d_reclen;
+         memcpy(newDent, record, record->d_reclen);
+#endif
+         myDents[myNumDents++] = newDent;
       }
    }
 
@@ -4034,6 +4903,8 @@ HgfsPlatformScanvdir(HgfsServerResEnumGetFunc enumNamesGet,   // IN: Function to
          LOG(4, ("%s:  Error: allocate dentry memory ret %u\n", __FUNCTION__, status));
          goto exit;
       }
+      /* Virtual entries have no cached attributes. */
+      memset(currentEntry, 0, offsetof(DirectoryEntry, d_name));
       currentEntry->d_reclen = (unsigned short)currentEntryLen;
       memcpy(currentEntry->d_name, currentEntryName, currentEntryNameLen);
       currentEntry->d_name[currentEntryNameLen] = 0;
@@ -4141,6 +5012,7 @@ exit:
 
 HgfsInternalStatus
 HgfsPlatformReadFile(fileDesc file,               // IN: file descriptor
+                     HgfsHandle handle,           // IN: HGFS file handle
                      HgfsSessionInfo *session,    // IN: session info
                      uint64 offset,               // IN: file offset to read from
                      uint32 requiredSize,         // IN: length of data to read
@@ -4149,7 +5021,6 @@ HgfsPlatformReadFile(fileDesc file,               // IN: file descriptor
 {
    int error;
    HgfsInternalStatus status = 0;
-   HgfsHandle handle;
    Bool sequentialOpen;
 
    ASSERT(session);
@@ -4158,11 +5029,6 @@ HgfsPlatformReadFile(fileDesc file,               // IN: file descriptor
    LOG(4, ("%s: read fh %u, offset %"FMT64"u, count %u\n", __FUNCTION__,
            file, offset, requiredSize));
 
-   if (!HgfsFileDesc2Handle(file, session, &handle)) {
-      LOG(4, ("%s: Could not get file handle\n", __FUNCTION__));
-      return EBADF;
-   }
-
    if (!HgfsHandleIsSequentialOpen(handle, session, &sequentialOpen)) {
       LOG(4, ("%s: Could not get sequenial open status\n", __FUNCTION__));
       return EBADF;
@@ -4222,6 +5088,117 @@ HgfsPlatformReadFile(fileDesc file,               // IN: file descriptor
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformReadFileV --
+ *
+ *    Reads data from a file directly into a set of buffers, such as the
+ *    mapped iovs of a data packet, avoiding an intermediate copy.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformReadFileV(fileDesc file,               // IN: file descriptor
+                      HgfsHandle handle,           // IN: HGFS file handle
+                      HgfsSessionInfo *session,    // IN: session info
+                      uint64 offset,               // IN: file offset to read from
+                      uint32 requiredSize,         // IN: length of data to read
+                      HgfsVmxIov *iov,             // OUT: buffers for the read data
+                      uint32 iovCount,             // IN: number of buffers
+                      uint32 *actualSize)          // OUT: actual length read
+{
+#if defined(__linux__)
+   struct iovec vec[HGFS_READV_MAX_IOVS];
+   HgfsInternalStatus status = 0;
+   Bool sequentialOpen;
+   uint32 totalRead = 0;
+   uint32 i = 0;
+
+   ASSERT(session);
+
+   LOG(4, ("%s: read fh %u, offset %"FMT64"u, count %u, %u iovs\n", __FUNCTION__,
+           file, offset, requiredSize, iovCount));
+
+   if (!HgfsHandleIsSequentialOpen(handle, session, &sequentialOpen)) {
+      LOG(4, ("%s: Could not get sequenial open status\n", __FUNCTION__));
+      return EBADF;
+   }
+
+   /* Read in batches of at most HGFS_READV_MAX_IOVS buffers. */
+   while (i < iovCount && totalRead < requiredSize) {
+      uint32 batchSize = 0;
+      int vecCount = 0;
+      ssize_t result;
+
+      while (i + vecCount < iovCount && vecCount < ARRAYSIZE(vec) &&
+             totalRead + batchSize < requiredSize) {
+         uint32 len = MIN(iov[i + vecCount].len,
+                          requiredSize - totalRead - batchSize);
+
+         vec[vecCount].iov_base = iov[i + vecCount].va;
+         vec[vecCount].iov_len = len;
+         batchSize += len;
+         vecCount++;
+      }
+
+      if (sequentialOpen) {
+         result = readv(file, vec, vecCount);
+      } else {
+         result = preadv(file, vec, vecCount, offset + totalRead);
+      }
+      if (result < 0) {
+         status = errno;
+         LOG(4, ("%s: error reading from file: %s\n", __FUNCTION__,
+                 strerror(status)));
+         return status;
+      }
+
+      totalRead += result;
+      if (result < batchSize) {
+         /* End of file or a short read from a pipe. */
+         break;
+      }
+      i += vecCount;
+   }
+
+   LOG(4, ("%s: read %u bytes\n", __FUNCTION__, totalRead));
+   *actualSize = totalRead;
+   return status;
+#else
+   HgfsInternalStatus status = 0;
+   uint32 totalRead = 0;
+   uint32 i;
+
+   for (i = 0; i < iovCount && totalRead < requiredSize; i++) {
+      uint32 len = MIN(iov[i].len, requiredSize - totalRead);
+      uint32 bytesRead;
+
+      status = HgfsPlatformReadFile(file, handle, session, offset + totalRead,
+                                    len, iov[i].va, &bytesRead);
+      if (status != 0) {
+         return status;
+      }
+      totalRead += bytesRead;
+      if (bytesRead < len) {
+         break;
+      }
+   }
+
+   *actualSize = totalRead;
+   return status;
+#endif
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -4241,6 +5218,7 @@ HgfsPlatformReadFile(fileDesc file,               // IN: file descriptor
 
 HgfsInternalStatus
 HgfsPlatformWriteFile(fileDesc writeFd,            // IN: file descriptor
+                      HgfsHandle writeHandle,      // IN: HGFS file handle
                       HgfsSessionInfo *session,    // IN: session info
                       uint64 writeOffset,          // IN: file offset to write to
                       uint32 writeDataSize,        // IN: length of data to write
@@ -4322,13 +5300,286 @@ HgfsPlatformWriteFile(fileDesc writeFd,            // IN: file descriptor
       LOG(4, ("%s: error writing to file: %s\n", __FUNCTION__,
          strerror(status)));
    } else {
+      uint64 flushOffset;
+      uint64 flushLength;
+
       *writtenSize = error;
       LOG(4, ("%s: wrote %d bytes\n", __FUNCTION__, *writtenSize));
+
+      if (HgfsHandleTrackWrite(writeHandle, session, writeOffset, *writtenSize,
+                               &flushOffset, &flushLength) &&
+          flushLength != 0) {
+         HgfsPlatformWriteBehind(writeFd, flushOffset, flushLength);
+      }
    }
    return status;
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsExtentRunLength --
+ *
+ *    Counts the extents starting at the given one which are adjacent in the
+ *    file, so they can be transferred by a single vectored I/O call, and sets
+ *    up an iovec for each of them over the packed extent data.
+ *
+ * Results:
+ *    The number of extents in the run, at least one.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsExtentRunLength(const HgfsIoExtentV4 *extents, // IN: extents
+                    uint32 numExtents,             // IN: number of extents
+                    char *data,                    // IN: data of the first extent
+                    struct iovec *vec,             // OUT: iovecs for the run
+                    size_t *runSize)               // OUT: bytes in the run
+{
+   uint32 count = 0;
+   size_t size = 0;
+
+   do {
+      vec[count].iov_base = data + size;
+      vec[count].iov_len = extents[count].length;
+      size += extents[count].length;
+      count++;
+   } while (count < numExtents &&
+            extents[count].offset == extents[count - 1].offset +
+                                     extents[count - 1].length);
+
+   *runSize = size;
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformReadExtents --
+ *
+ *    Reads a list of file extents into a buffer where they are packed one
+ *    after another. Each run of extents adjacent in the file is read with a
+ *    single FileIO_Preadv call. An extent that is read short leaves the rest
+ *    of its space in the buffer unused.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformReadExtents(fileDesc file,                  // IN: file descriptor
+                        HgfsHandle handle,              // IN: HGFS file handle
+                        HgfsSessionInfo *session,       // IN: session info
+                        const HgfsIoExtentV4 *extents,  // IN: extents to read
+                        uint32 numExtents,              // IN: number of extents
+                        void *payload,                  // OUT: buffer for the data
+                        uint32 *extentSizes,            // OUT: bytes read per extent
+                        uint32 *actualSize)             // OUT: total bytes read
+{
+   struct iovec vec[HGFS_VECTORED_IO_MAX_EXTENTS];
+   FileIODescriptor fd = FileIO_CreateFDPosix(file, O_RDONLY);
+   Bool sequentialOpen;
+   char *data = payload;
+   uint32 totalRead = 0;
+   uint32 i = 0;
+
+   ASSERT(session);
+   ASSERT(numExtents <= ARRAYSIZE(vec));
+
+   LOG(4, ("%s: read fh %u, %u extents\n", __FUNCTION__, file, numExtents));
+
+   if (!HgfsHandleIsSequentialOpen(handle, session, &sequentialOpen)) {
+      LOG(4, ("%s: Could not get sequenial open status\n", __FUNCTION__));
+      return EBADF;
+   }
+
+   if (sequentialOpen) {
+      LOG(4, ("%s: Extents cannot be read from a sequential handle\n",
+              __FUNCTION__));
+      return EINVAL;
+   }
+
+   while (i < numExtents) {
+      size_t runSize;
+      size_t bytesRead = 0;
+      uint32 runCount;
+      uint32 j;
+      FileIOResult fret;
+
+      runCount = HgfsExtentRunLength(&extents[i], numExtents - i, data,
+                                     vec, &runSize);
+      if (runSize != 0) {
+         errno = 0;
+         fret = FileIO_Preadv(&fd, vec, runCount, extents[i].offset, runSize,
+                              &bytesRead);
+         if (fret != FILEIO_SUCCESS && fret != FILEIO_READ_ERROR_EOF) {
+            HgfsInternalStatus status = (errno != 0) ? errno : EIO;
+
+            LOG(4, ("%s: error reading from file: %s\n", __FUNCTION__,
+                    strerror(status)));
+            return status;
+         }
+      }
+
+      /* Hand the bytes read out to the extents of the run in order. */
+      for (j = 0; j < runCount; j++) {
+         extentSizes[i + j] = MIN(extents[i + j].length, bytesRead);
+         bytesRead -= extentSizes[i + j];
+         totalRead += extentSizes[i + j];
+      }
+
+      data += runSize;
+      i += runCount;
+   }
+
+   LOG(4, ("%s: read %u bytes\n", __FUNCTION__, totalRead));
+   *actualSize = totalRead;
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformWriteExtents --
+ *
+ *    Writes a list of file extents from a buffer where they are packed one
+ *    after another. Each run of extents adjacent in the file is written with
+ *    a single FileIO_Pwritev call. Writing stops at the first extent which
+ *    is not written completely.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformWriteExtents(fileDesc writeFd,               // IN: file descriptor
+                         HgfsSessionInfo *session,       // IN: session info
+                         const HgfsIoExtentV4 *extents,  // IN: extents to write
+                         uint32 numExtents,              // IN: number of extents
+                         Bool writeSequential,           // IN: write is sequential
+                         Bool writeAppend,               // IN: write is appended
+                         const void *writeData,          // IN: data to be written
+                         uint32 *writtenSize)            // OUT: total bytes written
+{
+   struct iovec vec[HGFS_VECTORED_IO_MAX_EXTENTS];
+   FileIODescriptor fd = FileIO_CreateFDPosix(writeFd, O_WRONLY);
+   char *data = (char *)writeData;
+   uint32 totalWritten = 0;
+   uint32 i = 0;
+
+   ASSERT(numExtents <= ARRAYSIZE(vec));
+
+   LOG(4, ("%s: write fh %u, %u extents\n", __FUNCTION__, writeFd,
+           numExtents));
+
+   if (writeSequential || writeAppend) {
+      LOG(4, ("%s: Extents cannot be written to a sequential or append handle\n",
+              __FUNCTION__));
+      return EINVAL;
+   }
+
+#if !defined(sun)
+   for (i = 0; i < numExtents; i++) {
+      HgfsInternalStatus status = HgfsWriteCheckIORange(extents[i].offset,
+                                                        extents[i].length);
+      if (status != 0) {
+         return status;
+      }
+   }
+   i = 0;
+#endif
+
+   while (i < numExtents) {
+      size_t runSize;
+      size_t bytesWritten = 0;
+      uint32 runCount;
+      FileIOResult fret;
+
+      runCount = HgfsExtentRunLength(&extents[i], numExtents - i, data,
+                                     vec, &runSize);
+      if (runSize != 0) {
+         errno = 0;
+         fret = FileIO_Pwritev(&fd, vec, runCount, extents[i].offset, runSize,
+                               &bytesWritten);
+         totalWritten += bytesWritten;
+         if (fret == FILEIO_WRITE_ERROR_NOSPC && totalWritten != 0) {
+            /* Report the partial write, as write(2) would. */
+            break;
+         } else if (fret != FILEIO_SUCCESS) {
+            HgfsInternalStatus status;
+
+            if (fret == FILEIO_WRITE_ERROR_NOSPC) {
+               status = ENOSPC;
+            } else {
+               status = (errno != 0) ? errno : EIO;
+            }
+            LOG(4, ("%s: error writing to file: %s\n", __FUNCTION__,
+                    strerror(status)));
+            return status;
+         }
+      }
+
+      data += runSize;
+      i += runCount;
+   }
+
+   LOG(4, ("%s: wrote %u bytes\n", __FUNCTION__, totalWritten));
+   *writtenSize = totalWritten;
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformWriteBehind --
+ *
+ *    Starts write back of the dirty pages in the given range of the file
+ *    without waiting for it to complete, so that a sequential writer keeps
+ *    the disk busy instead of leaving all the dirty data to a later flush.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Asynchronous I/O may be started on the file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsPlatformWriteBehind(fileDesc file,   // IN: file descriptor
+                        uint64 offset,   // IN: start of the range
+                        uint64 length)   // IN: length of the range
+{
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+   if (sync_file_range(file, offset, length, SYNC_FILE_RANGE_WRITE) != 0) {
+      LOG(4, ("%s: fd %d offset %"FMT64"u length %"FMT64"u: %s\n",
+              __FUNCTION__, file, offset, length, strerror(errno)));
+   }
+#endif
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
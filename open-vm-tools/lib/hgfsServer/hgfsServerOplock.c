@@ -195,7 +195,7 @@ HgfsFileHasServerLock(const char *utf8Name,             // IN: Name in UTF8
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
    for (i = 0; i < session->numNodes; i++) {
-      HgfsFileNode *existingFileNode = &session->nodeArray[i];
+      HgfsFileNode *existingFileNode = HGFS_SESSION_NODE(session, i);
 
       if ((existingFileNode->state == FILENODE_STATE_IN_USE_CACHED) &&
           (existingFileNode->serverLock != HGFS_LOCK_NONE) &&
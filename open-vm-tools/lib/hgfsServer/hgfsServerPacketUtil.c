@@ -407,6 +407,75 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPU_GetDataPacketIov --
+ *
+ *    Map the data packet of an hgfs packet for in place access.
+ *
+ *    Unlike HSPU_GetDataPacketBuf, no contiguous buffer is allocated when the
+ *    data spans several iovs, so nothing needs to be copied. The caller
+ *    accesses the data through the returned iov mappings, which are released
+ *    by HSPU_PutDataPacketBuf.
+ *
+ * Results:
+ *    TRUE and the mapped iovs covering the data packet on success.
+ *    FALSE if the packet has no data buffer or it could not be mapped.
+ *
+ * Side effects:
+ *    Guest mappings are established.
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HSPU_GetDataPacketIov(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
+                      MappingType mappingType,              // IN: Writeable/Readable
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      HgfsVmxIov **iov,                     // OUT: mapped data iovs
+                      uint32 *iovCount)                     // OUT: mapped iov count
+{
+   HgfsChannelMapVirtAddrFunc mapVa;
+
+   ASSERT(iov != NULL);
+   ASSERT(iovCount != NULL);
+
+   if (packet->dataPacket != NULL || packet->dataPacketMappedIov != 0 ||
+       packet->dataPacketSize == 0 || chanCb == NULL) {
+      return FALSE;
+   }
+
+   if (mappingType == BUF_WRITEABLE ||
+       mappingType == BUF_READWRITEABLE) {
+      mapVa = chanCb->getWriteVa;
+   } else {
+      ASSERT(mappingType == BUF_READABLE);
+      mapVa = chanCb->getReadVa;
+   }
+
+   /* Looks like we are in the middle of poweroff. */
+   if (mapVa == NULL || chanCb->putVa == NULL) {
+      return FALSE;
+   }
+
+   if (!HSPUMapBuf(mapVa,
+                   chanCb->putVa,
+                   packet->dataPacketSize,
+                   packet->dataPacketIovIndex,
+                   packet->iovCount,
+                   packet->iov,
+                   &packet->dataPacketMappedIov)) {
+      /* Guest probably passed us bad physical address */
+      return FALSE;
+   }
+
+   packet->dataMappingType = mappingType;
+   *iov = &packet->iov[packet->dataPacketIovIndex];
+   *iovCount = packet->dataPacketMappedIov;
+   return TRUE;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -585,7 +654,8 @@ void
 HSPU_PutDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
                       HgfsServerChannelCallbacks *chanCb)   // IN: Channel callbacks
 {
-   if (packet->dataPacket == NULL) {
+   /* Mapped in place by HSPU_GetDataPacketIov if there is no buffer. */
+   if (packet->dataPacket == NULL && packet->dataPacketMappedIov == 0) {
       return;
    }
 
@@ -123,6 +123,8 @@ static HgfsCapability hgfsDefaultCapabilityTable[] =
    {HGFS_OP_UNLOCK_BYTE_RANGE_V4,  HGFS_REQUEST_NOT_SUPPORTED},
    {HGFS_OP_QUERY_EAS_V4,          HGFS_REQUEST_NOT_SUPPORTED},
    {HGFS_OP_SET_EAS_V4,            HGFS_REQUEST_NOT_SUPPORTED},
+   {HGFS_OP_READV_V4,              HGFS_REQUEST_NOT_SUPPORTED},
+   {HGFS_OP_WRITEV_V4,             HGFS_REQUEST_NOT_SUPPORTED},
 };
 
 
@@ -4525,6 +4527,16 @@ HgfsPackWriteReply(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
    *payloadSize = 0;
 
    switch (op) {
+   case HGFS_OP_WRITEV_V4: {
+      HgfsReplyWriteVV4 *reply;
+
+      reply = HgfsAllocInitReply(packet, packetHeader, sizeof *reply,
+                                 session);
+      reply->reserved = 0;
+      reply->actualSize = actualSize;
+      *payloadSize = sizeof *reply;
+      break;
+   }
    case HGFS_OP_WRITE_FAST_V4:
    case HGFS_OP_WRITE_V3: {
       HgfsReplyWriteV3 *reply;
@@ -4554,6 +4566,157 @@ HgfsPackWriteReply(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackIoExtentsV4 --
+ *
+ *    Unpack and validate the extent list of a vectored read or write request.
+ *    The extents are copied out of the request since the reply may be built
+ *    in the same buffer.
+ *
+ * Results:
+ *    TRUE on success.
+ *    FALSE if the list does not fit in the request or exceeds the limits.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsUnpackIoExtentsV4(const HgfsIoExtentV4 *requestExtents, // IN: request extents
+                      uint32 requestNumExtents,             // IN: request extent count
+                      size_t extentsSize,                   // IN: space for extents
+                      HgfsIoExtentV4 *extents,              // OUT: extents
+                      uint32 *numExtents,                   // OUT: extent count
+                      uint32 *totalSize)                    // OUT: total extent size
+{
+   uint64 size = 0;
+   uint32 i;
+
+   if (requestNumExtents == 0 ||
+       requestNumExtents > HGFS_VECTORED_IO_MAX_EXTENTS) {
+      LOG(4, ("%s: Invalid number of extents %u\n", __FUNCTION__,
+              requestNumExtents));
+      return FALSE;
+   }
+
+   if (requestNumExtents * sizeof *requestExtents > extentsSize) {
+      LOG(4, ("%s: HGFS packet too small\n", __FUNCTION__));
+      return FALSE;
+   }
+
+   for (i = 0; i < requestNumExtents; i++) {
+      extents[i] = requestExtents[i];
+      size += extents[i].length;
+   }
+
+   if (size > HGFS_VECTORED_IO_MAX) {
+      LOG(4, ("%s: Extents too large %"FMT64"u\n", __FUNCTION__, size));
+      return FALSE;
+   }
+
+   *numExtents = requestNumExtents;
+   *totalSize = (uint32)size;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackReadVRequest --
+ *
+ *    Unpack hgfs vectored read request to get the file handle and the list of
+ *    extents to read.
+ *
+ * Results:
+ *    TRUE on success.
+ *    FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackReadVRequest(const void *packet,         // IN: HGFS request
+                       size_t packetSize,          // IN: request packet size
+                       HgfsHandle *file,           // OUT: Handle to read from
+                       HgfsIoExtentV4 *extents,    // OUT: extents to read
+                       uint32 *numExtents,         // OUT: number of extents
+                       uint32 *totalSize)          // OUT: total size to read
+{
+   const HgfsRequestReadVV4 *request = packet;
+   size_t headerSize = offsetof(HgfsRequestReadVV4, extents);
+
+   ASSERT(packet);
+
+   LOG(4, ("%s: HGFS_OP_READV_V4\n", __FUNCTION__));
+   if (packetSize < headerSize ||
+       !HgfsUnpackIoExtentsV4(request->extents, request->numExtents,
+                              packetSize - headerSize, extents, numExtents,
+                              totalSize)) {
+      LOG(4, ("%s: Error decoding HGFS packet\n", __FUNCTION__));
+      return FALSE;
+   }
+
+   *file = request->file;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackWriteVRequest --
+ *
+ *    Unpack hgfs vectored write request to get the file handle, write flags
+ *    and the list of extents to write. The data to write is in the separate
+ *    data packet.
+ *
+ * Results:
+ *    TRUE on success.
+ *    FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackWriteVRequest(const void *packet,         // IN: HGFS request
+                        size_t packetSize,          // IN: request packet size
+                        HgfsHandle *file,           // OUT: Handle to write to
+                        HgfsWriteFlags *flags,      // OUT: write flags
+                        HgfsIoExtentV4 *extents,    // OUT: extents to write
+                        uint32 *numExtents,         // OUT: number of extents
+                        uint32 *totalSize)          // OUT: total size to write
+{
+   const HgfsRequestWriteVV4 *request = packet;
+   size_t headerSize = offsetof(HgfsRequestWriteVV4, extents);
+
+   ASSERT(packet);
+
+   LOG(4, ("%s: HGFS_OP_WRITEV_V4\n", __FUNCTION__));
+   if (packetSize < headerSize ||
+       !HgfsUnpackIoExtentsV4(request->extents, request->numExtents,
+                              packetSize - headerSize, extents, numExtents,
+                              totalSize)) {
+      LOG(4, ("%s: Error decoding HGFS packet\n", __FUNCTION__));
+      return FALSE;
+   }
+
+   *file = request->file;
+   *flags = request->flags;
+   return TRUE;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -297,6 +297,21 @@ HgfsUnpackWriteRequest(const void *writeRequest,// IN: HGFS write request params
                        HgfsWriteFlags *flags,   // OUT: write flags
                        const void **data);      // OUT: data to be written
 Bool
+HgfsUnpackReadVRequest(const void *packet,         // IN: HGFS request
+                       size_t packetSize,          // IN: request packet size
+                       HgfsHandle *file,           // OUT: Handle to read from
+                       HgfsIoExtentV4 *extents,    // OUT: extents to read
+                       uint32 *numExtents,         // OUT: number of extents
+                       uint32 *totalSize);         // OUT: total size to read
+Bool
+HgfsUnpackWriteVRequest(const void *packet,         // IN: HGFS request
+                        size_t packetSize,          // IN: request packet size
+                        HgfsHandle *file,           // OUT: Handle to write to
+                        HgfsWriteFlags *flags,      // OUT: write flags
+                        HgfsIoExtentV4 *extents,    // OUT: extents to write
+                        uint32 *numExtents,         // OUT: number of extents
+                        uint32 *totalSize);         // OUT: total size to write
+Bool
 HgfsPackCreateSessionReply(HgfsPacket *packet,        // IN/OUT: Hgfs Packet
                            const void *packetHeader,  // IN: packet header
                            size_t *payloadSize,       // OUT: size of packet
@@ -146,6 +146,8 @@ typedef enum {
    HGFS_OP_UNLOCK_BYTE_RANGE_V4,  /* Release byte range lock. */
    HGFS_OP_QUERY_EAS_V4,          /* Query extended attributes. */
    HGFS_OP_SET_EAS_V4,            /* Add or modify extended attributes. */
+   HGFS_OP_READV_V4,              /* Read a list of file extents. */
+   HGFS_OP_WRITEV_V4,             /* Write a list of file extents. */
 
    HGFS_OP_MAX,                   /* Dummy op, must be last in enum */
    HGFS_OP_NEW_HEADER = 0xff,     /* Header op, must be unique, distinguishes packet headers. */
@@ -2684,4 +2686,74 @@ struct HgfsReplyDeleteFileV4 {
 #include "vmware_pack_end.h"
 HgfsReplyDeleteFileV4;
 
+/*
+ * Vectored reads and writes transfer a list of file extents in a single
+ * request. The extent data is transferred in the separate data packet, as
+ * for HGFS_OP_READ_FAST_V4 and HGFS_OP_WRITE_FAST_V4, and is packed there in
+ * the order of the extents with each extent starting at the sum of the lengths
+ * of the extents before it.
+ */
+
+#define HGFS_VECTORED_IO_MAX_EXTENTS  64
+#define HGFS_VECTORED_IO_MAX          (256 * 4096)
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsIoExtentV4 {
+   uint64 offset;        /* File offset of the extent. */
+   uint32 length;        /* Length of the extent in bytes. */
+   uint32 reserved;      /* Reserved for future use */
+}
+#include "vmware_pack_end.h"
+HgfsIoExtentV4;
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsRequestReadVV4 {
+   HgfsHandle file;      /* Opaque file ID used by the server */
+   uint32 numExtents;    /* Number of entries in extents. */
+   uint64 reserved;      /* Reserved for future use */
+   HgfsIoExtentV4 extents[1];
+}
+#include "vmware_pack_end.h"
+HgfsRequestReadVV4;
+
+/*
+ * The reply returns the number of bytes read for each extent. An extent that is
+ * read short, e.g. because it extends beyond the end of the file, leaves the rest
+ * of its space in the data packet unused.
+ */
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsReplyReadVV4 {
+   uint32 actualSize;    /* Total number of bytes read. */
+   uint32 numExtents;    /* Number of entries in extentSizes. */
+   uint64 reserved;      /* Reserved for future use */
+   uint32 extentSizes[1];
+}
+#include "vmware_pack_end.h"
+HgfsReplyReadVV4;
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsRequestWriteVV4 {
+   HgfsHandle file;      /* Opaque file ID used by the server */
+   HgfsWriteFlags flags;
+   uint32 numExtents;    /* Number of entries in extents. */
+   uint64 reserved;      /* Reserved for future use */
+   HgfsIoExtentV4 extents[1];
+}
+#include "vmware_pack_end.h"
+HgfsRequestWriteVV4;
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsReplyWriteVV4 {
+   uint32 actualSize;    /* Total number of bytes written. */
+   uint64 reserved;      /* Reserved for future use */
+}
+#include "vmware_pack_end.h"
+HgfsReplyWriteVV4;
+
 #endif /* _HGFS_PROTO_H_ */
@@ -20,6 +20,7 @@
 #define _HGFS_SERVER_H_
 
 #include "hgfs.h"             /* for HGFS_PACKET_MAX */
+#include "hgfsProto.h"        /* for HGFS_OP_MAX */
 #include "dbllnklst.h"
 
 typedef struct HgfsVmxIov {
@@ -100,6 +101,8 @@ typedef uint32 HgfsSendFlags;
 typedef uint32 HgfsChannelFlags;
 #define HGFS_CHANNEL_SHARED_MEM     (1 << 0)
 #define HGFS_CHANNEL_ASYNC          (1 << 1)
+/* Data buffer iovs can be mapped all at once and accessed in place. */
+#define HGFS_CHANNEL_DATA_IOV       (1 << 2)
 
 typedef struct HgfsServerChannelData {
    HgfsChannelFlags flags;
@@ -209,4 +212,31 @@ void HgfsServer_SetHandleCounter(uint32 newHandleCounter);
 
 void HgfsServer_Quiesce(Bool freeze);
 
+/*
+ * Per operation statistics.
+ *
+ * Latencies are measured from the receipt of a request to the sending of its
+ * reply and are kept in a log-scale histogram with HGFS_STATS_BINS_PER_DECADE
+ * bins for each decade from 1us. Samples past the last bin are summed in it.
+ */
+#define HGFS_STATS_BINS_PER_DECADE 4
+#define HGFS_STATS_DECADES         7
+#define HGFS_STATS_NUM_BINS        (HGFS_STATS_BINS_PER_DECADE * HGFS_STATS_DECADES)
+
+typedef struct HgfsServerOpStats {
+   const char *name;                          // NULL if the op has no handler
+   uint64 requests;                           // Replies sent
+   uint64 errors;                             // Replies with an error status
+   uint64 bytes;                              // Request, reply and data bytes
+   uint64 totalLatencyUS;                     // Sum of all latencies
+   uint64 latencyHisto[HGFS_STATS_NUM_BINS];  // Latency histogram
+} HgfsServerOpStats;
+
+typedef struct HgfsServerStats {
+   HgfsServerOpStats ops[HGFS_OP_MAX];
+} HgfsServerStats;
+
+void HgfsServer_GetStats(HgfsServerStats *stats);
+uint64 HgfsServer_GetStatsBinLimitNS(uint32 bin);
+
 #endif // _HGFS_SERVER_H_
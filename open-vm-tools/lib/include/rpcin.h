@@ -84,6 +84,7 @@ unsigned int RpcIn_SetRetVals(char const **result, size_t *resultLen,
 
 void RpcIn_Destruct(RpcIn *in);
 void RpcIn_stop(RpcIn *in);
+void RpcIn_ResetDelay(RpcIn *in);
 
 #ifdef __cplusplus
 } // extern "C"
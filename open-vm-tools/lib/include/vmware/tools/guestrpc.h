@@ -207,6 +207,10 @@ RpcChannel_New(void);
 void
 RpcChannel_SetBackdoorOnly(void);
 
+void
+RpcChannel_SetThreadChannels(RpcChannel *chan,
+                             guint maxChannels);
+
 G_END_DECLS
 
 /** @} */
@@ -46,11 +46,16 @@ typedef struct RpcChannelInt {
    gpointer                resetData;
    gboolean                rpcError;
    guint                   rpcErrorCount;
+   GSource                *poolIdleCheck;
+   GThread                *mainThread;
 } RpcChannelInt;
 
 /** Max number of times to attempt a channel restart. */
 #define RPCIN_MAX_RESTARTS 60
 
+/** Seconds a pooled channel may stay unused before it is closed. */
+#define RPCCHANNEL_POOL_IDLE_SECS 30
+
 #define LGPFX "RpcChannel: "
 
 static gboolean
@@ -69,7 +74,26 @@ static gboolean gUseBackdoorOnly = FALSE;
  */
 static gboolean gVSocketFailed = FALSE;
 
+/*
+ * Pool of started outbound channels used by RpcChannel_Send instead of the
+ * shared channel when per-thread channels are enabled. gIdleChannels holds
+ * the channels not checked out by any thread, most recently used first.
+ * gPoolMaxChannels is the pool size limit, reset to 0 when the owning
+ * channel is destroyed so that channels checked in afterwards are closed.
+ * gPoolChannels counts the open channels, idle or checked out, and
+ * gPoolUnused is the fewest idle channels seen since the last idle check,
+ * i.e. how many of the least recently used ones sat unused all along.
+ */
+static GSList *gIdleChannels = NULL;
+static guint gPoolIdle = 0;
+static guint gPoolUnused = 0;
+static guint gPoolChannels = 0;
+static guint gPoolMaxChannels = 0;
+G_LOCK_DEFINE_STATIC(gPool);
+
 static void RpcChannelStopNoLock(RpcChannel *chan);
+static void RpcChannelPoolCloseIdle(gboolean all);
+static gboolean RpcChannelPoolIdleCheck(gpointer data);
 
 /**
  * Handler for a "ping" message. Does nothing.
@@ -439,6 +463,17 @@ RpcChannel_Destroy(RpcChannel *chan)
    size_t i;
    RpcChannelInt *cdata = (RpcChannelInt *) chan;
 
+   if (cdata->poolIdleCheck != NULL) {
+      g_source_destroy(cdata->poolIdleCheck);
+      g_source_unref(cdata->poolIdleCheck);
+      cdata->poolIdleCheck = NULL;
+
+      G_LOCK(gPool);
+      gPoolMaxChannels = 0;
+      G_UNLOCK(gPool);
+      RpcChannelPoolCloseIdle(TRUE);
+   }
+
    if (cdata->impl.funcs != NULL && cdata->impl.funcs->shutdown != NULL) {
       cdata->impl.funcs->shutdown(chan);
    }
@@ -847,10 +882,214 @@ RpcChannel_Free(void *ptr)
 }
 
 
+/**
+ * Enables a pool of outbound channels for threads sending on the given
+ * channel.
+ *
+ * Once enabled, RpcChannel_Send called on @a chan from a thread other than
+ * the one calling this function checks out a started RpcOut channel from
+ * the pool, opening one if none is idle, sends over it instead of the
+ * shared channel, and returns it to the pool. Threads then don't wait on
+ * the shared channel's lock while another thread's RPC is in flight, and
+ * short-lived threads don't pay for opening and closing a channel. A pooled
+ * channel left unused for RPCCHANNEL_POOL_IDLE_SECS is closed, and all of
+ * them are closed when @a chan is destroyed.
+ *
+ * The host limits the number of channels a guest may open, so at most
+ * @a maxChannels pooled channels are open at any time; senders finding
+ * all of them checked out, or failing to start a new one, use the shared
+ * channel. Only one channel in the process may enable the pool.
+ *
+ * This needs to be called after RpcChannel_Setup to take effect, from the
+ * thread that runs the channel's main loop; that thread keeps using the
+ * shared channel.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ * @param[in]  maxChannels Max number of pooled channels, 0 to disable.
+ */
+
+void
+RpcChannel_SetThreadChannels(RpcChannel *chan,
+                             guint maxChannels)
+{
+   RpcChannelInt *cdata = (RpcChannelInt *) chan;
+
+   ASSERT(chan);
+   ASSERT(cdata->mainCtx != NULL);
+
+   G_LOCK(gPool);
+   gPoolMaxChannels = maxChannels;
+   G_UNLOCK(gPool);
+
+   cdata->mainThread = g_thread_self();
+   if (maxChannels > 0 && cdata->poolIdleCheck == NULL) {
+      cdata->poolIdleCheck =
+         g_timeout_source_new_seconds(RPCCHANNEL_POOL_IDLE_SECS);
+      g_source_set_callback(cdata->poolIdleCheck, RpcChannelPoolIdleCheck,
+                            NULL, NULL);
+      g_source_attach(cdata->poolIdleCheck, cdata->mainCtx);
+   }
+   Debug(LGPFX "Using up to %u per-thread channels.\n", maxChannels);
+}
+
+
+/**
+ * Closes a pooled channel and drops it from the count of open ones.
+ *
+ * @param[in]  poolChan    The pooled RPC channel.
+ */
+
+static void
+RpcChannelPoolClose(RpcChannel *poolChan)
+{
+   RpcChannel_Stop(poolChan);
+   RpcChannel_Destroy(poolChan);
+
+   G_LOCK(gPool);
+   ASSERT(gPoolChannels > 0);
+   gPoolChannels--;
+   G_UNLOCK(gPool);
+}
+
+
+/**
+ * Closes idle pooled channels.
+ *
+ * @param[in]  all         Close every idle channel if TRUE, otherwise only
+ *                         the ones unused since the last idle check.
+ */
+
+static void
+RpcChannelPoolCloseIdle(gboolean all)
+{
+   GSList *closing = NULL;
+   guint count;
+
+   G_LOCK(gPool);
+   count = all ? gPoolIdle : gPoolUnused;
+   while (count-- > 0) {
+      GSList *last = g_slist_last(gIdleChannels);
+
+      gIdleChannels = g_slist_remove_link(gIdleChannels, last);
+      closing = g_slist_concat(last, closing);
+      gPoolIdle--;
+   }
+   gPoolUnused = gPoolIdle;
+   G_UNLOCK(gPool);
+
+   while (closing != NULL) {
+      RpcChannelPoolClose(closing->data);
+      closing = g_slist_delete_link(closing, closing);
+   }
+}
+
+
+/**
+ * Periodic check closing the pooled channels that were not checked out
+ * since the previous check.
+ *
+ * @param[in]  data        Unused.
+ *
+ * @return TRUE, to keep the check scheduled.
+ */
+
+static gboolean
+RpcChannelPoolIdleCheck(gpointer data)
+{
+   RpcChannelPoolCloseIdle(FALSE);
+   return TRUE;
+}
+
+
+/**
+ * Checks out a pooled outbound channel if RpcChannel_Send on @a chan should
+ * use one, opening a new one if none is idle. The channel must be returned
+ * with RpcChannelPoolPut.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ *
+ * @return The pooled channel, or NULL to send on @a chan itself.
+ */
+
+static RpcChannel *
+RpcChannelPoolGet(RpcChannel *chan)
+{
+   RpcChannelInt *cdata = (RpcChannelInt *) chan;
+   RpcChannel *poolChan;
+
+   if (cdata->poolIdleCheck == NULL ||
+       g_thread_self() == cdata->mainThread) {
+      return NULL;
+   }
+
+   G_LOCK(gPool);
+   if (gIdleChannels != NULL) {
+      poolChan = gIdleChannels->data;
+      gIdleChannels = g_slist_delete_link(gIdleChannels, gIdleChannels);
+      gPoolIdle--;
+      gPoolUnused = MIN(gPoolUnused, gPoolIdle);
+      G_UNLOCK(gPool);
+      return poolChan;
+   }
+   if (gPoolChannels >= gPoolMaxChannels) {
+      G_UNLOCK(gPool);
+      return NULL;
+   }
+   gPoolChannels++;
+   G_UNLOCK(gPool);
+
+   poolChan = RpcChannel_New();
+   if (poolChan == NULL || !RpcChannel_Start(poolChan)) {
+      Debug(LGPFX "Failed to start pooled channel, using the shared one.\n");
+      if (poolChan != NULL) {
+         RpcChannel_Stop(poolChan);
+         RpcChannel_Destroy(poolChan);
+      }
+      G_LOCK(gPool);
+      gPoolChannels--;
+      G_UNLOCK(gPool);
+      return NULL;
+   }
+
+   return poolChan;
+}
+
+
+/**
+ * Returns a channel checked out with RpcChannelPoolGet to the pool, or
+ * closes it if the pool has shrunk below the number of open channels or
+ * its owning channel has been destroyed.
+ *
+ * @param[in]  poolChan    The pooled channel.
+ */
+
+static void
+RpcChannelPoolPut(RpcChannel *poolChan)
+{
+   G_LOCK(gPool);
+   if (gPoolChannels <= gPoolMaxChannels) {
+      gIdleChannels = g_slist_prepend(gIdleChannels, poolChan);
+      gPoolIdle++;
+      poolChan = NULL;
+   }
+   G_UNLOCK(gPool);
+
+   if (poolChan != NULL) {
+      RpcChannelPoolClose(poolChan);
+   }
+}
+
+
 /**
  * Send function of an RPC channel struct. Retry once if it fails for
  * non-backdoor Channels. Backdoor channel already tries inside. A second try
- * may create a different type of channel.
+ * may create a different type of channel. Threads other than the main one
+ * send on a pooled channel (see RpcChannel_SetThreadChannels) instead of
+ * @a chan when one is available.
+ *
+ * The host often follows a message from the guest with a command of its own,
+ * so a send from the thread running the channel's main context makes the
+ * next backdoor poll for host commands immediate.
  *
  * @param[in]  chan        The RPC channel instance.
  * @param[in]  data        Data to send.
@@ -874,11 +1113,17 @@ RpcChannel_Send(RpcChannel *chan,
    char *res = NULL;
    size_t resLen = 0;
    const RpcChannelFuncs *funcs;
-
-   Debug(LGPFX "Sending: %"FMTSZ"u bytes\n", dataLen);
+   RpcChannel *poolChan;
 
    ASSERT(chan && chan->funcs);
 
+   poolChan = RpcChannelPoolGet(chan);
+   if (poolChan != NULL) {
+      chan = poolChan;
+   }
+
+   Debug(LGPFX "Sending: %"FMTSZ"u bytes\n", dataLen);
+
    g_static_mutex_lock(&chan->outLock);
 
    funcs = chan->funcs;
@@ -931,6 +1176,12 @@ done:
 
 exit:
    g_static_mutex_unlock(&chan->outLock);
+   if (poolChan != NULL) {
+      RpcChannelPoolPut(poolChan);
+   } else if (ok && chan->in != NULL && chan->inStarted &&
+              g_main_context_is_owner(chan->mainCtx)) {
+      RpcIn_ResetDelay(chan->in);
+   }
    return ok && rpcStatus;
 }
 
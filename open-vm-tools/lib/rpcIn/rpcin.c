@@ -131,6 +131,15 @@ static void RpcInConnRecvHeader(ConnInfo *conn);
 static Bool RpcInConnRecvPacket(ConnInfo *conn, const char **errmsg);
 #endif  /* VMTOOLS_USE_VSOCKET */
 
+/*
+ * Backdoor polling adapts to the rate at which the host sends TCLO messages:
+ * while the next message is due according to the smoothed interval between
+ * past messages, the channel is polled RPCIN_POLLS_PER_ARRIVAL times per
+ * interval rather than at the full delay. Intervals are in 10ms units.
+ */
+#define RPCIN_POLLS_PER_ARRIVAL               4
+#define RPCIN_MAX_ARRIVAL_INTERVAL            (60 * 100)       /* 1 minute */
+
 
 struct RpcIn {
 #if defined(VMTOOLS_USE_GLIB)
@@ -151,6 +160,8 @@ struct RpcIn {
    Message_Channel *channel;
    unsigned int delay;   /* The delay of the previous iteration of RpcInLoop */
    unsigned int maxDelay;  /* The maximum delay to schedule in RpcInLoop */
+   uint64 lastArrival;     /* Time of the last TCLO message received */
+   unsigned int arrivalInterval; /* Smoothed time between TCLO messages */
    RpcIn_ErrorFunc *errorFunc;
    void *errorData;
 
@@ -1278,6 +1289,51 @@ RpcIn_stop(RpcIn *in) // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcIn_ResetDelay --
+ *
+ *      Poll the backdoor channel for a host message at once, and back off
+ *      again from the minimum delay, as after a received message. Called on
+ *      signs of activity, so that a command sent by the host after an idle
+ *      period does not wait for the full delay. Must be called from the
+ *      thread running the loop.
+ *
+ * Results:
+ *      None
+ *
+ * Side-effects:
+ *      Reschedules the loop. Stops the RPC channel on error.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+RpcIn_ResetDelay(RpcIn *in) // IN
+{
+   ASSERT(in);
+
+   /* The vsocket channel does not poll, and the loop resets its own delay. */
+   if (in->channel == NULL || in->nextEvent == NULL || in->inLoop ||
+       in->delay == 0) {
+      return;
+   }
+
+#if defined(VMTOOLS_USE_GLIB)
+   g_source_destroy(in->nextEvent);
+#else
+   EventManager_Remove(in->nextEvent);
+   in->nextEvent = NULL;
+#endif
+
+   in->delay = 0;
+   if (!RpcInScheduleRecvEvent(in)) {
+      (*in->errorFunc)(in->errorData, "RpcIn: Unable to run the loop");
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1373,6 +1429,88 @@ RpcInExecRpc(RpcIn *in,            // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInUpdateArrivalRate --
+ *
+ *      Account for a TCLO message received on the backdoor channel in the
+ *      smoothed interval between messages.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcInUpdateArrivalRate(RpcIn *in)          // IN
+{
+   uint64 now = System_GetTimeMonotonic();
+
+   if (in->lastArrival != 0) {
+      unsigned int interval = (unsigned int)MIN(now - in->lastArrival,
+                                                RPCIN_MAX_ARRIVAL_INTERVAL);
+
+      /*
+       * Two messages received within the same tick count as one tick apart,
+       * since an interval of 0 would read as "rate unknown".
+       */
+      interval = MAX(1, interval);
+
+      if (in->arrivalInterval == 0) {
+         in->arrivalInterval = interval;
+      } else {
+         in->arrivalInterval = (3 * in->arrivalInterval + interval) / 4;
+      }
+   }
+   in->lastArrival = now;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInGetIdleDelay --
+ *
+ *      Compute the longest delay between two polls of an idle channel.
+ *
+ *      While the next message is due according to the observed arrival
+ *      rate, poll a few times per expected interval so that it is picked
+ *      up quickly. Once the host has been quiet for longer than usual, or
+ *      if nothing is known about its rate yet, use the full delay.
+ *
+ * Result:
+ *      The delay, between 1 and the max delay.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned int
+RpcInGetIdleDelay(RpcIn *in)               // IN
+{
+   uint64 idle;
+
+   if (in->arrivalInterval == 0 || in->maxDelay == 0) {
+      return in->maxDelay;
+   }
+
+   idle = System_GetTimeMonotonic() - in->lastArrival;
+   if (idle > 2 * (uint64)in->arrivalInterval) {
+      return in->maxDelay;
+   }
+
+   return MAX(1, MIN(in->arrivalInterval / RPCIN_POLLS_PER_ARRIVAL,
+                     in->maxDelay));
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1380,7 +1518,7 @@ RpcInExecRpc(RpcIn *in,            // IN
  *
  *      Calculate new delay time.
  *      Use an exponential back-off, doubling the time to wait each time up to
- *      the max delay.
+ *      the idle delay given by RpcInGetIdleDelay.
  *
  * Result:
  *      None
@@ -1394,16 +1532,20 @@ RpcInExecRpc(RpcIn *in,            // IN
 static void
 RpcInUpdateDelayTime(RpcIn *in)            // IN
 {
-   if (in->delay < in->maxDelay) {
+   unsigned int maxDelay = RpcInGetIdleDelay(in);
+
+   if (in->delay < maxDelay) {
       if (in->delay > 0) {
          /*
           * Catch overflow.
           */
-         in->delay = ((in->delay * 2) > in->delay) ? (in->delay * 2) : in->maxDelay;
+         in->delay = ((in->delay * 2) > in->delay) ? (in->delay * 2) : maxDelay;
       } else {
          in->delay = 1;
       }
-      in->delay = MIN(in->delay, in->maxDelay);
+      in->delay = MIN(in->delay, maxDelay);
+   } else {
+      in->delay = maxDelay;
    }
 }
 
@@ -1570,6 +1712,7 @@ RpcInLoop(void *clientData) // IN
    if (repLen) {
       char *s = ByteDump(reply, repLen);
       Debug("RpcIn: received %d bytes, content:\"%s\"\n", (int) repLen, s);
+      RpcInUpdateArrivalRate(in);
       if (!RpcInExecRpc(in, reply, repLen, &errmsg)) {
          goto error;
       }
@@ -1811,6 +1954,8 @@ RpcIn_start(RpcIn *in,                    // IN
 
    in->delay = 0;
    in->maxDelay = delay;
+   in->lastArrival = 0;
+   in->arrivalInterval = 0;
    in->errorFunc = errorFunc;
    in->errorData = errorData;
 
@@ -30,6 +30,7 @@
 #define G_LOG_DOMAIN "hgfsd"
 
 #include "hgfs.h"
+#include "hgfsServer.h"
 #include "hgfsServerManager.h"
 #include "vm_basic_defs.h"
 #include "vm_assert.h"
@@ -98,6 +99,127 @@ HgfsServerRpcDispatch(RpcInData *data)
 }
 
 
+/**
+ * Returns the latency histogram bin holding the given percentile of the
+ * samples.
+ * @param[in]  opStats  Operation statistics.
+ * @param[in]  percent  Percentile to find.
+ * @return The histogram bin.
+ */
+
+static guint32
+HgfsServerStatsPercentileBin(const HgfsServerOpStats *opStats,
+                             guint percent)
+{
+   guint64 target = (opStats->requests * percent + 99) / 100;
+   guint64 count = 0;
+   guint32 i;
+
+   for (i = 0; i < HGFS_STATS_NUM_BINS - 1; i++) {
+      count += opStats->latencyHisto[i];
+      if (count >= target) {
+         break;
+      }
+   }
+
+   return i;
+}
+
+
+/**
+ * Formats the latency range of a histogram bin. Percentiles are reported as
+ * the range of the bin holding them, not interpolated within it.
+ * @param[in]  bin   Histogram bin.
+ * @return The formatted range. Should be freed with g_free().
+ */
+
+static gchar *
+HgfsServerFormatLatency(guint32 bin)
+{
+   if (bin < HGFS_STATS_NUM_BINS - 1) {
+      return g_strdup_printf("<%"G_GUINT64_FORMAT"us",
+                             HgfsServer_GetStatsBinLimitNS(bin) / 1000);
+   }
+   return g_strdup_printf(">=%"G_GUINT64_FORMAT"us",
+                          HgfsServer_GetStatsBinLimitNS(bin - 1) / 1000);
+}
+
+
+/**
+ * Formats the statistics of an operation.
+ * @param[in]  opStats  Operation statistics.
+ * @return The formatted line, NULL if the operation has not been used.
+ *         Should be freed with g_free().
+ */
+
+static gchar *
+HgfsServerFormatOpStats(const HgfsServerOpStats *opStats)
+{
+   gchar *p50;
+   gchar *p99;
+   gchar *line;
+
+   if (opStats->name == NULL || opStats->requests == 0) {
+      return NULL;
+   }
+
+   p50 = HgfsServerFormatLatency(HgfsServerStatsPercentileBin(opStats, 50));
+   p99 = HgfsServerFormatLatency(HgfsServerStatsPercentileBin(opStats, 99));
+
+   line = g_strdup_printf("%-22s requests %"G_GUINT64_FORMAT
+                          " errors %"G_GUINT64_FORMAT
+                          " bytes %"G_GUINT64_FORMAT
+                          " avg %"G_GUINT64_FORMAT"us p50 %s p99 %s",
+                          opStats->name, opStats->requests, opStats->errors,
+                          opStats->bytes,
+                          opStats->totalLatencyUS / opStats->requests,
+                          p50, p99);
+   g_free(p50);
+   g_free(p99);
+   return line;
+}
+
+
+/**
+ * Logs the HGFS server operation statistics as part of the service state.
+ * This is the only way to read them: run "vmtoolsd --dump-state" in the
+ * guest and the running service writes them to its log.
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      Unused.
+ * @param[in]  data     Unused.
+ */
+
+static void
+HgfsServerDumpState(gpointer src,
+                    ToolsAppCtx *ctx,
+                    gpointer data)
+{
+   HgfsServerStats *stats = g_malloc(sizeof *stats);
+   gboolean used = FALSE;
+   guint i;
+
+   HgfsServer_GetStats(stats);
+   for (i = 0; i < ARRAYSIZE(stats->ops); i++) {
+      gchar *line = HgfsServerFormatOpStats(&stats->ops[i]);
+
+      if (line != NULL) {
+         if (!used) {
+            ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                               "HGFS requests, p50 and p99 are the latency "
+                               "range of the histogram bin holding them:\n");
+         }
+         ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "%s\n", line);
+         g_free(line);
+         used = TRUE;
+      }
+   }
+   if (!used) {
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "No HGFS requests.\n");
+   }
+   g_free(stats);
+}
+
+
 /**
  * Sends the HGFS capability to the VMX.
  *
@@ -276,6 +398,7 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       };
       ToolsPluginSignalCb sigs[] = {
          { TOOLS_CORE_SIG_CAPABILITIES, HgfsServerCapReg, &regData },
+         { TOOLS_CORE_SIG_DUMP_STATE, HgfsServerDumpState, NULL },
          { TOOLS_CORE_SIG_SHUTDOWN, HgfsServerShutdown, &regData }
       };
       ToolsAppReg regs[] = {
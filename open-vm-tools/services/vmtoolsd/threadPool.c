@@ -33,15 +33,27 @@
 #define DEFAULT_MAX_THREADS         5
 #define DEFAULT_MAX_UNUSED_THREADS  0
 
+typedef struct ThreadPoolStats {
+   guint          depth;         /* Tasks currently queued. */
+   guint          maxDepth;      /* Most tasks queued at once. */
+   guint64        executed;      /* Tasks dequeued for execution. */
+   guint64        cancelled;     /* Tasks cancelled while queued. */
+   gint64         totalWait;     /* Queued time of executed tasks, in us. */
+   gint64         maxWait;       /* Longest queued time, in us. */
+} ThreadPoolStats;
+
+
 typedef struct ThreadPoolState {
    ToolsCorePool  funcs;
    gboolean       active;
    ToolsAppCtx   *ctx;
    GThreadPool   *pool;
    GQueue        *workQueue;
+   GHashTable    *workTasks;
    GPtrArray     *threads;
    GMutex        *lock;
    guint          nextWorkId;
+   ThreadPoolStats stats;
 } ThreadPoolState;
 
 
@@ -51,6 +63,8 @@ typedef struct WorkerTask {
    ToolsCorePoolCb   cb;
    gpointer          data;
    GDestroyNotify    dtor;
+   GList            *link;
+   gint64            queueTime;
 } WorkerTask;
 
 
@@ -69,34 +83,90 @@ static ThreadPoolState gState;
 
 /*
  *******************************************************************************
- * ToolsCorePoolCompareTask --                                            */ /**
+ * ToolsCorePoolNow --                                                    */ /**
+ *
+ * Returns the current time, used to measure how long tasks stay queued.
  *
- * Compares two WorkerTask instances.
+ * @return Time in microseconds.
+ *
+ *******************************************************************************
+ */
+
+static gint64
+ToolsCorePoolNow(void)
+{
+#if GLIB_CHECK_VERSION(2, 28, 0)
+   return g_get_monotonic_time();
+#else
+   GTimeVal now;
+
+   g_get_current_time(&now);
+   return (gint64)now.tv_sec * G_USEC_PER_SEC + now.tv_usec;
+#endif
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCorePoolEnqueue --                                                */ /**
  *
- * @param[in] p1  Pointer to WorkerTask.
- * @param[in] p2  Pointer to WorkerTask.
+ * Adds a task to the work queue and to the ID index. Must be called with the
+ * lock held.
  *
- * @return > 0, 0, < 0  if p1's ID is less than, equal, or greater than p2's.
+ * @param[in] task   A WorkerTask.
  *
  *******************************************************************************
  */
 
-static gint
-ToolsCorePoolCompareTask(gconstpointer p1,
-                         gconstpointer p2)
+static void
+ToolsCorePoolEnqueue(WorkerTask *task)
 {
-   const WorkerTask *t1 = p1;
-   const WorkerTask *t2 = p2;
+   ThreadPoolStats *stats = &gState.stats;
 
-   if (t1 != NULL && t2 != NULL) {
-      return (t2->id - t1->id);
-   }
+   g_queue_push_head(gState.workQueue, task);
+   task->link = g_queue_peek_head_link(gState.workQueue);
+   task->queueTime = ToolsCorePoolNow();
+   g_hash_table_insert(gState.workTasks, GUINT_TO_POINTER(task->id), task);
+
+   stats->depth++;
+   stats->maxDepth = MAX(stats->maxDepth, stats->depth);
+}
 
-   if (t1 == NULL && t2 == NULL) {
-      return 0;
-   }
 
-   return (t1 != NULL) ? -1 : 1;
+/*
+ *******************************************************************************
+ * ToolsCorePoolDequeue --                                                */ /**
+ *
+ * Removes a task from the work queue and from the ID index in constant time.
+ * Must be called with the lock held.
+ *
+ * @param[in] task      A queued WorkerTask.
+ * @param[in] executed  Whether the task is removed to be executed, rather
+ *                      than cancelled.
+ *
+ *******************************************************************************
+ */
+
+static void
+ToolsCorePoolDequeue(WorkerTask *task,
+                     gboolean executed)
+{
+   ThreadPoolStats *stats = &gState.stats;
+
+   g_queue_delete_link(gState.workQueue, task->link);
+   task->link = NULL;
+   g_hash_table_remove(gState.workTasks, GUINT_TO_POINTER(task->id));
+
+   stats->depth--;
+   if (executed) {
+      gint64 wait = ToolsCorePoolNow() - task->queueTime;
+
+      stats->executed++;
+      stats->totalWait += wait;
+      stats->maxWait = MAX(stats->maxWait, wait);
+   } else {
+      stats->cancelled++;
+   }
 }
 
 
@@ -169,11 +239,11 @@ ToolsCorePoolDoWork(gpointer data)
     * In single threaded mode, remove the task being executed from the queue.
     * In multi-threaded mode, the thread pool callback already did this.
     */
-   if (gState.pool == NULL) {
-      g_mutex_lock(gState.lock);
-      g_queue_remove(gState.workQueue, work);
-      g_mutex_unlock(gState.lock);
+   g_mutex_lock(gState.lock);
+   if (work->link != NULL) {
+      ToolsCorePoolDequeue(work, TRUE);
    }
+   g_mutex_unlock(gState.lock);
 
    work->cb(gState.ctx, work->data);
    return FALSE;
@@ -243,7 +313,8 @@ ToolsCorePoolRunThread(gpointer data)
  * ToolsCorePoolRunWorker --                                              */ /**
  *
  * Thread pool callback function. Dequeues the next work item from the work
- * queue and execute it.
+ * queue and execute it. The pool is pushed once per submitted task, so there
+ * may be nothing left to run if tasks were cancelled.
  *
  * @param[in] state        Description of state.
  * @param[in] clientData   Description of clientData.
@@ -258,10 +329,15 @@ ToolsCorePoolRunWorker(gpointer state,
    WorkerTask *work;
 
    g_mutex_lock(gState.lock);
-   work = g_queue_pop_tail(gState.workQueue);
+   work = g_queue_peek_tail(gState.workQueue);
+   if (work != NULL) {
+      ToolsCorePoolDequeue(work, TRUE);
+   }
    g_mutex_unlock(gState.lock);
 
-   ASSERT(work != NULL);
+   if (work == NULL) {
+      return;
+   }
 
    ToolsCorePoolDoWork(work);
    ToolsCorePoolDestroyTask(work);
@@ -308,18 +384,18 @@ ToolsCorePoolSubmit(ToolsAppCtx *ctx,
    }
 
    /*
-    * XXX: a reeeeeeeeeally long running task could cause clashes (e.g., reusing
-    * the same task ID after the counter wraps). That shouldn't really happen in
-    * practice (and is an abuse of the thread pool, and could cause issues if
-    * someone sets the pool size to 0 or 1), but it might be good to have more
-    * fail-safe code here.
+    * A reeeeeeeeeally long running task could still be queued when the
+    * counter wraps, so skip the IDs of queued tasks.
     */
-   if (gState.nextWorkId + 1 == UINT_MAX) {
-      task->id = UINT_MAX;
-      gState.nextWorkId = 0;
-   } else {
-      task->id = ++gState.nextWorkId;
-   }
+   do {
+      if (gState.nextWorkId + 1 == UINT_MAX) {
+         task->id = UINT_MAX;
+         gState.nextWorkId = 0;
+      } else {
+         task->id = ++gState.nextWorkId;
+      }
+   } while (g_hash_table_lookup(gState.workTasks,
+                                GUINT_TO_POINTER(task->id)) != NULL);
 
    id = task->id;
 
@@ -328,7 +404,7 @@ ToolsCorePoolSubmit(ToolsAppCtx *ctx,
     * that it can be canceled. In single threaded mode, it's unlikely someone
     * will be able to cancel it before it runs, but they can try.
     */
-   g_queue_push_head(gState.workQueue, task);
+   ToolsCorePoolEnqueue(task);
 
    if (gState.pool != NULL) {
       GError *err = NULL;
@@ -372,9 +448,7 @@ exit:
 static void
 ToolsCorePoolCancel(guint id)
 {
-   GList *taskLnk;
    WorkerTask *task = NULL;
-   WorkerTask search = { id, };
 
    g_return_if_fail(id != 0);
 
@@ -383,10 +457,9 @@ ToolsCorePoolCancel(guint id)
       goto exit;
    }
 
-   taskLnk = g_queue_find_custom(gState.workQueue, &search, ToolsCorePoolCompareTask);
-   if (taskLnk != NULL) {
-      task = taskLnk->data;
-      g_queue_delete_link(gState.workQueue, taskLnk);
+   task = g_hash_table_lookup(gState.workTasks, GUINT_TO_POINTER(id));
+   if (task != NULL) {
+      ToolsCorePoolDequeue(task, FALSE);
    }
 
 exit:
@@ -529,6 +602,7 @@ ToolsCorePool_Init(ToolsAppCtx *ctx)
    gState.lock = g_mutex_new();
    gState.threads = g_ptr_array_new();
    gState.workQueue = g_queue_new();
+   gState.workTasks = g_hash_table_new(g_direct_hash, g_direct_equal);
 
    ToolsCoreService_RegisterProperty(ctx->serviceObj, &prop);
    g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_TPOOL, &gState.funcs, NULL);
@@ -586,9 +660,20 @@ ToolsCorePool_Shutdown(ToolsAppCtx *ctx)
       }
    }
 
+   g_debug("Pool: %"G_GUINT64_FORMAT" tasks executed, "
+           "%"G_GUINT64_FORMAT" cancelled, %u still queued, "
+           "max queue depth %u, wait avg %"G_GINT64_FORMAT" us, "
+           "max %"G_GINT64_FORMAT" us.\n",
+           gState.stats.executed, gState.stats.cancelled, gState.stats.depth,
+           gState.stats.maxDepth,
+           gState.stats.executed > 0 ?
+              gState.stats.totalWait / (gint64)gState.stats.executed : 0,
+           gState.stats.maxWait);
+
    /* Cleanup. */
    g_ptr_array_free(gState.threads, TRUE);
    g_queue_free(gState.workQueue);
+   g_hash_table_destroy(gState.workTasks);
    g_mutex_free(gState.lock);
    memset(&gState, 0, sizeof gState);
    g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_TPOOL, NULL, NULL);
@@ -44,6 +44,9 @@
 #include "vmci_sockets.h"
 #endif
 
+/** Default max number of pooled RPC channels; the pool is off by default. */
+#define DEFAULT_THREAD_CHANNELS  0
+
 /**
  * Take action after an RPC channel reset.
  *
@@ -328,6 +331,28 @@ ToolsCore_InitRpc(ToolsServiceState *state)
                        ToolsCoreCheckReset,
                        state);
 
+      /*
+       * Optionally let pool and plugin threads of the main service talk to
+       * the host over pooled channels, so that a slow reply to one of them
+       * doesn't hold up the others.
+       */
+      if (state->mainService && state->debugPlugin == NULL) {
+         GError *err = NULL;
+         gint threadChannels;
+
+         threadChannels = g_key_file_get_integer(state->ctx.config,
+                                                 state->name,
+                                                 "rpc.threadChannels",
+                                                 &err);
+         if (err != NULL) {
+            threadChannels = DEFAULT_THREAD_CHANNELS;
+            g_clear_error(&err);
+         }
+         if (threadChannels > 0) {
+            RpcChannel_SetThreadChannels(state->ctx.rpc, threadChannels);
+         }
+      }
+
       /* Register the "built in" RPCs. */
       for (i = 0; i < ARRAYSIZE(rpcs); i++) {
          RpcChannelCallback *rpc = &rpcs[i];
@@ -0,0 +1,639 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file testBench.c
+ *
+ * A debug plugin that benchmarks the plugins loaded by the service. It
+ * replays a stream of TCLO requests, either recorded in a file or a
+ * built-in synthetic one, at a configurable rate, and reports the latency
+ * of each kind of request along with the CPU time and heap used by the
+ * process while the stream was replayed.
+ *
+ * Run it as "vmtoolsd -g libtestBench.so -p <plugin dir> -c <config>",
+ * where the plugin directory holds the plugins to benchmark. The config
+ * file may have a [testBench] group with these keys:
+ *
+ *    requests      File with one request per line; empty lines and lines
+ *                  starting with '#' are skipped, C escapes are expanded.
+ *    count         Number of requests to send, cycling through the stream
+ *                  (default 1000).
+ *    rate          Requests per second, 0 to send as fast as possible
+ *                  (default 100).
+ *    concurrency   Requests dispatched back to back per tick (default 1).
+ *                  TCLO requests are handled on the service's main loop,
+ *                  so this models bursts rather than parallel requests.
+ *    max-p99       If not 0, fail the run when the 99th percentile latency
+ *                  of all requests exceeds this many microseconds.
+ */
+
+#define G_LOG_DOMAIN "testBench"
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#  include <sys/time.h>
+#  include <sys/resource.h>
+#endif
+#if defined(__GLIBC__)
+#  include <malloc.h>
+#endif
+#include <glib-object.h>
+#include <CUnit/CUnit.h>
+
+#include "util.h"
+#include "vmware/guestrpc/tclodefs.h"
+#include "vmware/tools/rpcdebug.h"
+
+#define BENCH_CONFGROUP             "testBench"
+#define BENCH_DEFAULT_COUNT         1000
+#define BENCH_DEFAULT_RATE          100
+#define BENCH_DEFAULT_CONCURRENCY   1
+
+#define BENCH_SET_OPTION ("Set_Option " TOOLSOPTION_BROADCASTIP " 1")
+
+/** Requests replayed when no recorded stream is configured. */
+static const char *gSyntheticRequests[] = {
+   "ping",
+   "Capabilities_Register",
+   BENCH_SET_OPTION,
+   "ping",
+};
+
+/** A distinct request in the stream, and its measurements. */
+typedef struct BenchRequest {
+   gchar      *message;
+   size_t      messageLen;
+   GArray     *latencies;    /* gint64, in microseconds. */
+   guint       failures;
+} BenchRequest;
+
+/** Resource usage of the process at some point in time. */
+typedef struct BenchUsage {
+   gint64      time;         /* Microseconds. */
+   gint64      userTime;     /* Microseconds, -1 if unknown. */
+   gint64      systemTime;   /* Microseconds, -1 if unknown. */
+   gint64      heapInUse;    /* Bytes, -1 if unknown. */
+} BenchUsage;
+
+static struct {
+   ToolsAppCtx   *ctx;
+   GHashTable    *requests;  /* Message -> BenchRequest. */
+   GPtrArray     *stream;    /* BenchRequest, in replay order. */
+   guint          count;
+   guint          rate;
+   guint          concurrency;
+   gint64         maxP99;
+   guint          sent;
+   gboolean       started;
+   gboolean       done;
+   GSource       *timer;
+   BenchUsage     start;
+   BenchUsage     end;
+   gint           outMessages;
+} gBench;
+
+
+/**
+ * Returns the current time.
+ *
+ * @return Time in microseconds.
+ */
+
+static gint64
+TestBenchNow(void)
+{
+#if GLIB_CHECK_VERSION(2, 28, 0)
+   return g_get_monotonic_time();
+#else
+   GTimeVal now;
+
+   g_get_current_time(&now);
+   return (gint64)now.tv_sec * G_USEC_PER_SEC + now.tv_usec;
+#endif
+}
+
+
+/**
+ * Samples the resource usage of the process.
+ *
+ * @param[out] usage    Where to store the usage.
+ */
+
+static void
+TestBenchGetUsage(BenchUsage *usage)
+{
+#if !defined(_WIN32)
+   struct rusage ru;
+#endif
+
+   usage->time = TestBenchNow();
+   usage->userTime = -1;
+   usage->systemTime = -1;
+   usage->heapInUse = -1;
+
+#if !defined(_WIN32)
+   if (getrusage(RUSAGE_SELF, &ru) == 0) {
+      usage->userTime = (gint64)ru.ru_utime.tv_sec * G_USEC_PER_SEC +
+                        ru.ru_utime.tv_usec;
+      usage->systemTime = (gint64)ru.ru_stime.tv_sec * G_USEC_PER_SEC +
+                          ru.ru_stime.tv_usec;
+   }
+#endif
+
+#if defined(__GLIBC__)
+   {
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+      struct mallinfo2 mi = mallinfo2();
+#else
+      struct mallinfo mi = mallinfo();
+#endif
+      usage->heapInUse = (gint64)mi.uordblks + mi.hblkhd;
+   }
+#endif
+}
+
+
+/**
+ * Returns the stats entry of a request, adding one if needed.
+ *
+ * @param[in]  message  The request, NULL-terminated.
+ *
+ * @return The request's entry.
+ */
+
+static BenchRequest *
+TestBenchGetRequest(const gchar *message)
+{
+   BenchRequest *req = g_hash_table_lookup(gBench.requests, message);
+
+   if (req == NULL) {
+      req = g_malloc0(sizeof *req);
+      req->message = g_strdup(message);
+      /* Like the VMX, include the terminating NUL in the request. */
+      req->messageLen = strlen(message) + 1;
+      req->latencies = g_array_new(FALSE, FALSE, sizeof (gint64));
+      g_hash_table_insert(gBench.requests, req->message, req);
+   }
+   return req;
+}
+
+
+/**
+ * Frees a stats entry.
+ *
+ * @param[in]  _req     The entry.
+ */
+
+static void
+TestBenchFreeRequest(gpointer _req)
+{
+   BenchRequest *req = _req;
+
+   g_array_free(req->latencies, TRUE);
+   g_free(req->message);
+   g_free(req);
+}
+
+
+/**
+ * Loads the stream of requests to replay, from the configured file or the
+ * built-in list.
+ *
+ * @param[in]  path     File with the recorded requests, may be NULL.
+ *
+ * @return Whether the stream was loaded and is not empty.
+ */
+
+static gboolean
+TestBenchLoadStream(const gchar *path)
+{
+   guint i;
+
+   if (path == NULL) {
+      for (i = 0; i < ARRAYSIZE(gSyntheticRequests); i++) {
+         g_ptr_array_add(gBench.stream,
+                         TestBenchGetRequest(gSyntheticRequests[i]));
+      }
+   } else {
+      gchar *contents;
+      gchar **lines;
+      GError *err = NULL;
+
+      if (!g_file_get_contents(path, &contents, NULL, &err)) {
+         g_warning("Cannot read requests from %s: %s\n", path, err->message);
+         g_clear_error(&err);
+         return FALSE;
+      }
+
+      lines = g_strsplit(contents, "\n", -1);
+      for (i = 0; lines[i] != NULL; i++) {
+         gchar *line = g_strstrip(lines[i]);
+         gchar *message;
+
+         if (*line == '\0' || *line == '#') {
+            continue;
+         }
+
+         message = g_strcompress(line);
+         g_ptr_array_add(gBench.stream, TestBenchGetRequest(message));
+         g_free(message);
+      }
+      g_strfreev(lines);
+      g_free(contents);
+   }
+
+   return gBench.stream->len > 0;
+}
+
+
+/**
+ * Dispatches one request to the service and records how long it took.
+ *
+ * @param[in]  req      The request.
+ */
+
+static void
+TestBenchDispatch(BenchRequest *req)
+{
+   RpcInData data;
+   gboolean ret;
+   gint64 start;
+   gint64 elapsed;
+
+   memset(&data, 0, sizeof data);
+   data.clientData = gBench.ctx->rpc;
+   data.appCtx = gBench.ctx;
+   data.args = req->message;
+   data.argsSize = req->messageLen;
+
+   start = TestBenchNow();
+   ret = RpcChannel_Dispatch(&data);
+   elapsed = TestBenchNow() - start;
+
+   g_array_append_val(req->latencies, elapsed);
+   if (!ret) {
+      req->failures++;
+   }
+
+   if (data.freeResult) {
+      vm_free(data.result);
+   }
+}
+
+
+/**
+ * Timer callback that sends the next burst of requests.
+ *
+ * @param[in]  data     Unused.
+ *
+ * @return Whether to keep sending.
+ */
+
+static gboolean
+TestBenchTick(gpointer data)
+{
+   guint i;
+
+   for (i = 0; i < gBench.concurrency && gBench.sent < gBench.count; i++) {
+      TestBenchDispatch(g_ptr_array_index(gBench.stream,
+                                          gBench.sent % gBench.stream->len));
+      gBench.sent++;
+   }
+
+   if (gBench.sent < gBench.count) {
+      return TRUE;
+   }
+
+   TestBenchGetUsage(&gBench.end);
+   gBench.done = TRUE;
+   return FALSE;
+}
+
+
+/**
+ * Reads the configuration and starts replaying the stream.
+ *
+ * @return Whether the benchmark was started.
+ */
+
+static gboolean
+TestBenchStart(void)
+{
+   GKeyFile *config = gBench.ctx->config;
+   GError *err = NULL;
+   gchar *path = NULL;
+   gint value;
+   RpcInData data;
+
+   gBench.count = BENCH_DEFAULT_COUNT;
+   gBench.rate = BENCH_DEFAULT_RATE;
+   gBench.concurrency = BENCH_DEFAULT_CONCURRENCY;
+   gBench.maxP99 = 0;
+
+   if (config != NULL) {
+      path = g_key_file_get_string(config, BENCH_CONFGROUP, "requests", NULL);
+
+      value = g_key_file_get_integer(config, BENCH_CONFGROUP, "count", &err);
+      if (err == NULL && value > 0) {
+         gBench.count = value;
+      }
+      g_clear_error(&err);
+
+      value = g_key_file_get_integer(config, BENCH_CONFGROUP, "rate", &err);
+      if (err == NULL && value >= 0) {
+         gBench.rate = value;
+      }
+      g_clear_error(&err);
+
+      value = g_key_file_get_integer(config, BENCH_CONFGROUP, "concurrency",
+                                     &err);
+      if (err == NULL && value > 0) {
+         gBench.concurrency = value;
+      }
+      g_clear_error(&err);
+
+      value = g_key_file_get_integer(config, BENCH_CONFGROUP, "max-p99", &err);
+      if (err == NULL && value > 0) {
+         gBench.maxP99 = value;
+      }
+      g_clear_error(&err);
+   }
+
+   if (!TestBenchLoadStream(path)) {
+      g_free(path);
+      CU_FAIL("No requests to replay.");
+      return FALSE;
+   }
+   g_free(path);
+
+   /*
+    * Put the service in the state it is in after the VMX connects, without
+    * measuring it.
+    */
+   memset(&data, 0, sizeof data);
+   data.clientData = gBench.ctx->rpc;
+   data.appCtx = gBench.ctx;
+   data.args = "reset";
+   data.argsSize = sizeof "reset";
+   RpcChannel_Dispatch(&data);
+   if (data.freeResult) {
+      vm_free(data.result);
+   }
+
+   g_message("Replaying %u requests (%u distinct) at %u/s, %u per tick.\n",
+             gBench.count, g_hash_table_size(gBench.requests), gBench.rate,
+             gBench.concurrency);
+
+   if (gBench.rate == 0) {
+      gBench.timer = g_idle_source_new();
+   } else {
+      guint interval = 1000 * gBench.concurrency / gBench.rate;
+      gBench.timer = g_timeout_source_new(MAX(interval, 1));
+   }
+
+   TestBenchGetUsage(&gBench.start);
+   VMTOOLSAPP_ATTACH_SOURCE(gBench.ctx, gBench.timer, TestBenchTick,
+                            NULL, NULL);
+   return TRUE;
+}
+
+
+/**
+ * Called by the debug channel when the service polls for a request. The
+ * requests are dispatched by TestBenchTick at the configured rate, so this
+ * only starts the benchmark and tells the channel when it's over.
+ *
+ * @param[in]  rpcdata     Unused.
+ *
+ * @return FALSE once all the requests were sent.
+ */
+
+static gboolean
+TestBenchSendNext(RpcDebugMsgMapping *rpcdata)
+{
+   if (!gBench.started) {
+      gBench.started = TRUE;
+      if (!TestBenchStart()) {
+         return FALSE;
+      }
+   }
+   return !gBench.done;
+}
+
+
+/**
+ * Receives the messages plugins send to the host while handling the
+ * requests, and acknowledges them.
+ *
+ * @param[in]  data        Incoming data.
+ * @param[in]  dataLen     Size of incoming data.
+ * @param[out] result      Result sent back to the application.
+ * @param[out] resultLen   Length of result.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+TestBenchReceive(char *data,
+                 size_t dataLen,
+                 char **result,
+                 size_t *resultLen)
+{
+   /* Plugins may send from pool threads. */
+   g_atomic_int_inc(&gBench.outMessages);
+   RpcDebug_SetResult("", result, resultLen);
+   return TRUE;
+}
+
+
+/**
+ * Compares two latencies, for sorting.
+ *
+ * @param[in]  a     First latency.
+ * @param[in]  b     Second latency.
+ *
+ * @return Negative, 0 or positive as @a a is lower, equal or higher.
+ */
+
+static gint
+TestBenchCompareLatency(gconstpointer a,
+                        gconstpointer b)
+{
+   gint64 la = *(const gint64 *)a;
+   gint64 lb = *(const gint64 *)b;
+
+   return (la > lb) - (la < lb);
+}
+
+
+/**
+ * Returns a percentile of sorted latencies.
+ *
+ * @param[in]  latencies   Sorted latencies, not empty.
+ * @param[in]  pct         Percentile.
+ *
+ * @return The latency.
+ */
+
+static gint64
+TestBenchPercentile(GArray *latencies,
+                    guint pct)
+{
+   guint idx = (guint)(((guint64)latencies->len - 1) * pct / 100);
+
+   return g_array_index(latencies, gint64, idx);
+}
+
+
+/**
+ * Prints one line of the latency report.
+ *
+ * @param[in]  name        Row name.
+ * @param[in]  latencies   Latencies, sorted by this function.
+ * @param[in]  failures    Number of failed requests.
+ *
+ * @return The 99th percentile, 0 if there are no latencies.
+ */
+
+static gint64
+TestBenchReportLatencies(const gchar *name,
+                         GArray *latencies,
+                         guint failures)
+{
+   gint64 p99;
+
+   if (latencies->len == 0) {
+      return 0;
+   }
+
+   g_array_sort(latencies, TestBenchCompareLatency);
+   p99 = TestBenchPercentile(latencies, 99);
+   g_print("%-32.32s %8u %6u %10"G_GINT64_FORMAT" %10"G_GINT64_FORMAT
+           " %10"G_GINT64_FORMAT" %10"G_GINT64_FORMAT"\n",
+           name, latencies->len, failures,
+           TestBenchPercentile(latencies, 50),
+           TestBenchPercentile(latencies, 90),
+           p99,
+           g_array_index(latencies, gint64, latencies->len - 1));
+   return p99;
+}
+
+
+/**
+ * Prints the benchmark report, and fails the run if the latency is above
+ * the configured limit.
+ *
+ * @param[in]  ctx      The application context.
+ * @param[in]  plugin   Unused.
+ */
+
+static void
+TestBenchShutdown(ToolsAppCtx *ctx,
+                  RpcDebugPlugin *plugin)
+{
+   GHashTableIter iter;
+   gpointer value;
+   GArray *all;
+   guint failures = 0;
+   gint64 elapsed;
+   gint64 p99;
+
+   if (gBench.timer != NULL) {
+      g_source_destroy(gBench.timer);
+      g_source_unref(gBench.timer);
+      gBench.timer = NULL;
+   }
+
+   if (!gBench.done) {
+      goto exit;
+   }
+
+   elapsed = gBench.end.time - gBench.start.time;
+   g_print("\n%u requests in %.3f s (%.1f/s), %d messages to the host.\n",
+           gBench.sent, elapsed / 1e6,
+           elapsed > 0 ? gBench.sent * 1e6 / elapsed : 0.0,
+           g_atomic_int_get(&gBench.outMessages));
+   g_print("%-32s %8s %6s %10s %10s %10s %10s\n", "request", "count", "failed",
+           "p50 (us)", "p90 (us)", "p99 (us)", "max (us)");
+
+   all = g_array_new(FALSE, FALSE, sizeof (gint64));
+   g_hash_table_iter_init(&iter, gBench.requests);
+   while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      BenchRequest *req = value;
+
+      TestBenchReportLatencies(req->message, req->latencies, req->failures);
+      g_array_append_vals(all, req->latencies->data, req->latencies->len);
+      failures += req->failures;
+   }
+   p99 = TestBenchReportLatencies("(all)", all, failures);
+   g_array_free(all, TRUE);
+
+   if (gBench.start.userTime >= 0) {
+      g_print("CPU time: %.3f s user, %.3f s system.\n",
+              (gBench.end.userTime - gBench.start.userTime) / 1e6,
+              (gBench.end.systemTime - gBench.start.systemTime) / 1e6);
+   }
+   if (gBench.start.heapInUse >= 0) {
+      g_print("Heap in use: %"G_GINT64_FORMAT" bytes before, "
+              "%"G_GINT64_FORMAT" bytes after.\n",
+              gBench.start.heapInUse, gBench.end.heapInUse);
+   }
+
+   if (gBench.maxP99 > 0) {
+      CU_ASSERT(p99 <= gBench.maxP99);
+   }
+
+exit:
+   g_ptr_array_free(gBench.stream, TRUE);
+   g_hash_table_destroy(gBench.requests);
+}
+
+
+/**
+ * Returns the debug plugin's registration data.
+ *
+ * @param[in]  ctx      The application context.
+ *
+ * @return The application data.
+ */
+
+TOOLS_MODULE_EXPORT RpcDebugPlugin *
+RpcDebugOnLoad(ToolsAppCtx *ctx)
+{
+   static ToolsPluginData pluginData = {
+      "testBench",
+      NULL,
+      NULL,
+      NULL,
+   };
+   static RpcDebugPlugin regData = {
+      NULL,
+      TestBenchReceive,
+      TestBenchSendNext,
+      TestBenchShutdown,
+      &pluginData,
+   };
+
+   memset(&gBench, 0, sizeof gBench);
+   gBench.ctx = ctx;
+   gBench.requests = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                           TestBenchFreeRequest);
+   gBench.stream = g_ptr_array_new();
+
+   return &regData;
+}
@@ -0,0 +1,564 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsbench.c --
+ *
+ *   Benchmark driver for an HGFS file system mount. Runs sequential
+ *   write, sequential read, random read and metadata workloads from a
+ *   number of threads against a directory and reports the throughput
+ *   of each.
+ *
+ *   Together with the vmhgfs-fuse loopback transport, built into the
+ *   vmhgfs-fuse-loopback program of the vmhgfs-fuse directory, the whole
+ *   HGFS stack can be profiled without a hypervisor, e.g.
+ *
+ *      mkdir -p /tmp/hgfs-src /tmp/hgfs-mnt
+ *      vmhgfs-fuse-loopback -o loopback .host:/root/tmp/hgfs-src /tmp/hgfs-mnt
+ *      vmware-testhgfs-bench -t 4 /tmp/hgfs-mnt
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_THREADS      1
+#define DEFAULT_FILE_SIZE    (64 * 1024 * 1024)
+#define DEFAULT_BLOCK_SIZE   (128 * 1024)
+#define DEFAULT_RANDOM_SIZE  4096
+#define DEFAULT_RANDOM_OPS   4096
+#define DEFAULT_META_FILES   256
+
+#define ERROR(fmt, args...)  fprintf(stderr, fmt, ## args)
+
+typedef enum {
+   BENCH_SEQ_WRITE,
+   BENCH_SEQ_READ,
+   BENCH_RANDOM_READ,
+   BENCH_METADATA,
+} BenchWorkload;
+
+typedef struct BenchConfig {
+   const char *dir;
+   unsigned int threads;
+   size_t fileSize;
+   size_t blockSize;
+   size_t randomSize;
+   unsigned int randomOps;
+   unsigned int metaFiles;
+} BenchConfig;
+
+typedef struct ThreadInfo {
+   const BenchConfig *config;
+   BenchWorkload workload;
+   unsigned int index;
+   pthread_t thread;
+   uint64_t bytes;
+   uint64_t ops;
+   int error;
+} ThreadInfo;
+
+static const char *workloadNames[] = {
+   "seq-write",
+   "seq-read",
+   "random-read",
+   "metadata",
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64_t
+NowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataFileName --
+ *
+ *      Builds the name of the data file of a thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+DataFileName(const BenchConfig *config,  // IN
+             unsigned int index,         // IN: thread index
+             char *name,                 // OUT
+             size_t nameSize)            // IN
+{
+   snprintf(name, nameSize, "%s/hgfsbench.%u.dat", config->dir, index);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SeqWrite --
+ *
+ *      Writes the data file of a thread sequentially.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+SeqWrite(ThreadInfo *info,   // IN/OUT
+         char *buf)          // IN: block buffer
+{
+   const BenchConfig *config = info->config;
+   char name[PATH_MAX];
+   size_t done = 0;
+   int fd;
+
+   DataFileName(config, info->index, name, sizeof name);
+   fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0) {
+      return errno;
+   }
+
+   while (done < config->fileSize) {
+      size_t len = config->fileSize - done;
+      ssize_t res;
+
+      if (len > config->blockSize) {
+         len = config->blockSize;
+      }
+      res = write(fd, buf, len);
+      if (res <= 0) {
+         int error = res < 0 ? errno : EIO;
+         close(fd);
+         return error;
+      }
+      done += res;
+      info->ops++;
+   }
+   info->bytes += done;
+
+   if (fsync(fd) != 0 || close(fd) != 0) {
+      return errno;
+   }
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SeqRead --
+ *
+ *      Reads the data file of a thread sequentially.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+SeqRead(ThreadInfo *info,   // IN/OUT
+        char *buf)          // IN: block buffer
+{
+   const BenchConfig *config = info->config;
+   char name[PATH_MAX];
+   ssize_t res;
+   int fd;
+
+   DataFileName(config, info->index, name, sizeof name);
+   fd = open(name, O_RDONLY);
+   if (fd < 0) {
+      return errno;
+   }
+
+   while ((res = read(fd, buf, config->blockSize)) > 0) {
+      info->bytes += res;
+      info->ops++;
+   }
+   if (res < 0) {
+      int error = errno;
+      close(fd);
+      return error;
+   }
+
+   close(fd);
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RandomRead --
+ *
+ *      Reads small blocks from random offsets of the data file of a thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+RandomRead(ThreadInfo *info,   // IN/OUT
+           char *buf)          // IN: block buffer
+{
+   const BenchConfig *config = info->config;
+   unsigned int seed = info->index + 1;
+   size_t blocks = config->fileSize / config->randomSize;
+   char name[PATH_MAX];
+   unsigned int i;
+   int fd;
+
+   if (blocks == 0) {
+      return EINVAL;
+   }
+
+   DataFileName(config, info->index, name, sizeof name);
+   fd = open(name, O_RDONLY);
+   if (fd < 0) {
+      return errno;
+   }
+
+   for (i = 0; i < config->randomOps; i++) {
+      off_t offset = (off_t)(rand_r(&seed) % blocks) * config->randomSize;
+      ssize_t res = pread(fd, buf, config->randomSize, offset);
+
+      if (res < 0) {
+         int error = errno;
+         close(fd);
+         return error;
+      }
+      info->bytes += res;
+      info->ops++;
+   }
+
+   close(fd);
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Metadata --
+ *
+ *      Creates, stats, lists and removes a directory of empty files.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+Metadata(ThreadInfo *info)   // IN/OUT
+{
+   const BenchConfig *config = info->config;
+   char dirName[PATH_MAX];
+   char name[PATH_MAX + 16];
+   struct stat st;
+   struct dirent *entry;
+   DIR *dir;
+   unsigned int i;
+   int error = 0;
+
+   snprintf(dirName, sizeof dirName, "%s/hgfsbench.%u.d", config->dir,
+            info->index);
+   if (mkdir(dirName, 0755) != 0 && errno != EEXIST) {
+      return errno;
+   }
+   info->ops++;
+
+   for (i = 0; i < config->metaFiles && error == 0; i++) {
+      int fd;
+
+      snprintf(name, sizeof name, "%s/f%u", dirName, i);
+      fd = open(name, O_WRONLY | O_CREAT, 0644);
+      if (fd < 0) {
+         error = errno;
+      } else {
+         close(fd);
+         info->ops++;
+      }
+   }
+
+   for (i = 0; i < config->metaFiles && error == 0; i++) {
+      snprintf(name, sizeof name, "%s/f%u", dirName, i);
+      if (stat(name, &st) != 0) {
+         error = errno;
+      } else {
+         info->ops++;
+      }
+   }
+
+   if (error == 0) {
+      dir = opendir(dirName);
+      if (dir == NULL) {
+         error = errno;
+      } else {
+         while ((entry = readdir(dir)) != NULL) {
+            info->ops++;
+         }
+         closedir(dir);
+      }
+   }
+
+   for (i = 0; i < config->metaFiles; i++) {
+      snprintf(name, sizeof name, "%s/f%u", dirName, i);
+      if (unlink(name) == 0) {
+         info->ops++;
+      }
+   }
+   if (rmdir(dirName) == 0) {
+      info->ops++;
+   }
+
+   return error;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchThread --
+ *
+ *      Runs the workload of a thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+BenchThread(void *arg)   // IN: ThreadInfo
+{
+   ThreadInfo *info = arg;
+   char *buf = NULL;
+   size_t bufSize = info->config->blockSize;
+
+   if (info->config->randomSize > bufSize) {
+      bufSize = info->config->randomSize;
+   }
+
+   if (info->workload != BENCH_METADATA) {
+      buf = malloc(bufSize);
+      if (buf == NULL) {
+         info->error = ENOMEM;
+         return NULL;
+      }
+      memset(buf, 'h' + info->index, bufSize);
+   }
+
+   switch (info->workload) {
+   case BENCH_SEQ_WRITE:
+      info->error = SeqWrite(info, buf);
+      break;
+   case BENCH_SEQ_READ:
+      info->error = SeqRead(info, buf);
+      break;
+   case BENCH_RANDOM_READ:
+      info->error = RandomRead(info, buf);
+      break;
+   case BENCH_METADATA:
+      info->error = Metadata(info);
+      break;
+   }
+
+   free(buf);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RunWorkload --
+ *
+ *      Runs a workload on all the threads and prints its throughput.
+ *
+ * Results:
+ *      0 on success, an errno value on failure.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+RunWorkload(const BenchConfig *config,   // IN
+            BenchWorkload workload)      // IN
+{
+   ThreadInfo *infos;
+   uint64_t bytes = 0;
+   uint64_t ops = 0;
+   uint64_t start;
+   uint64_t elapsedUS;
+   unsigned int i;
+   int error = 0;
+
+   infos = calloc(config->threads, sizeof *infos);
+   if (infos == NULL) {
+      return ENOMEM;
+   }
+
+   start = NowUS();
+   for (i = 0; i < config->threads; i++) {
+      infos[i].config = config;
+      infos[i].workload = workload;
+      infos[i].index = i;
+      if (pthread_create(&infos[i].thread, NULL, BenchThread, &infos[i]) != 0) {
+         ERROR("Cannot create thread %u\n", i);
+         exit(1);
+      }
+   }
+
+   for (i = 0; i < config->threads; i++) {
+      pthread_join(infos[i].thread, NULL);
+      bytes += infos[i].bytes;
+      ops += infos[i].ops;
+      if (infos[i].error != 0 && error == 0) {
+         error = infos[i].error;
+      }
+   }
+   elapsedUS = NowUS() - start;
+   if (elapsedUS == 0) {
+      elapsedUS = 1;
+   }
+
+   if (error != 0) {
+      ERROR("%-12s failed: %s\n", workloadNames[workload], strerror(error));
+   } else {
+      printf("%-12s %10.3f s %12.1f ops/s %10.2f MB/s\n",
+             workloadNames[workload], elapsedUS / 1e6,
+             ops * 1e6 / elapsedUS, bytes / (double)elapsedUS);
+   }
+
+   free(infos);
+   return error;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Usage --
+ *
+ *      Prints the usage message.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Usage(const char *progName)   // IN
+{
+   fprintf(stderr,
+           "Usage: %s [options] dir\n"
+           "   -t threads     number of threads (default %u)\n"
+           "   -s size        data file size per thread in KB (default %u)\n"
+           "   -b size        sequential I/O block size in KB (default %u)\n"
+           "   -r size        random read size in bytes (default %u)\n"
+           "   -n count       random reads per thread (default %u)\n"
+           "   -m count       metadata files per thread (default %u)\n",
+           progName, DEFAULT_THREADS, DEFAULT_FILE_SIZE / 1024,
+           DEFAULT_BLOCK_SIZE / 1024, DEFAULT_RANDOM_SIZE,
+           DEFAULT_RANDOM_OPS, DEFAULT_META_FILES);
+}
+
+
+int
+main(int argc,      // IN
+     char *argv[])  // IN
+{
+   BenchConfig config;
+   char name[PATH_MAX];
+   unsigned int i;
+   int error = 0;
+   int opt;
+
+   config.threads = DEFAULT_THREADS;
+   config.fileSize = DEFAULT_FILE_SIZE;
+   config.blockSize = DEFAULT_BLOCK_SIZE;
+   config.randomSize = DEFAULT_RANDOM_SIZE;
+   config.randomOps = DEFAULT_RANDOM_OPS;
+   config.metaFiles = DEFAULT_META_FILES;
+
+   while ((opt = getopt(argc, argv, "t:s:b:r:n:m:h")) != -1) {
+      switch (opt) {
+      case 't':
+         config.threads = strtoul(optarg, NULL, 0);
+         break;
+      case 's':
+         config.fileSize = strtoul(optarg, NULL, 0) * 1024;
+         break;
+      case 'b':
+         config.blockSize = strtoul(optarg, NULL, 0) * 1024;
+         break;
+      case 'r':
+         config.randomSize = strtoul(optarg, NULL, 0);
+         break;
+      case 'n':
+         config.randomOps = strtoul(optarg, NULL, 0);
+         break;
+      case 'm':
+         config.metaFiles = strtoul(optarg, NULL, 0);
+         break;
+      default:
+         Usage(argv[0]);
+         return 1;
+      }
+   }
+
+   if (optind != argc - 1 || config.threads == 0 || config.blockSize == 0 ||
+       config.randomSize == 0) {
+      Usage(argv[0]);
+      return 1;
+   }
+   config.dir = argv[optind];
+
+   printf("%s: %u threads, %zu KB per thread, %zu KB blocks\n", config.dir,
+          config.threads, config.fileSize / 1024, config.blockSize / 1024);
+
+   error = RunWorkload(&config, BENCH_SEQ_WRITE);
+   if (error == 0) {
+      error = RunWorkload(&config, BENCH_SEQ_READ);
+   }
+   if (error == 0) {
+      error = RunWorkload(&config, BENCH_RANDOM_READ);
+   }
+   if (error == 0) {
+      error = RunWorkload(&config, BENCH_METADATA);
+   }
+
+   for (i = 0; i < config.threads; i++) {
+      DataFileName(&config, i, name, sizeof name);
+      unlink(name);
+   }
+
+   return error == 0 ? 0 : 1;
+}
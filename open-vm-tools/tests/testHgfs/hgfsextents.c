@@ -0,0 +1,201 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsextents.c --
+ *
+ *   Checks that the HGFS server unpacks the extent lists of vectored read
+ *   and write requests (HGFS_OP_READV_V4 and HGFS_OP_WRITEV_V4) and rejects
+ *   the ones beyond the protocol limits of HGFS_VECTORED_IO_MAX_EXTENTS
+ *   extents and HGFS_VECTORED_IO_MAX bytes.
+ *
+ *   Exits with a non-zero status if any check fails.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "vmware.h"
+#include "hgfsServerParameters.h"
+
+#define TEST_HANDLE  42
+
+#define ERROR(fmt, args...)  fprintf(stderr, fmt, ## args)
+
+/* Large enough for one extent more than allowed. */
+typedef union TestPacket {
+   HgfsRequestReadVV4 readV;
+   HgfsRequestWriteVV4 writeV;
+   char buf[sizeof (HgfsRequestWriteVV4) +
+            HGFS_VECTORED_IO_MAX_EXTENTS * sizeof (HgfsIoExtentV4)];
+} TestPacket;
+
+static unsigned int failures;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FillExtents --
+ *
+ *      Fills in an extent list with extents of the given length, one after
+ *      another in the file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FillExtents(HgfsIoExtentV4 *extents,   // OUT
+            uint32 numExtents,         // IN
+            uint32 length)             // IN: length of each extent
+{
+   uint32 i;
+
+   for (i = 0; i < numExtents; i++) {
+      extents[i].offset = (uint64)i * length;
+      extents[i].length = length;
+      extents[i].reserved = 0;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckUnpack --
+ *
+ *      Unpacks a vectored read and a vectored write request with the given
+ *      extent list and checks the result of both.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CheckUnpack(const char *name,          // IN: test name
+            uint32 numExtents,         // IN: extents in the request
+            uint32 length,             // IN: length of each extent
+            size_t extentsSize,        // IN: bytes of extents in the packet
+            Bool valid)                // IN: whether the list is valid
+{
+   static TestPacket packet;
+   HgfsIoExtentV4 extents[HGFS_VECTORED_IO_MAX_EXTENTS];
+   HgfsHandle file;
+   HgfsWriteFlags flags;
+   uint32 unpackedExtents;
+   uint32 totalSize;
+   size_t packetSize;
+   unsigned int oldFailures = failures;
+   Bool result;
+
+   ASSERT(numExtents <= HGFS_VECTORED_IO_MAX_EXTENTS + 1);
+
+   /* Vectored read. */
+   memset(&packet, 0, sizeof packet);
+   packet.readV.file = TEST_HANDLE;
+   packet.readV.numExtents = numExtents;
+   FillExtents(packet.readV.extents, numExtents, length);
+   packetSize = offsetof(HgfsRequestReadVV4, extents) + extentsSize;
+
+   unpackedExtents = 0;
+   totalSize = 0;
+   result = HgfsUnpackReadVRequest(&packet, packetSize, &file, extents,
+                                   &unpackedExtents, &totalSize);
+   if (result != valid ||
+       (valid && (file != TEST_HANDLE || unpackedExtents != numExtents ||
+                  totalSize != numExtents * length))) {
+      ERROR("FAIL %s: read: result %d, %u extents, %u bytes\n", name,
+            result, unpackedExtents, totalSize);
+      failures++;
+   }
+
+   /* Vectored write. */
+   memset(&packet, 0, sizeof packet);
+   packet.writeV.file = TEST_HANDLE;
+   packet.writeV.flags = 0;
+   packet.writeV.numExtents = numExtents;
+   FillExtents(packet.writeV.extents, numExtents, length);
+   packetSize = offsetof(HgfsRequestWriteVV4, extents) + extentsSize;
+
+   unpackedExtents = 0;
+   totalSize = 0;
+   result = HgfsUnpackWriteVRequest(&packet, packetSize, &file, &flags,
+                                    extents, &unpackedExtents, &totalSize);
+   if (result != valid ||
+       (valid && (file != TEST_HANDLE || unpackedExtents != numExtents ||
+                  totalSize != numExtents * length))) {
+      ERROR("FAIL %s: write: result %d, %u extents, %u bytes\n", name,
+            result, unpackedExtents, totalSize);
+      failures++;
+   }
+
+   printf("%-32s %s\n", name, failures == oldFailures ? "ok" : "FAILED");
+}
+
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   const uint32 maxExtents = HGFS_VECTORED_IO_MAX_EXTENTS;
+   const uint32 maxLength = HGFS_VECTORED_IO_MAX / HGFS_VECTORED_IO_MAX_EXTENTS;
+   const size_t extentSize = sizeof (HgfsIoExtentV4);
+
+   CheckUnpack("one extent", 1, 4096, extentSize, TRUE);
+   CheckUnpack("max extents and size", maxExtents, maxLength,
+               maxExtents * extentSize, TRUE);
+   CheckUnpack("no extents", 0, 4096, extentSize, FALSE);
+   CheckUnpack("too many extents", maxExtents + 1, 1,
+               (maxExtents + 1) * extentSize, FALSE);
+   CheckUnpack("too many bytes", maxExtents, maxLength + 1,
+               maxExtents * extentSize, FALSE);
+   CheckUnpack("single extent too large", 1, HGFS_VECTORED_IO_MAX + 1,
+               extentSize, FALSE);
+   CheckUnpack("extent lengths wrapping", 2, 0x80000000, 2 * extentSize,
+               FALSE);
+   CheckUnpack("extents beyond packet", maxExtents, 1,
+               (maxExtents - 1) * extentSize, FALSE);
+
+   /* A packet too small for the request header. */
+   {
+      HgfsRequestReadVV4 request;
+      HgfsIoExtentV4 extents[HGFS_VECTORED_IO_MAX_EXTENTS];
+      HgfsHandle file;
+      uint32 numExtents;
+      uint32 totalSize;
+      Bool result;
+
+      memset(&request, 0, sizeof request);
+      request.numExtents = 1;
+      result = HgfsUnpackReadVRequest(&request,
+                                      offsetof(HgfsRequestReadVV4, extents) - 1,
+                                      &file, extents, &numExtents, &totalSize);
+      if (result) {
+         ERROR("FAIL truncated header: read: result %d\n", result);
+         failures++;
+      }
+      printf("%-32s %s\n", "truncated header", result ? "FAILED" : "ok");
+   }
+
+   if (failures != 0) {
+      ERROR("%u checks failed\n", failures);
+      return 1;
+   }
+   return 0;
+}
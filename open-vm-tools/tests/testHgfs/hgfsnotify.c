@@ -0,0 +1,365 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsnotify.c --
+ *
+ *   Checks the inotify based directory change notification of the HGFS
+ *   server.
+ *
+ *   The server must not start monitoring the shared folders until a
+ *   session on a channel able to deliver notifications is created.
+ *
+ *   A recursive subscriber must get the events of the directories below
+ *   the watched one, both of those present when subscribing and of those
+ *   moved into the tree later on.
+ *
+ *   Exits with a non-zero status if any check fails.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "vmware.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsServerPolicy.h"
+#include "hgfsDirNotify.h"
+#include "str.h"
+
+#define TEST_EVENT_WAIT_MSEC   2000
+#define TEST_MAX_EVENTS        64
+
+#define ERROR(fmt, args...)  fprintf(stderr, fmt, ## args)
+
+static pthread_mutex_t eventLock = PTHREAD_MUTEX_INITIALIZER;
+static char *eventNames[TEST_MAX_EVENTS];
+static unsigned int numEvents;
+
+static unsigned int failures;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Check --
+ *
+ *      Reports the result of a check.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Check(const char *name,   // IN
+      Bool ok)            // IN
+{
+   printf("%-40s %s\n", name, ok ? "ok" : "FAILED");
+   if (!ok) {
+      failures++;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CountThreads --
+ *
+ *      Returns the number of threads of this process, or -1 on error.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+CountThreads(void)
+{
+   struct dirent *entry;
+   DIR *dir = opendir("/proc/self/task");
+   int count = 0;
+
+   if (NULL == dir) {
+      return -1;
+   }
+   while ((entry = readdir(dir)) != NULL) {
+      if ('.' != entry->d_name[0]) {
+         count++;
+      }
+   }
+   closedir(dir);
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * EventReceived --
+ *
+ *      Notification callback, records the name of the changed file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+EventReceived(HgfsSharedFolderHandle sharedFolder,   // IN
+              HgfsSubscriberHandle subscriber,       // IN
+              char *name,                            // IN
+              uint32 mask,                           // IN
+              struct HgfsSessionInfo *session)       // IN
+{
+   pthread_mutex_lock(&eventLock);
+   if (NULL != name && numEvents < ARRAYSIZE(eventNames)) {
+      eventNames[numEvents++] = strdup(name);
+   }
+   pthread_mutex_unlock(&eventLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WaitForEvent --
+ *
+ *      Waits for an event about the given file.
+ *
+ * Results:
+ *      TRUE if the event arrived in time.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+WaitForEvent(const char *name)   // IN
+{
+   int waited;
+
+   for (waited = 0; waited < TEST_EVENT_WAIT_MSEC; waited += 10) {
+      Bool found = FALSE;
+      unsigned int i;
+
+      pthread_mutex_lock(&eventLock);
+      for (i = 0; i < numEvents && !found; i++) {
+         found = strcmp(eventNames[i], name) == 0;
+      }
+      pthread_mutex_unlock(&eventLock);
+
+      if (found) {
+         return TRUE;
+      }
+      usleep(10 * 1000);
+   }
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MakePath --
+ *
+ *      Creates a directory or, if isFile, an empty file, below root.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+MakePath(const char *root,   // IN
+         const char *path,   // IN
+         Bool isFile)        // IN
+{
+   char *fullPath = Str_Asprintf(NULL, "%s/%s", root, path);
+   Bool ok;
+
+   if (isFile) {
+      FILE *f = fopen(fullPath, "w");
+
+      ok = NULL != f;
+      if (ok) {
+         fclose(f);
+      }
+   } else {
+      ok = mkdir(fullPath, 0700) == 0;
+   }
+   free(fullPath);
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RemovePath --
+ *
+ *      Removes a file or an empty directory below root.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RemovePath(const char *root,   // IN
+           const char *path)   // IN
+{
+   char *fullPath = Str_Asprintf(NULL, "%s/%s", root, path);
+
+   remove(fullPath);
+   free(fullPath);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckServerStart --
+ *
+ *      Checks that starting the server does not start the notification
+ *      monitor thread, even with notification enabled.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CheckServerStart(void)
+{
+   static HgfsServerConfig serverCfg = {
+      HGFS_CONFIG_NOTIFY_ENABLED | HGFS_CONFIG_VOL_INFO_MIN,
+      HGFS_MAX_CACHED_FILENODES
+   };
+   HgfsServerCallbacks *serverCbTable;
+   HgfsServerMgrCallbacks mgrCb;
+   int threads = CountThreads();
+
+   memset(&mgrCb, 0, sizeof mgrCb);
+   if (!HgfsServerPolicy_Init(NULL, NULL, &mgrCb.enumResources) ||
+       !HgfsServer_InitState(&serverCbTable, &serverCfg, &mgrCb)) {
+      Check("server start", FALSE);
+      return;
+   }
+
+   Check("no monitor thread without a session",
+         threads > 0 && CountThreads() == threads);
+
+   HgfsServer_ExitState();
+   HgfsServerPolicy_Cleanup();
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckRecursive --
+ *
+ *      Checks the events of a recursive subscriber on a tree which changes
+ *      while it is watched.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CheckRecursive(const char *root,    // IN: shared folder
+               const char *other)   // IN: directory outside the share
+{
+   HgfsSharedFolderHandle folder;
+   HgfsSubscriberHandle subscriber;
+   char *from;
+   char *to;
+
+   if (!MakePath(root, "a", FALSE) || !MakePath(root, "a/b", FALSE) ||
+       !MakePath(other, "c", FALSE) || !MakePath(other, "c/d", FALSE)) {
+      Check("test tree", FALSE);
+      return;
+   }
+
+   if (HgfsNotify_Init() != HGFS_STATUS_SUCCESS) {
+      Check("notify init", FALSE);
+      return;
+   }
+
+   folder = HgfsNotify_AddSharedFolder(root, "share");
+   subscriber = HgfsNotify_AddSubscriber(folder, "",
+                                         HGFS_NOTIFY_CREATE_FILE |
+                                         HGFS_NOTIFY_CREATE_DIR |
+                                         HGFS_NOTIFY_NEW_DIR_NAME,
+                                         TRUE, EventReceived, NULL);
+   Check("subscribe", folder != HGFS_INVALID_FOLDER_HANDLE &&
+                      subscriber != HGFS_INVALID_SUBSCRIBER_HANDLE);
+
+   Check("event in existing subtree",
+         MakePath(root, "a/b/f1", TRUE) && WaitForEvent("a/b/f1"));
+
+   /* The moved tree is watched by the time its own event is delivered. */
+   from = Str_Asprintf(NULL, "%s/c", other);
+   to = Str_Asprintf(NULL, "%s/c", root);
+   Check("event for moved in tree", rename(from, to) == 0 && WaitForEvent("c"));
+   Check("event in moved in subtree",
+         MakePath(root, "c/d/f2", TRUE) && WaitForEvent("c/d/f2"));
+   free(from);
+   free(to);
+
+   Check("event for created directory",
+         MakePath(root, "e", FALSE) && WaitForEvent("e"));
+   Check("event in created directory",
+         MakePath(root, "e/f3", TRUE) && WaitForEvent("e/f3"));
+
+   Check("unsubscribe", HgfsNotify_RemoveSubscriber(subscriber));
+   HgfsNotify_RemoveSharedFolder(folder);
+   HgfsNotify_Exit();
+
+   RemovePath(root, "e/f3");
+   RemovePath(root, "e");
+   RemovePath(root, "c/d/f2");
+   RemovePath(root, "c/d");
+   RemovePath(root, "c");
+   RemovePath(root, "a/b/f1");
+   RemovePath(root, "a/b");
+   RemovePath(root, "a");
+}
+
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   char root[] = "/tmp/hgfsnotify.XXXXXX";
+   char other[] = "/tmp/hgfsnotify.XXXXXX";
+   unsigned int i;
+
+   if (NULL == mkdtemp(root) || NULL == mkdtemp(other)) {
+      ERROR("cannot create the test directories\n");
+      return 1;
+   }
+
+   CheckServerStart();
+   CheckRecursive(root, other);
+
+   rmdir(root);
+   rmdir(other);
+   for (i = 0; i < numEvents; i++) {
+      free(eventNames[i]);
+   }
+
+   if (failures != 0) {
+      ERROR("%u checks failed\n", failures);
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,931 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsserverio.c --
+ *
+ *   Sends reads and writes to an HGFS server running in this process over
+ *   a test channel which, like the vmhgfs-fuse loopback channel, identity
+ *   maps request buffers, and checks the data against a local file.
+ *
+ *   HGFS_OP_READ_FAST_V4 replies are read in place into the data packet
+ *   iovs when the channel advertises HGFS_CHANNEL_DATA_IOV, and through an
+ *   intermediate buffer otherwise. Both are checked, and so is that the in
+ *   place read maps each data page only once.
+ *
+ *   Vectored reads and writes (HGFS_OP_READV_V4 and HGFS_OP_WRITEV_V4) must
+ *   be advertised on such a channel, and are checked to transfer each
+ *   extent to and from its place in the file.
+ *
+ *   Search reads must not report the attributes gathered when the directory
+ *   was scanned once those are older than the server keeps them.
+ *
+ *   Exits with a non-zero status if any check fails.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "cpName.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsServerPolicy.h"
+#include "str.h"
+
+#define TEST_FILE_SIZE    (5 * PAGE_SIZE + 123)
+#define TEST_PACKET_MAX   HGFS_LARGE_PACKET_MAX
+#define TEST_MAX_IOVS     (2 * (CEILING(TEST_PACKET_MAX, PAGE_SIZE) + 1))
+
+/* Longer than the server uses the attributes of a directory scan. */
+#define TEST_SEARCH_ATTR_WAIT_MSEC   1500
+
+#define ERROR(fmt, args...)  fprintf(stderr, fmt, ## args)
+
+typedef struct TestChannel {
+   HgfsServerCallbacks *serverCbTable;   /* Server entry points. */
+   void *serverSession;                  /* Server transport session. */
+   uint64 sessionId;                     /* HGFS session ID. */
+   uint32 requestId;                     /* Last request ID. */
+   size_t replySize;                     /* Size of the last reply. */
+   const char *dataStart;                /* Data packet buffer, */
+   const char *dataEnd;                  /* and its end. */
+   unsigned int dataMaps;                /* Data pages mapped. */
+   Bool supported[HGFS_OP_MAX];          /* Ops advertised by the session. */
+} TestChannel;
+
+static TestChannel channel;
+static char request[TEST_PACKET_MAX];
+static char reply[TEST_PACKET_MAX];
+static char fileData[TEST_FILE_SIZE];
+
+static unsigned int failures;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestMapVa --
+ *
+ *      Maps a request buffer page for the server. Pages are identity mapped
+ *      and maps of data packet pages are counted.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+TestMapVa(uint64 pa,        // IN: "physical" address
+          uint32 size,      // IN: size of the mapping
+          void **context)   // OUT: mapping context
+{
+   const char *va = (const char *)(uintptr_t)pa;
+
+   if (va >= channel.dataStart && va < channel.dataEnd) {
+      channel.dataMaps++;
+   }
+   *context = (void *)va;
+   return (void *)va;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestUnmapVa --
+ *
+ *      Releases a page mapped by TestMapVa.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestUnmapVa(void **context)   // IN/OUT: mapping context
+{
+   *context = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestServerSend --
+ *
+ *      Called by the server to send the reply of a request, which is
+ *      already in the reply buffer.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestServerSend(void *opaqueSession,   // IN: channel
+               HgfsPacket *packet,    // IN/OUT: reply packet
+               HgfsSendFlags flags)   // IN: send flags
+{
+   channel.replySize = packet->replyPacketDataSize;
+   channel.serverCbTable->session.sendComplete(packet, channel.serverSession);
+   return TRUE;
+}
+
+
+static HgfsServerChannelCallbacks testChannelCbTable = {
+   TestMapVa,
+   TestMapVa,
+   TestUnmapVa,
+   TestServerSend,
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestInitIov --
+ *
+ *      Describes a buffer to the server as a list of page bounded iovs.
+ *
+ * Results:
+ *      The number of iovs used.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+TestInitIov(char *buf,          // IN: buffer
+            size_t size,        // IN: buffer size
+            HgfsVmxIov *iov)    // OUT: iovs
+{
+   uint32 count = 0;
+
+   while (size > 0) {
+      uint32 len = MIN(size, PAGE_SIZE - PAGE_OFFSET(buf));
+
+      iov[count].va = NULL;
+      iov[count].pa = (uintptr_t)buf;
+      iov[count].len = len;
+      iov[count].context = NULL;
+      buf += len;
+      size -= len;
+      count++;
+   }
+
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestSend --
+ *
+ *      Sends the request in the request buffer, with an optional separate
+ *      data packet, to the server and checks the reply header.
+ *
+ * Results:
+ *      The reply payload, NULL if the request failed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+TestSend(HgfsOp op,            // IN: operation
+         size_t payloadSize,   // IN: size of the request payload
+         char *data,           // IN/OUT: data packet, may be NULL
+         size_t dataSize)      // IN: size of the data packet
+{
+   HgfsHeader *header = (HgfsHeader *)request;
+   HgfsHeader *replyHeader = (HgfsHeader *)reply;
+   HgfsPacket *packet;
+   size_t requestSize = sizeof *header + payloadSize;
+
+   memset(header, 0, sizeof *header);
+   header->version = HGFS_HEADER_VERSION;
+   header->dummy = HGFS_OP_NEW_HEADER;
+   header->headerSize = sizeof *header;
+   header->packetSize = requestSize;
+   header->requestId = ++channel.requestId;
+   header->op = op;
+   header->sessionId = channel.sessionId;
+   header->flags = HGFS_PACKET_FLAG_REQUEST;
+
+   packet = calloc(1, sizeof *packet + TEST_MAX_IOVS * sizeof (HgfsVmxIov));
+   if (packet == NULL) {
+      ERROR("out of memory\n");
+      exit(1);
+   }
+
+   packet->iovCount = TestInitIov(request, requestSize, packet->iov);
+   packet->metaPacketSize = requestSize;
+   packet->metaPacketDataSize = requestSize;
+   if (data != NULL) {
+      packet->dataPacketIovIndex = packet->iovCount;
+      packet->iovCount += TestInitIov(data, dataSize,
+                                      &packet->iov[packet->iovCount]);
+      packet->dataPacketSize = dataSize;
+   }
+   packet->replyPacket = reply;
+   packet->replyPacketSize = sizeof reply;
+   packet->state |= HGFS_STATE_CLIENT_REQUEST;
+
+   channel.dataStart = data;
+   channel.dataEnd = data + dataSize;
+   channel.dataMaps = 0;
+   channel.replySize = 0;
+   memset(replyHeader, 0, sizeof *replyHeader);
+
+   channel.serverCbTable->session.receive(packet, channel.serverSession);
+   free(packet);
+
+   if (channel.replySize < sizeof *replyHeader ||
+       replyHeader->requestId != channel.requestId) {
+      ERROR("op %d: no reply\n", op);
+      return NULL;
+   }
+   if (replyHeader->status != HGFS_STATUS_SUCCESS) {
+      ERROR("op %d: status %u\n", op, replyHeader->status);
+      return NULL;
+   }
+   return reply + replyHeader->headerSize;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestConnect --
+ *
+ *      Connects the test channel to the server with the given capabilities
+ *      and creates an HGFS session.
+ *
+ * Results:
+ *      TRUE on success, FALSE otherwise.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestConnect(HgfsChannelFlags flags)   // IN: channel capabilities
+{
+   HgfsServerChannelData capabilities = { flags, TEST_PACKET_MAX };
+   HgfsRequestCreateSessionV4 *requestV4;
+   HgfsReplyCreateSessionV4 *replyV4;
+   uint32 i;
+
+   if (!channel.serverCbTable->session.connect(&channel, &testChannelCbTable,
+                                               &capabilities,
+                                               &channel.serverSession)) {
+      ERROR("cannot connect to the server\n");
+      return FALSE;
+   }
+
+   requestV4 = (HgfsRequestCreateSessionV4 *)(request + sizeof (HgfsHeader));
+   memset(requestV4, 0, sizeof *requestV4);
+   requestV4->numCapabilities = 0;
+   requestV4->maxPacketSize = TEST_PACKET_MAX;
+
+   channel.sessionId = HGFS_INVALID_SESSION_ID;
+   replyV4 = TestSend(HGFS_OP_CREATE_SESSION_V4, sizeof *requestV4, NULL, 0);
+   if (replyV4 == NULL) {
+      ERROR("cannot create a session\n");
+      return FALSE;
+   }
+   channel.sessionId = replyV4->sessionId;
+
+   memset(channel.supported, 0, sizeof channel.supported);
+   for (i = 0; i < replyV4->numCapabilities; i++) {
+      HgfsOp op = replyV4->capabilities[i].op;
+
+      if (op < ARRAYSIZE(channel.supported)) {
+         channel.supported[op] =
+            (replyV4->capabilities[i].flags & HGFS_REQUEST_SUPPORTED) != 0;
+      }
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestDisconnect --
+ *
+ *      Disconnects the test channel from the server.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestDisconnect(void)
+{
+   channel.serverCbTable->session.disconnect(channel.serverSession);
+   channel.serverCbTable->session.close(channel.serverSession);
+   channel.serverSession = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestOpen --
+ *
+ *      Opens a local file through the server root share.
+ *
+ * Results:
+ *      TRUE and the HGFS handle on success, FALSE otherwise.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestOpen(const char *path,       // IN: absolute local path
+         HgfsOpenMode mode,      // IN: access mode
+         HgfsHandle *file)       // OUT: HGFS handle
+{
+   HgfsRequestOpenV3 *requestV3;
+   HgfsReplyOpenV3 *replyV3;
+   char name[PATH_MAX];
+   int nameLen;
+
+   requestV3 = (HgfsRequestOpenV3 *)(request + sizeof (HgfsHeader));
+   memset(requestV3, 0, sizeof *requestV3);
+
+   Str_Sprintf(name, sizeof name, "%s%s", HGFS_SERVER_POLICY_ROOT_SHARE_NAME,
+               path);
+   nameLen = CPName_ConvertTo(name, sizeof request - sizeof (HgfsHeader) -
+                                    sizeof *requestV3,
+                              requestV3->fileName.name);
+   if (nameLen < 0) {
+      ERROR("cannot convert %s\n", path);
+      return FALSE;
+   }
+
+   requestV3->mask = HGFS_OPEN_VALID_MODE | HGFS_OPEN_VALID_FLAGS |
+                     HGFS_OPEN_VALID_FILE_NAME;
+   requestV3->mode = mode;
+   requestV3->flags = HGFS_OPEN;
+   requestV3->desiredLock = HGFS_LOCK_NONE;
+   requestV3->fileName.length = nameLen;
+   requestV3->fileName.caseType = HGFS_FILE_NAME_CASE_SENSITIVE;
+   requestV3->fileName.fid = HGFS_INVALID_HANDLE;
+
+   replyV3 = TestSend(HGFS_OP_OPEN_V3, sizeof *requestV3 + nameLen, NULL, 0);
+   if (replyV3 == NULL) {
+      ERROR("cannot open %s\n", path);
+      return FALSE;
+   }
+   *file = replyV3->file;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestClose --
+ *
+ *      Closes an HGFS handle.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestClose(HgfsHandle file)   // IN: HGFS handle
+{
+   HgfsRequestCloseV3 *requestV3;
+
+   requestV3 = (HgfsRequestCloseV3 *)(request + sizeof (HgfsHeader));
+   memset(requestV3, 0, sizeof *requestV3);
+   requestV3->file = file;
+   if (TestSend(HGFS_OP_CLOSE_V3, sizeof *requestV3, NULL, 0) == NULL) {
+      failures++;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckReadFast --
+ *
+ *      Reads a range of the file with HGFS_OP_READ_FAST_V4 into a data
+ *      packet which starts at an offset into a page, and checks the data.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CheckReadFast(const char *name,      // IN: test name
+              HgfsHandle file,       // IN: HGFS handle
+              uint64 offset,         // IN: file offset
+              uint32 size,           // IN: size to read
+              uint32 pageOffset,     // IN: data packet offset into a page
+              Bool inPlace)          // IN: data iovs are read in place
+{
+   static char dataBuf[TEST_FILE_SIZE + 2 * PAGE_SIZE];
+   char *data = (char *)ROUNDUP((uintptr_t)dataBuf, PAGE_SIZE) + pageOffset;
+   uint32 expected = offset < TEST_FILE_SIZE ?
+                     MIN(size, TEST_FILE_SIZE - offset) : 0;
+   uint32 dataIovs = CEILING(pageOffset + size, PAGE_SIZE) -
+                     pageOffset / PAGE_SIZE;
+   HgfsRequestReadV3 *requestV3;
+   HgfsReplyReadV3 *replyV3;
+   unsigned int oldFailures = failures;
+
+   ASSERT(pageOffset < PAGE_SIZE && size <= TEST_FILE_SIZE);
+
+   requestV3 = (HgfsRequestReadV3 *)(request + sizeof (HgfsHeader));
+   memset(requestV3, 0, sizeof *requestV3);
+   requestV3->file = file;
+   requestV3->offset = offset;
+   requestV3->requiredSize = size;
+
+   memset(data, 0xa5, size);
+   replyV3 = TestSend(HGFS_OP_READ_FAST_V4, sizeof *requestV3, data, size);
+   if (replyV3 == NULL) {
+      failures++;
+   } else if (replyV3->actualSize != expected) {
+      ERROR("FAIL %s: read %u bytes, expected %u\n", name,
+            replyV3->actualSize, expected);
+      failures++;
+   } else if (memcmp(data, fileData + offset, expected) != 0) {
+      ERROR("FAIL %s: data mismatch\n", name);
+      failures++;
+   } else if (inPlace && channel.dataMaps != dataIovs) {
+      ERROR("FAIL %s: %u data page maps, expected %u\n", name,
+            channel.dataMaps, dataIovs);
+      failures++;
+   }
+
+   printf("%-40s %s\n", name, failures == oldFailures ? "ok" : "FAILED");
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckReads --
+ *
+ *      Runs the read checks over a channel with the given capabilities.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CheckReads(const char *path,          // IN: local test file
+           HgfsChannelFlags flags)    // IN: channel capabilities
+{
+   Bool inPlace = (flags & HGFS_CHANNEL_DATA_IOV) != 0;
+   HgfsHandle file;
+
+   printf("%s:\n", inPlace ? "in place reads" : "buffered reads");
+   if (!TestConnect(flags)) {
+      failures++;
+      return;
+   }
+   if (!TestOpen(path, HGFS_OPEN_MODE_READ_ONLY, &file)) {
+      failures++;
+      TestDisconnect();
+      return;
+   }
+
+   CheckReadFast("  one page", file, 0, PAGE_SIZE, 0, inPlace);
+   CheckReadFast("  unaligned pages", file, 17, 3 * PAGE_SIZE, 100, inPlace);
+   CheckReadFast("  less than a page", file, PAGE_SIZE + 5, 200,
+                 PAGE_SIZE - 50, inPlace);
+   CheckReadFast("  short read at end of file", file, 4 * PAGE_SIZE,
+                 2 * PAGE_SIZE, 10, inPlace);
+   CheckReadFast("  read past end of file", file, TEST_FILE_SIZE + 1,
+                 PAGE_SIZE, 0, inPlace);
+
+   TestClose(file);
+   TestDisconnect();
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckWriteV --
+ *
+ *      Writes a list of extents with HGFS_OP_WRITEV_V4 and checks the whole
+ *      file against the expected contents.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CheckWriteV(const char *name,                 // IN: test name
+            const char *path,                 // IN: local test file
+            HgfsHandle file,                  // IN: HGFS handle
+            const HgfsIoExtentV4 *extents,    // IN: extents to write
+            uint32 numExtents)                // IN: number of extents
+{
+   static char data[HGFS_VECTORED_IO_MAX];
+   static char contents[TEST_FILE_SIZE];
+   HgfsRequestWriteVV4 *requestV4;
+   HgfsReplyWriteVV4 *replyV4;
+   unsigned int oldFailures = failures;
+   uint32 totalSize = 0;
+   uint32 i;
+   FILE *fp;
+
+   requestV4 = (HgfsRequestWriteVV4 *)(request + sizeof (HgfsHeader));
+   memset(requestV4, 0, sizeof *requestV4);
+   requestV4->file = file;
+   requestV4->flags = 0;
+   requestV4->numExtents = numExtents;
+   memcpy(requestV4->extents, extents, numExtents * sizeof *extents);
+
+   /* Pack new data for each extent and expect it in the file. */
+   for (i = 0; i < numExtents; i++) {
+      uint32 j;
+
+      ASSERT(extents[i].offset + extents[i].length <= TEST_FILE_SIZE);
+      for (j = 0; j < extents[i].length; j++) {
+         data[totalSize + j] = (char)(0x80 + i * 13 + j);
+      }
+      memcpy(fileData + extents[i].offset, data + totalSize,
+             extents[i].length);
+      totalSize += extents[i].length;
+   }
+
+   replyV4 = TestSend(HGFS_OP_WRITEV_V4,
+                      offsetof(HgfsRequestWriteVV4, extents) +
+                      numExtents * sizeof *extents, data, totalSize);
+   if (replyV4 == NULL) {
+      failures++;
+   } else if (replyV4->actualSize != totalSize) {
+      ERROR("FAIL %s: wrote %u bytes, expected %u\n", name,
+            replyV4->actualSize, totalSize);
+      failures++;
+   } else if ((fp = fopen(path, "rb")) == NULL) {
+      ERROR("FAIL %s: cannot open %s\n", name, path);
+      failures++;
+   } else {
+      if (fread(contents, 1, sizeof contents, fp) != sizeof contents ||
+          memcmp(contents, fileData, sizeof contents) != 0) {
+         ERROR("FAIL %s: file contents mismatch\n", name);
+         failures++;
+      }
+      fclose(fp);
+   }
+
+   printf("%-40s %s\n", name, failures == oldFailures ? "ok" : "FAILED");
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckReadV --
+ *
+ *      Reads a list of extents with HGFS_OP_READV_V4 and checks the size and
+ *      data of each extent.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CheckReadV(const char *name,                  // IN: test name
+           HgfsHandle file,                   // IN: HGFS handle
+           const HgfsIoExtentV4 *extents,     // IN: extents to read
+           uint32 numExtents)                 // IN: number of extents
+{
+   static char data[HGFS_VECTORED_IO_MAX];
+   HgfsRequestReadVV4 *requestV4;
+   HgfsReplyReadVV4 *replyV4;
+   unsigned int oldFailures = failures;
+   uint32 totalSize = 0;
+   uint32 actualSize = 0;
+   uint32 i;
+
+   requestV4 = (HgfsRequestReadVV4 *)(request + sizeof (HgfsHeader));
+   memset(requestV4, 0, sizeof *requestV4);
+   requestV4->file = file;
+   requestV4->numExtents = numExtents;
+   memcpy(requestV4->extents, extents, numExtents * sizeof *extents);
+   for (i = 0; i < numExtents; i++) {
+      totalSize += extents[i].length;
+   }
+
+   memset(data, 0xa5, totalSize);
+   replyV4 = TestSend(HGFS_OP_READV_V4,
+                      offsetof(HgfsRequestReadVV4, extents) +
+                      numExtents * sizeof *extents, data, totalSize);
+   if (replyV4 == NULL) {
+      failures++;
+      goto exit;
+   }
+   if (replyV4->numExtents != numExtents) {
+      ERROR("FAIL %s: %u extents, expected %u\n", name,
+            replyV4->numExtents, numExtents);
+      failures++;
+      goto exit;
+   }
+
+   totalSize = 0;
+   for (i = 0; i < numExtents; i++) {
+      uint64 offset = extents[i].offset;
+      uint32 expected = offset < TEST_FILE_SIZE ?
+                        MIN(extents[i].length, TEST_FILE_SIZE - offset) : 0;
+
+      if (replyV4->extentSizes[i] != expected) {
+         ERROR("FAIL %s: extent %u: read %u bytes, expected %u\n", name, i,
+               replyV4->extentSizes[i], expected);
+         failures++;
+      } else if (memcmp(data + totalSize, fileData + offset, expected) != 0) {
+         ERROR("FAIL %s: extent %u: data mismatch\n", name, i);
+         failures++;
+      }
+      totalSize += extents[i].length;
+      actualSize += expected;
+   }
+   if (replyV4->actualSize != actualSize) {
+      ERROR("FAIL %s: read %u bytes, expected %u\n", name,
+            replyV4->actualSize, actualSize);
+      failures++;
+   }
+
+exit:
+   printf("%-40s %s\n", name, failures == oldFailures ? "ok" : "FAILED");
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckVectored --
+ *
+ *      Runs the vectored read and write checks over a channel with the
+ *      capabilities of the loopback channel.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CheckVectored(const char *path)   // IN: local test file
+{
+   static const HgfsIoExtentV4 writeExtents[] = {
+      { 10,                   100,           0 },
+      { 3 * PAGE_SIZE + 5,    PAGE_SIZE + 7, 0 },
+      { 500,                  200,           0 },
+      { 700,                  300,           0 },   /* Adjacent to the last. */
+   };
+   static const HgfsIoExtentV4 readExtents[] = {
+      { 0,                    64,            0 },
+      { 64,                   PAGE_SIZE,     0 },   /* Adjacent to the last. */
+      { 2 * PAGE_SIZE + 1,    3,             0 },
+      { 5 * PAGE_SIZE,        PAGE_SIZE,     0 },   /* Short at end of file. */
+      { TEST_FILE_SIZE + 10,  100,           0 },   /* Past end of file. */
+      { 700,                  300,           0 },
+   };
+   HgfsHandle file;
+   Bool supported;
+
+   printf("vectored reads and writes:\n");
+   if (!TestConnect(HGFS_CHANNEL_SHARED_MEM | HGFS_CHANNEL_DATA_IOV)) {
+      failures++;
+      return;
+   }
+
+   supported = channel.supported[HGFS_OP_READV_V4] &&
+               channel.supported[HGFS_OP_WRITEV_V4];
+   if (!supported) {
+      ERROR("FAIL vectored ops are not advertised\n");
+      failures++;
+   }
+   printf("%-40s %s\n", "  advertised", supported ? "ok" : "FAILED");
+
+   if (!TestOpen(path, HGFS_OPEN_MODE_READ_WRITE, &file)) {
+      failures++;
+      TestDisconnect();
+      return;
+   }
+
+   CheckReadV("  read extents", file, readExtents, ARRAYSIZE(readExtents));
+   CheckWriteV("  write extents", path, file, writeExtents,
+               ARRAYSIZE(writeExtents));
+   CheckReadV("  read written extents", file, writeExtents,
+              ARRAYSIZE(writeExtents));
+
+   TestClose(file);
+   TestDisconnect();
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestSearchRead --
+ *
+ *      Reads the entry at an offset of an open search with
+ *      HGFS_OP_SEARCH_READ_V3.
+ *
+ * Results:
+ *      TRUE and the name and size of the entry if there is one, FALSE at the
+ *      end of the search or on error.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestSearchRead(HgfsHandle search,   // IN: search handle
+               uint32 offset,       // IN: entry offset
+               char *name,          // OUT: entry name
+               size_t nameSize,     // IN: size of name
+               uint64 *size)        // OUT: entry file size
+{
+   HgfsRequestSearchReadV3 *requestV3;
+   HgfsReplySearchReadV3 *replyV3;
+   HgfsDirEntry *entry;
+
+   requestV3 = (HgfsRequestSearchReadV3 *)(request + sizeof (HgfsHeader));
+   memset(requestV3, 0, sizeof *requestV3);
+   requestV3->search = search;
+   requestV3->offset = offset;
+
+   replyV3 = TestSend(HGFS_OP_SEARCH_READ_V3, sizeof *requestV3, NULL, 0);
+   if (replyV3 == NULL || replyV3->count == 0) {
+      return FALSE;
+   }
+
+   entry = (HgfsDirEntry *)replyV3->payload;
+   if (entry->fileName.length == 0 || entry->fileName.length >= nameSize) {
+      return FALSE;
+   }
+   memcpy(name, entry->fileName.name, entry->fileName.length);
+   name[entry->fileName.length] = '\0';
+   *size = entry->attr.size;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckSearch --
+ *
+ *      Checks that a search read long after the directory was scanned
+ *      reports the current size of a file that grew in the meantime.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CheckSearch(void)
+{
+   char dir[] = "/tmp/hgfsserverio.XXXXXX";
+   char path[PATH_MAX];
+   char name[PATH_MAX];
+   HgfsRequestSearchOpenV3 *openV3;
+   HgfsReplySearchOpenV3 *openReplyV3;
+   HgfsRequestSearchCloseV3 *closeV3;
+   HgfsHandle search;
+   uint32 offset;
+   uint64 size = 0;
+   int nameLen;
+   FILE *f;
+   Bool ok = FALSE;
+
+   printf("search reads:\n");
+   if (NULL == mkdtemp(dir)) {
+      ERROR("cannot create the search directory\n");
+      failures++;
+      return;
+   }
+   Str_Sprintf(path, sizeof path, "%s/f", dir);
+   f = fopen(path, "w");
+   if (NULL == f || fwrite("x", 1, 1, f) != 1 || fclose(f) != 0) {
+      ERROR("cannot create the search file\n");
+      failures++;
+      rmdir(dir);
+      return;
+   }
+
+   if (!TestConnect(0)) {
+      failures++;
+      goto exit;
+   }
+
+   openV3 = (HgfsRequestSearchOpenV3 *)(request + sizeof (HgfsHeader));
+   memset(openV3, 0, sizeof *openV3);
+   Str_Sprintf(name, sizeof name, "%s%s", HGFS_SERVER_POLICY_ROOT_SHARE_NAME,
+               dir);
+   nameLen = CPName_ConvertTo(name, sizeof request - sizeof (HgfsHeader) -
+                                    sizeof *openV3,
+                              openV3->dirName.name);
+   openV3->dirName.length = nameLen;
+   openV3->dirName.caseType = HGFS_FILE_NAME_CASE_SENSITIVE;
+   openV3->dirName.fid = HGFS_INVALID_HANDLE;
+   openReplyV3 = nameLen < 0 ? NULL :
+                 TestSend(HGFS_OP_SEARCH_OPEN_V3, sizeof *openV3 + nameLen,
+                          NULL, 0);
+   if (openReplyV3 == NULL) {
+      ERROR("cannot open a search of %s\n", dir);
+      failures++;
+      TestDisconnect();
+      goto exit;
+   }
+   search = openReplyV3->search;
+
+   /* Stop at the file, a read past the last entry would rescan. */
+   for (offset = 0;
+        TestSearchRead(search, offset, name, sizeof name, &size);
+        offset++) {
+      if (strcmp(name, "f") == 0) {
+         break;
+      }
+   }
+
+   if (size == 1) {
+      f = fopen(path, "a");
+      if (NULL != f && fwrite("yz", 1, 2, f) == 2 && fclose(f) == 0) {
+         usleep(TEST_SEARCH_ATTR_WAIT_MSEC * 1000);
+         ok = TestSearchRead(search, offset, name, sizeof name, &size) &&
+              strcmp(name, "f") == 0 && size == 3;
+      }
+   }
+   if (!ok) {
+      ERROR("FAIL search read reported size %"FMT64"u\n", size);
+      failures++;
+   }
+   printf("%-40s %s\n", "  size after the scan", ok ? "ok" : "FAILED");
+
+   closeV3 = (HgfsRequestSearchCloseV3 *)(request + sizeof (HgfsHeader));
+   memset(closeV3, 0, sizeof *closeV3);
+   closeV3->search = search;
+   if (TestSend(HGFS_OP_SEARCH_CLOSE_V3, sizeof *closeV3, NULL, 0) == NULL) {
+      failures++;
+   }
+   TestDisconnect();
+
+exit:
+   unlink(path);
+   rmdir(dir);
+}
+
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   static HgfsServerConfig serverCfg = {
+      HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED | HGFS_CONFIG_VOL_INFO_MIN,
+      HGFS_MAX_CACHED_FILENODES
+   };
+   HgfsServerMgrCallbacks mgrCb;
+   char path[] = "/tmp/hgfsserverio.XXXXXX";
+   size_t i;
+   int fd;
+
+   for (i = 0; i < sizeof fileData; i++) {
+      fileData[i] = (char)(i * 7 + i / PAGE_SIZE);
+   }
+
+   fd = mkstemp(path);
+   if (fd < 0 || write(fd, fileData, sizeof fileData) != sizeof fileData) {
+      ERROR("cannot create the test file\n");
+      return 1;
+   }
+   close(fd);
+
+   memset(&mgrCb, 0, sizeof mgrCb);
+   if (!HgfsServerPolicy_Init(NULL, NULL, &mgrCb.enumResources) ||
+       !HgfsServer_InitState(&channel.serverCbTable, &serverCfg, &mgrCb)) {
+      ERROR("cannot start the server\n");
+      unlink(path);
+      return 1;
+   }
+
+   CheckReads(path, 0);
+   CheckReads(path, HGFS_CHANNEL_DATA_IOV);
+   CheckVectored(path);
+   CheckSearch();
+
+   HgfsServer_ExitState();
+   HgfsServerPolicy_Cleanup();
+   unlink(path);
+
+   if (failures != 0) {
+      ERROR("%u checks failed\n", failures);
+      return 1;
+   }
+   return 0;
+}
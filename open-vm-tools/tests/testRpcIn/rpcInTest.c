@@ -0,0 +1,236 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * rpcInTest.c --
+ *
+ *   Checks how the RpcIn backdoor loop adapts its polling delay to the
+ *   rate of TCLO messages: RpcInUpdateArrivalRate, RpcInGetIdleDelay and
+ *   the back-off of RpcInUpdateDelayTime. Time is driven by the test, in
+ *   the 10ms ticks of System_GetTimeMonotonic.
+ *
+ *   Also checks that RpcIn_ResetDelay makes the next poll of an idle
+ *   channel immediate.
+ *
+ *   Exits with a non-zero status if any check fails.
+ */
+
+#include <stdio.h>
+
+/* Let the test drive the clock of rpcin.c. */
+#define System_GetTimeMonotonic TestGetTimeMonotonic
+#include "rpcin.c"
+
+#define ERROR(fmt, args...)  fprintf(stderr, fmt, ## args)
+
+/* Max delay of the Tools RPC channel, RPCIN_MAX_DELAY in rpcChannelInt.h. */
+#define TEST_MAX_DELAY  10
+
+static unsigned int failures;
+static uint64 testNow;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestGetTimeMonotonic --
+ *
+ *      Clock of the code under test.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint64
+TestGetTimeMonotonic(void)
+{
+   return testNow;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestReset --
+ *
+ *      Puts the channel back in the state RpcIn_start leaves it in.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestReset(RpcIn *in)   // OUT
+{
+   memset(in, 0, sizeof *in);
+   in->maxDelay = TEST_MAX_DELAY;
+   testNow = 1000;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestArrivals --
+ *
+ *      Receives count messages, interval ticks apart, the first one
+ *      interval ticks from now.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestArrivals(RpcIn *in,              // IN/OUT
+             unsigned int count,     // IN
+             unsigned int interval)  // IN
+{
+   unsigned int i;
+
+   for (i = 0; i < count; i++) {
+      testNow += interval;
+      RpcInUpdateArrivalRate(in);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Check --
+ *
+ *      Reports the result of a check.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Check(const char *name,   // IN: test name
+      Bool ok)            // IN: check passed
+{
+   if (!ok) {
+      failures++;
+   }
+   printf("%-40s %s\n", name, ok ? "ok" : "FAILED");
+}
+
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   RpcIn in;
+   unsigned int delays[5];
+   unsigned int i;
+
+   /* Nothing is known about the rate before two messages arrived. */
+   TestReset(&in);
+   Check("no messages: full delay",
+         RpcInGetIdleDelay(&in) == TEST_MAX_DELAY);
+   TestArrivals(&in, 1, 5);
+   Check("one message: full delay",
+         in.arrivalInterval == 0 && RpcInGetIdleDelay(&in) == TEST_MAX_DELAY);
+
+   /* A host sending every 200ms is polled every 50ms while a message is due. */
+   TestReset(&in);
+   TestArrivals(&in, 4, 20);
+   Check("steady rate: interval",
+         in.arrivalInterval == 20);
+   Check("steady rate: quarter interval",
+         RpcInGetIdleDelay(&in) == 20 / RPCIN_POLLS_PER_ARRIVAL);
+   testNow += 40;
+   Check("quiet for 2 intervals: quarter interval",
+         RpcInGetIdleDelay(&in) == 20 / RPCIN_POLLS_PER_ARRIVAL);
+   testNow++;
+   Check("quiet for longer: full delay",
+         RpcInGetIdleDelay(&in) == TEST_MAX_DELAY);
+
+   /* The cap never exceeds the max delay: hosts slower than every 400ms. */
+   TestReset(&in);
+   TestArrivals(&in, 4, 4 * TEST_MAX_DELAY + 20);
+   Check("slow rate: full delay",
+         RpcInGetIdleDelay(&in) == TEST_MAX_DELAY);
+
+   /* The interval is smoothed and bounded. */
+   TestReset(&in);
+   TestArrivals(&in, 2, 20);
+   TestArrivals(&in, 1, 4);
+   Check("interval smoothed",
+         in.arrivalInterval == (3 * 20 + 4) / 4);
+   TestReset(&in);
+   TestArrivals(&in, 2, RPCIN_MAX_ARRIVAL_INTERVAL + 100);
+   Check("interval bounded",
+         in.arrivalInterval == RPCIN_MAX_ARRIVAL_INTERVAL);
+
+   /* Two messages within one tick: a zero interval. */
+   TestReset(&in);
+   TestArrivals(&in, 1, 1);
+   TestArrivals(&in, 1, 0);
+   Check("zero interval: rate known",
+         in.arrivalInterval == 1 && RpcInGetIdleDelay(&in) == 1);
+   TestArrivals(&in, 8, 0);
+   Check("burst in one tick: rate known",
+         in.arrivalInterval == 1 && RpcInGetIdleDelay(&in) == 1);
+   testNow += 3;
+   Check("burst then quiet: full delay",
+         RpcInGetIdleDelay(&in) == TEST_MAX_DELAY);
+
+   /* The back-off doubles up to the idle delay. */
+   TestReset(&in);
+   TestArrivals(&in, 4, 20);
+   for (i = 0; i < ARRAYSIZE(delays); i++) {
+      RpcInUpdateDelayTime(&in);
+      delays[i] = in.delay;
+   }
+   Check("back-off capped at idle delay",
+         delays[0] == 1 && delays[1] == 2 && delays[2] == 4 &&
+         delays[3] == 5 && delays[4] == 5);
+   testNow += 41;
+   RpcInUpdateDelayTime(&in);
+   Check("back-off resumes to full delay", in.delay == TEST_MAX_DELAY);
+
+   /*
+    * Activity on an idle channel reschedules the poll at once. The channel
+    * is never used, as the loop does not run.
+    */
+   TestReset(&in);
+   in.channel = (Message_Channel *)&in;
+#if defined(VMTOOLS_USE_GLIB)
+   in.mainCtx = g_main_context_new();
+#endif
+   in.delay = TEST_MAX_DELAY;
+   if (RpcInScheduleRecvEvent(&in)) {
+      RpcIn_ResetDelay(&in);
+      Check("activity: poll at once", in.delay == 0 && in.nextEvent != NULL);
+      in.inLoop = TRUE;
+      in.delay = TEST_MAX_DELAY;
+      RpcIn_ResetDelay(&in);
+      Check("activity in the loop: unchanged", in.delay == TEST_MAX_DELAY);
+      in.inLoop = FALSE;
+   } else {
+      Check("activity: schedule", FALSE);
+   }
+   in.channel = NULL;
+   RpcInStop(&in);
+#if defined(VMTOOLS_USE_GLIB)
+   g_main_context_unref(in.mainCtx);
+#endif
+
+   if (failures != 0) {
+      ERROR("%u checks failed\n", failures);
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,284 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * threadPoolTest.c --
+ *
+ *   Checks the task queue of the vmtoolsd shared thread pool: task IDs
+ *   skip the IDs of queued tasks when the counter wraps, and a worker
+ *   woken for a task that was cancelled in the meantime returns without
+ *   running anything.
+ *
+ *   The pool's worker function is called directly rather than from pool
+ *   threads, so that each wake up happens at a known point.
+ *
+ *   Exits with a non-zero status if any check fails.
+ */
+
+#include <stdio.h>
+
+#include "threadPool.c"
+
+#define ERROR(fmt, args...)  fprintf(stderr, fmt, ## args)
+
+static unsigned int failures;
+static guint tasksRun;
+static guint tasksFreed;
+static guint lastRun;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ToolsCoreService_RegisterProperty --
+ *
+ *      Stub for the service object, which the test does not create.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+ToolsCoreService_RegisterProperty(ToolsCoreService *obj,    // IN
+                                  ToolsServiceProperty *prop) // IN
+{
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestTask --
+ *
+ *      Task callback. Records that the task with the ID in data ran.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestTask(ToolsAppCtx *ctx,   // IN
+         gpointer data)      // IN: task number
+{
+   tasksRun++;
+   lastRun = GPOINTER_TO_UINT(data);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestTaskFree --
+ *
+ *      Task data destructor. Counts destroyed tasks.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestTaskFree(gpointer data)   // IN: task number
+{
+   tasksFreed++;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestIgnoreWake --
+ *
+ *      Function of the thread pool the tasks are pushed to. Does nothing:
+ *      the test wakes workers itself with ToolsCorePoolRunWorker.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestIgnoreWake(gpointer state,        // IN
+               gpointer clientData)   // IN
+{
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestSubmit --
+ *
+ *      Submits a TestTask.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static guint
+TestSubmit(guint number)   // IN: task number
+{
+   return ToolsCorePoolSubmit(NULL, TestTask, GUINT_TO_POINTER(number),
+                              TestTaskFree);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Check --
+ *
+ *      Reports the result of a check.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Check(const char *name,   // IN: test name
+      gboolean ok)        // IN: check passed
+{
+   if (!ok) {
+      failures++;
+   }
+   printf("%-40s %s\n", name, ok ? "ok" : "FAILED");
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckCancelAfterWake --
+ *
+ *      Cancels tasks after the pool was pushed for them and then wakes the
+ *      workers the pushes are for.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CheckCancelAfterWake(void)
+{
+   guint id1;
+   guint id2;
+
+   tasksRun = 0;
+   tasksFreed = 0;
+
+   id1 = TestSubmit(1);
+   ToolsCorePoolCancel(id1);
+   ToolsCorePoolRunWorker(NULL, NULL);
+   Check("cancelled task is not run",
+         tasksRun == 0 && tasksFreed == 1 && gState.stats.depth == 0 &&
+         gState.stats.cancelled == 1);
+
+   id1 = TestSubmit(2);
+   id2 = TestSubmit(3);
+   ToolsCorePoolCancel(id1);
+   ToolsCorePoolRunWorker(NULL, NULL);
+   ToolsCorePoolRunWorker(NULL, NULL);
+   Check("wake runs the task still queued",
+         tasksRun == 1 && lastRun == 3 && tasksFreed == 3 &&
+         g_hash_table_lookup(gState.workTasks,
+                             GUINT_TO_POINTER(id2)) == NULL);
+
+   TestSubmit(4);
+   TestSubmit(5);
+   ToolsCorePoolRunWorker(NULL, NULL);
+   Check("tasks run in submission order", tasksRun == 2 && lastRun == 4);
+   ToolsCorePoolRunWorker(NULL, NULL);
+   Check("queue drained",
+         tasksRun == 3 && lastRun == 5 && gState.stats.depth == 0 &&
+         g_queue_is_empty(gState.workQueue));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckIdWrap --
+ *
+ *      Wraps the task ID counter around tasks that are still queued.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CheckIdWrap(void)
+{
+   guint ids[3];
+   guint id;
+   guint i;
+
+   gState.nextWorkId = UINT_MAX - 2;
+   ids[0] = TestSubmit(0);
+   ids[1] = TestSubmit(1);
+   ids[2] = TestSubmit(2);
+   Check("counter wraps to 1",
+         ids[0] == UINT_MAX - 1 && ids[1] == UINT_MAX && ids[2] == 1);
+
+   gState.nextWorkId = UINT_MAX - 2;
+   id = TestSubmit(3);
+   Check("IDs of queued tasks are skipped", id == 2);
+   ToolsCorePoolCancel(id);
+
+   ToolsCorePoolCancel(ids[1]);
+   gState.nextWorkId = UINT_MAX - 2;
+   id = TestSubmit(4);
+   Check("ID of a cancelled task is reused", id == UINT_MAX);
+   ids[1] = id;
+
+   for (i = 0; i < ARRAYSIZE(ids); i++) {
+      ToolsCorePoolCancel(ids[i]);
+   }
+   Check("wrapped tasks cancelled",
+         gState.stats.depth == 0 && g_hash_table_size(gState.workTasks) == 0);
+}
+
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   GError *err = NULL;
+
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+   if (!g_thread_supported()) {
+      g_thread_init(NULL);
+   }
+#endif
+
+   gState.active = TRUE;
+   gState.lock = g_mutex_new();
+   gState.threads = g_ptr_array_new();
+   gState.workQueue = g_queue_new();
+   gState.workTasks = g_hash_table_new(g_direct_hash, g_direct_equal);
+   gState.pool = g_thread_pool_new(TestIgnoreWake, NULL, 1, FALSE, &err);
+   if (err != NULL) {
+      ERROR("cannot create thread pool: %s\n", err->message);
+      g_clear_error(&err);
+      return 1;
+   }
+
+   CheckCancelAfterWake();
+   CheckIdWrap();
+
+   g_thread_pool_free(gState.pool, FALSE, TRUE);
+   g_hash_table_destroy(gState.workTasks);
+   g_queue_free(gState.workQueue);
+   g_ptr_array_free(gState.threads, TRUE);
+   g_mutex_free(gState.lock);
+
+   if (failures != 0) {
+      ERROR("%u checks failed\n", failures);
+      return 1;
+   }
+   return 0;
+}
@@ -20,6 +20,13 @@
  * bdhandler.c --
  *
  * Background thread for handling backdoor requests and replies.
+ *
+ * Each backdoor request is one synchronous round trip on an RpcOut channel,
+ * so a single channel allows only one request in flight. The backdoor
+ * transport therefore keeps a small set of RpcOut channels: a sender takes an
+ * idle one, opening another while fewer than the bd_connections mount option
+ * exist, and dispatches on it without holding connLock. By default there is
+ * a single channel and requests are sent one at a time.
  */
 
 /* Must come before any kernel header file. */
@@ -34,7 +41,15 @@
 #include "transport.h"
 #include "vm_assert.h"
 
+typedef struct HgfsBdConnections {
+   RpcOut *idle[HGFS_BD_MAX_CONNECTIONS];  /* Open channels not in use. */
+   uint32 numIdle;                         /* Entries in idle. */
+   uint32 numOpen;                         /* Idle plus in use channels. */
+   pthread_cond_t idleCond;                /* Signalled on check-in. */
+} HgfsBdConnections;
+
 static HgfsTransportChannel bdChannel;
+static HgfsBdConnections bdConnections;
 
 
 /*
@@ -64,15 +79,22 @@ HgfsBdChannelOpen(HgfsTransportChannel *channel) // IN: Channel
    case HGFS_CHANNEL_CONNECTED:
       LOG(8, ("Backdoor already connected.\n"));
       break;
-   case HGFS_CHANNEL_NOTCONNECTED:
-      if (HgfsBd_OpenBackdoor((RpcOut **)&channel->priv)) {
+   case HGFS_CHANNEL_NOTCONNECTED: {
+      HgfsBdConnections *conns = channel->priv;
+      RpcOut *out = NULL;
+
+      ASSERT(conns->numOpen == 0);
+      if (HgfsBd_OpenBackdoor(&out)) {
          LOG(8, ("Backdoor opened and connected.\n"));
+         conns->idle[0] = out;
+         conns->numIdle = 1;
+         conns->numOpen = 1;
          channel->status = HGFS_CHANNEL_CONNECTED;
-         ASSERT(channel->priv != NULL);
       } else {
          LOG(8, ("ERROR: Backdoor cannot connect.\n"));
       }
       break;
+   }
    default:
       ASSERT(0); /* Not reached. */
       LOG(2, ("ERROR: Backdoor status %d is unknown resetting.\n",
@@ -105,9 +127,14 @@ static void
 HgfsBdChannelCloseInt(HgfsTransportChannel *channel) // IN: Channel
 {
    if (channel->status == HGFS_CHANNEL_CONNECTED) {
-      ASSERT(channel->priv != NULL);
-      HgfsBd_CloseBackdoor((RpcOut **)&channel->priv);
-      ASSERT(channel->priv == NULL);
+      HgfsBdConnections *conns = channel->priv;
+
+      /* The transport never closes the channel with sends in progress. */
+      ASSERT(conns->numIdle == conns->numOpen);
+      while (conns->numIdle > 0) {
+         HgfsBd_CloseBackdoor(&conns->idle[--conns->numIdle]);
+      }
+      conns->numOpen = 0;
       channel->status = HGFS_CHANNEL_NOTCONNECTED;
    }
    LOG(8, ("Backdoor closed.\n"));
@@ -140,6 +167,100 @@ HgfsBdChannelClose(HgfsTransportChannel *channel) // IN: Channel
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsBdConnectionGet --
+ *
+ *     Take an idle RpcOut channel for a request, opening a new one if
+ *     there is none and the limit has not been reached, otherwise waiting
+ *     for another sender to return one. Called with connLock held.
+ *
+ * Results:
+ *     0 and the channel on success, negative error on failure.
+ *
+ * Side effects:
+ *     May open a channel to the host. connLock is dropped while opening
+ *     and waiting.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsBdConnectionGet(HgfsTransportChannel *channel, // IN: Channel
+                    RpcOut **out)                  // OUT: RpcOut channel
+{
+   HgfsBdConnections *conns = channel->priv;
+
+   for (;;) {
+      if (channel->status != HGFS_CHANNEL_CONNECTED) {
+         LOG(6, ("Backdoor not opened.\n"));
+         return -ENOTCONN;
+      }
+      if (conns->numIdle > 0) {
+         *out = conns->idle[--conns->numIdle];
+         return 0;
+      }
+      if (conns->numOpen < gState->bdConnections) {
+         Bool opened;
+
+         *out = NULL;
+         conns->numOpen++;
+         pthread_mutex_unlock(&channel->connLock);
+         opened = HgfsBd_OpenBackdoor(out);
+         pthread_mutex_lock(&channel->connLock);
+         if (opened) {
+            LOG(8, ("Backdoor connection %u opened.\n", conns->numOpen));
+            return 0;
+         }
+         conns->numOpen--;
+         LOG(6, ("Backdoor cannot open connection %u.\n",
+                 conns->numOpen + 1));
+         if (conns->numOpen == 0) {
+            return -EIO;
+         }
+      }
+      pthread_cond_wait(&conns->idleCond, &channel->connLock);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsBdConnectionPut --
+ *
+ *     Return an RpcOut channel taken by HgfsBdConnectionGet. A channel
+ *     whose last request failed is closed rather than reused. Called with
+ *     connLock held.
+ *
+ * Results:
+ *     None
+ *
+ * Side effects:
+ *     Wakes a sender waiting for a channel.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsBdConnectionPut(HgfsTransportChannel *channel, // IN: Channel
+                    RpcOut *out,                   // IN: RpcOut channel
+                    Bool failed)                   // IN: last request failed
+{
+   HgfsBdConnections *conns = channel->priv;
+
+   if (failed) {
+      HgfsBd_CloseBackdoor(&out);
+      conns->numOpen--;
+   } else {
+      ASSERT(conns->numIdle < HGFS_BD_MAX_CONNECTIONS);
+      conns->idle[conns->numIdle++] = out;
+   }
+   pthread_cond_signal(&conns->idleCond);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -162,27 +283,30 @@ HgfsBdChannelSend(HgfsTransportChannel *channel, // IN: Channel
 {
    char const *replyPacket = NULL;
    size_t payloadSize;
+   RpcOut *out;
    int ret;
 
    ASSERT(req);
    ASSERT(req->state == HGFS_REQ_STATE_UNSENT);
-   ASSERT(req->payloadSize <= HGFS_LARGE_PACKET_MAX);
+   ASSERT(req->payloadSize <= channel->maxPacketSize);
 
    pthread_mutex_lock(&channel->connLock);
-
-   if (channel->status != HGFS_CHANNEL_CONNECTED) {
-      LOG(6, ("Backdoor not opened.\n"));
-      pthread_mutex_unlock(&channel->connLock);
-      return -ENOTCONN;
+   ret = HgfsBdConnectionGet(channel, &out);
+   pthread_mutex_unlock(&channel->connLock);
+   if (ret != 0) {
+      return ret;
    }
 
    payloadSize = req->payloadSize;
    LOG(8, ("Backdoor sending.\n"));
-   ret = HgfsBd_Dispatch(channel->priv, HGFS_REQ_PAYLOAD(req), &payloadSize,
+   ret = HgfsBd_Dispatch(out, HGFS_REQ_PAYLOAD(req), &payloadSize,
                          &replyPacket);
    if (ret == 0) {
       LOG(8, ("Backdoor reply received.\n"));
-      /* Request sent successfully. Copy the reply and wake the client. */
+      /*
+       * Request sent successfully. Copy the reply, which lives in the
+       * RpcOut channel, before the channel is handed to another sender.
+       */
       ASSERT(replyPacket);
       HgfsCompleteReq(req, replyPacket, payloadSize);
    } else {
@@ -190,6 +314,8 @@ HgfsBdChannelSend(HgfsTransportChannel *channel, // IN: Channel
       ret = -EIO;
    }
 
+   pthread_mutex_lock(&channel->connLock);
+   HgfsBdConnectionPut(channel, out, ret != 0);
    pthread_mutex_unlock(&channel->connLock);
 
    return ret;
@@ -247,8 +373,17 @@ HgfsBdChannelInit(void)
    bdChannel.ops.send = HgfsBdChannelSend;
    bdChannel.ops.recv = NULL;
    bdChannel.ops.exit = HgfsBdChannelExit;
-   bdChannel.priv = NULL;
+   bdChannel.priv = &bdConnections;
+   /*
+    * The backdoor RPC cannot carry more, and the host advertises no way to
+    * exceed it, so sessions over the backdoor always negotiate this size.
+    * Only the loopback channel negotiates larger packets.
+    */
+   bdChannel.maxPacketSize = HGFS_LARGE_PACKET_MAX;
    pthread_mutex_init(&bdChannel.connLock, NULL);
+   bdConnections.numIdle = 0;
+   bdConnections.numOpen = 0;
+   pthread_cond_init(&bdConnections.idleCond, NULL);
    bdChannel.status = HGFS_CHANNEL_NOTCONNECTED;
    return &bdChannel;
 }
@@ -27,6 +27,13 @@
 
 #include "transport.h"
 
+/*
+ * RpcOut channels opened for concurrent requests, set with the
+ * bd_connections mount option.
+ */
+#define HGFS_BD_DEFAULT_CONNECTIONS 1
+#define HGFS_BD_MAX_CONNECTIONS     16
+
 HgfsTransportChannel *HgfsBdChannelInit(void);
 
 #endif // _HGFS_DRIVER_BDHANDLER_H_
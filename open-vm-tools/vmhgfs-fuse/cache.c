@@ -20,84 +20,111 @@
  * cache.c --
  *
  * Module-specific components of the vmhgfs driver.
+ *
+ * The attribute cache is split into shards by a hash of the path, each
+ * with its own lock, hash buckets and LRU list, so that FUSE threads
+ * looking up different files rarely contend. Each shard holds a fixed
+ * share of the capacity and evicts its least recently used entry when
+ * full. Entries expire a fixed time after they were stored; the expiry
+ * is checked when an entry is looked up, so no purge thread is needed.
+ *
+ * A path the server reported as nonexistent gets a negative entry, with
+ * its own lifetime, so that repeated probes of missing files (include
+ * paths, module search paths) are answered without a round trip. It is
+ * dropped when the path is created, renamed to or its attributes stored.
+ *
+ * In page cache mode an entry also remembers the version of the file,
+ * its size and times, as of the last open. It outlives the attributes
+ * until evicted or invalidated, so that the next open can tell whether
+ * the kernel page cache of the file is still valid. Our own writes
+ * invalidate the entry: their replies do not carry the resulting
+ * version, and one fetched later could include changes made by others.
+ *
+ * The hit, miss and eviction counters are logged at level 4 once a minute
+ * while lookups go on, and at exit.
  */
 #include "module.h"
-#if !defined(__FreeBSD__) && !defined(__SOLARIS__)
-#include <glib.h>
-#endif
-
-/*
- * We make the default attribute cache timeout 1 second which is the same
- * as the FUSE driver.
- * This can be overridden with the mount option attr_timeout=T
- */
-#define CACHE_TIMEOUT HGFS_DEFAULT_TTL
-#define CACHE_PURGE_TIME 10
-#define CACHE_PURGE_SLEEP_TIME 30
-#define HASH_THRESHOLD_SIZE (2046 * 4)
-#define HASH_PURGE_SIZE (HASH_THRESHOLD_SIZE / 2)
+#include <time.h>
 #include "cache.h"
 
+/* Number of shards, must be a power of 2. */
+#define HGFS_ATTR_CACHE_SHARDS 16
+
+/* Time between two logs of the cache counters, in ns. */
+#define HGFS_ATTR_CACHE_STATS_INTERVAL (60ULL * 1000000000)
+
 /*
  * HgfsAttrCache, holds an entry for each path
  */
 
 typedef struct HgfsAttrCache {
-   HgfsAttrInfo attr; /* Attribute of a file or directory */
-   uint64 changeTime; /* time the attribute was last updated */
-   struct list_head list; /* used in linked list implementation */
-   char path[0];      /* path of the file corresponding the the attr */
+   HgfsAttrInfo attr;            /* Attribute of a file or directory */
+   uint64 expireTime;            /* Monotonic time the entry expires, in ns */
+   uint32 hash;                  /* Hash of the path */
+   Bool negative;                /* The path does not exist */
+   Bool hasVersion;              /* The file version below is set */
+   uint64 versionSize;           /* File size at the last open */
+   uint64 versionWriteTime;      /* Write time at the last open */
+   uint64 versionChangeTime;     /* Change time at the last open */
+   struct list_head hashList;    /* Hash bucket link */
+   struct list_head lruList;     /* Shard LRU link, most recent first */
+   char path[0];                 /* path of the file corresponding the the attr */
 } HgfsAttrCache;
 
+typedef struct HgfsAttrCacheShard {
+   pthread_mutex_t lock;         /* Protects the shard */
+   struct list_head *buckets;    /* Hash buckets */
+   uint32 bucketMask;            /* Number of buckets - 1 */
+   struct list_head lru;         /* Entries, most recently used first */
+   uint32 count;                 /* Entries in the shard */
+   uint32 capacity;              /* Maximum entries in the shard */
+   HgfsAttrCacheStats stats;     /* Shard counters */
+} HgfsAttrCacheShard;
+
+static HgfsAttrCacheShard gHgfsAttrCache[HGFS_ATTR_CACHE_SHARDS];
+static uint64 gHgfsAttrCacheTimeout;   /* Entry lifetime, in ns */
+static uint64 gHgfsNegCacheTimeout;    /* Negative entry lifetime, in ns */
+#ifdef VMX86_DEVEL
+static pthread_mutex_t gHgfsAttrCacheStatsLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64 gHgfsAttrCacheStatsTime; /* Next log of the counters, in ns */
+#endif
 
-/* Head of the list */
-struct HgfsAttrCache attrList;
-
-/*Lock for accessing the attribute cache*/
-static pthread_mutex_t HgfsAttrCacheLock = PTHREAD_MUTEX_INITIALIZER;
-
-/*
- * Lists are used to manage attribute cache in Solaris and FreeBSD,
- * HashTables are used in Linux. HashTables perform better and hence
- * once newer version of glib with hash tables are packaged for Solaris
- * and FreeBSD, this section will go away.
- */
-
-#if defined(__FreeBSD__) || defined(__SOLARIS__)
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsInitCache
+ * HgfsAttrCacheNow
  *
- *    Initializes the list attrList to cache attributes.
+ *    Get the current monotonic time.
  *
  * Results:
- *    None
+ *    The time in nanoseconds.
  *
  * Side effects:
  *    None
  *
  *----------------------------------------------------------------------
- *
  */
 
-void
-HgfsInitCache()
+static uint64
+HgfsAttrCacheNow(void)
 {
-   INIT_LIST_HEAD(&attrList.list);
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64)now.tv_sec * 1000000000 + now.tv_nsec;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsGetAttrCache
+ * HgfsAttrCacheHash
  *
- *    Retrieves the attr from the list for a given path.
+ *    Hash a path (FNV-1a).
  *
  * Results:
- *    0 on success else -1 on error
+ *    The hash.
  *
  * Side effects:
  *    None
@@ -105,47 +132,51 @@ HgfsInitCache()
  *----------------------------------------------------------------------
  */
 
-int
-HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
-                 HgfsAttrInfo *attr) //IN: Attribute for a given path
+static uint32
+HgfsAttrCacheHash(const char *path)   //IN: Path of file or directory
 {
-   HgfsAttrCache *tmp;
-   int res = -1;
-   int diff;
+   uint32 hash = 2166136261U;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-
-   attrList.changeTime = HGFS_GET_TIME(time(NULL));
-   list_for_each_entry(tmp, &attrList.list, list) {
-      LOG(4, ("tmp->path = %d\n", tmp->path));
-      if (strcmp(path, tmp->path) == 0) {
-         LOG(4, ("cache hit. path = %s\n", tmp->path));
+   while (*path != '\0') {
+      hash ^= (uint8)*path++;
+      hash *= 16777619U;
+   }
+   return hash;
+}
 
-         diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
 
-         LOG(4, ("time since last updated is %d seconds\n", diff));
-         if (diff <= CACHE_TIMEOUT) {
-            *attr = tmp->attr;
-            res = 0;
-         }
-         break;
-      }
-   }
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheShardOf
+ *
+ *    Get the shard of a path hash.
+ *
+ * Results:
+ *    The shard.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
 
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
-   return res;
+static INLINE HgfsAttrCacheShard *
+HgfsAttrCacheShardOf(uint32 hash)   //IN: Hash of the path
+{
+   return &gHgfsAttrCache[hash & (HGFS_ATTR_CACHE_SHARDS - 1)];
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsSetAttrCache
+ * HgfsAttrCacheLookup
  *
- *    Updates the list with the given (key, attr)pair.
+ *    Find the entry of a path in a locked shard.
  *
  * Results:
- *    0 on success else negative value on error
+ *    The entry, NULL if there is none.
  *
  * Side effects:
  *    None
@@ -153,49 +184,32 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
  *----------------------------------------------------------------------
  */
 
-int
-HgfsSetAttrCache(const char* path,   //IN: Path of file or directory
-                 HgfsAttrInfo *attr) //IN: Attribute for a given path
+static HgfsAttrCache *
+HgfsAttrCacheLookup(HgfsAttrCacheShard *shard,   //IN: Locked shard
+                    const char *path,            //IN: Path
+                    uint32 hash)                 //IN: Hash of the path
 {
+   struct list_head *bucket;
    HgfsAttrCache *tmp;
-   int res = 0;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-
-   attrList.changeTime = HGFS_GET_TIME(time(NULL));
-   list_for_each_entry (tmp, &attrList.list, list) {
-      if (strcmp(path, tmp->path) == 0) {
-         tmp->attr = *attr;
-         tmp->changeTime = HGFS_GET_TIME(time(NULL));
-         LOG(4, ("cache entry updated. path = %s\n", tmp->path));
-         goto out;
+   /* The low bits select the shard, use the others for the bucket. */
+   bucket = &shard->buckets[(hash / HGFS_ATTR_CACHE_SHARDS) &
+                            shard->bucketMask];
+   list_for_each_entry(tmp, bucket, hashList) {
+      if (tmp->hash == hash && strcmp(path, tmp->path) == 0) {
+         return tmp;
       }
    }
-
-   tmp = malloc(sizeof(HgfsAttrCache) + strlen(path) + 1);
-   if (tmp == NULL) {
-      res = -ENOMEM;
-      goto out;
-   }
-   INIT_LIST_HEAD(&tmp->list);
-   Str_Strcpy(tmp->path, path, strlen(path) + 1);
-   tmp->attr = *attr;
-   tmp->changeTime = HGFS_GET_TIME(time(NULL));
-   list_add(&tmp->list, &attrList.list);
-   LOG(4, ("cache entry added. path = %s\n", tmp->path));
-
-out:
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
-   return res;
+   return NULL;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsInvalidateAttrCache
+ * HgfsAttrCacheRemove
  *
- *    Invalidate the attribute list entry for a given path.
+ *    Remove an entry from a locked shard and free it.
  *
  * Results:
  *    None
@@ -206,94 +220,195 @@ out:
  *----------------------------------------------------------------------
  */
 
-void
-HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
+static void
+HgfsAttrCacheRemove(HgfsAttrCacheShard *shard,   //IN: Locked shard
+                    HgfsAttrCache *entry)        //IN: Entry to remove
 {
+   list_del(&entry->hashList);
+   list_del(&entry->lruList);
+   shard->count--;
+   free(entry);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheInsert
+ *
+ *    Add an empty, expired entry for a path to a locked shard.
+ *
+ * Results:
+ *    The entry, NULL if out of memory.
+ *
+ * Side effects:
+ *    The least recently used entry of a full shard is evicted.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsAttrCache *
+HgfsAttrCacheInsert(HgfsAttrCacheShard *shard,   //IN: Locked shard
+                    const char *path,            //IN: Path
+                    uint32 hash)                 //IN: Hash of the path
+{
+   size_t pathLen = strlen(path);
    HgfsAttrCache *tmp;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
+   tmp = malloc(sizeof(HgfsAttrCache) + pathLen + 1);
+   if (tmp == NULL) {
+      return NULL;
+   }
 
-   list_for_each_entry (tmp, &attrList.list, list) {
-      if (strcmp(path, tmp->path) == 0) {
-         list_del(&tmp->list);
-         free(tmp);
-         break;
-      }
+   if (shard->count >= shard->capacity) {
+      HgfsAttrCache *lru = list_entry(shard->lru.prev, HgfsAttrCache, lruList);
+
+      LOG(4, ("cache entry evicted. path = %s\n", lru->path));
+      HgfsAttrCacheRemove(shard, lru);
+      shard->stats.evictions++;
    }
 
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   Str_Strcpy(tmp->path, path, pathLen + 1);
+   memset(&tmp->attr, 0, sizeof tmp->attr);
+   tmp->expireTime = 0;
+   tmp->hash = hash;
+   tmp->negative = FALSE;
+   tmp->hasVersion = FALSE;
+   list_add(&tmp->hashList,
+            &shard->buckets[(hash / HGFS_ATTR_CACHE_SHARDS) &
+                            shard->bucketMask]);
+   list_add(&tmp->lruList, &shard->lru);
+   shard->count++;
+   return tmp;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsPurgeCache:
+ * HgfsInitCache
  *
- *    This routine is called by an independent thread to purge the cache,
- *    deletion is based on time of last update.
+ *    Creates the attribute cache shards.
  *
  * Results:
- *    None
+ *    0 on success else negative value on error
  *
  * Side effects:
  *    None
- *
  *----------------------------------------------------------------------
+ *
  */
 
-void*
-HgfsPurgeCache(void* unused) //IN: Thread argument
+int
+HgfsInitCache(uint32 capacity,      //IN: Maximum number of entries
+              uint32 timeout,       //IN: Entry lifetime in seconds
+              uint32 negTimeout)    //IN: Negative entry lifetime in seconds
 {
-   HgfsAttrCache *tmp;
-   HgfsAttrCache *prev;
-   int diff;
+   uint32 shardCapacity = MAX(1, capacity / HGFS_ATTR_CACHE_SHARDS);
+   uint32 buckets = 1;
+   uint32 i;
 
-   while (1)
-   {
-      sleep(CACHE_PURGE_SLEEP_TIME);
+   while (buckets < shardCapacity) {
+      buckets <<= 1;
+   }
 
-      pthread_mutex_lock(&HgfsAttrCacheLock);
+   gHgfsAttrCacheTimeout = (uint64)timeout * 1000000000;
+   gHgfsNegCacheTimeout = (uint64)negTimeout * 1000000000;
 
-      list_for_each_entry_safe (tmp, prev, &attrList.list, list) {
-         diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
-         if (diff > CACHE_PURGE_TIME) {
-            list_del (&tmp->list);
-            free (tmp);
-         }
-      }
+   for (i = 0; i < HGFS_ATTR_CACHE_SHARDS; i++) {
+      HgfsAttrCacheShard *shard = &gHgfsAttrCache[i];
+      uint32 j;
 
-      pthread_mutex_unlock(&HgfsAttrCacheLock);
+      shard->buckets = malloc(buckets * sizeof *shard->buckets);
+      if (shard->buckets == NULL) {
+         LOG(4, ("Can't allocate memory!\n"));
+         return -ENOMEM;
+      }
+      for (j = 0; j < buckets; j++) {
+         INIT_LIST_HEAD(&shard->buckets[j]);
+      }
+      shard->bucketMask = buckets - 1;
+      INIT_LIST_HEAD(&shard->lru);
+      shard->count = 0;
+      shard->capacity = shardCapacity;
+      memset(&shard->stats, 0, sizeof shard->stats);
+      pthread_mutex_init(&shard->lock, NULL);
    }
+
+   LOG(4, ("attr cache capacity = %u, timeout = %u, negative timeout = %u\n",
+           shardCapacity * HGFS_ATTR_CACHE_SHARDS, timeout, negTimeout));
    return 0;
 }
 
-#else
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheLogStats
+ *
+ *    Log the cache counters.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsAttrCacheLogStats(void)
+{
+   HgfsAttrCacheStats stats;
+
+   HgfsGetAttrCacheStats(&stats);
+   LOG(4, ("attr cache: %"FMT64"u hits, %"FMT64"u negative hits, "
+           "%"FMT64"u misses, %"FMT64"u expirations, %"FMT64"u evictions, "
+           "%"FMT64"u entries\n",
+           stats.hits, stats.negativeHits, stats.misses, stats.expirations,
+           stats.evictions, stats.entries));
+}
 
-GHashTable *g_hash_table;
 
+#ifdef VMX86_DEVEL
 /*
  *----------------------------------------------------------------------
  *
- * HgfsInitCache
+ * HgfsAttrCacheLogStatsPeriodic
  *
- *    Creates a hash table with string as a key.
+ *    Log the cache counters if HGFS_ATTR_CACHE_STATS_INTERVAL passed
+ *    since the last time. Must be called without a shard lock held.
  *
  * Results:
  *    None
  *
  * Side effects:
  *    None
- *----------------------------------------------------------------------
  *
+ *----------------------------------------------------------------------
  */
 
-void
-HgfsInitCache()
+static void
+HgfsAttrCacheLogStatsPeriodic(void)
 {
-   g_hash_table = g_hash_table_new(g_str_hash, g_str_equal);
+   uint64 now;
+
+   /* Another thread is checking or logging. */
+   if (pthread_mutex_trylock(&gHgfsAttrCacheStatsLock) != 0) {
+      return;
+   }
+
+   now = HgfsAttrCacheNow();
+   if (now >= gHgfsAttrCacheStatsTime) {
+      if (gHgfsAttrCacheStatsTime != 0) {
+         HgfsAttrCacheLogStats();
+      }
+      gHgfsAttrCacheStatsTime = now + HGFS_ATTR_CACHE_STATS_INTERVAL;
+   }
+   pthread_mutex_unlock(&gHgfsAttrCacheStatsLock);
 }
+#endif
 
 
 /*
@@ -301,40 +416,56 @@ HgfsInitCache()
  *
  * HgfsGetAttrCache
  *
- *    Retrieves the attr from the HashTable for a given path.
+ *    Retrieves the attr from the cache for a given path.
  *
  * Results:
- *    0 on success else -1 on error
+ *    0 on success, -ENOENT if the path is cached as nonexistent, else -1
  *
  * Side effects:
- *    None
+ *    An expired entry is removed, unless it holds a file version. A
+ *    found entry becomes the most recently used of its shard.
  *
  *----------------------------------------------------------------------
  */
 
 int
 HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
-                 HgfsAttrInfo *attr) //IN: Attribute for a given path
+                 HgfsAttrInfo *attr) //OUT: Attribute for a given path
 {
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheShardOf(hash);
    HgfsAttrCache *tmp;
    int res = -1;
-   int diff;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
+   pthread_mutex_lock(&shard->lock);
 
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
-   if (tmp != NULL) {
-      LOG(4, ("cache hit. path = %s\n", tmp->path));
-
-      diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
-      LOG(4, ("time since last updated is %d seconds\n", diff));
-      if ( diff <= CACHE_TIMEOUT ) {
-         *attr = tmp->attr;
-         res = 0;
+   tmp = HgfsAttrCacheLookup(shard, path, hash);
+   if (tmp == NULL) {
+      shard->stats.misses++;
+   } else if (HgfsAttrCacheNow() >= tmp->expireTime) {
+      LOG(4, ("cache entry expired. path = %s\n", tmp->path));
+      if (!tmp->hasVersion) {
+         HgfsAttrCacheRemove(shard, tmp);
       }
+      shard->stats.expirations++;
+      shard->stats.misses++;
+   } else if (tmp->negative) {
+      LOG(4, ("negative cache hit. path = %s\n", tmp->path));
+      list_move(&tmp->lruList, &shard->lru);
+      shard->stats.negativeHits++;
+      res = -ENOENT;
+   } else {
+      LOG(4, ("cache hit. path = %s\n", tmp->path));
+      list_move(&tmp->lruList, &shard->lru);
+      *attr = tmp->attr;
+      shard->stats.hits++;
+      res = 0;
    }
 
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   pthread_mutex_unlock(&shard->lock);
+#ifdef VMX86_DEVEL
+   HgfsAttrCacheLogStatsPeriodic();
+#endif
    return res;
 }
 
@@ -344,13 +475,13 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
  *
  * HgfsSetAttrCache
  *
- *    Updates the HashTable with the given (key, attr) pair.
+ *    Updates the cache with the given (key, attr) pair.
  *
  * Results:
  *    0 on success else negative value on error
  *
  * Side effects:
- *    None
+ *    The least recently used entry of a full shard is evicted.
  *
  *----------------------------------------------------------------------
  */
@@ -359,42 +490,170 @@ int
 HgfsSetAttrCache(const char* path,         //IN: Path of file or directory
                  HgfsAttrInfo *attr)       //IN: Attribute for a given path
 {
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheShardOf(hash);
+   uint64 expireTime = HgfsAttrCacheNow() + gHgfsAttrCacheTimeout;
    HgfsAttrCache *tmp;
    int res = 0;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
+   if (gHgfsAttrCacheTimeout == 0 && gHgfsNegCacheTimeout == 0) {
+      return 0;
+   }
 
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
+   pthread_mutex_lock(&shard->lock);
+
+   /* An existing entry is updated even if it expires at once. */
+   tmp = HgfsAttrCacheLookup(shard, path, hash);
    if (tmp != NULL) {
       tmp->attr = *attr;
-      tmp->changeTime = HGFS_GET_TIME(time(NULL));
+      tmp->expireTime = expireTime;
+      tmp->negative = FALSE;
+      list_move(&tmp->lruList, &shard->lru);
       goto out;
    }
 
-   tmp = malloc(sizeof(HgfsAttrCache) + strlen(path) + 1);
-   if (tmp == NULL) {
-      return -ENOMEM;
+   if (gHgfsAttrCacheTimeout == 0) {
       goto out;
    }
 
-   Str_Strcpy(tmp->path, path, strlen(path) + 1);
+   tmp = HgfsAttrCacheInsert(shard, path, hash);
+   if (tmp == NULL) {
+      res = -ENOMEM;
+      goto out;
+   }
    tmp->attr = *attr;
-   tmp->changeTime = HGFS_GET_TIME(time(NULL));
+   tmp->expireTime = expireTime;
+
+out:
+   pthread_mutex_unlock(&shard->lock);
+   return res;
+}
 
-   g_hash_table_insert(g_hash_table, (gpointer)tmp->path, (gpointer)tmp);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsSetNegativeCache
+ *
+ *    Record that a path does not exist.
+ *
+ * Results:
+ *    0 on success else negative value on error
+ *
+ * Side effects:
+ *    The least recently used entry of a full shard is evicted.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsSetNegativeCache(const char* path)   //IN: Path of file or directory
+{
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheShardOf(hash);
+   HgfsAttrCache *tmp;
+   int res = 0;
+
+   if (gHgfsNegCacheTimeout == 0) {
+      return 0;
+   }
+
+   pthread_mutex_lock(&shard->lock);
+
+   tmp = HgfsAttrCacheLookup(shard, path, hash);
+   if (tmp != NULL) {
+      list_move(&tmp->lruList, &shard->lru);
+   } else {
+      tmp = HgfsAttrCacheInsert(shard, path, hash);
+      if (tmp == NULL) {
+         res = -ENOMEM;
+         goto out;
+      }
+   }
+   memset(&tmp->attr, 0, sizeof tmp->attr);
+   tmp->negative = TRUE;
+   tmp->expireTime = HgfsAttrCacheNow() + gHgfsNegCacheTimeout;
 
 out:
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   pthread_mutex_unlock(&shard->lock);
    return res;
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsCheckFileVersion
+ *
+ *    Compare the version of a file, given by its current attributes,
+ *    with the version recorded by the last call for the same path, and
+ *    record the new version. Fresh attributes are also cached, those
+ *    taken from the cache keep their expiry.
+ *
+ * Results:
+ *    TRUE if the file is unchanged since the last call, FALSE if it
+ *    changed or no version was recorded.
+ *
+ * Side effects:
+ *    The least recently used entry of a full shard may be evicted.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+HgfsCheckFileVersion(const char* path,         //IN: Path of file
+                     HgfsAttrInfo *attr,       //IN: Current attributes
+                     Bool fresh)               //IN: attr came from the server
+{
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheShardOf(hash);
+   HgfsAttrCache *tmp;
+   Bool unchanged = FALSE;
+
+   pthread_mutex_lock(&shard->lock);
+
+   tmp = HgfsAttrCacheLookup(shard, path, hash);
+   if (tmp == NULL) {
+      tmp = HgfsAttrCacheInsert(shard, path, hash);
+      if (tmp == NULL) {
+         goto out;
+      }
+   } else {
+      unchanged = tmp->hasVersion &&
+                  tmp->versionSize == attr->size &&
+                  tmp->versionWriteTime == attr->writeTime &&
+                  tmp->versionChangeTime == attr->attrChangeTime;
+      list_move(&tmp->lruList, &shard->lru);
+   }
+
+   tmp->hasVersion = TRUE;
+   tmp->versionSize = attr->size;
+   tmp->versionWriteTime = attr->writeTime;
+   tmp->versionChangeTime = attr->attrChangeTime;
+   if (!fresh) {
+      goto out;
+   }
+   tmp->negative = FALSE;
+   if (gHgfsAttrCacheTimeout != 0) {
+      tmp->attr = *attr;
+      tmp->expireTime = HgfsAttrCacheNow() + gHgfsAttrCacheTimeout;
+   } else {
+      tmp->expireTime = 0;
+   }
+
+out:
+   pthread_mutex_unlock(&shard->lock);
+   LOG(4, ("path = %s, unchanged = %d\n", path, unchanged));
+   return unchanged;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
  * HgfsInvalidateAttrCache
  *
- *    Invalidate the HashTable entry for a path.
+ *    Invalidate the cache entry for a path.
  *
  * Results:
  *    None
@@ -408,24 +667,25 @@ out:
 void
 HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
 {
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheShardOf(hash);
    HgfsAttrCache *tmp;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
+   pthread_mutex_lock(&shard->lock);
+   tmp = HgfsAttrCacheLookup(shard, path, hash);
    if (tmp != NULL) {
-      tmp->changeTime = 0;
+      HgfsAttrCacheRemove(shard, tmp);
    }
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   pthread_mutex_unlock(&shard->lock);
 }
 
+
 /*
  *----------------------------------------------------------------------
  *
- * HgfsPurgeCache
+ * HgfsGetAttrCacheStats
  *
- *    This routine is called by an independent thread to purge the cache,
- *    for performance reasons, the deletion is done in random based
- *    on the order of iteration.
+ *    Sum the counters of all the shards.
  *
  * Results:
  *    None
@@ -436,28 +696,58 @@ HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
  *----------------------------------------------------------------------
  */
 
-void*
-HgfsPurgeCache(void* unused)      //IN: Thread argument
+void
+HgfsGetAttrCacheStats(HgfsAttrCacheStats *stats)   //OUT: Cache counters
 {
-   gpointer key, value;
-   GHashTableIter iter;
+   uint32 i;
+
+   memset(stats, 0, sizeof *stats);
+   for (i = 0; i < HGFS_ATTR_CACHE_SHARDS; i++) {
+      HgfsAttrCacheShard *shard = &gHgfsAttrCache[i];
+
+      pthread_mutex_lock(&shard->lock);
+      stats->hits += shard->stats.hits;
+      stats->negativeHits += shard->stats.negativeHits;
+      stats->misses += shard->stats.misses;
+      stats->expirations += shard->stats.expirations;
+      stats->evictions += shard->stats.evictions;
+      stats->entries += shard->count;
+      pthread_mutex_unlock(&shard->lock);
+   }
+}
 
-   while (1) {
-      sleep(CACHE_PURGE_SLEEP_TIME);
 
-      pthread_mutex_lock(&HgfsAttrCacheLock);
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsExitCache
+ *
+ *    Log the cache counters and free all the entries.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
 
-      if (g_hash_table_size(g_hash_table) >= HASH_THRESHOLD_SIZE) {
-         g_hash_table_iter_init(&iter, g_hash_table);
-         while (g_hash_table_iter_next(&iter, &key, &value) &&
-               (g_hash_table_size(g_hash_table) >= HASH_PURGE_SIZE)) {
-            g_hash_table_iter_remove(&iter);
-            free(value);
-         }
-      }
+void
+HgfsExitCache(void)
+{
+   uint32 i;
+
+   HgfsAttrCacheLogStats();
+
+   for (i = 0; i < HGFS_ATTR_CACHE_SHARDS; i++) {
+      HgfsAttrCacheShard *shard = &gHgfsAttrCache[i];
 
-      pthread_mutex_unlock(&HgfsAttrCacheLock);
+      pthread_mutex_lock(&shard->lock);
+      while (!list_empty(&shard->lru)) {
+         HgfsAttrCacheRemove(shard, list_entry(shard->lru.next,
+                                               HgfsAttrCache, lruList));
+      }
+      pthread_mutex_unlock(&shard->lock);
    }
-   return 0;
 }
-#endif
@@ -25,10 +25,32 @@
 #ifndef _HGFS_DRIVER_CACHE_H_
 #define _HGFS_DRIVER_CACHE_H_
 
+/*
+ * We make the default attribute cache timeout 1 second which is the same
+ * as the FUSE driver, and nonexistent paths are remembered as long.
+ * These can be overridden with the mount options attr_cache_size=N,
+ * attr_cache_timeout=T and neg_cache_timeout=T.
+ */
+#define HGFS_ATTR_CACHE_DEFAULT_SIZE    (32 * 1024)
+#define HGFS_ATTR_CACHE_DEFAULT_TIMEOUT HGFS_DEFAULT_TTL
+#define HGFS_NEG_CACHE_DEFAULT_TIMEOUT  HGFS_DEFAULT_TTL
+
+typedef struct HgfsAttrCacheStats {
+   uint64 hits;          /* Lookups served from the cache */
+   uint64 negativeHits;  /* Lookups of paths cached as nonexistent */
+   uint64 misses;        /* Lookups not found or expired */
+   uint64 expirations;   /* Entries dropped at lookup as expired */
+   uint64 evictions;     /* Entries dropped to make room */
+   uint64 entries;       /* Entries currently cached */
+} HgfsAttrCacheStats;
+
 int HgfsGetAttrCache(const char* path, HgfsAttrInfo *attr);
 int HgfsSetAttrCache(const char* path, HgfsAttrInfo *attr);
-void HgfsInitCache();
-void* HgfsPurgeCache(void*);
+int HgfsSetNegativeCache(const char* path);
+int HgfsInitCache(uint32 capacity, uint32 timeout, uint32 negTimeout);
+void HgfsExitCache(void);
 void HgfsInvalidateAttrCache(const char* path);
+Bool HgfsCheckFileVersion(const char* path, HgfsAttrInfo *attr, Bool fresh);
+void HgfsGetAttrCacheStats(HgfsAttrCacheStats *stats);
 
 #endif
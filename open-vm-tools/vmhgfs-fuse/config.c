@@ -22,6 +22,8 @@
  */
 
 #include "module.h"
+#include "bdhandler.h"
+#include "cache.h"
 #include <sys/utsname.h>
 
 #ifdef VMX86_DEVEL
@@ -66,6 +68,13 @@ enum {
    KEY_BIG_WRITES,
    KEY_NO_BIG_WRITES,
    KEY_ENABLED_FUSE,
+#ifdef VMHGFS_LOOPBACK
+   KEY_LOOPBACK,
+   KEY_ALLOW_OTHER,
+   KEY_DEFAULT_PERMISSIONS,
+#endif
+   KEY_LOW_LEVEL,
+   KEY_PAGE_CACHE,
 };
 
 #define VMHGFS_OPT(t, p, v) { t, offsetof(struct vmhgfsConfig, p), v }
@@ -78,6 +87,17 @@ const struct fuse_opt vmhgfsOpts[] = {
      /* We will change the default value, unless it is specified explicitly. */
      FUSE_OPT_KEY("big_writes",     KEY_BIG_WRITES),
      FUSE_OPT_KEY("nobig_writes",   KEY_NO_BIG_WRITES),
+#ifdef VMHGFS_LOOPBACK
+     FUSE_OPT_KEY("loopback",       KEY_LOOPBACK),
+     FUSE_OPT_KEY("allow_other",    KEY_ALLOW_OTHER),
+     FUSE_OPT_KEY("default_permissions", KEY_DEFAULT_PERMISSIONS),
+#endif
+     FUSE_OPT_KEY("lowlevel",       KEY_LOW_LEVEL),
+     FUSE_OPT_KEY("page_cache",     KEY_PAGE_CACHE),
+     VMHGFS_OPT("attr_cache_size=%u",    attrCacheSize, 0),
+     VMHGFS_OPT("attr_cache_timeout=%u", attrCacheTimeout, 0),
+     VMHGFS_OPT("neg_cache_timeout=%u",  negCacheTimeout, 0),
+     VMHGFS_OPT("bd_connections=%u",     bdConnections, 0),
 
      FUSE_OPT_KEY("-V",             KEY_VERSION),
      FUSE_OPT_KEY("--version",      KEY_VERSION),
@@ -121,12 +141,40 @@ Usage(char *prog_name)  // IN
            "                           1 - system OS version is not supported for HGFS FUSE\n"
            "                           2 - system needs FUSE packages for HGFS FUSE\n"
            "\n"
+           "vmhgfs mount options:\n"
+           "    -o lowlevel            use the FUSE low-level (inode based) interface\n"
+           "    -o page_cache          keep the cached data of a file across opens while\n"
+           "                           the host reports it unchanged\n"
+           "    -o attr_cache_size=N   cache the attributes of up to N files (default %u)\n"
+           "    -o attr_cache_timeout=T\n"
+           "                           cache attributes for T seconds (default %u)\n"
+           "    -o neg_cache_timeout=T\n"
+           "                           remember nonexistent paths for T seconds\n"
+           "                           (default %u)\n"
+           "    -o bd_connections=N    send up to N requests to the host at once\n"
+           "                           (default %u, at most %u)\n"
+           "\n"
 #ifdef VMX86_DEVEL
            "vmhgfs options:\n"
            "    -l   --loglevel NUM    set loglevel=NUM only available in debug build.\n"
            "\n"
 #endif
-           , prog_name, prog_name, prog_name);
+           , prog_name, prog_name, prog_name,
+           HGFS_ATTR_CACHE_DEFAULT_SIZE, HGFS_ATTR_CACHE_DEFAULT_TIMEOUT,
+           HGFS_NEG_CACHE_DEFAULT_TIMEOUT, HGFS_BD_DEFAULT_CONNECTIONS,
+           HGFS_BD_MAX_CONNECTIONS);
+#ifdef VMHGFS_LOOPBACK
+   fprintf(stderr,
+           "loopback options:\n"
+           "    -o loopback            serve the mount from an HGFS server in this\n"
+           "                           process, which exports the local filesystem\n"
+           "                           as the share \"root\" with the credentials of\n"
+           "                           this process, e.g.\n"
+           "                           %s -o loopback .host:/root/tmp /mnt/tmp\n"
+           "                           allow_other requires default_permissions\n"
+           "\n"
+           , prog_name);
+#endif
 }
 
 #define LIB_MODULEPATH         "/lib/modules"
@@ -442,6 +490,28 @@ vmhgfsOptProc(void *data,                // IN
       config->addBigWrites = FALSE;
       return 0;
 
+#ifdef VMHGFS_LOOPBACK
+   case KEY_LOOPBACK:
+      gState->loopback = TRUE;
+      return 0;
+
+   case KEY_ALLOW_OTHER:
+      config->allowOther = TRUE;
+      return 1;
+
+   case KEY_DEFAULT_PERMISSIONS:
+      config->defaultPermissions = TRUE;
+      return 1;
+#endif
+
+   case KEY_LOW_LEVEL:
+      gState->lowLevel = TRUE;
+      return 0;
+
+   case KEY_PAGE_CACHE:
+      gState->pageCache = TRUE;
+      return 0;
+
    case KEY_HELP:
       Usage(outargs->argv[0]);
       fuse_opt_add_arg(outargs, "-ho");
@@ -489,6 +559,11 @@ vmhgfsPreprocessArgs(struct fuse_args *outargs)    // IN/OUT
 
    gState->basePath = NULL;
    gState->basePathLen = 0;
+   gState->loopback = FALSE;
+   gState->lowLevel = FALSE;
+   gState->pageCache = FALSE;
+   /* Until the session says otherwise, use the size every server handles. */
+   gState->maxPacketSize = HGFS_LARGE_PACKET_MAX;
 
    VMTools_LoadConfig(NULL, G_KEY_FILE_NONE, &gState->conf, NULL);
    VMTools_ConfigLogging(G_LOG_DOMAIN, gState->conf, FALSE, FALSE);
@@ -502,15 +577,41 @@ vmhgfsPreprocessArgs(struct fuse_args *outargs)    // IN/OUT
 #else
    config.addBigWrites = TRUE;
 #endif
+   config.attrCacheSize = HGFS_ATTR_CACHE_DEFAULT_SIZE;
+   config.attrCacheTimeout = HGFS_ATTR_CACHE_DEFAULT_TIMEOUT;
+   config.negCacheTimeout = HGFS_NEG_CACHE_DEFAULT_TIMEOUT;
+   config.bdConnections = HGFS_BD_DEFAULT_CONNECTIONS;
+#ifdef VMHGFS_LOOPBACK
+   config.allowOther = FALSE;
+   config.defaultPermissions = FALSE;
+#endif
 
    res = fuse_opt_parse(outargs, &config, vmhgfsOpts, vmhgfsOptProc);
    if (res != 0) {
       goto exit;
    }
 
+#ifdef VMHGFS_LOOPBACK
+   /*
+    * The loopback server accesses files with the credentials of this
+    * process, only the kernel permission checks keep other users out.
+    */
+   if (gState->loopback && config.allowOther && !config.defaultPermissions) {
+      fprintf(stderr, "%s: loopback with allow_other requires "
+              "default_permissions\n", outargs->argv[0]);
+      res = -1;
+      goto exit;
+   }
+#endif
+
 #ifdef VMX86_DEVEL
    LOGLEVEL_THRESHOLD = config.logLevel;
 #endif
+   gState->attrCacheSize = config.attrCacheSize;
+   gState->attrCacheTimeout = config.attrCacheTimeout;
+   gState->negCacheTimeout = config.negCacheTimeout;
+   gState->bdConnections = MAX(1, MIN(config.bdConnections,
+                                      HGFS_BD_MAX_CONNECTIONS));
    /* Default option changes for vmhgfs fuse client. */
    if (config.addBigWrites) {
       res = fuse_opt_add_arg(outargs, "-obig_writes");
@@ -32,6 +32,14 @@ struct vmhgfsConfig {
 #endif
    int addBigWrites;
    int addAllowOther;
+#ifdef VMHGFS_LOOPBACK
+   int allowOther;
+   int defaultPermissions;
+#endif
+   unsigned int attrCacheSize;
+   unsigned int attrCacheTimeout;
+   unsigned int negCacheTimeout;
+   unsigned int bdConnections;
 };
 
 int vmhgfsOptProc(void *data, const char *arg,
@@ -22,6 +22,7 @@
  * File operations for the hgfs driver.
  */
 #include "module.h"
+#include "cache.h"
 
 
 #define HGFS_CREATE_DIR_MASK (HGFS_CREATE_DIR_VALID_FILE_NAME | \
@@ -30,6 +31,20 @@
                               HGFS_CREATE_DIR_VALID_GROUP_PERMS | \
                               HGFS_CREATE_DIR_VALID_OTHER_PERMS)
 
+/* A directory entry of a listing. */
+typedef struct HgfsDirListingEntry {
+   char *name;                 /* Escaped entry name. */
+   struct stat st;             /* Entry attributes. */
+} HgfsDirListingEntry;
+
+/* A complete directory listing read by HgfsDirListingRead. */
+struct HgfsDirListing {
+   HgfsDirListingEntry *entries;
+   size_t count;               /* Entries filled. */
+   size_t size;                /* Entries allocated. */
+   int error;                  /* First error filling the listing. */
+};
+
 
 
 
@@ -98,7 +113,7 @@ HgfsPackDirOpenRequest(const char *path,    // IN: Path of the dir to open
 
    LOG(4, ("After buildPath = %s\n", path));
    result = CPName_ConvertTo(path,
-                             HGFS_LARGE_PACKET_MAX - (reqSize - 1),
+                             req->bufferSize - (reqSize - 1),
                              name);
    if (result < 0) {
       LOG(4, ("CP conversion failed\n"));
@@ -217,6 +232,49 @@ out:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsPrimeAttrCache --
+ *
+ *    Store the attributes of a directory entry, as returned by a search
+ *    read, in the attribute cache so that the getattr which usually
+ *    follows a readdir does not need a round trip to the server.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsPrimeAttrCache(const char *dirPath,   // IN: Path of the directory
+                   const char *name,      // IN: Escaped entry name
+                   HgfsAttrInfo *attr)    // IN: Entry attributes
+{
+   size_t dirLen = strlen(dirPath);
+   Bool addSep = dirLen == 0 || dirPath[dirLen - 1] != '/';
+   char *path;
+
+   if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+      return;
+   }
+
+   path = malloc(dirLen + addSep + strlen(name) + 1);
+   if (path == NULL) {
+      LOG(4, ("Out of memory priming attr cache for %s\n", name));
+      return;
+   }
+   Str_Sprintf(path, dirLen + addSep + strlen(name) + 1, "%s%s%s",
+               dirPath, addSep ? "/" : "", name);
+   HgfsSetAttrCache(path, attr);
+   free(path);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -224,7 +282,9 @@ out:
  *
  *    This function reads directory entries from the reply packet
  *    contained in the specified request structure. It calls filldir
- *    to copy each entry into the vfsDirent buffer.
+ *    to copy each entry into the vfsDirent buffer. If the path of the
+ *    directory is given, the attributes of each entry are added to the
+ *    attribute cache.
  *
  *    For V1 and V2 search read reply, only one entry is returned from
  *    server, while for V3 we may have multiple directory entries. The
@@ -240,7 +300,8 @@ out:
  */
 
 static int
-HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
+HgfsReadDirFromReply(const char *dirPath, // IN: Path of dir or NULL
+                     uint32 *f_pos,     // IN/OUT: Offset
                      void *vfsDirent,   // OUT: Buffer to copy dentries into
                      fuse_fill_dir_t filldir, // IN:  Filler function
                      HgfsReq *req,      // IN:  The request containing reply
@@ -281,8 +342,6 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
       void *rawAttr;
       char *fileName;
       uint32 fileNameLength;
-      ino_t ino;
-      uint32 d_type;
       struct stat st;
 
       switch(opUsed) {
@@ -328,6 +387,7 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
          *done = TRUE;
          goto out;
       }
+      memset(&attr, 0, sizeof attr);
       result = HgfsUnpackCommonAttr(rawAttr, opUsed, &attr);
       if (result != 0) {
          goto out;
@@ -371,35 +431,11 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
       /* Reuse fileNameLength to store the filename length after escape. */
       fileNameLength = result;
 
-      /* Assign the correct dentry type. */
-      switch (attr.type) {
-      case HGFS_FILE_TYPE_SYMLINK:
-         d_type = DT_LNK;
-         break;
-      case HGFS_FILE_TYPE_REGULAR:
-         d_type = DT_REG;
-         break;
-      case HGFS_FILE_TYPE_DIRECTORY:
-         d_type = DT_DIR;
-         break;
-      default:
-         /*
-          * XXX Should never happen. I'd put NOT_IMPLEMENTED() here
-          * but if the driver ever goes in the host it's probably not
-          * a good idea for an attacker to be able to hang the host
-          * simply by using a bogus file type in a reply. [bac]
-          */
-         d_type = DT_UNKNOWN;
-         break;
+      if (dirPath != NULL) {
+         HgfsPrimeAttrCache(dirPath, escName, &attr);
       }
 
-      ino = attr.hostFileId;
-      memset(&st, 0, sizeof(st));
-      st.st_blksize = HGFS_BLOCKSIZE;
-      st.st_blocks = HgfsCalcBlockSize(attr.size);
-      st.st_size = attr.size;
-      st.st_ino = ino;
-      st.st_mode = d_type << 12;
+      HgfsAttrToStat(&attr, &st);
       result = filldir(vfsDirent, escName, &st, 0);
 
       if (result) {
@@ -547,13 +583,15 @@ HgfsRequestDirEntries(HgfsHandle searchHandle, // IN: Handle to dir
  *    means it succeeded).
  *
  * Side effects:
- *    None
+ *    With a directory path, the attribute cache is primed with the
+ *    attributes of the entries read.
  *
  *----------------------------------------------------------------------
  */
 
 int
 HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
+            const char *dirPath,      // IN:  Path of the dir or NULL
             void *dirent,             // OUT: Buffer to copy dentries into
             fuse_fill_dir_t filldir)  // IN:  Filler function
 {
@@ -581,8 +619,8 @@ HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
          break;
       }
 
-      result = HgfsReadDirFromReply(&f_pos, dirent, filldir, request, opUsed,
-                                    &done);
+      result = HgfsReadDirFromReply(dirPath, &f_pos, dirent, filldir,
+                                    request, opUsed, &done);
 
       LOG(4, ("f_pos = %d\n", f_pos));
       if (result == -ENAMETOOLONG) {
@@ -604,6 +642,267 @@ HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirClose --
+ *
+ *    Close a search handle opened by HgfsDirOpen.
+ *
+ * Results:
+ *    Returns zero on success, or an error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsDirClose(HgfsHandle handle)  // IN: Search handle to close
+{
+   HgfsReq *req;
+   HgfsOp opUsed;
+   HgfsStatus replyStatus;
+   int result = 0;
+
+   LOG(6, ("Entry(handle = %u)\n", handle));
+
+   req = HgfsGetNewRequest();
+   if (!req) {
+      LOG(4, ("Out of memory while getting new request\n"));
+      result = -ENOMEM;
+      goto out;
+   }
+
+retry:
+   opUsed = hgfsVersionSearchClose;
+   if (opUsed == HGFS_OP_SEARCH_CLOSE_V3) {
+      HgfsRequestSearchCloseV3 *requestV3 = HgfsGetRequestPayload(req);
+
+      requestV3->search = handle;
+      requestV3->reserved = 0;
+      req->payloadSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
+
+   } else {
+      HgfsRequestSearchClose *request;
+
+      request = (HgfsRequestSearchClose *)(HGFS_REQ_PAYLOAD(req));
+      request->search = handle;
+      req->payloadSize = sizeof *request;
+   }
+
+   /* Fill in header here as payloadSize needs to be there. */
+   HgfsPackHeader(req, opUsed);
+
+   /* Send the request and process the reply. */
+   result = HgfsSendRequest(req);
+   if (result == 0) {
+      /* Get the reply. */
+      replyStatus = HgfsGetReplyStatus(req);
+      result = HgfsStatusConvertToLinux(replyStatus);
+
+      switch (result) {
+      case 0:
+         LOG(4, ("Closed search handle %u\n", handle));
+         break;
+      case -EPROTO:
+         /* Retry with older version(s). Set globally. */
+         if (opUsed == HGFS_OP_SEARCH_CLOSE_V3) {
+            LOG(4, ("Version 3 not supported. Falling back to version 1.\n"));
+            hgfsVersionSearchClose = HGFS_OP_SEARCH_CLOSE;
+            goto retry;
+         }
+         break;
+      default:
+         LOG(4, ("Failed. handle = %u\n", handle));
+         break;
+      }
+   } else if (result == -EIO) {
+      LOG(4, ("Timed out. error: %d\n", result));
+   } else if (result == -EPROTO) {
+      LOG(4, ("Server returned error: %d\n", result));
+   } else {
+      LOG(4, ("Unknown error: %d\n", result));
+   }
+
+out:
+   HgfsFreeRequest(req);
+   LOG(6, ("Exit(%d)\n", result));
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirListingFill --
+ *
+ *    Filler used by HgfsReaddir which appends an entry to a listing.
+ *
+ * Results:
+ *    Zero on success, 1 to stop reading on error.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsDirListingFill(void *buf,                 // IN/OUT: Listing
+                   const char *name,          // IN: Entry name
+                   const struct stat *stbuf,  // IN: Entry attributes
+                   off_t off)                 // IN: Unused
+{
+   HgfsDirListing *listing = buf;
+   HgfsDirListingEntry *entry;
+
+   if (listing->count == listing->size) {
+      size_t size = listing->size == 0 ? 64 : listing->size * 2;
+      HgfsDirListingEntry *entries;
+
+      entries = realloc(listing->entries, size * sizeof *entries);
+      if (entries == NULL) {
+         listing->error = -ENOMEM;
+         return 1;
+      }
+      listing->entries = entries;
+      listing->size = size;
+   }
+
+   entry = &listing->entries[listing->count];
+   entry->name = strdup(name);
+   if (entry->name == NULL) {
+      listing->error = -ENOMEM;
+      return 1;
+   }
+   entry->st = *stbuf;
+   listing->count++;
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirListingRead --
+ *
+ *    Read all the entries of a directory in one search, priming the
+ *    attribute cache with their attributes. The listing is kept by the
+ *    open directory so that repeated readdir calls replay it instead of
+ *    searching the directory again.
+ *
+ * Results:
+ *    Returns zero on success and the listing, negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsDirListingRead(const char *path,           // IN: Path of the dir
+                   HgfsDirListing **listing)   // OUT: Directory listing
+{
+   HgfsHandle handle = HGFS_INVALID_HANDLE;
+   HgfsDirListing *newListing;
+   int result;
+
+   newListing = calloc(1, sizeof *newListing);
+   if (newListing == NULL) {
+      return -ENOMEM;
+   }
+
+   result = HgfsDirOpen(path, &handle);
+   if (result < 0) {
+      goto out;
+   }
+
+   result = HgfsReaddir(handle, path, newListing, HgfsDirListingFill);
+   if (result == 0) {
+      result = newListing->error;
+   }
+   HgfsDirClose(handle);
+
+out:
+   if (result < 0) {
+      HgfsDirListingFree(newListing);
+      newListing = NULL;
+   }
+   *listing = newListing;
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirListingReplay --
+ *
+ *    Pass the entries of a listing from the given offset to a filler.
+ *    The offset of each entry is the offset of the entry after it.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsDirListingReplay(HgfsDirListing *listing,   // IN: Directory listing
+                     off_t offset,              // IN: First entry to pass
+                     void *buf,                 // OUT: Filler buffer
+                     fuse_fill_dir_t filldir)   // IN: Filler function
+{
+   size_t i;
+
+   for (i = offset; i < listing->count; i++) {
+      if (filldir(buf, listing->entries[i].name, &listing->entries[i].st,
+                  i + 1) != 0) {
+         break;
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirListingFree --
+ *
+ *    Free a directory listing.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsDirListingFree(HgfsDirListing *listing)   // IN: Directory listing
+{
+   size_t i;
+
+   if (listing == NULL) {
+      return;
+   }
+
+   for (i = 0; i < listing->count; i++) {
+      free(listing->entries[i].name);
+   }
+   free(listing->entries);
+   free(listing);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -696,7 +995,7 @@ HgfsPackCreateDirRequest(const char *path,
 
    /* Convert to CP name. */
    result = CPName_ConvertTo(path,
-                             HGFS_LARGE_PACKET_MAX - (reqSize - 1),
+                             req->bufferSize - (reqSize - 1),
                              fileName);
    if (result < 0) {
       LOG(4, ("CP conversion failed.\n"));
@@ -768,6 +1067,8 @@ retry:
       switch (result) {
       case 0:
          LOG(6, ("Directory created successfully, instantiating dentry.\n"));
+         /* Drop the negative entry of the path, if any. */
+         HgfsInvalidateAttrCache(path);
          /*
           * XXX: When we support hard links, this is a good place to
           * increment link count of parent dir.
@@ -882,7 +1183,7 @@ HgfsDelete(const char* path,       // IN: Path to file
 
    /* Convert to CP name. */
    result = CPName_ConvertTo(path,
-                             HGFS_NAME_BUFFER_SIZET(HGFS_LARGE_PACKET_MAX, reqSize),
+                             HGFS_NAME_BUFFER_SIZET(req->bufferSize, reqSize),
                              fileName);
    if (result < 0) {
       LOG(4, ("CP conversion failed.\n"));
@@ -29,9 +29,28 @@
 #include "hgfsUtil.h"
 #include "fsutil.h"
 #include "file.h"
+#include "cache.h"
 #include "vm_assert.h"
 #include "vm_basic_types.h"
 
+/*
+ * Maximum number of read or write requests a single read or write keeps
+ * outstanding. Enough to cover a 1MB FUSE request in one round even with
+ * the 60KB chunks of a server that does not negotiate larger packets.
+ */
+#define HGFS_IO_CHUNKS_MAX 18
+
+/* One server sized piece of a read or write. */
+typedef struct HgfsIoChunk {
+   HgfsReq *req;       /* Request, NULL once completed. */
+   HgfsOp opUsed;      /* Op version the request was packed with. */
+   Bool isWrite;       /* Write if TRUE, read otherwise. */
+   char *buf;          /* Data of the chunk. */
+   size_t count;       /* Size of the chunk. */
+   loff_t offset;      /* File offset of the chunk. */
+   int result;         /* Result of sending the request. */
+   Bool completed;     /* Reply received by the send. */
+} HgfsIoChunk;
 
 
 static int
@@ -171,7 +190,7 @@ HgfsPackOpenRequest(const char *path,          // IN: Path to file
 
    /* Convert to CP name. */
    result = CPName_ConvertTo(path,
-                             HGFS_LARGE_PACKET_MAX - (reqSize - 1),
+                             req->bufferSize - (reqSize - 1),
                              name);
    if (result < 0) {
       LOG(4, ("CP conversion failed.\n"));
@@ -347,6 +366,51 @@ HgfsGetOpenFlags(uint32 flags) // IN: Open flags
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsKeepPageCache --
+ *
+ *    Decide whether an open of a file may keep the kernel page cache
+ *    of the file. It may if the server granted an oplock, which it only
+ *    does when no one else can change the file, or if the size and
+ *    times of the file are the same as at its last open.
+ *
+ *    Cached attributes are used while they are within the attribute
+ *    timeout, so only opens of files not stat'ed recently pay for a
+ *    getattr.
+ *
+ * Results:
+ *    TRUE if the cached data is still valid, FALSE otherwise.
+ *
+ * Side effects:
+ *    Records the current version of the file.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsKeepPageCache(const char *path,      // IN: Path of the file
+                  HgfsHandle handle,     // IN: Handle of the open file
+                  HgfsLockType lock)     // IN: Oplock granted by the server
+{
+   HgfsAttrInfo attr = {0};
+   Bool fresh = FALSE;
+   Bool keep;
+
+   if (HgfsGetAttrCache(path, &attr) != 0) {
+      if (HgfsPrivateGetattr(handle, path, &attr) != 0) {
+         return FALSE;
+      }
+      fresh = TRUE;
+   }
+
+   keep = HgfsCheckFileVersion(path, &attr, fresh) || lock != HGFS_LOCK_NONE;
+   LOG(4, ("path = %s, lock = %d, keep_cache = %d\n", path, lock, keep));
+   return keep;
+}
+
+
 /*
  * HGFS file operations for files.
  */
@@ -427,6 +491,10 @@ retry:
          fi->fh = (uint64_t)replyFile;
          LOG( 4,("Server file handle: %"FMT64"u\n", fi->fh));
 
+         if (gState->pageCache) {
+            fi->keep_cache = HgfsKeepPageCache(path, replyFile, replyLock);
+         }
+
          break;
 
       case -EPROTO:
@@ -507,56 +575,40 @@ HgfsCreate(const char *path,          //IN: Path to a file
            mode_t permsMode,          //IN: Permission to open the file
            struct fuse_file_info *fi) //OUT: File info structure
 {
-     return HgfsOpenInt(path, fi, permsMode, HGFS_FILE_CREATE_MASK);
+   int result;
+
+   result = HgfsOpenInt(path, fi, permsMode, HGFS_FILE_CREATE_MASK);
+   if (result == 0) {
+      /* Drop the negative entry of the path, if any. */
+      HgfsInvalidateAttrCache(path);
+   }
+   return result;
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsDoRead --
- *
- *    Do one read request. Called by HgfsRead, possibly multiple times
- *    if the size of the read is too big to be handled by one server request.
- *
- *    We send a "Read" request to the server with the given handle.
+ * HgfsPackReadRequest --
  *
+ *    Setup the Read request, depending on the op version.
  *
  * Results:
- *    Returns the number of bytes read on success, or an error on failure.
+ *    None
  *
  * Side effects:
- *    None.
+ *    None
  *
- *----------------------------------------------------------------------------
+ *-----------------------------------------------------------------------------
  */
 
-static int
-HgfsDoRead(HgfsHandle handle,  // IN:  Handle for this file
-           char *buf,          // OUT: Buffer to copy data into
-           size_t count,       // IN:  Number of bytes to read
-           loff_t offset)      // IN:  Offset at which to read
+static void
+HgfsPackReadRequest(HgfsHandle handle,  // IN:  Handle for this file
+                    size_t count,       // IN:  Number of bytes to read
+                    loff_t offset,      // IN:  Offset at which to read
+                    HgfsOp opUsed,      // IN:  Op to be used
+                    HgfsReq *req)       // IN/OUT: Packet to write into
 {
-   HgfsReq *req;
-   HgfsOp opUsed;
-   int result = 0;
-   uint32 actualSize = 0;
-   char *payload = NULL;
-   HgfsStatus replyStatus;
-
-   ASSERT(NULL != buf);
-
-   LOG(4, ("Entry(handle = %u, 0x%"FMTSZ"x @ 0x%"FMT64"x)\n", handle, count, offset));
-
-   req = HgfsGetNewRequest();
-   if (!req) {
-      LOG(4, ("Out of memory while getting new request\n"));
-      result = -ENOMEM;
-      goto out;
-   }
-
- retry:
-   opUsed = hgfsVersionRead;
    if (opUsed == HGFS_OP_READ_V3) {
       HgfsRequestReadV3 *requestV3 = HgfsGetRequestPayload(req);
 
@@ -579,178 +631,91 @@ HgfsDoRead(HgfsHandle handle,  // IN:  Handle for this file
 
    /* Fill in header here as payloadSize needs to be there. */
    HgfsPackHeader(req, opUsed);
-
-   /* Send the request and process the reply. */
-   result = HgfsSendRequest(req);
-   if (result == 0) {
-      /* Get the reply. */
-      replyStatus = HgfsGetReplyStatus(req);
-      result = HgfsStatusConvertToLinux(replyStatus);
-
-      switch (result) {
-      case 0:
-         if (opUsed == HGFS_OP_READ_V3) {
-            HgfsReplyReadV3 * replyV3 = HgfsGetReplyPayload(req);
-
-            actualSize = replyV3->actualSize;
-            payload = replyV3->payload;
-
-         } else {
-            actualSize = ((HgfsReplyRead *)HGFS_REQ_PAYLOAD(req))->actualSize;
-            payload = ((HgfsReplyRead *)HGFS_REQ_PAYLOAD(req))->payload;
-         }
-
-         /* Sanity check on read size. */
-         if (actualSize > count) {
-            LOG(4, ("Server reply: read too big!\n"));
-            result = -EPROTO;
-            goto out;
-         }
-
-         if (0 == actualSize) {
-            /* We got no bytes, so don't need to copy to user. */
-            LOG(8, ("Server reply returned zero\n"));
-            result = actualSize;
-            goto out;
-         }
-
-         /* Return result. */
-         memcpy(buf, payload, actualSize);
-         LOG(8, ("Copied %u\n", actualSize));
-         result = actualSize;
-         break;
-
-      case -EPROTO:
-         /* Retry with older version(s). Set globally. */
-         if (opUsed == HGFS_OP_READ_V3) {
-            LOG(4, ("Version 3 not supported. Falling back to version 1.\n"));
-            hgfsVersionRead = HGFS_OP_READ;
-            goto retry;
-         }
-         break;
-
-      default:
-         break;
-      }
-   } else if (result == -EIO) {
-      LOG(8, ("Error: send request timed out\n"));
-   } else if (result == -EPROTO) {
-      LOG(4, ("Error: send request server returned error: %d\n", result));
-   } else {
-      LOG(4, ("Error: send request unknown : %d\n", result));
-   }
-
-out:
-   HgfsFreeRequest(req);
-   LOG(4, ("Exit(%d)\n", result));
-   return result;
 }
 
 
 /*
- *----------------------------------------------------------------------
+ *-----------------------------------------------------------------------------
  *
- * HgfsRead --
+ * HgfsUnpackReadReply --
  *
- *    Called whenever a process reads from a file in our filesystem.
+ *    Copy the data of a successful Read reply to the caller's buffer.
  *
  * Results:
- *    Returns the number of bytes read on success, or an error on
- *    failure.
+ *    Returns the number of bytes read on success, or an error on failure.
  *
  * Side effects:
  *    None
  *
- *----------------------------------------------------------------------
+ *-----------------------------------------------------------------------------
  */
 
-ssize_t
-HgfsRead(struct fuse_file_info *fi,  // IN:  File info struct
-         char  *buf,                 // OUT: User buffer to copy data into
-         size_t count,               // IN:  Number of bytes to read
-         loff_t offset)              // IN:  Offset at which to read
+static int
+HgfsUnpackReadReply(HgfsReq *req,        // IN:  Packet with reply inside
+                    HgfsOp opUsed,       // IN:  Op used for the request
+                    char *buf,           // OUT: Buffer to copy data into
+                    size_t count)        // IN:  Number of bytes requested
 {
-   int result = 0;
-   char *buffer = buf;
-   loff_t curOffset = offset;
-   size_t nextCount, remainingCount = count;
+   uint32 actualSize;
+   char *payload;
 
-   ASSERT(NULL != fi);
-   ASSERT(NULL != buf);
+   if (opUsed == HGFS_OP_READ_V3) {
+      HgfsReplyReadV3 * replyV3 = HgfsGetReplyPayload(req);
 
-   LOG(4, ("Entry(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
-           fi->fh, count, offset));
+      actualSize = replyV3->actualSize;
+      payload = replyV3->payload;
 
-    do {
-      nextCount = (remainingCount > HGFS_LARGE_IO_MAX) ?
-                                     HGFS_LARGE_IO_MAX : remainingCount;
-      LOG(4, ("Issue DoRead(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
-              fi->fh, nextCount, curOffset));
-      result = HgfsDoRead(fi->fh, buffer, nextCount, curOffset);
-      if (result < 0) {
-         LOG(8, ("Error: DoRead: -> %d\n", result));
-         goto out;
-      }
-      remainingCount -= result;
-      curOffset += result;
-      buffer += result;
+   } else {
+      actualSize = ((HgfsReplyRead *)HGFS_REQ_PAYLOAD(req))->actualSize;
+      payload = ((HgfsReplyRead *)HGFS_REQ_PAYLOAD(req))->payload;
+   }
 
-   } while ((result > 0) && (remainingCount > 0));
+   /* Sanity check on read size. */
+   if (actualSize > count) {
+      LOG(4, ("Server reply: read too big!\n"));
+      return -EPROTO;
+   }
 
-  memset(buffer, 0, remainingCount);
+   if (0 == actualSize) {
+      /* We got no bytes, so don't need to copy to user. */
+      LOG(8, ("Server reply returned zero\n"));
+      return 0;
+   }
 
-  out:
-   LOG(4, ("Exit(%"FMTSZ"d)\n", count - remainingCount));
-   return (count - remainingCount);
+   memcpy(buf, payload, actualSize);
+   LOG(8, ("Copied %u\n", actualSize));
+   return actualSize;
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsDoWrite --
- *
- *    Do one write request. Called by HgfsWrite, possibly multiple
- *    times if the size of the write is too big to be handled by one server
- *    request.
+ * HgfsPackWriteRequest --
  *
- *    We send a "Write" request to the server with the given handle.
+ *    Setup the Write request, depending on the op version.
  *
  * Results:
- *    Returns the number of bytes written on success, or an error on failure.
+ *    None
  *
  * Side effects:
- *    None.
+ *    None
  *
  *-----------------------------------------------------------------------------
  */
 
-static int
-HgfsDoWrite(HgfsHandle handle,       // IN: Handle for the file
-            const char *buf,         // IN: Buffer containing data
-            size_t count,            // IN: Number of bytes to write
-            loff_t offset)           // IN: Offset to begin writing at
+static void
+HgfsPackWriteRequest(HgfsHandle handle,  // IN: Handle for the file
+                     const char *buf,    // IN: Buffer containing data
+                     size_t count,       // IN: Number of bytes to write
+                     loff_t offset,      // IN: Offset to begin writing at
+                     HgfsOp opUsed,      // IN: Op to be used
+                     HgfsReq *req)       // IN/OUT: Packet to write into
 {
-   HgfsReq *req;
-   int result = 0;
-   HgfsOp opUsed;
-   uint32 requiredSize = 0;
-   uint32 actualSize = 0;
-   char *payload = NULL;
+   uint32 requiredSize;
+   char *payload;
    uint32 reqSize;
-   HgfsStatus replyStatus;
 
-   ASSERT(buf);
-
-   req = HgfsGetNewRequest();
-   if (!req) {
-      LOG(4, ("Out of memory while getting new request\n"));
-      result = -ENOMEM;
-      goto out;
-   }
-   LOG( 4,("handle = %u \n", handle));
- retry:
-   opUsed = hgfsVersionWrite;
    if (opUsed == HGFS_OP_WRITE_V3) {
       HgfsRequestWriteV3 *requestV3 = HgfsGetRequestPayload(req);
 
@@ -781,53 +746,313 @@ HgfsDoWrite(HgfsHandle handle,       // IN: Handle for the file
 
    /* Fill in header here as payloadSize needs to be there. */
    HgfsPackHeader(req, opUsed);
+}
 
-   /* Send the request and process the reply. */
-   result = HgfsSendRequest(req);
-   if (result == 0) {
-      /* Get the reply. */
-      replyStatus = HgfsGetReplyStatus(req);
-      result = HgfsStatusConvertToLinux(replyStatus);
 
-      switch (result) {
-      case 0:
-         if (opUsed == HGFS_OP_WRITE_V3) {
-            HgfsReplyWriteV3 * replyV3 = HgfsGetReplyPayload(req);
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackWriteReply --
+ *
+ *    Get the size written from a successful Write reply.
+ *
+ * Results:
+ *    Returns the number of bytes written.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-            actualSize = replyV3->actualSize;
+static int
+HgfsUnpackWriteReply(HgfsReq *req,        // IN: Packet with reply inside
+                     HgfsOp opUsed)       // IN: Op used for the request
+{
+   uint32 actualSize;
 
-         } else {
-            actualSize = ((HgfsReplyWrite *)HGFS_REQ_PAYLOAD(req))->actualSize;
-         }
+   if (opUsed == HGFS_OP_WRITE_V3) {
+      HgfsReplyWriteV3 * replyV3 = HgfsGetReplyPayload(req);
 
-         /* Return result. */
-         LOG(6, ("wrote %u bytes\n", actualSize));
-         result = actualSize;
-         break;
+      actualSize = replyV3->actualSize;
 
-      case -EPROTO:
+   } else {
+      actualSize = ((HgfsReplyWrite *)HGFS_REQ_PAYLOAD(req))->actualSize;
+   }
+
+   LOG(6, ("wrote %u bytes\n", actualSize));
+   return actualSize;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsGetMaxIoSize --
+ *
+ *    Get the largest read or write a request can carry. Large requests are
+ *    sized for the packet size negotiated with the server, from which
+ *    the same room is left for the headers as HGFS_LARGE_PACKET_MAX
+ *    leaves beyond HGFS_LARGE_IO_MAX.
+ *
+ * Results:
+ *    The size in bytes, at least HGFS_LARGE_IO_MAX.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static size_t
+HgfsGetMaxIoSize(HgfsReq *req)   // IN: Request to send
+{
+   ASSERT(req->bufferSize >= HGFS_LARGE_PACKET_MAX);
+
+   return req->bufferSize - (HGFS_LARGE_PACKET_MAX - HGFS_LARGE_IO_MAX);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSubmitIoChunk --
+ *
+ *    Send the read or write request of one chunk without waiting for
+ *    its reply. The outcome is collected by HgfsCompleteIoChunk.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The chunk is shortened to the largest size the request can carry.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsSubmitIoChunk(HgfsHandle handle,   // IN: Handle for the file
+                  HgfsIoChunk *chunk)  // IN/OUT: Chunk to send
+{
+   chunk->completed = FALSE;
+   if (chunk->req == NULL) {
+      chunk->req = HgfsGetNewLargeRequest();
+      if (chunk->req == NULL) {
+         LOG(4, ("Out of memory while getting new request\n"));
+         chunk->result = -ENOMEM;
+         return;
+      }
+   }
+
+   chunk->count = MIN(chunk->count, HgfsGetMaxIoSize(chunk->req));
+   LOG(4, ("Issue %s(0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
+           chunk->isWrite ? "DoWrite" : "DoRead", chunk->count, chunk->offset));
+
+   if (chunk->isWrite) {
+      chunk->opUsed = hgfsVersionWrite;
+      HgfsPackWriteRequest(handle, chunk->buf, chunk->count, chunk->offset,
+                           chunk->opUsed, chunk->req);
+   } else {
+      chunk->opUsed = hgfsVersionRead;
+      HgfsPackReadRequest(handle, chunk->count, chunk->offset,
+                          chunk->opUsed, chunk->req);
+   }
+
+   chunk->result = HgfsSubmitRequest(chunk->req, &chunk->completed);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCompleteIoChunk --
+ *
+ *    Wait for the reply of a chunk sent by HgfsSubmitIoChunk and process
+ *    it. Retries with the older op version if the server does not
+ *    support version 3.
+ *
+ * Results:
+ *    Returns the number of bytes transferred on success, or an error on
+ *    failure.
+ *
+ * Side effects:
+ *    The request of the chunk is freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsCompleteIoChunk(HgfsHandle handle,   // IN: Handle for the file
+                    HgfsIoChunk *chunk)  // IN/OUT: Chunk to complete
+{
+   int result;
+
+ retry:
+   result = chunk->result;
+   if (result == 0) {
+      HgfsWaitRequest(chunk->req);
+
+      /* Get the reply. */
+      result = HgfsStatusConvertToLinux(HgfsGetReplyStatus(chunk->req));
+      if (result == -EPROTO) {
          /* Retry with older version(s). Set globally. */
-         if (opUsed == HGFS_OP_WRITE_V3) {
+         if (chunk->opUsed == HGFS_OP_READ_V3) {
+            LOG(4, ("Version 3 not supported. Falling back to version 1.\n"));
+            hgfsVersionRead = HGFS_OP_READ;
+            HgfsSubmitIoChunk(handle, chunk);
+            goto retry;
+         } else if (chunk->opUsed == HGFS_OP_WRITE_V3) {
             LOG(4, ("Version 3 not supported. Falling back to version 1.\n"));
             hgfsVersionWrite = HGFS_OP_WRITE;
+            HgfsSubmitIoChunk(handle, chunk);
             goto retry;
          }
-         break;
+      }
 
-      default:
+      if (result == 0) {
+         result = chunk->isWrite ?
+                  HgfsUnpackWriteReply(chunk->req, chunk->opUsed) :
+                  HgfsUnpackReadReply(chunk->req, chunk->opUsed,
+                                      chunk->buf, chunk->count);
+      } else {
          LOG(4, ("Server returned error: %d\n", result));
-         break;
       }
    } else if (result == -EIO) {
-      LOG(8, ("Timed out. error: %d\n", result));
+      LOG(8, ("Error: send request timed out\n"));
    } else if (result == -EPROTO) {
-      LOG(4, ("Server returned error: %d\n", result));
+      LOG(4, ("Error: send request server returned error: %d\n", result));
    } else {
-      LOG(4, ("Unknown error: %d\n", result));
+      LOG(4, ("Error: send request unknown : %d\n", result));
    }
 
-out:
-   HgfsFreeRequest(req);
+   HgfsFreeRequest(chunk->req);
+   chunk->req = NULL;
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDoIo --
+ *
+ *    Read or write a range of an open file. The range is split into
+ *    chunks of the largest size negotiated with the server, and up to
+ *    HGFS_IO_CHUNKS_MAX chunk requests are kept outstanding at once so
+ *    that a large transfer is not serialized on the round trip of each
+ *    chunk. Replies are processed in file order, and the transfer stops
+ *    at the first short or failed chunk.
+ *
+ *    A chunk whose reply was received by its send, as on synchronous
+ *    channels, is checked before the next one is sent, since sending
+ *    more at once would not overlap anything.
+ *
+ * Results:
+ *    Returns the number of bytes transferred, or an error if nothing
+ *    could be transferred.
+ *
+ * Side effects:
+ *    On asynchronous channels, chunks beyond a short or failed one may
+ *    still have been written.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ssize_t
+HgfsDoIo(HgfsHandle handle,   // IN: Handle for the file
+         char *buf,           // IN/OUT: Buffer to transfer
+         size_t count,        // IN: Number of bytes to transfer
+         loff_t offset,       // IN: Offset to begin at
+         Bool isWrite)        // IN: Write if TRUE, read otherwise
+{
+   HgfsIoChunk chunks[HGFS_IO_CHUNKS_MAX];
+   size_t done = 0;
+   int error = 0;
+   Bool stop = FALSE;
+
+   while (!stop && done < count) {
+      size_t queued = done;
+      unsigned int numChunks;
+      unsigned int i;
+
+      for (numChunks = 0;
+           numChunks < HGFS_IO_CHUNKS_MAX && queued < count;
+           numChunks++) {
+         HgfsIoChunk *chunk = &chunks[numChunks];
+
+         chunk->req = NULL;
+         chunk->isWrite = isWrite;
+         chunk->buf = buf + queued;
+         chunk->count = count - queued;
+         chunk->offset = offset + queued;
+         HgfsSubmitIoChunk(handle, chunk);
+         queued += chunk->count;
+
+         if (chunk->result != 0 || chunk->completed) {
+            numChunks++;
+            break;
+         }
+      }
+
+      for (i = 0; i < numChunks; i++) {
+         int result = HgfsCompleteIoChunk(handle, &chunks[i]);
+
+         if (stop) {
+            continue;
+         }
+         if (result < 0) {
+            LOG(4, ("Error: %s -> %d\n", isWrite ? "DoWrite" : "DoRead",
+                    result));
+            error = result;
+            stop = TRUE;
+         } else {
+            done += result;
+            stop = result < chunks[i].count;
+         }
+      }
+   }
+
+   return done > 0 ? done : error;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsRead --
+ *
+ *    Called whenever a process reads from a file in our filesystem.
+ *
+ * Results:
+ *    Returns the number of bytes read on success, or an error on
+ *    failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+ssize_t
+HgfsRead(struct fuse_file_info *fi,  // IN:  File info struct
+         char  *buf,                 // OUT: User buffer to copy data into
+         size_t count,               // IN:  Number of bytes to read
+         loff_t offset)              // IN:  Offset at which to read
+{
+   ssize_t result;
+
+   ASSERT(NULL != fi);
+   ASSERT(NULL != buf);
+
+   LOG(4, ("Entry(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
+           fi->fh, count, offset));
+
+   result = HgfsDoIo(fi->fh, buf, count, offset, FALSE);
+   if (result >= 0) {
+      memset(buf + result, 0, count - result);
+   }
+
+   LOG(4, ("Exit(%"FMTSZ"d)\n", result));
    return result;
 }
 
@@ -855,11 +1080,7 @@ HgfsWrite(struct fuse_file_info *fi,  // IN: File info structure
          size_t count,                // IN:  Number of bytes to read
          loff_t offset)               // IN:  Offset at which to read
 {
-   int result;
-   const char *buffer = buf;
-   loff_t curOffset = offset;
-   size_t nextCount, remainingCount = count;
-   ssize_t bytesWritten = 0;
+   ssize_t bytesWritten;
 
    ASSERT(NULL != buf);
    ASSERT(NULL != fi);
@@ -867,28 +1088,8 @@ HgfsWrite(struct fuse_file_info *fi,  // IN: File info structure
    LOG(6, ("Entry(0x%"FMT64"x off bytes 0x%"FMTSZ"x @ 0x%"FMT64"x)\n",
            fi->fh, count, offset));
 
-   do {
-      nextCount = (remainingCount > HGFS_LARGE_IO_MAX) ?
-                                     HGFS_LARGE_IO_MAX : remainingCount;
-
-      LOG(4, ("Issue DoWrite(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
-              fi->fh, nextCount, curOffset));
-
-      result = HgfsDoWrite(fi->fh, buffer, nextCount, curOffset);
-      if (result < 0) {
-         bytesWritten = result;
-         LOG(4, ("Error: DoWrite -> %d\n", result));
-         goto out;
-      }
-      remainingCount -= result;
-      curOffset += result;
-      buffer += result;
-
-   } while ((result > 0) && (remainingCount > 0));
+   bytesWritten = HgfsDoIo(fi->fh, (char *)buf, count, offset, TRUE);
 
-   bytesWritten = count - remainingCount;
-
-out:
    LOG(6, ("Exit(0x%"FMTSZ"x)\n", bytesWritten));
    return bytesWritten;
 }
@@ -958,7 +1159,7 @@ retry:
    }
    /* Convert old name to CP format. */
    result = CPName_ConvertTo(from,
-                             HGFS_NAME_BUFFER_SIZET(HGFS_LARGE_PACKET_MAX, reqSize),
+                             HGFS_NAME_BUFFER_SIZET(req->bufferSize, reqSize),
                              oldName);
    if (result < 0) {
       LOG(4, ("oldName CP conversion failed\n"));
@@ -1000,7 +1201,7 @@ retry:
 
    /* Convert new name to CP format. */
    result = CPName_ConvertTo(to,
-                             HGFS_NAME_BUFFER_SIZET(HGFS_LARGE_PACKET_MAX, reqSize) - result,
+                             HGFS_NAME_BUFFER_SIZET(req->bufferSize, reqSize) - result,
                              newName);
    if (result < 0) {
       LOG(4, ("newName CP conversion failed\n"));
@@ -1149,7 +1350,7 @@ HgfsPackSetattrRequest(const char *path,   // IN:  path to file
       requestV3->fileName.flags = 0;
       requestV3->reserved = 0;
       reqSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
-      reqBufferSize = HGFS_NAME_BUFFER_SIZET(HGFS_LARGE_PACKET_MAX, reqSize);
+      reqBufferSize = HGFS_NAME_BUFFER_SIZET(req->bufferSize, reqSize);
 
       attrV2->mask = attr->mask;
       if (attr->mask & (HGFS_ATTR_VALID_SPECIAL_PERMS |
@@ -1201,7 +1402,7 @@ HgfsPackSetattrRequest(const char *path,   // IN:  path to file
       fileNameLength = &requestV2->fileName.length;
 
       reqSize = sizeof *requestV2;
-      reqBufferSize = HGFS_NAME_BUFFER_SIZE(HGFS_LARGE_PACKET_MAX, requestV2);
+      reqBufferSize = HGFS_NAME_BUFFER_SIZE(req->bufferSize, requestV2);
 
       if (attr->mask & (HGFS_ATTR_VALID_SPECIAL_PERMS |
                           HGFS_ATTR_VALID_OWNER_PERMS |
@@ -1244,7 +1445,7 @@ HgfsPackSetattrRequest(const char *path,   // IN:  path to file
       fileName = request->fileName.name;
       fileNameLength = &request->fileName.length;
       reqSize = sizeof *request;
-      reqBufferSize = HGFS_NAME_BUFFER_SIZE(HGFS_LARGE_PACKET_MAX, request);
+      reqBufferSize = HGFS_NAME_BUFFER_SIZE(req->bufferSize, request);
 
       /*
        * Clear attributes before touching them.
@@ -30,6 +30,7 @@
 #include "module.h"
 #include "request.h"
 #include "fsutil.h"
+#include "cache.h"
 #include "vm_assert.h"
 #include "vm_basic_types.h"
 #include "rpcout.h"
@@ -162,7 +163,7 @@ HgfsPackQueryVolumeRequest(const char *path,        // IN: File pointer for this
 
    /* Convert to CP name. */
    result = CPName_ConvertTo(path,
-                             HGFS_LARGE_PACKET_MAX - (requestSize - 1),
+                             req->bufferSize - (requestSize - 1),
                              name);
    if (result < 0) {
       LOG(4, ("CP conversion failed.\n"));
@@ -288,3 +289,71 @@ out:
    HgfsFreeRequest(req);
    return result;
 }
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsFilesystemInit --
+ *
+ *    Called once the filesystem is mounted. Creates the HGFS session.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsFilesystemInit(void)
+{
+   int res;
+
+   res = HgfsCreateSession();
+   if (res < 0) {
+      LOG(4, ("Create session failed. error = %d\n", res));
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsFilesystemExit --
+ *
+ *    Called when the filesystem is unmounted. Destroys the HGFS session
+ *    and tears down the transport.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsFilesystemExit(void)
+{
+   int res;
+
+   res = HgfsDestroySession();
+   if (res < 0) {
+      LOG(4, ("Destroy session failed. error = %d\n", res));
+   }
+
+   HgfsTransportExit();
+   HgfsExitRequestPool();
+   HgfsExitCache();
+
+   free(gState->basePath);
+
+   if (gState->conf != NULL) {
+      g_key_file_free(gState->conf);
+      gState->conf = NULL;
+   }
+}
@@ -37,6 +37,8 @@ typedef struct HgfsFuseState {
    Bool sessionEnabled;
    uint64 sessionId;
    uint8 headerVersion;
+   /* Largest request or reply, as negotiated when creating the session. */
+   size_t maxPacketSize;
    /*
     * When mount a subdirectory of hgfs shared directory, basePath holds
     * the prefix to the root. e.g. 'mount.vmhgfs .host:/shared/sub /hgfs',
@@ -44,6 +46,19 @@ typedef struct HgfsFuseState {
     */
    char *basePath;
    size_t basePathLen;
+   /* Requests are served by an HGFS server in this process. */
+   Bool loopback;
+   /* Most RpcOut channels the backdoor transport opens. */
+   uint32 bdConnections;
+   /* Serve the mount with the FUSE low-level (inode based) operations. */
+   Bool lowLevel;
+   /* Keep the kernel page cache of files unchanged since the last open. */
+   Bool pageCache;
+   /* Attribute cache capacity in entries and entry lifetime in seconds. */
+   uint32 attrCacheSize;
+   uint32 attrCacheTimeout;
+   /* Lifetime of the cache entries of nonexistent paths in seconds. */
+   uint32 negCacheTimeout;
 
    GKeyFile *conf;
 
@@ -51,5 +66,7 @@ typedef struct HgfsFuseState {
 
 /* Public functions (with respect to the entire module). */
 int HgfsStatfs(const char *path, struct statvfs *stat);
+void HgfsFilesystemInit(void);
+void HgfsFilesystemExit(void);
 
 #endif // _HGFS_DRIVER_FILESYSTEM_H_
@@ -113,7 +113,7 @@ HgfsUnpackGetattrReply(HgfsReq *req,        // IN: Reply packet
       length = replyV3->symlinkTarget.length;
 
       /* Skip the symlinkTarget if it's too long. */
-      if (length > HGFS_NAME_BUFFER_SIZET(HGFS_LARGE_PACKET_MAX,
+      if (length > HGFS_NAME_BUFFER_SIZET(req->bufferSize,
                                           sizeof *replyV3 + sizeof (HgfsReply))) {
          LOG(4, ("symlink target name too long, ignoring\n"));
          return -ENAMETOOLONG;
@@ -125,7 +125,7 @@ HgfsUnpackGetattrReply(HgfsReq *req,        // IN: Reply packet
       length = replyV2->symlinkTarget.length;
 
       /* Skip the symlinkTarget if it's too long. */
-      if (length > HGFS_NAME_BUFFER_SIZE(HGFS_LARGE_PACKET_MAX, replyV2)) {
+      if (length > HGFS_NAME_BUFFER_SIZE(req->bufferSize, replyV2)) {
          LOG(4, ("symlink target name too long, ignoring\n"));
          return -ENAMETOOLONG;
       }
@@ -212,7 +212,7 @@ HgfsPackGetattrRequest(HgfsReq *req,            // IN/OUT: Request buffer
 
       requestV3->reserved = 0;
       reqSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
-      reqBufferSize = HGFS_NAME_BUFFER_SIZET(HGFS_LARGE_PACKET_MAX, reqSize);
+      reqBufferSize = HGFS_NAME_BUFFER_SIZET(req->bufferSize, reqSize);
       break;
    }
 
@@ -226,7 +226,7 @@ HgfsPackGetattrRequest(HgfsReq *req,            // IN/OUT: Request buffer
       fileName = requestV2->fileName.name;
       fileNameLength = &requestV2->fileName.length;
       reqSize = sizeof *requestV2;
-      reqBufferSize = HGFS_NAME_BUFFER_SIZE(HGFS_LARGE_PACKET_MAX, requestV2);
+      reqBufferSize = HGFS_NAME_BUFFER_SIZE(req->bufferSize, requestV2);
       break;
    }
 
@@ -236,7 +236,7 @@ HgfsPackGetattrRequest(HgfsReq *req,            // IN/OUT: Request buffer
       fileName = requestV1->fileName.name;
       fileNameLength = &requestV1->fileName.length;
       reqSize = sizeof *requestV1;
-      reqBufferSize = HGFS_NAME_BUFFER_SIZE(HGFS_LARGE_PACKET_MAX, requestV1);
+      reqBufferSize = HGFS_NAME_BUFFER_SIZE(req->bufferSize, requestV1);
       break;
    }
 
@@ -685,6 +685,84 @@ HgfsCalcBlockSize(uint64 tsize)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrToStat --
+ *
+ *    Fill in a struct stat from the HGFS attributes of a file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsAttrToStat(const HgfsAttrInfo *attr,  // IN: HGFS attributes
+               struct stat *stbuf)        // OUT: stat structure
+{
+   uint32 d_type;
+
+   memset(stbuf, 0, sizeof *stbuf);
+
+   if (attr->mask & HGFS_ATTR_VALID_SPECIAL_PERMS) {
+      stbuf->st_mode |= (attr->specialPerms << 9);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_OWNER_PERMS) {
+      stbuf->st_mode |= (attr->ownerPerms << 6);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_GROUP_PERMS) {
+      stbuf->st_mode |= (attr->groupPerms << 3);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_OTHER_PERMS) {
+      stbuf->st_mode |= (attr->otherPerms);
+   }
+
+   /* Mask the access mode. */
+   switch (attr->type) {
+   case HGFS_FILE_TYPE_SYMLINK:
+      d_type = DT_LNK;
+      break;
+
+   case HGFS_FILE_TYPE_REGULAR:
+      d_type = DT_REG;
+      break;
+
+   case HGFS_FILE_TYPE_DIRECTORY:
+      d_type = DT_DIR;
+      break;
+
+   default:
+      d_type = DT_UNKNOWN;
+      break;
+   }
+
+   stbuf->st_mode |= d_type << 12;
+   stbuf->st_blksize = HGFS_BLOCKSIZE;
+   stbuf->st_blocks = HgfsCalcBlockSize(attr->size);
+   stbuf->st_size = attr->size;
+   stbuf->st_ino = attr->hostFileId;
+   stbuf->st_nlink = 1;
+   stbuf->st_uid = attr->userId;
+   stbuf->st_gid = attr->groupId;
+   stbuf->st_rdev = 0;
+
+   if (attr->mask & HGFS_ATTR_VALID_ACCESS_TIME) {
+      HGFS_SET_TIME(stbuf->st_atime, attr->accessTime);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_WRITE_TIME) {
+      HGFS_SET_TIME(stbuf->st_mtime, attr->writeTime);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_CHANGE_TIME) {
+      HGFS_SET_TIME(stbuf->st_ctime, attr->attrChangeTime);
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
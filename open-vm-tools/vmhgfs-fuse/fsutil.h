@@ -119,11 +119,30 @@ HgfsGetOpenMode(uint32 flags);
 int
 HgfsDirOpen(const char* path, HgfsHandle* handle);
 
+int
+HgfsDirClose(HgfsHandle handle);
+
 int
 HgfsReaddir(HgfsHandle handle,
+            const char *dirPath,
             void *dirent,
             fuse_fill_dir_t filldir);
 
+typedef struct HgfsDirListing HgfsDirListing;
+
+int
+HgfsDirListingRead(const char *path,
+                   HgfsDirListing **listing);
+
+void
+HgfsDirListingReplay(HgfsDirListing *listing,
+                     off_t offset,
+                     void *buf,
+                     fuse_fill_dir_t filldir);
+
+void
+HgfsDirListingFree(HgfsDirListing *listing);
+
 int
 HgfsMkdir(const char *path,
           int mode);
@@ -142,4 +161,8 @@ HgfsResetOps(void);
 unsigned long
 HgfsCalcBlockSize(uint64 tsize);
 
+void
+HgfsAttrToStat(const HgfsAttrInfo *attr,
+               struct stat *stbuf);
+
 #endif // _HGFS_DRIVER_FSUTIL_H_
@@ -25,6 +25,7 @@
 
 
 #include "module.h"
+#include "cache.h"
 
 
 /*
@@ -91,7 +92,7 @@ HgfsPackSymlinkCreateRequest(const char* symlink,     // IN: path of the link
 
    /* Convert symlink name to CP format. */
    result = CPName_ConvertTo(symlink,
-                             HGFS_LARGE_PACKET_MAX - (requestSize - 1),
+                             req->bufferSize - (requestSize - 1),
                              symlinkName);
    if (result < 0) {
       LOG(4, ("SymlinkName CP conversion failed.\n"));
@@ -130,7 +131,7 @@ HgfsPackSymlinkCreateRequest(const char* symlink,     // IN: path of the link
    targetNameBytes = strlen(symname) + 1;
 
    /* Copy target name into request packet. */
-   if (targetNameBytes > HGFS_LARGE_PACKET_MAX - (requestSize - 1)) {
+   if (targetNameBytes > req->bufferSize - (requestSize - 1)) {
       LOG(4, ("Target name is too long.\n"));
       return -EINVAL;
    }
@@ -197,6 +198,8 @@ HgfsSymlink(const char* source,    // IN: Source name
       result = HgfsStatusConvertToLinux(replyStatus);
       if (result == 0) {
          LOG(6, ("Symlink created successfully, instantiating dentry.\n"));
+         /* Drop the negative entry of the path, if any. */
+         HgfsInvalidateAttrCache(source);
       } else if (result == -EPROTO) {
          /* Retry with older version(s). Set globally. */
          if (opUsed == HGFS_OP_CREATE_SYMLINK_V3) {
@@ -0,0 +1,613 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * loopback.c --
+ *
+ * Loopback channel which hands requests straight to an HGFS server
+ * running in this process. The server exports the root of the local
+ * filesystem as the "root" share, so the whole HGFS stack can be run
+ * and profiled without a hypervisor.
+ *
+ * The server accesses files with the credentials of the process, so the
+ * transport is only built into the vmhgfs-fuse-loopback benchmarking
+ * program (VMHGFS_LOOPBACK), which is not installed.
+ *
+ * Each request is processed by the server in the FUSE thread sending it
+ * and its reply is delivered through HgfsTransportProcessPacket, so
+ * requests from different FUSE threads are in flight at once.
+ * The server addresses request buffers as guest physical pages, which
+ * here are identity mapped onto the process address space. Any number
+ * of them can be mapped at once, so data packets are accessed in place
+ * (HGFS_CHANNEL_DATA_IOV), and the ops which transfer data in a separate
+ * data packet, such as vectored reads and writes, are offered to the
+ * client (HGFS_CHANNEL_SHARED_MEM).
+ */
+
+#include <stddef.h>
+
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsServerPolicy.h"
+#include "loopback.h"
+#include "module.h"
+#include "request.h"
+#include "transport.h"
+#include "vm_assert.h"
+#include "vm_basic_defs.h"
+
+typedef struct HgfsLoopbackData {
+   HgfsServerCallbacks *serverCbTable;        /* Server entry points. */
+   void *serverSession;                       /* Server transport session. */
+   uint32 inFlight;                           /* Requests held by the server. */
+   pthread_cond_t drained;                    /* Signalled when none are. */
+} HgfsLoopbackData;
+
+/*
+ * A request handed to the server. The server owns it until the reply is
+ * sent. The packet must be last as its iov array extends past the end of
+ * the structure, followed by a private copy of the request and the reply
+ * buffer.
+ */
+typedef struct HgfsLoopbackPacket {
+   HgfsLoopbackData *data;                    /* Owning channel data. */
+   char *request;                             /* Private copy of the request. */
+   size_t requestSize;
+   char *replyPacket;                         /* Reply buffer. */
+   HgfsPacket packet;                         /* Server packet. */
+} HgfsLoopbackPacket;
+
+/*
+ * Nothing but memory limits the size of a loopback packet, offer reads
+ * and writes of 1MB to the server, with the same room for headers as
+ * HGFS_LARGE_PACKET_MAX.
+ */
+#define HGFS_LOOPBACK_IO_MAX (256 * 4096)
+#define HGFS_LOOPBACK_PACKET_MAX \
+   (HGFS_LOOPBACK_IO_MAX + HGFS_LARGE_PACKET_MAX - HGFS_LARGE_IO_MAX)
+
+/* Enough iovs for a buffer of the given size at any alignment. */
+#define HGFS_LOOPBACK_IOVS(size) (CEILING((size), PAGE_SIZE) + 1)
+
+static HgfsTransportChannel loopbackChannel;
+
+static HgfsServerMgrCallbacks loopbackMgrCb;
+
+static HgfsServerConfig loopbackServerCfg = {
+   (HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED | HGFS_CONFIG_VOL_INFO_MIN),
+   HGFS_MAX_CACHED_FILENODES
+};
+
+static void *HgfsLoopbackMapVa(uint64 pa, uint32 size, void **context);
+static void HgfsLoopbackUnmapVa(void **context);
+static Bool HgfsLoopbackServerSend(void *opaqueSession, HgfsPacket *packet,
+                                   HgfsSendFlags flags);
+
+static HgfsServerChannelCallbacks loopbackChannelCbTable = {
+   HgfsLoopbackMapVa,
+   HgfsLoopbackMapVa,
+   HgfsLoopbackUnmapVa,
+   HgfsLoopbackServerSend,
+};
+
+static HgfsServerChannelData loopbackCapabilities = {
+   HGFS_CHANNEL_SHARED_MEM | HGFS_CHANNEL_DATA_IOV,
+   HGFS_LOOPBACK_PACKET_MAX
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLoopbackMapVa --
+ *
+ *      Map a request buffer page for the server. Pages are identity mapped.
+ *
+ * Results:
+ *      The virtual address of the page.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsLoopbackMapVa(uint64 pa,        // IN: "physical" address
+                  uint32 size,      // IN: size of the mapping
+                  void **context)   // OUT: mapping context
+{
+   *context = (void *)(uintptr_t)pa;
+   return (void *)(uintptr_t)pa;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLoopbackUnmapVa --
+ *
+ *      Release a page mapped by HgfsLoopbackMapVa.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsLoopbackUnmapVa(void **context)   // IN/OUT: mapping context
+{
+   *context = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLoopbackInitIov --
+ *
+ *      Describe a buffer to the server as a list of page bounded iovs.
+ *
+ * Results:
+ *      The number of iovs used.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsLoopbackInitIov(char *buf,          // IN: buffer
+                    size_t size,        // IN: buffer size
+                    HgfsVmxIov *iov)    // OUT: iovs
+{
+   uint32 count = 0;
+
+   while (size > 0) {
+      uint32 len = MIN(size, PAGE_SIZE - PAGE_OFFSET(buf));
+
+      iov[count].va = NULL;
+      iov[count].pa = (uintptr_t)buf;
+      iov[count].len = len;
+      iov[count].context = NULL;
+      buf += len;
+      size -= len;
+      count++;
+   }
+
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLoopbackFailRequest --
+ *
+ *      Complete a request with HGFS_STATUS_GENERIC_ERROR, using the reply
+ *      header matching the request header.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsLoopbackFailRequest(char const *request,   // IN: request packet
+                        size_t requestSize)    // IN: request packet size
+{
+   HgfsHeader const *requestHeader = (HgfsHeader const *)request;
+
+   if (requestSize >= sizeof *requestHeader &&
+       requestHeader->dummy == HGFS_OP_NEW_HEADER) {
+      HgfsHeader reply = *requestHeader;
+
+      reply.headerSize = sizeof reply;
+      reply.packetSize = sizeof reply;
+      reply.flags = HGFS_PACKET_FLAG_REPLY;
+      reply.status = HGFS_STATUS_GENERIC_ERROR;
+      reply.information = 0;
+      HgfsTransportProcessPacket((char *)&reply, sizeof reply);
+   } else {
+      HgfsReply reply;
+
+      reply.id = ((HgfsRequest const *)request)->id;
+      reply.status = HGFS_STATUS_GENERIC_ERROR;
+      HgfsTransportProcessPacket((char *)&reply, sizeof reply);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLoopbackServerSend --
+ *
+ *      Called by the server to send the reply of a request. The reply is
+ *      matched to the waiting request by HgfsTransportProcessPacket. A
+ *      request the server completes without a reply fails with EIO.
+ *
+ * Results:
+ *      Always TRUE.
+ *
+ * Side effects:
+ *      The loopback packet is freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsLoopbackServerSend(void *opaqueSession,   // IN: channel data
+                       HgfsPacket *packet,    // IN/OUT: reply packet
+                       HgfsSendFlags flags)   // IN: send flags
+{
+   HgfsLoopbackData *data = opaqueSession;
+   HgfsLoopbackPacket *lbPacket;
+   size_t replySize = packet->replyPacketDataSize;
+
+   ASSERT(data != NULL);
+   ASSERT(0 != (packet->state & HGFS_STATE_CLIENT_REQUEST));
+   ASSERT(0 == (flags & HGFS_SEND_NO_COMPLETE));
+
+   lbPacket = (HgfsLoopbackPacket *)((char *)packet -
+                                     offsetof(HgfsLoopbackPacket, packet));
+
+   /* Let the server drop its mappings before the reply is handed back. */
+   data->serverCbTable->session.sendComplete(packet, data->serverSession);
+
+   if (replySize != 0) {
+      LOG(8, ("Loopback reply received.\n"));
+      HgfsTransportProcessPacket(lbPacket->replyPacket, replySize);
+   } else {
+      /* The server dropped the request, don't leave the sender waiting. */
+      LOG(4, ("Loopback request dropped by the server.\n"));
+      HgfsLoopbackFailRequest(lbPacket->request, lbPacket->requestSize);
+   }
+   free(lbPacket);
+
+   pthread_mutex_lock(&loopbackChannel.connLock);
+   ASSERT(data->inFlight > 0);
+   if (--data->inFlight == 0) {
+      pthread_cond_broadcast(&data->drained);
+   }
+   pthread_mutex_unlock(&loopbackChannel.connLock);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLoopbackServerStart --
+ *
+ *      Start the in-process server and connect to it.
+ *
+ * Results:
+ *      TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsLoopbackServerStart(HgfsLoopbackData *data) // IN/OUT: channel data
+{
+   if (!HgfsServerPolicy_Init(NULL, NULL, &loopbackMgrCb.enumResources)) {
+      LOG(8, ("ERROR: Loopback cannot initialize the share policy.\n"));
+      return FALSE;
+   }
+
+   if (!HgfsServer_InitState(&data->serverCbTable, &loopbackServerCfg,
+                             &loopbackMgrCb)) {
+      LOG(8, ("ERROR: Loopback server cannot start.\n"));
+      goto cleanupPolicy;
+   }
+
+   if (!data->serverCbTable->session.connect(data, &loopbackChannelCbTable,
+                                             &loopbackCapabilities,
+                                             &data->serverSession)) {
+      LOG(8, ("ERROR: Loopback cannot connect to the server.\n"));
+      goto cleanupServer;
+   }
+
+   return TRUE;
+
+cleanupServer:
+   HgfsServer_ExitState();
+cleanupPolicy:
+   HgfsServerPolicy_Cleanup();
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLoopbackChannelOpen --
+ *
+ *      Start the in-process server in an idempotent way.
+ *
+ * Results:
+ *      Existing or updated channel status, HGFS_CHANNEL_CONNECTED on success.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsChannelStatus
+HgfsLoopbackChannelOpen(HgfsTransportChannel *channel) // IN: Channel
+{
+   HgfsLoopbackData *data;
+
+   pthread_mutex_lock(&channel->connLock);
+   switch (channel->status) {
+   case HGFS_CHANNEL_UNINITIALIZED:
+      LOG(8, ("Loopback uninitialized.\n"));
+      break;
+   case HGFS_CHANNEL_CONNECTED:
+      LOG(8, ("Loopback already connected.\n"));
+      break;
+   case HGFS_CHANNEL_NOTCONNECTED:
+      data = calloc(1, sizeof *data);
+      if (data == NULL) {
+         LOG(8, ("ERROR: Loopback cannot allocate channel data.\n"));
+         break;
+      }
+      pthread_cond_init(&data->drained, NULL);
+      if (HgfsLoopbackServerStart(data)) {
+         LOG(8, ("Loopback server started and connected.\n"));
+         channel->priv = data;
+         channel->status = HGFS_CHANNEL_CONNECTED;
+      } else {
+         pthread_cond_destroy(&data->drained);
+         free(data);
+      }
+      break;
+   default:
+      ASSERT(0); /* Not reached. */
+      LOG(2, ("ERROR: Loopback status %d is unknown resetting.\n",
+              channel->status));
+      channel->status = HGFS_CHANNEL_UNINITIALIZED;
+   }
+
+   pthread_mutex_unlock(&channel->connLock);
+   return channel->status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLoopbackChannelCloseInt --
+ *
+ *      Stop the in-process server in an idempotent way, once the requests
+ *      it holds have been replied to.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsLoopbackChannelCloseInt(HgfsTransportChannel *channel) // IN: Channel
+{
+   if (channel->status == HGFS_CHANNEL_CONNECTED) {
+      HgfsLoopbackData *data = channel->priv;
+
+      ASSERT(data != NULL);
+      while (data->inFlight > 0) {
+         pthread_cond_wait(&data->drained, &channel->connLock);
+      }
+      data->serverCbTable->session.disconnect(data->serverSession);
+      data->serverCbTable->session.close(data->serverSession);
+      HgfsServer_ExitState();
+      HgfsServerPolicy_Cleanup();
+      pthread_cond_destroy(&data->drained);
+      free(data);
+      channel->priv = NULL;
+      channel->status = HGFS_CHANNEL_NOTCONNECTED;
+   }
+   LOG(8, ("Loopback closed.\n"));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLoopbackChannelClose --
+ *
+ *      Stop the in-process server in an idempotent way.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsLoopbackChannelClose(HgfsTransportChannel *channel) // IN: Channel
+{
+   pthread_mutex_lock(&channel->connLock);
+   HgfsLoopbackChannelCloseInt(channel);
+   pthread_mutex_unlock(&channel->connLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLoopbackChannelSend --
+ *
+ *     Hand a request to the in-process server. The request is complete
+ *     on return.
+ *
+ * Results:
+ *     0 on success, negative error on failure.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLoopbackChannelSend(HgfsTransportChannel *channel, // IN: Channel
+                        HgfsReq *req)                  // IN: request to send
+{
+   HgfsLoopbackData *data;
+   HgfsLoopbackPacket *lbPacket;
+   HgfsPacket *packet;
+   uint32 maxIovs;
+   char *request;
+
+   ASSERT(req);
+   ASSERT(req->state == HGFS_REQ_STATE_UNSENT);
+   ASSERT(req->payloadSize <= channel->maxPacketSize);
+
+   /* The server cannot reply to a request without a header. */
+   if (req->payloadSize < sizeof (HgfsRequest)) {
+      return -EINVAL;
+   }
+
+   /* The reply may be as large as the request buffer can take. */
+   maxIovs = HGFS_LOOPBACK_IOVS(req->payloadSize);
+   lbPacket = malloc(sizeof *lbPacket +
+                     (maxIovs - 1) * sizeof (HgfsVmxIov) +
+                     req->payloadSize + req->bufferSize);
+   if (lbPacket == NULL) {
+      return -ENOMEM;
+   }
+
+   pthread_mutex_lock(&channel->connLock);
+   if (channel->status != HGFS_CHANNEL_CONNECTED) {
+      LOG(6, ("Loopback not opened.\n"));
+      pthread_mutex_unlock(&channel->connLock);
+      free(lbPacket);
+      return -ENOTCONN;
+   }
+   data = channel->priv;
+   data->inFlight++;
+   pthread_mutex_unlock(&channel->connLock);
+
+   /*
+    * The server reads the request while the reply may already be copied
+    * into the request packet, so it works on a private copy.
+    */
+   packet = &lbPacket->packet;
+   memset(packet, 0, sizeof *packet);
+   lbPacket->data = data;
+   request = (char *)&packet->iov[maxIovs];
+   memcpy(request, HGFS_REQ_PAYLOAD(req), req->payloadSize);
+   lbPacket->request = request;
+   lbPacket->requestSize = req->payloadSize;
+   packet->iovCount = HgfsLoopbackInitIov(request, req->payloadSize,
+                                          packet->iov);
+   ASSERT(packet->iovCount <= maxIovs);
+   packet->metaPacketSize = req->payloadSize;
+   packet->metaPacketDataSize = req->payloadSize;
+   lbPacket->replyPacket = request + req->payloadSize;
+   packet->replyPacket = lbPacket->replyPacket;
+   packet->replyPacketSize = req->bufferSize;
+   packet->state |= HGFS_STATE_CLIENT_REQUEST;
+
+   LOG(8, ("Loopback sending.\n"));
+   req->state = HGFS_REQ_STATE_SUBMITTED;
+   data->serverCbTable->session.receive(packet, data->serverSession);
+
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLoopbackChannelExit --
+ *
+ *     Tear down the channel.
+ *
+ * Results:
+ *     None
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLoopbackChannelExit(HgfsTransportChannel *channel)  // IN
+{
+   pthread_mutex_lock(&channel->connLock);
+   HgfsLoopbackChannelCloseInt(channel);
+   channel->status = HGFS_CHANNEL_UNINITIALIZED;
+   pthread_mutex_unlock(&channel->connLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLoopbackChannelInit --
+ *
+ *     Initialize loopback channel.
+ *
+ * Results:
+ *     Always return pointer to loopback channel.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+HgfsTransportChannel*
+HgfsLoopbackChannelInit(void)
+{
+   loopbackChannel.name = "loopback";
+   loopbackChannel.ops.open = HgfsLoopbackChannelOpen;
+   loopbackChannel.ops.close = HgfsLoopbackChannelClose;
+   loopbackChannel.ops.send = HgfsLoopbackChannelSend;
+   loopbackChannel.ops.recv = NULL;
+   loopbackChannel.ops.exit = HgfsLoopbackChannelExit;
+   loopbackChannel.priv = NULL;
+   loopbackChannel.maxPacketSize = HGFS_LOOPBACK_PACKET_MAX;
+   pthread_mutex_init(&loopbackChannel.connLock, NULL);
+   loopbackChannel.status = HGFS_CHANNEL_NOTCONNECTED;
+   return &loopbackChannel;
+}
@@ -0,0 +1,1818 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * lowlevel.c --
+ *
+ * Entry points for the FUSE low-level (inode based) file operations for
+ * HGFS.
+ *
+ * The kernel refers to files by inode number. Each inode handed to the
+ * kernel by a lookup holds the absolute HGFS path of the file, which is
+ * built once per lookup and shared by every later operation, and a
+ * lookup count which the kernel drops with forget. Entries and attributes
+ * are replied with a timeout so the kernel dentry and inode caches absorb
+ * repeated lookups.
+ */
+
+#include <fuse_lowlevel.h>
+#include <glib.h>
+
+#include "module.h"
+#include "cache.h"
+#include "file.h"
+#include "lowlevel.h"
+
+/*
+ * Absolute HGFS path of an inode. Paths are immutable and reference
+ * counted so an operation can use one while a rename replaces it.
+ */
+typedef struct HgfsInodePath {
+   uint32 refCount;   /* Protected by gHgfsInodeLock. */
+   char path[0];
+} HgfsInodePath;
+
+typedef struct HgfsInode {
+   fuse_ino_t ino;          /* Inode number handed to the kernel. */
+   uint64 nlookup;          /* Kernel lookup count. */
+   HgfsInodePath *path;     /* Current path of the inode. */
+   Bool isDir;              /* Type at the last lookup. */
+} HgfsInode;
+
+/* Directory listing read at opendir and replied from by readdir. */
+typedef struct HgfsDirBuf {
+   fuse_req_t req;          /* Request used to size the entries. */
+   char *buf;               /* Packed directory entries. */
+   size_t size;             /* Size of the packed entries. */
+   int error;               /* First error filling the buffer. */
+} HgfsDirBuf;
+
+static GHashTable *gHgfsInodes;          /* fuse_ino_t -> HgfsInode */
+static GHashTable *gHgfsInodePaths;      /* path -> HgfsInode */
+static fuse_ino_t gHgfsNextIno = FUSE_ROOT_ID + 1;
+static pthread_mutex_t gHgfsInodeLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInodePathNew --
+ *
+ *    Build the absolute path of a file from the path of its parent
+ *    directory and its name.
+ *
+ * Results:
+ *    A new path with one reference, NULL if out of memory.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsInodePath *
+HgfsInodePathNew(const char *dir,    // IN: parent path
+                 const char *name)   // IN: name, may be NULL
+{
+   HgfsInodePath *path;
+   size_t dirLen = strlen(dir);
+   size_t nameLen = name != NULL ? strlen(name) : 0;
+   Bool addSep = name != NULL && (dirLen == 0 || dir[dirLen - 1] != '/');
+
+   path = malloc(sizeof *path + dirLen + addSep + nameLen + 1);
+   if (path == NULL) {
+      LOG(4, ("Can't allocate memory!\n"));
+      return NULL;
+   }
+   path->refCount = 1;
+   memcpy(path->path, dir, dirLen);
+   if (addSep) {
+      path->path[dirLen] = '/';
+   }
+   memcpy(path->path + dirLen + addSep, name, nameLen);
+   path->path[dirLen + addSep + nameLen] = '\0';
+   return path;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInodePathPut --
+ *
+ *    Drop a reference to a path.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The path is freed with its last reference.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsInodePathPut(HgfsInodePath *path)   // IN: path
+{
+   Bool last;
+
+   if (path == NULL) {
+      return;
+   }
+
+   pthread_mutex_lock(&gHgfsInodeLock);
+   last = --path->refCount == 0;
+   pthread_mutex_unlock(&gHgfsInodeLock);
+
+   if (last) {
+      free(path);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInodeGetPath --
+ *
+ *    Take a reference to the current path of an inode.
+ *
+ * Results:
+ *    The path, NULL if the inode is unknown.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsInodePath *
+HgfsInodeGetPath(fuse_ino_t ino)   // IN: inode number
+{
+   HgfsInode *inode;
+   HgfsInodePath *path = NULL;
+
+   pthread_mutex_lock(&gHgfsInodeLock);
+   inode = g_hash_table_lookup(gHgfsInodes, GSIZE_TO_POINTER(ino));
+   if (inode != NULL) {
+      path = inode->path;
+      path->refCount++;
+   }
+   pthread_mutex_unlock(&gHgfsInodeLock);
+
+   if (path == NULL) {
+      LOG(4, ("Unknown inode %lu\n", (unsigned long)ino));
+   }
+   return path;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInodeGetChildPath --
+ *
+ *    Build the path of a name within a directory inode.
+ *
+ * Results:
+ *    The new path, NULL with an error set on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsInodePath *
+HgfsInodeGetChildPath(fuse_ino_t parent,   // IN: directory inode
+                      const char *name,    // IN: name
+                      int *err)            // OUT: error
+{
+   HgfsInodePath *dir;
+   HgfsInodePath *path;
+
+   dir = HgfsInodeGetPath(parent);
+   if (dir == NULL) {
+      *err = ESTALE;
+      return NULL;
+   }
+
+   path = HgfsInodePathNew(dir->path, name);
+   HgfsInodePathPut(dir);
+   if (path == NULL) {
+      *err = ENOMEM;
+   }
+   return path;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInodeUnhashPath --
+ *
+ *    Remove an inode from the path table if it is the inode its path
+ *    maps to. The inode lock must be held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsInodeUnhashPath(HgfsInode *inode)   // IN: inode
+{
+   if (g_hash_table_lookup(gHgfsInodePaths, inode->path->path) == inode) {
+      g_hash_table_remove(gHgfsInodePaths, inode->path->path);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInodeLookup --
+ *
+ *    Find or create the inode of a path and count a kernel lookup of it.
+ *    The type of the file is recorded for renames.
+ *
+ * Results:
+ *    The inode number, 0 if out of memory.
+ *
+ * Side effects:
+ *    A new inode takes a reference to the path.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static fuse_ino_t
+HgfsInodeLookup(HgfsInodePath *path,   // IN: path
+                Bool isDir)            // IN: path is a directory
+{
+   HgfsInode *inode;
+   fuse_ino_t ino = 0;
+
+   pthread_mutex_lock(&gHgfsInodeLock);
+   inode = g_hash_table_lookup(gHgfsInodePaths, path->path);
+   if (inode == NULL) {
+      inode = malloc(sizeof *inode);
+      if (inode == NULL) {
+         LOG(4, ("Can't allocate memory!\n"));
+         goto exit;
+      }
+      inode->ino = gHgfsNextIno++;
+      inode->nlookup = 0;
+      inode->path = path;
+      path->refCount++;
+      g_hash_table_insert(gHgfsInodes, GSIZE_TO_POINTER(inode->ino), inode);
+      g_hash_table_replace(gHgfsInodePaths, inode->path->path, inode);
+   }
+   inode->nlookup++;
+   inode->isDir = isDir;
+   ino = inode->ino;
+
+exit:
+   pthread_mutex_unlock(&gHgfsInodeLock);
+   return ino;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInodeForget --
+ *
+ *    Drop kernel lookups of an inode.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The inode is freed when the kernel no longer references it.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsInodeForget(fuse_ino_t ino,       // IN: inode number
+                uint64 nlookup)       // IN: lookups to drop
+{
+   HgfsInode *inode;
+   HgfsInodePath *path = NULL;
+
+   pthread_mutex_lock(&gHgfsInodeLock);
+   inode = g_hash_table_lookup(gHgfsInodes, GSIZE_TO_POINTER(ino));
+   if (inode != NULL && ino != FUSE_ROOT_ID) {
+      inode->nlookup -= MIN(nlookup, inode->nlookup);
+      if (inode->nlookup == 0) {
+         HgfsInodeUnhashPath(inode);
+         g_hash_table_remove(gHgfsInodes, GSIZE_TO_POINTER(ino));
+         if (--inode->path->refCount == 0) {
+            path = inode->path;
+         }
+         free(inode);
+      }
+   }
+   pthread_mutex_unlock(&gHgfsInodeLock);
+
+   free(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInodeMove --
+ *
+ *    Move an inode to the path of a name within a directory path. The
+ *    inode lock must be held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The inode keeps its old path if the new one cannot be allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsInodeMove(HgfsInode *inode,   // IN: inode
+              const char *dir,    // IN: new path or its directory
+              const char *name)   // IN: name within dir, may be NULL
+{
+   HgfsInodePath *path = HgfsInodePathNew(dir, name);
+
+   if (path == NULL) {
+      return;
+   }
+
+   HgfsInodeUnhashPath(inode);
+   if (--inode->path->refCount == 0) {
+      free(inode->path);
+   }
+   inode->path = path;
+   /*
+    * An inode may still be keyed by a path under the target; replace
+    * the key too so the table never points into a freed path.
+    */
+   g_hash_table_replace(gHgfsInodePaths, inode->path->path, inode);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInodeRename --
+ *
+ *    Move the inode of a renamed file, and the inodes of everything below
+ *    it if it is a directory, to their new paths.
+ *
+ *    The inode of a file is found by its path. Only directories, or files
+ *    the kernel never looked up, need a walk of the whole inode table.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Inodes whose new path cannot be allocated keep the old one.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsInodeRename(const char *from,   // IN: old path
+                const char *to)     // IN: new path
+{
+   size_t fromLen = strlen(from);
+   HgfsInode *source;
+   GHashTableIter iter;
+   gpointer value;
+
+   pthread_mutex_lock(&gHgfsInodeLock);
+
+   source = g_hash_table_lookup(gHgfsInodePaths, from);
+
+   /* The inode of an overwritten target no longer owns its path. */
+   g_hash_table_remove(gHgfsInodePaths, to);
+
+   if (source != NULL && !source->isDir) {
+      HgfsInodeMove(source, to, NULL);
+      goto exit;
+   }
+
+   g_hash_table_iter_init(&iter, gHgfsInodes);
+   while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      HgfsInode *inode = value;
+      const char *old = inode->path->path;
+
+      if (strncmp(old, from, fromLen) != 0 ||
+          (old[fromLen] != '\0' && old[fromLen] != '/')) {
+         continue;
+      }
+
+      HgfsInodeMove(inode, to, old[fromLen] != '\0' ? old + fromLen + 1
+                                                    : NULL);
+   }
+
+exit:
+   pthread_mutex_unlock(&gHgfsInodeLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInodeInit --
+ *
+ *    Create the inode table with the root of the mount.
+ *
+ * Results:
+ *    Zero on success, negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsInodeInit(void)
+{
+   HgfsInodePath *path;
+   HgfsInode *root;
+
+   /* The root is the share path with a trailing '/', as in getAbsPath. */
+   path = HgfsInodePathNew(gState->basePathLen > 0 ? gState->basePath : "",
+                           "");
+   root = malloc(sizeof *root);
+   if (path == NULL || root == NULL) {
+      free(path);
+      free(root);
+      return -ENOMEM;
+   }
+
+   gHgfsInodes = g_hash_table_new(g_direct_hash, g_direct_equal);
+   gHgfsInodePaths = g_hash_table_new(g_str_hash, g_str_equal);
+
+   root->ino = FUSE_ROOT_ID;
+   root->nlookup = 1;
+   root->path = path;
+   root->isDir = TRUE;
+   g_hash_table_insert(gHgfsInodes, GSIZE_TO_POINTER(root->ino), root);
+   g_hash_table_replace(gHgfsInodePaths, root->path->path, root);
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLowLevelGetattr --
+ *
+ *    Get the attributes of a path, from the attribute cache if possible.
+ *
+ * Results:
+ *    Zero on success, negative error on failure.
+ *
+ * Side effects:
+ *    The attribute cache is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLowLevelGetattr(const char *path,     // IN: path
+                    HgfsAttrInfo *attr)   // OUT: attributes
+{
+   int res;
+
+   res = HgfsGetAttrCache(path, attr);
+   LOG(4, ("Retrieve attr from cache. result = %d \n", res));
+   if (res != 0 && res != -ENOENT) {
+      /* Retrieve new complete attribute settings and update the cache. */
+      res = HgfsPrivateGetattr(HGFS_INVALID_HANDLE, path, attr);
+      LOG(4, ("Retrieve attr from server. result = %d \n", res));
+      if (res == 0) {
+         HgfsSetAttrCache(path, attr);
+      } else if (res == -ENOENT) {
+         HgfsSetNegativeCache(path);
+      }
+   }
+   return res;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLowLevelReplyEntry --
+ *
+ *    Look up a path on the server and reply its entry. If the path does
+ *    not exist and negative is set, reply an entry without an inode so
+ *    the kernel caches the miss for neg_cache_timeout.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The kernel lookup count of the inode is incremented.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLowLevelReplyEntry(fuse_req_t req,              // IN: request
+                       HgfsInodePath *path,         // IN: path
+                       struct fuse_file_info *fi,   // IN: created file or NULL
+                       Bool negative)               // IN: reply misses
+{
+   struct fuse_entry_param e;
+   HgfsAttrInfo attr = {0};
+   int res;
+
+   res = HgfsLowLevelGetattr(path->path, &attr);
+   if (res == -ENOENT && negative) {
+      ASSERT(fi == NULL);
+      memset(&e, 0, sizeof e);
+      e.entry_timeout = gState->negCacheTimeout;
+      fuse_reply_entry(req, &e);
+      return;
+   }
+   if (res < 0) {
+      goto error;
+   }
+
+   memset(&e, 0, sizeof e);
+   e.ino = HgfsInodeLookup(path, attr.type == HGFS_FILE_TYPE_DIRECTORY);
+   if (e.ino == 0) {
+      res = -ENOMEM;
+      goto error;
+   }
+   HgfsAttrToStat(&attr, &e.attr);
+   e.attr.st_ino = e.ino;
+   e.attr_timeout = gState->attrCacheTimeout;
+   e.entry_timeout = gState->attrCacheTimeout;
+
+   if (fi != NULL) {
+      if (fuse_reply_create(req, &e, fi) != 0) {
+         /* The open was interrupted, nobody will release the file. */
+         HgfsInodeForget(e.ino, 1);
+         HgfsRelease(fi->fh);
+      }
+   } else if (fuse_reply_entry(req, &e) != 0) {
+      HgfsInodeForget(e.ino, 1);
+   }
+   return;
+
+error:
+   if (fi != NULL) {
+      HgfsRelease(fi->fh);
+   }
+   fuse_reply_err(req, -res);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLowLevelReplyAttr --
+ *
+ *    Reply the attributes of an inode.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLowLevelReplyAttr(fuse_req_t req,             // IN: request
+                      fuse_ino_t ino,             // IN: inode
+                      const HgfsAttrInfo *attr)   // IN: attributes
+{
+   struct stat st;
+
+   HgfsAttrToStat(attr, &st);
+   st.st_ino = ino;
+   fuse_reply_attr(req, &st, gState->attrCacheTimeout);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_lookup
+ *
+ *    Look up a directory entry by name.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_lookup(fuse_req_t req,      //IN: request
+               fuse_ino_t parent,   //IN: directory inode
+               const char *name)    //IN: name to look up
+{
+   HgfsInodePath *path;
+   int err;
+
+   LOG(4, ("Entry(parent = %lu, name = %s)\n", (unsigned long)parent, name));
+   path = HgfsInodeGetChildPath(parent, name, &err);
+   if (path == NULL) {
+      fuse_reply_err(req, err);
+      return;
+   }
+
+   HgfsLowLevelReplyEntry(req, path, NULL, TRUE);
+   HgfsInodePathPut(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_forget
+ *
+ *    Drop kernel lookups of an inode.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_forget(fuse_req_t req,          //IN: request
+               fuse_ino_t ino,          //IN: inode
+               unsigned long nlookup)   //IN: lookups to drop
+{
+   HgfsInodeForget(ino, nlookup);
+   fuse_reply_none(req);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_forget_multi
+ *
+ *    Drop kernel lookups of several inodes.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_forget_multi(fuse_req_t req,                      //IN: request
+                     size_t count,                        //IN: inode count
+                     struct fuse_forget_data *forgets)    //IN: inodes
+{
+   size_t i;
+
+   for (i = 0; i < count; i++) {
+      HgfsInodeForget(forgets[i].ino, forgets[i].nlookup);
+   }
+   fuse_reply_none(req);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_getattr
+ *
+ *    Get the attributes of an inode.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_getattr(fuse_req_t req,               //IN: request
+                fuse_ino_t ino,               //IN: inode
+                struct fuse_file_info *fi)    //IN: unused
+{
+   HgfsAttrInfo attr = {0};
+   HgfsInodePath *path;
+   int res;
+
+   LOG(4, ("Entry(ino = %lu)\n", (unsigned long)ino));
+   path = HgfsInodeGetPath(ino);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   res = HgfsLowLevelGetattr(path->path, &attr);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      HgfsLowLevelReplyAttr(req, ino, &attr);
+   }
+   HgfsInodePathPut(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_setattr
+ *
+ *    Change the mode, owner, size or times of an inode in one request.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_setattr(fuse_req_t req,               //IN: request
+                fuse_ino_t ino,               //IN: inode
+                struct stat *stbuf,           //IN: new attributes
+                int toSet,                    //IN: attributes to set
+                struct fuse_file_info *fi)    //IN: unused
+{
+   HgfsAttrInfo newAttr = {0};
+   HgfsAttrInfo *attr = &newAttr;
+   HgfsInodePath *path;
+   uint64 now = HGFS_GET_TIME(time(NULL));
+   int res = 0;
+
+   LOG(4, ("Entry(ino = %lu, toSet = %#x)\n", (unsigned long)ino, toSet));
+   path = HgfsInodeGetPath(ino);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   if (toSet & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME)) {
+      /*
+       * As in hgfs_utimens, times of a symlink are left alone as there
+       * is no way to ask the server not to follow it.
+       */
+      res = HgfsLowLevelGetattr(path->path, attr);
+      if (res < 0) {
+         goto exit;
+      }
+      if (attr->type == HGFS_FILE_TYPE_SYMLINK) {
+         toSet &= ~(FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME);
+      }
+      attr->mask = 0;
+   }
+
+   if (toSet & FUSE_SET_ATTR_MODE) {
+      attr->mask |= (HGFS_ATTR_VALID_SPECIAL_PERMS |
+                     HGFS_ATTR_VALID_OWNER_PERMS |
+                     HGFS_ATTR_VALID_GROUP_PERMS |
+                     HGFS_ATTR_VALID_OTHER_PERMS);
+      attr->specialPerms = (stbuf->st_mode & (S_ISUID | S_ISGID | S_ISVTX)) >> 9;
+      attr->ownerPerms = (stbuf->st_mode & S_IRWXU) >> 6;
+      attr->groupPerms = (stbuf->st_mode & S_IRWXG) >> 3;
+      attr->otherPerms = stbuf->st_mode & S_IRWXO;
+   }
+   if (toSet & FUSE_SET_ATTR_UID) {
+      attr->mask |= HGFS_ATTR_VALID_USERID;
+      attr->userId = stbuf->st_uid;
+   }
+   if (toSet & FUSE_SET_ATTR_GID) {
+      attr->mask |= HGFS_ATTR_VALID_GROUPID;
+      attr->groupId = stbuf->st_gid;
+   }
+   if (toSet & FUSE_SET_ATTR_SIZE) {
+      attr->mask |= (HGFS_ATTR_VALID_SIZE |
+                     HGFS_ATTR_VALID_WRITE_TIME |
+                     HGFS_ATTR_VALID_CHANGE_TIME);
+      attr->size = stbuf->st_size;
+      attr->writeTime = attr->attrChangeTime = now;
+   }
+   if (attr->mask != 0) {
+      attr->mask |= HGFS_ATTR_VALID_ACCESS_TIME;
+      attr->accessTime = attr->attrChangeTime = now;
+   }
+   if (toSet & FUSE_SET_ATTR_ATIME) {
+      attr->mask |= HGFS_ATTR_VALID_ACCESS_TIME;
+      attr->accessTime = (toSet & FUSE_SET_ATTR_ATIME_NOW) ?
+                         now :
+                         HgfsConvertToNtTime(stbuf->st_atim.tv_sec,
+                                             stbuf->st_atim.tv_nsec);
+   }
+   if (toSet & FUSE_SET_ATTR_MTIME) {
+      attr->mask |= HGFS_ATTR_VALID_WRITE_TIME;
+      attr->writeTime = (toSet & FUSE_SET_ATTR_MTIME_NOW) ?
+                        now :
+                        HgfsConvertToNtTime(stbuf->st_mtim.tv_sec,
+                                            stbuf->st_mtim.tv_nsec);
+   }
+
+   if (attr->mask != 0) {
+      res = HgfsSetattr(path->path, attr);
+      if (res < 0) {
+         LOG(4, ("path = %s , HgfsSetattr failed. res = %d\n", path->path, res));
+         goto exit;
+      }
+   }
+
+   /* Retrieve new complete attribute settings and update the cache. */
+   res = HgfsPrivateGetattr(HGFS_INVALID_HANDLE, path->path, attr);
+   if (res < 0) {
+      LOG(4, ("path = %s , res = %d\n", path->path, res));
+      goto exit;
+   }
+   HgfsSetAttrCache(path->path, attr);
+
+exit:
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      HgfsLowLevelReplyAttr(req, ino, attr);
+   }
+   HgfsInodePathPut(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_readlink
+ *
+ *    Read the target of a symbolic link.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_readlink(fuse_req_t req,    //IN: request
+                 fuse_ino_t ino)    //IN: inode
+{
+   HgfsAttrInfo attr = {0};
+   HgfsInodePath *path;
+   int res;
+
+   path = HgfsInodeGetPath(ino);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   /* The attributes fileName field will hold the symlink target name. */
+   res = HgfsPrivateGetattr(HGFS_INVALID_HANDLE, path->path, &attr);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else if (attr.fileName == NULL) {
+      fuse_reply_err(req, EINVAL);
+   } else {
+      fuse_reply_readlink(req, attr.fileName);
+   }
+
+   free(attr.fileName);
+   HgfsInodePathPut(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_mknod
+ *
+ *    Not supported, regular files are created through hgfs_ll_create.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_mknod(fuse_req_t req,       //IN: request
+              fuse_ino_t parent,    //IN: directory inode
+              const char *name,     //IN: name
+              mode_t mode,          //IN: mode
+              dev_t rdev)           //IN: device
+{
+   fuse_reply_err(req, ENOSYS);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_mkdir
+ *
+ *    Create a directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_mkdir(fuse_req_t req,       //IN: request
+              fuse_ino_t parent,    //IN: directory inode
+              const char *name,     //IN: name
+              mode_t mode)          //IN: mode
+{
+   HgfsInodePath *path;
+   int res;
+
+   LOG(4, ("Entry(name = %s, mode = %#o)\n", name, mode));
+   path = HgfsInodeGetChildPath(parent, name, &res);
+   if (path == NULL) {
+      fuse_reply_err(req, res);
+      return;
+   }
+
+   res = HgfsMkdir(path->path, mode);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      HgfsLowLevelReplyEntry(req, path, NULL, FALSE);
+   }
+   HgfsInodePathPut(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLowLevelDelete --
+ *
+ *    Delete a file or a directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLowLevelDelete(fuse_req_t req,       // IN: request
+                   fuse_ino_t parent,    // IN: directory inode
+                   const char *name,     // IN: name
+                   HgfsOp op)            // IN: delete op
+{
+   HgfsInodePath *path;
+   int res;
+
+   LOG(4, ("Entry(name = %s)\n", name));
+   path = HgfsInodeGetChildPath(parent, name, &res);
+   if (path == NULL) {
+      fuse_reply_err(req, res);
+      return;
+   }
+
+   res = HgfsDelete(path->path, op);
+   if (res == 0) {
+      HgfsInode *inode;
+
+      HgfsInvalidateAttrCache(path->path);
+
+      /* A file created later with the same name is a new inode. */
+      pthread_mutex_lock(&gHgfsInodeLock);
+      inode = g_hash_table_lookup(gHgfsInodePaths, path->path);
+      if (inode != NULL) {
+         HgfsInodeUnhashPath(inode);
+      }
+      pthread_mutex_unlock(&gHgfsInodeLock);
+   }
+   fuse_reply_err(req, -res);
+   HgfsInodePathPut(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_unlink
+ *
+ *    Delete a file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_unlink(fuse_req_t req,       //IN: request
+               fuse_ino_t parent,    //IN: directory inode
+               const char *name)     //IN: name
+{
+   HgfsLowLevelDelete(req, parent, name, HGFS_OP_DELETE_FILE);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_rmdir
+ *
+ *    Delete a directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_rmdir(fuse_req_t req,       //IN: request
+              fuse_ino_t parent,    //IN: directory inode
+              const char *name)     //IN: name
+{
+   HgfsLowLevelDelete(req, parent, name, HGFS_OP_DELETE_DIR);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_symlink
+ *
+ *    Create a symbolic link.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_symlink(fuse_req_t req,       //IN: request
+                const char *link,     //IN: link target
+                fuse_ino_t parent,    //IN: directory inode
+                const char *name)     //IN: name
+{
+   HgfsInodePath *path;
+   int res;
+
+   LOG(4, ("Entry(link = %s, name = %s)\n", link, name));
+   path = HgfsInodeGetChildPath(parent, name, &res);
+   if (path == NULL) {
+      fuse_reply_err(req, res);
+      return;
+   }
+
+   res = HgfsSymlink(path->path, link);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      HgfsLowLevelReplyEntry(req, path, NULL, FALSE);
+   }
+   HgfsInodePathPut(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_rename
+ *
+ *    Rename a file or directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_rename(fuse_req_t req,          //IN: request
+               fuse_ino_t parent,       //IN: old directory inode
+               const char *name,        //IN: old name
+               fuse_ino_t newparent,    //IN: new directory inode
+               const char *newname)     //IN: new name
+{
+   HgfsInodePath *from;
+   HgfsInodePath *to = NULL;
+   int res;
+
+   LOG(4, ("Entry(from = %s, to = %s)\n", name, newname));
+   from = HgfsInodeGetChildPath(parent, name, &res);
+   if (from == NULL) {
+      goto exit;
+   }
+   to = HgfsInodeGetChildPath(newparent, newname, &res);
+   if (to == NULL) {
+      goto exit;
+   }
+
+   res = -HgfsRename(from->path, to->path);
+   if (res == 0) {
+      HgfsInvalidateAttrCache(from->path);
+      HgfsInvalidateAttrCache(to->path);
+      HgfsInodeRename(from->path, to->path);
+   }
+
+exit:
+   fuse_reply_err(req, res);
+   HgfsInodePathPut(from);
+   HgfsInodePathPut(to);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_link
+ *
+ *    Hard links are not supported.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_link(fuse_req_t req,          //IN: request
+             fuse_ino_t ino,          //IN: inode
+             fuse_ino_t newparent,    //IN: new directory inode
+             const char *newname)     //IN: new name
+{
+   fuse_reply_err(req, EPERM);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_open
+ *
+ *    Open a file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_open(fuse_req_t req,               //IN: request
+             fuse_ino_t ino,               //IN: inode
+             struct fuse_file_info *fi)    //IN/OUT: file info
+{
+   HgfsInodePath *path;
+   int res;
+
+   path = HgfsInodeGetPath(ino);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   res = HgfsOpen(path->path, fi);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else if (fuse_reply_open(req, fi) != 0) {
+      /* The open was interrupted, nobody will release the file. */
+      HgfsRelease(fi->fh);
+   }
+   HgfsInodePathPut(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_create
+ *
+ *    Create and open a file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_create(fuse_req_t req,               //IN: request
+               fuse_ino_t parent,            //IN: directory inode
+               const char *name,             //IN: name
+               mode_t mode,                  //IN: mode
+               struct fuse_file_info *fi)    //IN/OUT: file info
+{
+   HgfsInodePath *path;
+   int res;
+
+   LOG(4, ("Entry(name = %s, mode = %#o)\n", name, mode));
+   path = HgfsInodeGetChildPath(parent, name, &res);
+   if (path == NULL) {
+      fuse_reply_err(req, res);
+      return;
+   }
+
+   res = HgfsCreate(path->path, mode, fi);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      HgfsLowLevelReplyEntry(req, path, fi, FALSE);
+   }
+   HgfsInodePathPut(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_read
+ *
+ *    Read from an open file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_read(fuse_req_t req,               //IN: request
+             fuse_ino_t ino,               //IN: inode
+             size_t size,                  //IN: size to read
+             off_t off,                    //IN: starting point to read
+             struct fuse_file_info *fi)    //IN: file info
+{
+   char *buf;
+   ssize_t res;
+
+   buf = malloc(size);
+   if (buf == NULL) {
+      fuse_reply_err(req, ENOMEM);
+      return;
+   }
+
+   res = HgfsRead(fi, buf, size, off);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      fuse_reply_buf(req, buf, res);
+   }
+   free(buf);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_write
+ *
+ *    Write to an open file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_write(fuse_req_t req,               //IN: request
+              fuse_ino_t ino,               //IN: inode
+              const char *buf,              //IN: data to write
+              size_t size,                  //IN: size to write
+              off_t off,                    //IN: starting point to write
+              struct fuse_file_info *fi)    //IN: file info
+{
+   HgfsInodePath *path;
+   ssize_t res;
+
+   res = HgfsWrite(fi, buf, size, off);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+      return;
+   }
+
+   /* Even a zero byte write may have changed the attributes. */
+   path = HgfsInodeGetPath(ino);
+   if (path != NULL) {
+      HgfsInvalidateAttrCache(path->path);
+      HgfsInodePathPut(path);
+   }
+   fuse_reply_write(req, res);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_release
+ *
+ *    Release an open file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_release(fuse_req_t req,               //IN: request
+                fuse_ino_t ino,               //IN: inode
+                struct fuse_file_info *fi)    //IN: file info
+{
+   HgfsRelease(fi->fh);
+   fuse_reply_err(req, 0);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLowLevelFillDir --
+ *
+ *    Filler used by HgfsReaddir which appends an entry to a directory
+ *    listing. The offset of an entry is the offset of the next one.
+ *
+ * Results:
+ *    Zero on success, 1 to stop the listing on error.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLowLevelFillDir(void *data,                  // IN/OUT: listing
+                    const char *name,            // IN: entry name
+                    const struct stat *stbuf,    // IN: entry attributes
+                    off_t off)                   // IN: unused
+{
+   HgfsDirBuf *dirBuf = data;
+   size_t entrySize = fuse_add_direntry(dirBuf->req, NULL, 0, name, NULL, 0);
+   char *buf;
+
+   buf = realloc(dirBuf->buf, dirBuf->size + entrySize);
+   if (buf == NULL) {
+      dirBuf->error = -ENOMEM;
+      return 1;
+   }
+   dirBuf->buf = buf;
+   fuse_add_direntry(dirBuf->req, dirBuf->buf + dirBuf->size, entrySize,
+                     name, stbuf, dirBuf->size + entrySize);
+   dirBuf->size += entrySize;
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_opendir
+ *
+ *    Open a directory and read its listing, which readdir replies
+ *    from without further server round trips.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_opendir(fuse_req_t req,               //IN: request
+                fuse_ino_t ino,               //IN: inode
+                struct fuse_file_info *fi)    //IN/OUT: file info
+{
+   HgfsHandle handle = HGFS_INVALID_HANDLE;
+   HgfsDirBuf *dirBuf;
+   HgfsInodePath *path;
+   int res;
+
+   path = HgfsInodeGetPath(ino);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   dirBuf = calloc(1, sizeof *dirBuf);
+   if (dirBuf == NULL) {
+      res = -ENOMEM;
+      goto exit;
+   }
+   dirBuf->req = req;
+
+   res = HgfsDirOpen(path->path, &handle);
+   if (res < 0) {
+      goto exit;
+   }
+
+   res = HgfsReaddir(handle, path->path, dirBuf,
+                     HgfsLowLevelFillDir);
+   if (res == 0) {
+      res = dirBuf->error;
+   }
+   HgfsDirClose(handle);
+
+exit:
+   if (res < 0) {
+      if (dirBuf != NULL) {
+         free(dirBuf->buf);
+         free(dirBuf);
+      }
+      fuse_reply_err(req, -res);
+   } else {
+      fi->fh = (uintptr_t)dirBuf;
+      if (fuse_reply_open(req, fi) != 0) {
+         free(dirBuf->buf);
+         free(dirBuf);
+      }
+   }
+   HgfsInodePathPut(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_readdir
+ *
+ *    Reply directory entries from the listing read at opendir.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_readdir(fuse_req_t req,               //IN: request
+                fuse_ino_t ino,               //IN: inode
+                size_t size,                  //IN: reply buffer size
+                off_t off,                    //IN: offset to read from
+                struct fuse_file_info *fi)    //IN: file info
+{
+   HgfsDirBuf *dirBuf = (HgfsDirBuf *)(uintptr_t)fi->fh;
+
+   if (off < dirBuf->size) {
+      fuse_reply_buf(req, dirBuf->buf + off, MIN(size, dirBuf->size - off));
+   } else {
+      fuse_reply_buf(req, NULL, 0);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_releasedir
+ *
+ *    Release a directory listing.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_releasedir(fuse_req_t req,               //IN: request
+                   fuse_ino_t ino,               //IN: inode
+                   struct fuse_file_info *fi)    //IN: file info
+{
+   HgfsDirBuf *dirBuf = (HgfsDirBuf *)(uintptr_t)fi->fh;
+
+   free(dirBuf->buf);
+   free(dirBuf);
+   fuse_reply_err(req, 0);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_statfs
+ *
+ *    Stat the host for total and free bytes on disk.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_statfs(fuse_req_t req,    //IN: request
+               fuse_ino_t ino)    //IN: inode
+{
+   struct statvfs stbuf;
+   HgfsInodePath *path;
+   int res;
+
+   path = HgfsInodeGetPath(ino);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   res = HgfsStatfs(path->path, &stbuf);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      fuse_reply_statfs(req, &stbuf);
+   }
+   HgfsInodePathPut(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_access
+ *
+ *    Check access permissions to an inode, see hgfs_access.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_access(fuse_req_t req,    //IN: request
+               fuse_ino_t ino,    //IN: inode
+               int mask)          //IN: access mask
+{
+   HgfsAttrInfo attr = {0};
+   HgfsInodePath *path;
+   uint32 effectivePermissions;
+   int res;
+
+   path = HgfsInodeGetPath(ino);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   res = HgfsLowLevelGetattr(path->path, &attr);
+   if (res < 0 || mask == F_OK) {
+      goto exit;
+   }
+
+   if (attr.mask & HGFS_ATTR_VALID_EFFECTIVE_PERMS) {
+      effectivePermissions = attr.effectivePerms;
+   } else {
+      /* Optimistic, the host enforces the actual permissions. */
+      effectivePermissions = (attr.ownerPerms |
+                              attr.groupPerms |
+                              attr.otherPerms);
+   }
+
+   if ((effectivePermissions & mask) != mask) {
+      res = -EACCES;
+   }
+
+exit:
+   fuse_reply_err(req, -res);
+   HgfsInodePathPut(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_init
+ *
+ *    Initialization routine.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_init(void *userdata,                // IN: unused
+             struct fuse_conn_info *conn)   // IN: unused
+{
+   LOG(4, ("Entry()\n"));
+   HgfsFilesystemInit();
+   LOG(4, ("Exit()\n"));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_destroy
+ *
+ *    Cleanup routine.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_destroy(void *userdata) // IN: unused
+{
+   LOG(4, ("Entry()\n"));
+   HgfsFilesystemExit();
+   LOG(4, ("Exit()\n"));
+}
+
+
+/*--------------------------------------------------------------------------- */
+static struct fuse_lowlevel_ops vmhgfs_ll_operations = {
+   .init         = hgfs_ll_init,
+   .destroy      = hgfs_ll_destroy,
+   .lookup       = hgfs_ll_lookup,
+   .forget       = hgfs_ll_forget,
+   .forget_multi = hgfs_ll_forget_multi,
+   .getattr      = hgfs_ll_getattr,
+   .setattr      = hgfs_ll_setattr,
+   .readlink     = hgfs_ll_readlink,
+   .mknod        = hgfs_ll_mknod,
+   .mkdir        = hgfs_ll_mkdir,
+   .unlink       = hgfs_ll_unlink,
+   .rmdir        = hgfs_ll_rmdir,
+   .symlink      = hgfs_ll_symlink,
+   .rename       = hgfs_ll_rename,
+   .link         = hgfs_ll_link,
+   .open         = hgfs_ll_open,
+   .read         = hgfs_ll_read,
+   .write        = hgfs_ll_write,
+   .release      = hgfs_ll_release,
+   .opendir      = hgfs_ll_opendir,
+   .readdir      = hgfs_ll_readdir,
+   .releasedir   = hgfs_ll_releasedir,
+   .statfs       = hgfs_ll_statfs,
+   .access       = hgfs_ll_access,
+   .create       = hgfs_ll_create,
+};
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLowLevelMain --
+ *
+ *    Mount the filesystem and serve it with the low-level operations
+ *    until it is unmounted.
+ *
+ * Results:
+ *    Returns zero on success, or non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsLowLevelMain(struct fuse_args *args)   // IN: fuse arguments
+{
+   struct fuse_session *se;
+   struct fuse_chan *ch;
+   char *mountpoint = NULL;
+   int multithreaded;
+   int foreground;
+   int res = 1;
+
+   if (HgfsInodeInit() != 0) {
+      fprintf(stderr, "Error cannot allocate the inode table!\n");
+      return res;
+   }
+
+   if (fuse_parse_cmdline(args, &mountpoint, &multithreaded,
+                          &foreground) == -1) {
+      goto exit;
+   }
+
+   ch = fuse_mount(mountpoint, args);
+   if (ch == NULL) {
+      goto exit;
+   }
+
+   se = fuse_lowlevel_new(args, &vmhgfs_ll_operations,
+                          sizeof vmhgfs_ll_operations, NULL);
+   if (se != NULL) {
+      if (fuse_daemonize(foreground) != -1 &&
+          fuse_set_signal_handlers(se) != -1) {
+         fuse_session_add_chan(se, ch);
+         res = multithreaded ? fuse_session_loop_mt(se) :
+                               fuse_session_loop(se);
+         fuse_remove_signal_handlers(se);
+         fuse_session_remove_chan(ch);
+      }
+      fuse_session_destroy(se);
+   }
+   fuse_unmount(mountpoint, ch);
+
+exit:
+   free(mountpoint);
+   fuse_opt_free_args(args);
+   return res == -1 ? 1 : res;
+}
@@ -0,0 +1,32 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * lowlevel.h --
+ *
+ * Entry point for the FUSE low-level (inode based) operations.
+ */
+
+#ifndef _HGFS_DRIVER_LOWLEVEL_H_
+#define _HGFS_DRIVER_LOWLEVEL_H_
+
+#include <fuse.h>
+
+int HgfsLowLevelMain(struct fuse_args *args);
+
+#endif // _HGFS_DRIVER_LOWLEVEL_H_
@@ -30,6 +30,7 @@
 #include "cache.h"
 #include "filesystem.h"
 #include "file.h"
+#include "lowlevel.h"
 
 /*
  *----------------------------------------------------------------------
@@ -126,7 +127,6 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
    HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
    HgfsAttrInfo newAttr = {0};
    HgfsAttrInfo *attr = &newAttr;
-   uint32 d_type;
    char *abspath = NULL;
    int res;
 
@@ -138,12 +138,14 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
 
    res = HgfsGetAttrCache(abspath, attr);
    LOG(4, ("Retrieve attr from cache. result = %d \n", res));
-   if (res != 0) {
+   if (res != 0 && res != -ENOENT) {
       /* Retrieve new complete attribute settings and update the cache. */
       res = HgfsPrivateGetattr(fileHandle, abspath, attr);
       LOG(4, ("Retrieve attr from server. result = %d \n", res));
-      if (res == 0 ) {
+      if (res == 0) {
          HgfsSetAttrCache(abspath, attr);
+      } else if (res == -ENOENT) {
+         HgfsSetNegativeCache(abspath);
       }
    }
 
@@ -152,60 +154,7 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
    }
 
    LOG(4, ("fill stat for %s\n", abspath));
-
-   memset(stbuf, 0, sizeof *stbuf);
-
-   if (attr->mask & HGFS_ATTR_VALID_SPECIAL_PERMS) {
-      stbuf->st_mode |= (attr->specialPerms << 9);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_OWNER_PERMS) {
-      stbuf->st_mode |= (attr->ownerPerms << 6);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_GROUP_PERMS) {
-      stbuf->st_mode |= (attr->groupPerms << 3);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_OTHER_PERMS) {
-      stbuf->st_mode |= (attr->otherPerms);
-   }
-
-   /* Mask the access mode. */
-   switch (attr->type) {
-   case HGFS_FILE_TYPE_SYMLINK:
-      d_type = DT_LNK;
-      break;
-
-   case HGFS_FILE_TYPE_REGULAR:
-      d_type = DT_REG;
-      break;
-
-   case HGFS_FILE_TYPE_DIRECTORY:
-      d_type = DT_DIR;
-      break;
-
-   default:
-      d_type = DT_UNKNOWN;
-      break;
-   }
-
-   stbuf->st_mode |= d_type << 12;
-   stbuf->st_blksize = HGFS_BLOCKSIZE;
-   stbuf->st_blocks = HgfsCalcBlockSize(attr->size);
-   stbuf->st_size = attr->size;
-   stbuf->st_ino = attr->hostFileId;
-   stbuf->st_nlink = 1;
-   stbuf->st_uid = attr->userId;
-   stbuf->st_gid = attr->groupId;
-   stbuf->st_rdev = 0;
-
-   if (attr->mask & HGFS_ATTR_VALID_ACCESS_TIME) {
-      HGFS_SET_TIME(stbuf->st_atime, attr->accessTime);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_WRITE_TIME) {
-      HGFS_SET_TIME(stbuf->st_mtime, attr->writeTime);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_CHANGE_TIME) {
-      HGFS_SET_TIME(stbuf->st_ctime, attr->attrChangeTime);
-   }
+   HgfsAttrToStat(attr, stbuf);
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -247,14 +196,16 @@ hgfs_access(const char *path,  //IN: Path to a file.
       goto exit;
    }
 
-   res = HgfsGetAttrCache(path, attr);
+   res = HgfsGetAttrCache(abspath, attr);
    LOG(4, ("Retrieve attr from cache. result = %d \n", res));
-   if (res != 0) {
+   if (res != 0 && res != -ENOENT) {
       /* Retrieve new complete attribute settings and update the cache. */
       res = HgfsPrivateGetattr(fileHandle, abspath, attr);
       LOG(4, ("Retrieve attr from server. result = %d \n", res));
-      if (res == 0 ) {
+      if (res == 0) {
          HgfsSetAttrCache(abspath, attr);
+      } else if (res == -ENOENT) {
+         HgfsSetNegativeCache(abspath);
       }
    }
 
@@ -352,9 +303,12 @@ exit:
 /*
  *----------------------------------------------------------------------
  *
- * hgfs_readdir
+ * hgfs_opendir
  *
- *    Read the directoy file.
+ *    Open a directory and read its entries. The listing is kept with
+ *    the open directory and replayed by hgfs_readdir, and the entry
+ *    attributes are added to the attribute cache, so that a listing
+ *    followed by a stat of each entry costs one directory search.
  *
  * Results:
  *    Returns zero on success, or a negative error on failure.
@@ -366,29 +320,25 @@ exit:
  */
 
 static int
-hgfs_readdir(const char *path,          //IN: path to a directory
-             void *buf,                 //OUT: buffer to fill the dir entry
-             fuse_fill_dir_t filler,    //IN: function pointer to fill buf
-             off_t offset,              //IN: offset to read the dir
-             struct fuse_file_info *fi) //IN: file info set by open call
+hgfs_opendir(const char *path,          //IN: path to a directory
+             struct fuse_file_info *fi) //IN/OUT: file info
 {
+   HgfsDirListing *listing = NULL;
    char *abspath = NULL;
    int res = 0;
-   HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
 
-   LOG(4, ("Entry(path = %s, @ %#"FMT64"x)\n", path, offset));
+   LOG(4, ("Entry(path = %s)\n", path));
    res = getAbsPath(path, &abspath);
    if (res < 0) {
       goto exit;
    }
 
-   res = HgfsDirOpen(abspath, &fileHandle);
+   res = HgfsDirListingRead(abspath, &listing);
    if (res < 0) {
       goto exit;
    }
 
-   fi->fh = fileHandle;
-   res = HgfsReaddir(fileHandle, buf, filler);
+   fi->fh = (uintptr_t)listing;
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -397,6 +347,64 @@ exit:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_readdir
+ *
+ *    Read the directoy file from the listing read by hgfs_opendir.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+hgfs_readdir(const char *path,          //IN: path to a directory
+             void *buf,                 //OUT: buffer to fill the dir entry
+             fuse_fill_dir_t filler,    //IN: function pointer to fill buf
+             off_t offset,              //IN: offset to read the dir
+             struct fuse_file_info *fi) //IN: file info set by open call
+{
+   HgfsDirListing *listing = (HgfsDirListing *)(uintptr_t)fi->fh;
+
+   LOG(4, ("Entry(path = %s, @ %#"FMT64"x)\n", path, offset));
+   HgfsDirListingReplay(listing, offset, buf, filler);
+   LOG(4, ("Exit(0)\n"));
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_releasedir
+ *
+ *    Release the listing of an open directory.
+ *
+ * Results:
+ *    Returns zero.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+hgfs_releasedir(const char *path,          //IN: path to a directory
+                struct fuse_file_info *fi) //IN: file info set by opendir
+{
+   LOG(4, ("Entry(path = %s)\n", path));
+   HgfsDirListingFree((HgfsDirListing *)(uintptr_t)fi->fh);
+   return 0;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -909,12 +917,14 @@ hgfs_utime(const char *path,        //IN: path to a file
 
    res = HgfsGetAttrCache(abspath, attr);
    LOG(4, ("Retrieve attr from cache. result = %d \n", res));
-   if (res != 0) {
+   if (res != 0 && res != -ENOENT) {
       /* Retrieve new complete attribute settings and update the cache. */
       res = HgfsPrivateGetattr(fileHandle, abspath, attr);
       LOG(4, ("Retrieve attr from server. result = %d \n", res));
-      if (res == 0 ) {
+      if (res == 0) {
          HgfsSetAttrCache(abspath, attr);
+      } else if (res == -ENOENT) {
+         HgfsSetNegativeCache(abspath);
       }
    }
 
@@ -1252,27 +1262,8 @@ exit:
 static void*
 hgfs_init(struct fuse_conn_info *conn) // IN: unused
 {
-   pthread_t purgeCacheThread;
-   int dummy;
-   int res;
-
    LOG(4, ("Entry()\n"));
-
-   /*
-    * dummy argument is required for Solaris and FreeBSD while creating
-    * thread otherwise the program crashes.
-    */
-   res = pthread_create(&purgeCacheThread, NULL,
-                        HgfsPurgeCache, &dummy);
-   if (res < 0) {
-      LOG(4, ("Pthread create fail. error = %d\n", res));
-   }
-
-   res = HgfsCreateSession();
-   if (res < 0) {
-      LOG(4, ("Create session failed. error = %d\n", res));
-   }
-
+   HgfsFilesystemInit();
    LOG(4, ("Exit(NULL)\n"));
    return NULL;
 }
@@ -1297,24 +1288,8 @@ hgfs_init(struct fuse_conn_info *conn) // IN: unused
 static void
 hgfs_destroy(void *data) // IN: unused
 {
-   int res;
-
    LOG(4, ("Entry()\n"));
-
-   res = HgfsDestroySession();
-   if (res < 0) {
-      LOG(4, ("Destroy session failed. error = %d\n", res));
-   }
-
-   HgfsTransportExit();
-
-   free(gState->basePath);
-
-   if (gState->conf != NULL) {
-      g_key_file_free(gState->conf);
-      gState->conf = NULL;
-   }
-
+   HgfsFilesystemExit();
    LOG(4, ("Exit()\n"));
 }
 
@@ -1324,7 +1299,9 @@ static struct fuse_operations vmhgfs_operations = {
    .getattr     = hgfs_getattr,
    .access      = hgfs_access,
    .readlink    = hgfs_readlink,
+   .opendir     = hgfs_opendir,
    .readdir     = hgfs_readdir,
+   .releasedir  = hgfs_releasedir,
    .mknod       = hgfs_mknod,
    .mkdir       = hgfs_mkdir,
    .symlink     = hgfs_symlink,
@@ -1388,7 +1365,16 @@ main(int argc,       //IN: Argument count
       fprintf(stderr, "Error %d cannot open connection!\n", res);
       return res;
    }
-   HgfsInitCache();
+   res = HgfsInitCache(gState->attrCacheSize, gState->attrCacheTimeout,
+                       gState->negCacheTimeout);
+   if (res != 0) {
+      fprintf(stderr, "Error %d cannot create the attribute cache!\n", res);
+      return res;
+   }
+
+   if (gState->lowLevel) {
+      return HgfsLowLevelMain(&args);
+   }
 
    return fuse_main(args.argc, args.argv, &vmhgfs_operations, NULL);
 }
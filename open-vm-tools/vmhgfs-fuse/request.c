@@ -33,17 +33,44 @@
 static HgfsHandle hgfsIdCounter;
 pthread_mutex_t hgfsIdLock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Freed requests are kept for reuse, so that every operation does not
+ * allocate and free a packet buffer. There are two size classes: small
+ * requests for metadata operations, with room for two full paths, and
+ * large requests of the negotiated maximum packet size for reads and
+ * writes. Large requests of an older negotiated size are not reused.
+ */
+#define HGFS_REQ_SMALL_PACKET_MAX (4 * 4096)
+#define HGFS_REQ_POOL_MAX         64
+
+typedef struct HgfsReqPool {
+   pthread_mutex_t lock;         /* Protects the pool */
+   struct list_head requests;    /* Free requests, linked by their list */
+   uint32 count;                 /* Requests in the pool */
+} HgfsReqPool;
+
+static HgfsReqPool hgfsSmallReqPool = {
+   PTHREAD_MUTEX_INITIALIZER,
+   LIST_HEAD_INIT(hgfsSmallReqPool.requests),
+   0
+};
+
+static HgfsReqPool hgfsLargeReqPool = {
+   PTHREAD_MUTEX_INITIALIZER,
+   LIST_HEAD_INIT(hgfsLargeReqPool.requests),
+   0
+};
+
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsGetNewRequest --
+ * HgfsDestroyRequest --
  *
- *    Get a new request structure off the free list and initialize it.
+ *    Free the memory of a request.
  *
  * Results:
- *    On success the new struct is returned with all fields
- *    initialized. Returns NULL on failure.
+ *    None
  *
  * Side effects:
  *    None
@@ -51,22 +78,70 @@ pthread_mutex_t hgfsIdLock = PTHREAD_MUTEX_INITIALIZER;
  *----------------------------------------------------------------------
  */
 
-HgfsReq *
-HgfsGetNewRequest(void)
+static void
+HgfsDestroyRequest(HgfsReq *req) // IN: Request to free
+{
+   pthread_cond_destroy(&req->queue);
+   free(req);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAllocRequest --
+ *
+ *    Take a request with a payload buffer of the given size from a
+ *    pool, or allocate one if the pool has none.
+ *
+ * Results:
+ *    The request, with all fields initialized. NULL on failure.
+ *
+ * Side effects:
+ *    Pooled requests of another size are freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsReq *
+HgfsAllocRequest(HgfsReqPool *pool, // IN: Pool of the size class
+                 size_t bufferSize) // IN: Size of the payload buffer
 {
    HgfsReq *req = NULL;
 
-   req = (HgfsReq*)malloc(sizeof(HgfsReq));
+   pthread_mutex_lock(&pool->lock);
+   while (req == NULL && !list_empty(&pool->requests)) {
+      req = list_entry(pool->requests.next, HgfsReq, list);
+      list_del(&req->list);
+      pool->count--;
+      if (req->bufferSize != bufferSize) {
+         HgfsDestroyRequest(req);
+         req = NULL;
+      }
+   }
+   pthread_mutex_unlock(&pool->lock);
+
    if (req == NULL) {
-      LOG(4, ("Can't allocate memory.\n"));
-      return NULL;
+      req = (HgfsReq*)malloc(sizeof(HgfsReq) + HGFS_CLIENT_CMD_LEN +
+                             bufferSize);
+      if (req == NULL) {
+         LOG(4, ("Can't allocate memory.\n"));
+         return NULL;
+      }
+      if (pthread_cond_init(&req->queue, NULL) != 0) {
+         LOG(4, ("Can't initialize request wait queue.\n"));
+         free(req);
+         return NULL;
+      }
+      req->bufferSize = bufferSize;
+      /* Setup the packet prefix. */
+      memcpy(req->packet, HGFS_SYNC_REQREP_CLIENT_CMD,
+             HGFS_SYNC_REQREP_CLIENT_CMD_LEN);
    }
+
    INIT_LIST_HEAD(&req->list);
    req->payloadSize = 0;
    req->state = HGFS_REQ_STATE_ALLOCATED;
-   /* Setup the packet prefix. */
-   memcpy(req->packet, HGFS_SYNC_REQREP_CLIENT_CMD,
-          HGFS_SYNC_REQREP_CLIENT_CMD_LEN);
    pthread_mutex_lock(&hgfsIdLock);
    req->id = hgfsIdCounter;
    hgfsIdCounter++;
@@ -76,6 +151,95 @@ HgfsGetNewRequest(void)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetNewRequest --
+ *
+ *    Get a new request structure off the free list and initialize it.
+ *    The request is sized for metadata operations, reads and writes
+ *    use HgfsGetNewLargeRequest.
+ *
+ * Results:
+ *    On success the new struct is returned with all fields
+ *    initialized. Returns NULL on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+HgfsReq *
+HgfsGetNewRequest(void)
+{
+   return HgfsAllocRequest(&hgfsSmallReqPool, HGFS_REQ_SMALL_PACKET_MAX);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetNewLargeRequest --
+ *
+ *    Get a new request structure off the free list and initialize it,
+ *    with room for the largest packet negotiated with the server.
+ *
+ * Results:
+ *    On success the new struct is returned with all fields
+ *    initialized. Returns NULL on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+HgfsReq *
+HgfsGetNewLargeRequest(void)
+{
+   return HgfsAllocRequest(&hgfsLargeReqPool, gState->maxPacketSize);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsExitRequestPool --
+ *
+ *    Free the requests kept for reuse.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsExitRequestPool(void)
+{
+   HgfsReqPool *pools[] = { &hgfsSmallReqPool, &hgfsLargeReqPool };
+   unsigned int i;
+
+   for (i = 0; i < ARRAYSIZE(pools); i++) {
+      HgfsReqPool *pool = pools[i];
+
+      pthread_mutex_lock(&pool->lock);
+      while (!list_empty(&pool->requests)) {
+         HgfsReq *req = list_entry(pool->requests.next, HgfsReq, list);
+
+         list_del(&req->list);
+         HgfsDestroyRequest(req);
+      }
+      pool->count = 0;
+      pthread_mutex_unlock(&pool->lock);
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -311,7 +475,7 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
    int ret;
 
    ASSERT(req);
-   ASSERT(req->payloadSize <= HGFS_LARGE_PACKET_MAX);
+   ASSERT(req->payloadSize <= req->bufferSize);
 
    req->state = HGFS_REQ_STATE_UNSENT;
 
@@ -326,12 +490,77 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsSubmitRequest --
+ *
+ *    Send out an HGFS request via transport layer without waiting for
+ *    the reply, so that several requests can be outstanding at once.
+ *    Every successfully submitted request must be waited for with
+ *    HgfsWaitRequest before it is reused or freed.
+ *
+ * Results:
+ *    Returns zero on success, negative number on error. On success,
+ *    completed tells whether the reply was already received, as it is
+ *    on synchronous channels.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsSubmitRequest(HgfsReq *req,       // IN/OUT: Outgoing request
+                  Bool *completed)    // OUT: Reply already received
+{
+   int ret;
+
+   ASSERT(req);
+   ASSERT(req->payloadSize <= req->bufferSize);
+
+   req->state = HGFS_REQ_STATE_UNSENT;
+
+   LOG(8, ("Submitting request id %d\n", req->id));
+   ret = HgfsTransportSubmitRequest(req, completed);
+   LOG(8, ("Request submitted, return %d\n", ret));
+   return ret;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWaitRequest --
+ *
+ *    Wait for the reply to a request sent with HgfsSubmitRequest.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsWaitRequest(HgfsReq *req)       // IN/OUT: Submitted request
+{
+   ASSERT(req);
+
+   HgfsTransportWaitRequest(req);
+   LOG(8, ("Request id %d finished\n", req->id));
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
  * HgfsFreeRequest --
  *
- *    Free an HGFS request.
+ *    Free an HGFS request, or keep it for reuse.
  *
  * Results:
  *    None
@@ -345,7 +574,32 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
 void
 HgfsFreeRequest(HgfsReq *req) // IN: Request to free
 {
-   free(req);
+   HgfsReqPool *pool;
+
+   if (req == NULL) {
+      return;
+   }
+
+   if (req->bufferSize == HGFS_REQ_SMALL_PACKET_MAX) {
+      pool = &hgfsSmallReqPool;
+   } else if (req->bufferSize == gState->maxPacketSize) {
+      pool = &hgfsLargeReqPool;
+   } else {
+      HgfsDestroyRequest(req);
+      return;
+   }
+
+   pthread_mutex_lock(&pool->lock);
+   if (pool->count < HGFS_REQ_POOL_MAX) {
+      list_add(&req->list, &pool->requests);
+      pool->count++;
+      req = NULL;
+   }
+   pthread_mutex_unlock(&pool->lock);
+
+   if (req != NULL) {
+      HgfsDestroyRequest(req);
+   }
 }
 
 
@@ -421,6 +675,10 @@ out:
  *    Copies the reply packet into the request structure and wakes up
  *    the associated client.
  *
+ *    Asynchronous channels call this through HgfsTransportProcessPacket,
+ *    which holds the lock of the pending requests bucket and has already
+ *    removed the request from it.
+ *
  * Results:
  *    None
  *
@@ -437,12 +695,20 @@ HgfsCompleteReq(HgfsReq *req,       // IN: Request
 {
    ASSERT(req);
    ASSERT(reply);
-   ASSERT(replySize <= HGFS_LARGE_PACKET_MAX);
+
+   /*
+    * A metadata request is smaller than the largest reply the server
+    * may send. Truncate, the name lengths in the reply are checked
+    * against the buffer size when it is unpacked.
+    */
+   if (replySize > req->bufferSize) {
+      LOG(4, ("Reply of %"FMTSZ"u bytes truncated to %"FMTSZ"u\n",
+              replySize, req->bufferSize));
+      replySize = req->bufferSize;
+   }
 
    memcpy(HGFS_REQ_PAYLOAD(req), reply, replySize);
    req->payloadSize = replySize;
    req->state = HGFS_REQ_STATE_COMPLETED;
-   if (!list_empty(&req->list)) {
-      list_del_init(&req->list);
-   }
+   pthread_cond_signal(&req->queue);
 }
@@ -30,6 +30,7 @@
 //#include "driver-config.h"
 
 #include <linux/list.h>
+#include <pthread.h>
 //#include "compat_sched.h"
 //#include "compat_spinlock.h"
 //#include "compat_wait.h"
@@ -90,9 +91,10 @@ typedef struct HgfsReq {
 
    /*
     * When clients wait for the reply to a request, they'll wait on this
-    * wait queue.
+    * condition variable, together with the lock of the pending requests
+    * bucket the request is hashed into.
     */
-   //wait_queue_head_t queue;
+   pthread_cond_t queue;
 
    /* Current state of the request. */
    HgfsState state;
@@ -104,14 +106,24 @@ typedef struct HgfsReq {
    size_t payloadSize;
 
    /*
-    * Packet of data, for both incoming and outgoing messages.
-    * Include room for the command.
+    * Size of the payload buffer. Small for metadata requests, otherwise
+    * the maximum packet size negotiated with the server when the request
+    * was allocated.
     */
-   char packet[HGFS_LARGE_PACKET_MAX + HGFS_CLIENT_CMD_LEN];
+   size_t bufferSize;
+
+   /*
+    * Packet of data, for both incoming and outgoing messages: the
+    * HGFS_CLIENT_CMD_LEN bytes of the command, followed by bufferSize
+    * bytes of payload.
+    */
+   char packet[];
 } HgfsReq;
 
 /* Public functions (with respect to the entire module). */
 HgfsReq *HgfsGetNewRequest(void);
+HgfsReq *HgfsGetNewLargeRequest(void);
+void HgfsExitRequestPool(void);
 HgfsStatus HgfsPackHeader(HgfsReq *req, HgfsOp opUsed);
 HgfsStatus HgfsUnpackHeader(void *serverReply,
 			    size_t replySize,
@@ -129,6 +141,8 @@ void* HgfsGetReplyPayload(HgfsReq *req);
 size_t HgfsGetReplyHeaderSize(void);
 size_t HgfsGetRequestHeaderSize(void);
 int HgfsSendRequest(HgfsReq *req);
+int HgfsSubmitRequest(HgfsReq *req, Bool *completed);
+void HgfsWaitRequest(HgfsReq *req);
 void HgfsFreeRequest(HgfsReq *req);
 HgfsStatus HgfsGetReplyStatus(HgfsReq *req);
 void HgfsCompleteReq(HgfsReq *req,
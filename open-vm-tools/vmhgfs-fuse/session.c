@@ -44,15 +44,16 @@
  */
 
 static int
-HgfsPackCreateSessionRequest(HgfsOp opUsed, // IN: Op to be used
-                             HgfsReq *req)  // IN/OUT: Packet to write into
+HgfsPackCreateSessionRequest(HgfsOp opUsed,        // IN: Op to be used
+                             size_t maxPacketSize, // IN: Size to negotiate
+                             HgfsReq *req)         // IN/OUT: Packet to write into
 {
    switch (opUsed) {
    case HGFS_OP_CREATE_SESSION_V4: {
       HgfsRequestCreateSessionV4 *requestV4 = HgfsGetRequestPayload(req);
 
       requestV4->numCapabilities = 0;
-      requestV4->maxPacketSize = HGFS_LARGE_PACKET_MAX;
+      requestV4->maxPacketSize = maxPacketSize;
       requestV4->reserved = 0;
 
       req->payloadSize = sizeof(*requestV4) + HgfsGetRequestHeaderSize();
@@ -89,8 +90,9 @@ HgfsPackCreateSessionRequest(HgfsOp opUsed, // IN: Op to be used
  */
 
 static HgfsStatus
-HgfsCreateSessionProcessResult(const char *result,  // IN: Reply packet
-                               size_t resultSize)   // IN: packet size
+HgfsCreateSessionProcessResult(const char *result,   // IN: Reply packet
+                               size_t resultSize,    // IN: packet size
+                               size_t maxPacketSize) // IN: Size requested
 {
    HgfsStatus status = HGFS_STATUS_SUCCESS;
    uint64 sessionId = HGFS_INVALID_SESSION_ID;
@@ -145,12 +147,26 @@ HgfsCreateSessionProcessResult(const char *result,  // IN: Reply packet
        */
       sessionId = createSessionReply->sessionId;
       sessionIdPresent = TRUE;
+
+      /*
+       * The server replies with the smaller of the size we asked for and
+       * what its side of the channel supports. Never go below the size
+       * every server handles, older servers may reply with zero.
+       */
+      maxPacketSize = MIN(maxPacketSize, createSessionReply->maxPacketSize);
+      gState->maxPacketSize = MAX(maxPacketSize, HGFS_LARGE_PACKET_MAX);
+      LOG(4, ("Negotiated max packet size %"FMTSZ"u.\n",
+              gState->maxPacketSize));
    }
 
 out:
    gState->sessionId = sessionId;
    gState->headerVersion = headerVersion;
    gState->sessionEnabled = sessionIdPresent;
+   if (!sessionIdPresent) {
+      /* Without a session the old headers only allow large reads. */
+      gState->maxPacketSize = HGFS_LARGE_PACKET_MAX;
+   }
 
    LOG(4, ("Exit(%d)\n", status));
    return status;
@@ -180,6 +196,7 @@ HgfsCreateSession(void)
    int result;
    HgfsStatus status;
    HgfsOp opUsed;
+   size_t maxPacketSize = HgfsTransportGetMaxPacketSize();
 
    LOG(4, ("Entry()\n"));
    gState->sessionEnabled = TRUE;
@@ -193,7 +210,7 @@ HgfsCreateSession(void)
    }
 
    opUsed = hgfsVersionCreateSession;
-   result = HgfsPackCreateSessionRequest(opUsed, req);
+   result = HgfsPackCreateSessionRequest(opUsed, maxPacketSize, req);
    if (result != 0) {
       LOG(4, ("Error packing request.\n"));
       goto out;
@@ -207,7 +224,8 @@ HgfsCreateSession(void)
       switch (result) {
       case 0:
          status = HgfsCreateSessionProcessResult(HGFS_REQ_PAYLOAD(req),
-                                                 req->payloadSize);
+                                                 req->payloadSize,
+                                                 maxPacketSize);
          ASSERT(status == HGFS_STATUS_SUCCESS);
          break;
       case -EPROTO:
@@ -21,33 +21,49 @@
  *
  * This file handles the transport mechanisms available for HGFS.
  * This acts as a glue between the HGFS filesystem driver and the
- * actual transport channels (backdoor, tcp, vsock, ...).
+ * actual transport channels (backdoor, loopback, tcp, vsock, ...).
  *
  * The sends happen in the process context, where as a thread
- * handles the asynchronous replies. A queue of pending replies is
- * maintained and is protected by a lock. The channel opens and close
- * is protected by a mutex.
+ * handles the asynchronous replies. Pending requests are hashed by
+ * request ID into buckets, each protected by its own lock, so that a
+ * reply is matched without a scan of every outstanding request and
+ * only the client waiting for it is woken. The active channel is
+ * protected by a reader/writer lock: sends share it, so many requests
+ * may be in flight at once, while channel open, reset and close take
+ * it exclusively.
  */
 
 
 
 #include "bdhandler.h"
+#ifdef VMHGFS_LOOPBACK
+#include "loopback.h"
+#endif
 #include "hgfsProto.h"
 #include "module.h"
 #include "request.h"
 #include "transport.h"
 #include "vm_assert.h"
 
+/* Number of pending request buckets, must be a power of 2. */
+#define HGFS_PENDING_BUCKETS 64
+
+typedef struct HgfsPendingBucket {
+   struct list_head requests;                        /* Pending requests. */
+   pthread_mutex_t lock;                             /* Bucket lock. */
+} HgfsPendingBucket;
+
 static HgfsTransportChannel *gHgfsActiveChannel;     /* Current active channel. */
-static pthread_mutex_t gHgfsActiveChannelLock;       /* Current active channel lock. */
+static pthread_rwlock_t gHgfsActiveChannelLock;      /* Current active channel lock. */
+static uint32 gHgfsActiveChannelGeneration;          /* Bumped on each reset. */
 static Bool gHgfsActiveChannelLockInited;
 
-static struct list_head gHgfsPendingRequests;        /* Pending requests queue. */
-static pthread_mutex_t gHgfsPendingRequestsLock;     /* Pending requests queue lock. */
-static Bool gHgfsPendingRequestsLockInited;
+static HgfsPendingBucket gHgfsPendingRequests[HGFS_PENDING_BUCKETS];
+static unsigned int gHgfsPendingRequestsLockInited;  /* Initialized buckets. */
 
 
-#define HgfsRequestId(req) ((HgfsRequest *)req)->id
+#define HgfsPendingBucketOf(id) \
+   (&gHgfsPendingRequests[(id) & (HGFS_PENDING_BUCKETS - 1)])
 
 static void HgfsTransportChannelClose(HgfsTransportChannel **channel);
 
@@ -76,7 +92,14 @@ HgfsTransportChannelOpen(HgfsTransportChannel **channel) // IN: active channel
 {
    int result = 0;
 
-   *channel = HgfsBdChannelInit();
+#ifdef VMHGFS_LOOPBACK
+   if (gState->loopback) {
+      *channel = HgfsLoopbackChannelInit();
+   } else
+#endif
+   {
+      *channel = HgfsBdChannelInit();
+   }
    if (NULL != *channel) {
       HgfsChannelStatus status = (*channel)->ops.open(*channel);
       if (status != HGFS_CHANNEL_CONNECTED) {
@@ -158,7 +181,7 @@ HgfsTransportChannelReset(HgfsTransportChannel **channel) // IN: active channel
  *
  * HgfsTransportEnqueueRequest --
  *
- *     Add the request to the gHgfsPendingRequests queue.
+ *     Add the request to its gHgfsPendingRequests bucket.
  *
  *
  * Side effects:
@@ -170,11 +193,14 @@ HgfsTransportChannelReset(HgfsTransportChannel **channel) // IN: active channel
 static void
 HgfsTransportEnqueueRequest(HgfsReq *req)   // IN: Request to add
 {
+   HgfsPendingBucket *bucket;
+
    ASSERT(req);
 
-   pthread_mutex_lock(&gHgfsPendingRequestsLock);
-   list_add_tail(&req->list, &gHgfsPendingRequests);
-   pthread_mutex_unlock(&gHgfsPendingRequestsLock);
+   bucket = HgfsPendingBucketOf(req->id);
+   pthread_mutex_lock(&bucket->lock);
+   list_add_tail(&req->list, &bucket->requests);
+   pthread_mutex_unlock(&bucket->lock);
 }
 
 
@@ -183,7 +209,7 @@ HgfsTransportEnqueueRequest(HgfsReq *req)   // IN: Request to add
  *
  * HgfsTransportDequeueRequest --
  *
- *     Removes the request from the gHgfsPendingRequests queue.
+ *     Removes the request from its gHgfsPendingRequests bucket.
  *
  * Results:
  *     None
@@ -197,13 +223,157 @@ HgfsTransportEnqueueRequest(HgfsReq *req)   // IN: Request to add
 static void
 HgfsTransportDequeueRequest(HgfsReq *req)   // IN: Request to dequeue
 {
+   HgfsPendingBucket *bucket;
+
    ASSERT(req);
 
-   pthread_mutex_lock(&gHgfsPendingRequestsLock);
+   bucket = HgfsPendingBucketOf(req->id);
+   pthread_mutex_lock(&bucket->lock);
    if (!list_empty(&req->list)) {
       list_del_init(&req->list);
    }
-   pthread_mutex_unlock(&gHgfsPendingRequestsLock);
+   pthread_mutex_unlock(&bucket->lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportWaitForReply --
+ *
+ *     Block until a request submitted to an asynchronous channel is
+ *     completed by HgfsTransportProcessPacket or by the receive thread
+ *     teardown.
+ *
+ * Results:
+ *     None
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsTransportWaitForReply(HgfsReq *req)   // IN: Submitted request
+{
+   HgfsPendingBucket *bucket;
+
+   ASSERT(req);
+
+   bucket = HgfsPendingBucketOf(req->id);
+   pthread_mutex_lock(&bucket->lock);
+   while (req->state == HGFS_REQ_STATE_SUBMITTED) {
+      pthread_cond_wait(&req->queue, &bucket->lock);
+   }
+   pthread_mutex_unlock(&bucket->lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportGetChannel --
+ *
+ *     Take a shared reference to the active channel, opening it first
+ *     if there is none.
+ *
+ * Results:
+ *     0 on success with the channel lock held for read, otherwise
+ *     -ENOTCONN with the lock released.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsTransportGetChannel(void)
+{
+   int ret = 0;
+
+   pthread_rwlock_rdlock(&gHgfsActiveChannelLock);
+   while (NULL == gHgfsActiveChannel) {
+      pthread_rwlock_unlock(&gHgfsActiveChannelLock);
+
+      /* Another sender may open the channel while we wait. */
+      pthread_rwlock_wrlock(&gHgfsActiveChannelLock);
+      if (NULL == gHgfsActiveChannel) {
+         ret = HgfsTransportChannelOpen(&gHgfsActiveChannel);
+      }
+      pthread_rwlock_unlock(&gHgfsActiveChannelLock);
+      if (ret != 0) {
+         return ret;
+      }
+      pthread_rwlock_rdlock(&gHgfsActiveChannelLock);
+   }
+
+   return ret;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportResetChannel --
+ *
+ *     Reset the channel after a failed send, unless another sender
+ *     already reset it since the send was issued.
+ *
+ * Results:
+ *     TRUE if there is a usable channel, FALSE otherwise.
+ *
+ * Side effects:
+ *     Takes the channel lock exclusively, so it must not be held by
+ *     the caller.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsTransportResetChannel(uint32 generation) // IN: generation of failed send
+{
+   Bool ret = TRUE;
+
+   pthread_rwlock_wrlock(&gHgfsActiveChannelLock);
+   if (generation == gHgfsActiveChannelGeneration) {
+      ret = HgfsTransportChannelReset(&gHgfsActiveChannel);
+      gHgfsActiveChannelGeneration++;
+   }
+   pthread_rwlock_unlock(&gHgfsActiveChannelLock);
+
+   return ret;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportReplyId --
+ *
+ *     Extract the request ID from a reply, which carries either the
+ *     session header or the legacy reply header.
+ *
+ * Results:
+ *     The request ID.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsHandle
+HgfsTransportReplyId(char const *reply,   // IN: reply packet
+                     size_t replySize)    // IN: reply packet size
+{
+   HgfsHeader const *header = (HgfsHeader const *)reply;
+
+   if (replySize >= sizeof *header && header->dummy == HGFS_OP_NEW_HEADER) {
+      return header->requestId;
+   }
+   return ((HgfsReply const *)reply)->id;
 }
 
 
@@ -217,7 +387,8 @@ HgfsTransportDequeueRequest(HgfsReq *req)   // IN: Request to dequeue
  * HgfsTransportProcessPacket --
  *
  *     Helper function to process received packets, called by the channel
- *     handler thread.
+ *     handler thread. The reply is matched by request ID within its
+ *     bucket and only the client waiting on that request is woken.
  *
  * Results:
  *     None
@@ -233,31 +404,34 @@ HgfsTransportProcessPacket(char *receivedPacket,    //IN: received packet
                            size_t receivedSize)     //IN: packet size
 {
    struct list_head *cur, *next;
+   HgfsPendingBucket *bucket;
    HgfsHandle id;
    Bool found = FALSE;
 
    /* Got the reply. */
 
    ASSERT(receivedPacket != NULL && receivedSize > 0);
-   id = HgfsRequestId(receivedPacket);
+   id = HgfsTransportReplyId(receivedPacket, receivedSize);
    LOG(8, ("Entered.\n"));
    LOG(6, ("Req id: %d\n", id));
    /*
-    * Search through gHgfsPendingRequests queue for the matching id and wake up
-    * the associated waiting process. Delete the req from the queue.
+    * Search through the gHgfsPendingRequests bucket for the matching id and
+    * wake up the associated waiting process. Delete the req from the queue.
     */
-   pthread_mutex_lock(&gHgfsPendingRequestsLock);
-   list_for_each_safe(cur, next, &gHgfsPendingRequests) {
+   bucket = HgfsPendingBucketOf(id);
+   pthread_mutex_lock(&bucket->lock);
+   list_for_each_safe(cur, next, &bucket->requests) {
       HgfsReq *req;
       req = list_entry(cur, HgfsReq, list);
       if (req->id == id) {
          ASSERT(req->state == HGFS_REQ_STATE_SUBMITTED);
+         list_del_init(&req->list);
          HgfsCompleteReq(req, receivedPacket, receivedSize);
          found = TRUE;
          break;
       }
    }
-   pthread_mutex_unlock(&gHgfsPendingRequestsLock);
+   pthread_mutex_unlock(&bucket->lock);
 
    if (!found) {
       LOG(4, ("No matching id, dropping reply.\n"));
@@ -286,84 +460,205 @@ HgfsTransportProcessPacket(char *receivedPacket,    //IN: received packet
 void
 HgfsTransportBeforeExitingRecvThread(void)
 {
-   struct list_head *cur, *next;
-
-   /* Walk through gHgfsPendingRequests queue and reply them with error. */
-   pthread_mutex_lock(&gHgfsPendingRequestsLock);
-   list_for_each_safe(cur, next, &gHgfsPendingRequests) {
-      HgfsReq *req;
-      HgfsReply reply;
+   unsigned int i;
 
-      req = list_entry(cur, HgfsReq, list);
-      LOG(6, ("Injecting error reply to req id: %d\n", req->id));
-      HgfsCompleteReq(req, (char *)&reply, sizeof reply);
+   /*
+    * Walk through gHgfsPendingRequests buckets and reply the submitted
+    * requests with error.
+    */
+   for (i = 0; i < HGFS_PENDING_BUCKETS; i++) {
+      HgfsPendingBucket *bucket = &gHgfsPendingRequests[i];
+      struct list_head *cur, *next;
+
+      pthread_mutex_lock(&bucket->lock);
+      list_for_each_safe(cur, next, &bucket->requests) {
+         HgfsReq *req;
+         HgfsReply reply;
+
+         req = list_entry(cur, HgfsReq, list);
+         if (req->state != HGFS_REQ_STATE_SUBMITTED) {
+            continue;
+         }
+         LOG(6, ("Injecting error reply to req id: %d\n", req->id));
+         reply.id = req->id;
+         reply.status = HGFS_STATUS_PROTOCOL_ERROR;
+         list_del_init(&req->list);
+         HgfsCompleteReq(req, (char *)&reply, sizeof reply);
+      }
+      pthread_mutex_unlock(&bucket->lock);
    }
-   pthread_mutex_unlock(&gHgfsPendingRequestsLock);
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsTransportSendRequest --
+ * HgfsTransportSubmitRequest --
+ *
+ *     Sends the request via channel communication without waiting for
+ *     its reply.
  *
- *     Sends the request via channel communication.
+ *     Synchronous channels complete the request before their send
+ *     returns. Asynchronous channels leave it submitted, and the caller
+ *     then waits for the reply with HgfsTransportWaitRequest without
+ *     holding any transport lock, so other requests can be sent
+ *     meanwhile.
  *
  * Results:
- *     Zero on success, non-zero error on failure.
+ *     Zero on success, non-zero error on failure. On success, completed
+ *     tells whether the reply was already received when the send
+ *     returned.
  *
  * Side effects:
- *     None
+ *     On success the request stays pending until it is waited for.
  *
  *----------------------------------------------------------------------
  */
 
 int
-HgfsTransportSendRequest(HgfsReq *req)   // IN: Request to send
+HgfsTransportSubmitRequest(HgfsReq *req,      // IN: Request to send
+                           Bool *completed)   // OUT: Reply already received
 {
+   HgfsPendingBucket *bucket;
+   uint32 generation;
    int ret;
    ASSERT(req);
    ASSERT(req->state == HGFS_REQ_STATE_UNSENT);
-   ASSERT(req->payloadSize <= HGFS_LARGE_PACKET_MAX);
-
-   pthread_mutex_lock(&gHgfsActiveChannelLock);
+   ASSERT(req->payloadSize <= req->bufferSize);
 
    /* Try opening the channel. */
-   if (NULL == gHgfsActiveChannel) {
-      ret = HgfsTransportChannelOpen(&gHgfsActiveChannel);
-      if (ret != 0) {
-         goto exit;
-      }
+   ret = HgfsTransportGetChannel();
+   if (ret != 0) {
+      goto exit;
    }
 
    ASSERT(gHgfsActiveChannel->ops.send);
 
    HgfsTransportEnqueueRequest(req);
 
+   generation = gHgfsActiveChannelGeneration;
    ret = gHgfsActiveChannel->ops.send(gHgfsActiveChannel, req);
+   pthread_rwlock_unlock(&gHgfsActiveChannelLock);
+
    if (ret < 0) {
       LOG(4, ("Send failed, status = %d. Try reopening the channel ...\n",
               ret));
-      if (HgfsTransportChannelReset(&gHgfsActiveChannel)) {
+      if (HgfsTransportResetChannel(generation) &&
+          HgfsTransportGetChannel() == 0) {
          ret = gHgfsActiveChannel->ops.send(gHgfsActiveChannel, req);
+         pthread_rwlock_unlock(&gHgfsActiveChannelLock);
       }
    }
 
 exit:
-   ASSERT(req->state == HGFS_REQ_STATE_COMPLETED ||
-          req->state == HGFS_REQ_STATE_SUBMITTED ||
-          req->state == HGFS_REQ_STATE_UNSENT);
+   if (ret != 0) {
+      ASSERT(req->state == HGFS_REQ_STATE_COMPLETED ||
+             req->state == HGFS_REQ_STATE_UNSENT);
 
-   pthread_mutex_unlock(&gHgfsActiveChannelLock);
-
-   if (ret < 0) {
       HgfsTransportDequeueRequest(req);
+   } else if (completed != NULL) {
+      bucket = HgfsPendingBucketOf(req->id);
+      pthread_mutex_lock(&bucket->lock);
+      *completed = req->state == HGFS_REQ_STATE_COMPLETED;
+      pthread_mutex_unlock(&bucket->lock);
    }
 
    return ret;
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportWaitRequest --
+ *
+ *     Waits for the reply to a request submitted with
+ *     HgfsTransportSubmitRequest.
+ *
+ * Results:
+ *     None
+ *
+ * Side effects:
+ *     The request is no longer pending.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsTransportWaitRequest(HgfsReq *req)   // IN: Submitted request
+{
+   ASSERT(req);
+
+   HgfsTransportWaitForReply(req);
+
+   ASSERT(req->state == HGFS_REQ_STATE_COMPLETED);
+
+   HgfsTransportDequeueRequest(req);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportSendRequest --
+ *
+ *     Sends the request via channel communication and waits for its
+ *     reply.
+ *
+ * Results:
+ *     Zero on success, non-zero error on failure.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsTransportSendRequest(HgfsReq *req)   // IN: Request to send
+{
+   int ret;
+
+   ret = HgfsTransportSubmitRequest(req, NULL);
+   if (ret == 0) {
+      HgfsTransportWaitRequest(req);
+   }
+
+   return ret;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportGetMaxPacketSize --
+ *
+ *     Get the largest packet the active channel can carry, the size
+ *     offered to the server when the session is created.
+ *
+ * Results:
+ *     The size in bytes, HGFS_LARGE_PACKET_MAX if there is no channel.
+ *
+ * Side effects:
+ *     Opens the channel if it is not open yet.
+ *
+ *----------------------------------------------------------------------
+ */
+
+size_t
+HgfsTransportGetMaxPacketSize(void)
+{
+   size_t maxPacketSize = HGFS_LARGE_PACKET_MAX;
+
+   if (HgfsTransportGetChannel() == 0) {
+      maxPacketSize = gHgfsActiveChannel->maxPacketSize;
+      pthread_rwlock_unlock(&gHgfsActiveChannelLock);
+   }
+
+   return maxPacketSize;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -389,18 +684,24 @@ HgfsTransportInit(void)
    int res;
 
    gHgfsActiveChannel = NULL;
-   gHgfsPendingRequestsLockInited = FALSE;
+   gHgfsActiveChannelGeneration = 0;
+   gHgfsPendingRequestsLockInited = 0;
    gHgfsActiveChannelLockInited = FALSE;
-   INIT_LIST_HEAD(&gHgfsPendingRequests);
 
-   res = pthread_mutex_init(&gHgfsPendingRequestsLock, NULL);
-   if (res != 0) {
-      res = -res;
-      goto exit;
+   while (gHgfsPendingRequestsLockInited < HGFS_PENDING_BUCKETS) {
+      HgfsPendingBucket *bucket =
+         &gHgfsPendingRequests[gHgfsPendingRequestsLockInited];
+
+      INIT_LIST_HEAD(&bucket->requests);
+      res = pthread_mutex_init(&bucket->lock, NULL);
+      if (res != 0) {
+         res = -res;
+         goto exit;
+      }
+      gHgfsPendingRequestsLockInited++;
    }
-   gHgfsPendingRequestsLockInited = TRUE;
 
-   res = pthread_mutex_init(&gHgfsActiveChannelLock, NULL);
+   res = pthread_rwlock_init(&gHgfsActiveChannelLock, NULL);
    if (res != 0) {
       res = -res;
       goto exit;
@@ -439,19 +740,20 @@ HgfsTransportExit(void)
    LOG(8, ("Entered.\n"));
 
    if (gHgfsActiveChannelLockInited) {
-      pthread_mutex_lock(&gHgfsActiveChannelLock);
+      pthread_rwlock_wrlock(&gHgfsActiveChannelLock);
       HgfsTransportChannelClose(&gHgfsActiveChannel);
-      pthread_mutex_unlock(&gHgfsActiveChannelLock);
+      pthread_rwlock_unlock(&gHgfsActiveChannelLock);
 
-      pthread_mutex_destroy(&gHgfsActiveChannelLock);
+      pthread_rwlock_destroy(&gHgfsActiveChannelLock);
       gHgfsActiveChannelLockInited = FALSE;
    }
 
-   ASSERT(list_empty(&gHgfsPendingRequests));
+   while (gHgfsPendingRequestsLockInited > 0) {
+      HgfsPendingBucket *bucket =
+         &gHgfsPendingRequests[--gHgfsPendingRequestsLockInited];
 
-   if (gHgfsPendingRequestsLockInited) {
-      pthread_mutex_destroy(&gHgfsPendingRequestsLock);
-      gHgfsPendingRequestsLockInited = FALSE;
+      ASSERT(list_empty(&bucket->requests));
+      pthread_mutex_destroy(&bucket->lock);
    }
    LOG(8, ("Exited.\n"));
 }
@@ -49,6 +49,7 @@ typedef struct HgfsTransportChannel {
    HgfsTransportChannelOps ops;    /* Channel ops. */
    HgfsChannelStatus status;       /* Connection status. */
    void *priv;                     /* Channel private data. */
+   size_t maxPacketSize;           /* Largest request or reply. */
    pthread_mutex_t connLock;       /* Protect _this_ struct. */
 } HgfsTransportChannel;
 
@@ -56,8 +57,11 @@ typedef struct HgfsTransportChannel {
 int HgfsTransportInit(void);
 void HgfsTransportExit(void);
 int HgfsTransportSendRequest(HgfsReq *req);
+int HgfsTransportSubmitRequest(HgfsReq *req, Bool *completed);
+void HgfsTransportWaitRequest(HgfsReq *req);
 void HgfsTransportProcessPacket(char *receivedPacket,
                                 size_t receivedSize);
 void HgfsTransportBeforeExitingRecvThread(void);
+size_t HgfsTransportGetMaxPacketSize(void);
 
 #endif // _HGFS_DRIVER_TRANSPORT_H_